@@ -5,16 +5,19 @@ model_mat =
 		csm = 
 		{
 			queue='csm',
-			shader="shadow_map"
+			shader="shadow_map",
+			batchable=true
 		},
 		base =
 		{
 			queue='opaque',
 			shader="model",
+			batchable=true
 		},
 		depthPrepass =
 		{
 			shader='depth_prepass',
+			batchable=true
 		}
 	},
 	resources =
@@ -11,15 +11,18 @@ model_mat_gi =
 			depthTest=false,
 			blending=false,
 			cullface="none",
+			batchable=true
 		},
 		csm = 
 		{
-			shader="shadow_map"
+			shader="shadow_map",
+			batchable=true
 		},
 		base =
 		{
 			queue='opaque',
 			shader="model",
+			batchable=true
 		},
 		--depthPrepass =
 		--{
@@ -0,0 +1,25 @@
+particles_gpu_mat = 
+{
+	passes =
+	{
+		base = 
+		{
+			queue='transparent',
+			shader="particles_gpu",
+			blending=true,
+			srcBlendColor="src_alpha",
+			srcBlendAlpha="src_alpha",
+			dstBlendColor="one",
+			dstBlendAlpha="one",
+			depthWrite=false
+		}
+	},
+	resources =
+	{
+		[0] =
+		{
+			name="diffuse",
+			resType="texture2D"
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+particles_gpu_sim_mat =
+{
+	passes =
+	{
+		reset =
+		{
+			computeShader="particles_gpu_reset",
+		},
+		simulate =
+		{
+			computeShader="particles_gpu_simulate",
+		}
+	}
+}
\ No newline at end of file
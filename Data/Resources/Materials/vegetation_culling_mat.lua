@@ -0,0 +1,18 @@
+vegetation_culling_mat =
+{
+	passes =
+	{
+		count =
+		{
+			computeShader="vegetation_culling_count",
+		},
+		prefix =
+		{
+			computeShader="vegetation_culling_prefix",
+		},
+		write =
+		{
+			computeShader="vegetation_culling_write",
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+// Particles simulated by the particles_gpu_simulate compute shader. Must match the structs in ParticleManager.h
+
+struct GPUParticle
+{
+	vec4 posLife;			// xyz - position relative to the particle system, w - life
+	vec4 velBlend;			// xyz - velocity, w - atlas blend factor
+	vec4 color;
+	vec4 texOffsets;		// xy - offset of the current atlas frame, zw - offset of the next one
+};
+
+struct GPUParticleSystem
+{
+	mat4 transform;			// Particle system transform without the scale
+	uvec4 indices;			// x - first particle in the pool, y - max particles, z - first particle to emit, w - number of particles to emit
+	uvec4 state;			// x - kill every particle before emitting, y - random seed
+	vec4 simParams;			// x - delta time, y - life time, z - gravity velocity change, w - fade alpha over lifetime
+	vec4 limitParams;		// x - speed limit, y - speed limit / dampen, z - limit velocity
+	vec4 emissionCenter;
+	vec4 emissionBox;
+	vec4 velocityLow;
+	vec4 velocityHigh;
+	vec4 startColor;
+	vec4 atlas;				// x - columns, y - rows, z - cycles, w - use atlas
+};
+
+struct IndirectDraw
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	uint baseVertex;
+	uint baseInstance;
+};
+
+// The vertex shader only reads the particles
+#ifdef GPU_PARTICLES_READ_ONLY
+#define GPU_PARTICLES_ACCESS readonly
+#else
+#define GPU_PARTICLES_ACCESS
+#endif
+
+layout(std430, binding = GPU_PARTICLES_SSBO) GPU_PARTICLES_ACCESS buffer GPUParticles
+{
+	GPUParticle particles[];
+};
+
+layout(std430, binding = GPU_PARTICLES_ALIVE_LIST_SSBO) GPU_PARTICLES_ACCESS buffer GPUParticlesAliveList
+{
+	uint aliveList[];			// Indices of the alive particles of each system, starting at the system's first particle
+};
+
+layout(std430, binding = GPU_PARTICLE_SYSTEMS_SSBO) readonly buffer GPUParticleSystems
+{
+	GPUParticleSystem systems[];
+};
+
+#ifndef GPU_PARTICLES_READ_ONLY
+layout(std430, binding = GPU_PARTICLES_INDIRECT_DRAW) buffer GPUParticlesIndirect
+{
+	IndirectDraw indDraw[];		// One draw per particle system
+};
+#endif
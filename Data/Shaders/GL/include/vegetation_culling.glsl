@@ -0,0 +1,100 @@
+// Vegetation culled by the vegetation_culling compute shaders. Must match the structs in GPUVegetationCulling.h
+
+#define MAX_VEGETATION_TYPES		32
+#define MAX_VEGETATION_MESHES		4
+#define VEGETATION_LODS				3
+#define VEGETATION_VIEWS			2
+#define MAX_VEGETATION_FRUSTUMS		4
+#define VEGETATION_BATCHES			(VEGETATION_VIEWS * MAX_VEGETATION_TYPES * VEGETATION_LODS)
+
+struct VegetationType
+{
+	vec4 cullParams;			// x - radius, y - lod 1 distance, z - lod 2 distance
+	uvec4 range;				// x - first instance, y - number of instances
+	uvec4 lodMeshCount;
+	uvec4 meshes[VEGETATION_LODS * MAX_VEGETATION_MESHES];		// x - index count (or vertex count), y - first index, z - base vertex, w - 1 if indexed
+};
+
+struct VegetationIndirectDraw
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	uint baseVertex;
+	uint baseInstance;
+};
+
+layout(std430, binding = VEGETATION_INSTANCES_SSBO) readonly buffer VegetationInstances
+{
+	mat4 instances[];
+};
+
+layout(std430, binding = VEGETATION_CULL_PARAMS_SSBO) readonly buffer VegetationCullParams
+{
+	vec4 planes[MAX_VEGETATION_FRUSTUMS * 6];
+	uvec4 frustumViews;
+	vec4 camPos;
+	uvec4 counts;				// x - number of frustums, y - number of types, z - visible instances capacity
+	VegetationType types[MAX_VEGETATION_TYPES];
+};
+
+layout(std430, binding = VEGETATION_CULL_COUNTERS_SSBO) buffer VegetationCullCounters
+{
+	uint counters[];			// Count of each batch, then the next instance to write in each batch, then the end of each batch
+};
+
+layout(std430, binding = VEGETATION_VISIBLE_INSTANCES_SSBO) writeonly buffer VegetationVisibleInstances
+{
+	mat4 visibleInstances[];
+};
+
+layout(std430, binding = VEGETATION_INDIRECT_DRAW) writeonly buffer VegetationIndirect
+{
+	VegetationIndirectDraw indDraw[];
+};
+
+uint GetBatch(uint view, uint type, uint lod)
+{
+	return (view * MAX_VEGETATION_TYPES + type) * VEGETATION_LODS + lod;
+}
+
+// Same as Terrain::CullVegetationCell. Returns VEGETATION_LODS if the lod is not drawn
+uint GetLOD(uint type, vec3 pos)
+{
+	vec3 d = camPos.xyz - pos;
+	float distSqr = dot(d, d);
+
+	uint lod = 0;
+	if (distSqr > types[type].cullParams.z)
+		lod = 2;
+	else if (distSqr > types[type].cullParams.y)
+		lod = 1;
+
+	return types[type].lodMeshCount[lod] > 0 ? lod : VEGETATION_LODS;
+}
+
+// Same as Frustum::SphereInFrustum
+bool SphereInFrustum(uint frustum, vec3 center, float radius)
+{
+	for (uint i = 0; i < 6; i++)
+	{
+		vec4 p = planes[frustum * 6 + i];
+		if (dot(p.xyz, center) + p.w < -radius)
+			return false;
+	}
+
+	return true;
+}
+
+// A view can have more than one frustum, eg each shadow cascade has one
+uint GetVisibleViews(vec3 center, float radius)
+{
+	uint views = 0;
+	for (uint i = 0; i < counts.x; i++)
+	{
+		if (SphereInFrustum(i, center, radius))
+			views |= 1u << frustumViews[i];
+	}
+
+	return views;
+}
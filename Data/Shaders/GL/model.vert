@@ -88,6 +88,7 @@ void main()
 #endif
 	
 #ifdef INSTANCING
+	mat4 modelMatrix = instanceMatrix;
 	//normal = mat3(transpose(inverse(instanceMatrix))) * inNormal;		// Don't allow non-uniform scaling so we don't do this every frame
 	normal = (instanceMatrix * N).xyz;		// TODO: calculate normal after wind displacement
 	wPos = instanceMatrix * pos;
@@ -97,22 +98,15 @@ void main()
 	wPos.xyz = MainBending(wPos.xyz, objPos);
 	TBN = mat3(1.0);
 #else
-	if (instanceDataOffset == -1)
-	{
-		normal = (toWorldSpace * N).xyz;		// Incorrect if non-uniform scale is used
-		wPos = toWorldSpace * pos;	
-	}
-	else
-	{
-		mat4 t = transforms[instanceDataOffset + gl_InstanceID];
-		normal = (t * N).xyz;		// Incorrect if non-uniform scale is used
-		wPos = t * pos;
-	}
+	// Batched items have their transforms in the instance data instead of the uniform
+	mat4 modelMatrix = instanceDataOffset == -1 ? toWorldSpace : transforms[instanceDataOffset + gl_InstanceID];
+	normal = (modelMatrix * N).xyz;		// Incorrect if non-uniform scale is used
+	wPos = modelMatrix * pos;
 #endif
 
 #ifdef NORMAL_MAP
-	vec3 T = normalize(vec3(toWorldSpace * vec4(inTangent,   0.0)));
-	vec3 Nn = normalize(vec3(toWorldSpace * vec4(inNormal,    0.0)));
+	vec3 T = normalize(vec3(modelMatrix * vec4(inTangent,   0.0)));
+	vec3 Nn = normalize(vec3(modelMatrix * vec4(inNormal,    0.0)));
 	// re-orthogonalize T with respect to N
 	T = normalize(T - dot(T, Nn) * Nn);
 	// then retrieve perpendicular vector B with the cross product of T and N
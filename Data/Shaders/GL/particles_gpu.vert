@@ -0,0 +1,50 @@
+#version 450
+#define GPU_PARTICLES_READ_ONLY
+#define INSTANCE_ID gl_InstanceID
+#include "include/ubos.glsl"
+#include "include/gpu_particles.glsl"
+
+layout(location = 0) in vec4 posUv;
+
+layout(location = 0) out vec2 texCoord;
+layout(location = 1) out vec2 texCoord2;
+layout(location = 2) out vec4 particleColor;
+layout(location = 3) out float blendFactor;				// Use to blend two textures in the atlas
+
+PROPERTIES
+{
+	vec4 params;			// x - n of columns, y - n of rows, z - scale, w - useAtlas
+	uvec4 drawParams;		// x - particle system index, y - first particle of the system in the pool
+};
+
+void main()
+{
+	// The simulation packs the indices of the alive particles at the start of the system's range
+	GPUParticle particle = particles[aliveList[drawParams.y + INSTANCE_ID]];
+
+	particleColor = particle.color;
+	blendFactor = particle.velBlend.w;
+
+	vec3 worldPos = (systems[drawParams.x].transform * vec4(particle.posLife.xyz, 1.0)).xyz;
+
+	mat4 modelView = viewMatrix;
+	modelView[3] = viewMatrix * vec4(worldPos, 1.0);
+
+	// Remove rotation and set the scale so the quad always faces the camera
+	modelView[0] = vec4(params.z, 0.0, 0.0, 0.0);
+	modelView[1] = vec4(0.0, params.z, 0.0, 0.0);
+	modelView[2] = vec4(0.0, 0.0, params.z, 0.0);
+
+	texCoord = posUv.zw;
+	texCoord.y = 1.0 - texCoord.y;
+	texCoord2 = texCoord;
+	if (params.w == 1.0)
+	{
+		texCoord.x /= params.x;
+		texCoord.y /= params.y;
+		texCoord2 = texCoord + particle.texOffsets.zw;
+		texCoord += particle.texOffsets.xy;
+	}
+
+	gl_Position = projectionMatrix * modelView * vec4(posUv.xy, 0.0, 1.0);
+}
\ No newline at end of file
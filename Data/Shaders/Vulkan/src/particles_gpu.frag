@@ -0,0 +1,36 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "include/ubos.glsl"
+
+layout(location = 0) out vec4 color;
+
+layout(location = 0) in vec2 texCoord;
+layout(location = 1) in vec2 texCoord2;
+layout(location = 2) in vec4 particleColor;
+layout(location = 3) in float blendFactor;
+
+tex2D_u(0) particleTexture;
+
+PROPERTIES
+{
+	vec4 params;			// x - n of columns, y - n of rows, z - scale, w - useAtlas
+	uvec4 drawParams;		// x - particle system index, y - first particle of the system in the pool
+};
+
+void main()
+{
+	if (params.w > 0.0)
+	{
+		vec4 color1 = texture(particleTexture, texCoord);
+		vec4 color2 = texture(particleTexture, texCoord2);
+		vec4 mixed = mix(color1, color2, blendFactor);
+		color = mixed * particleColor;
+	}
+	else
+	{
+		vec4 texDiff = texture(particleTexture, texCoord);
+		color = texDiff * particleColor;
+	}
+
+	color.rgb *= color.a;
+}
\ No newline at end of file
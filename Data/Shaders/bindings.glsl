@@ -10,7 +10,16 @@
 #define OPAQUE_LIGHT_INDEX_COUNTER_SSBO			8
 #define DEBUG_VOXELS_INDIRECT_DRAW				9
 #define DEBUG_VOXELS_POSITION_SSBO				10
-#define BUFFERS_COUNT							(DEBUG_VOXELS_POSITION_SSBO + 1)
+#define GPU_PARTICLES_SSBO						11
+#define GPU_PARTICLES_ALIVE_LIST_SSBO			12
+#define GPU_PARTICLE_SYSTEMS_SSBO				13
+#define GPU_PARTICLES_INDIRECT_DRAW				14
+#define VEGETATION_INSTANCES_SSBO				15
+#define VEGETATION_CULL_PARAMS_SSBO				16
+#define VEGETATION_CULL_COUNTERS_SSBO			17
+#define VEGETATION_VISIBLE_INSTANCES_SSBO		18
+#define VEGETATION_INDIRECT_DRAW				19
+#define BUFFERS_COUNT							(VEGETATION_INDIRECT_DRAW + 1)
 
 // Textures
 #define CSM_TEXTURE								0
@@ -1,6 +1,7 @@
 #include "AIWindow.h"
 
 #include "Engine/Game/Game.h"
+#include "Engine/AI/AStarBenchmark.h"
 #include "Engine/Program/Input.h"
 #include "Engine/Program/Log.h"
 #include "Engine/Program/Utils.h"
@@ -72,6 +73,11 @@ void AIWindow::Render()
 			game->GetAISystem().GetAStarGrid().SaveGridToFile();
 		}
 
+		if (ImGui::Button("Run path benchmark"))
+		{
+			Engine::RunPathBenchmark();
+		}
+
 		ImGui::Checkbox("Select grid mode", &selectGrid);
 
 		if (selectGrid && Engine::Input::IsMousePressed(0) && editorManager->IsMouseInsideGameView())
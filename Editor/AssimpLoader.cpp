@@ -772,7 +772,7 @@ namespace Engine
 				list[j].time = static_cast<float>(bone->mPositionKeys[j].mTime);
 			}
 
-			a->bonesKeyframesList.insert({ std::string(bone->mNodeName.data), list });
+			animclip::CompressTrack(list, a->tracks[std::string(bone->mNodeName.data)]);
 		}
 	}
 
@@ -792,17 +792,16 @@ namespace Engine
 		Serializer s(fileManager);
 		s.OpenForWriting();
 
-		s.Write(315);
+		s.Write(316);
 		s.Write(a->name);
 		s.Write(a->duration);
 		s.Write(a->ticksPerSecond);
-		s.Write((unsigned int)a->bonesKeyframesList.size());
+		s.Write((unsigned int)a->tracks.size());
 
-		for (auto it = a->bonesKeyframesList.begin(); it != a->bonesKeyframesList.end(); it++)
+		for (auto it = a->tracks.begin(); it != a->tracks.end(); it++)
 		{
 			s.Write(it->first);
-			s.Write((unsigned int)it->second.size());
-			s.Write(it->second.data(), (unsigned int)it->second.size() * sizeof(Keyframe));
+			animclip::WriteTrack(s, it->second);
 		}
 
 		s.Save(a->path);
@@ -834,7 +833,7 @@ namespace Engine
 		if (name.empty())
 			name = "Animation";
 
-		std::map<std::string, KeyFrameList> bonesKeyframesList;
+		std::map<std::string, AnimationTrack> tracks;
 
 		for (unsigned int i = 0; i < anim->mNumChannels; i++)		// Num channels are the number of bones in this animation
 		{
@@ -857,23 +856,22 @@ namespace Engine
 				list[j].time = static_cast<float>(bone->mPositionKeys[j].mTime);
 			}
 
-			bonesKeyframesList.insert({ std::string(bone->mNodeName.data), list });
+			animclip::CompressTrack(list, tracks[std::string(bone->mNodeName.data)]);
 		}
 
 		Serializer s(fileManager);
 		s.OpenForWriting();
 
-		s.Write(315);
+		s.Write(316);
 		s.Write(name);
 		s.Write(static_cast<float>(anim->mDuration));
 		s.Write((float)(anim->mTicksPerSecond != 0.0 ? anim->mTicksPerSecond : 25.0f));
-		s.Write((unsigned int)bonesKeyframesList.size());
+		s.Write((unsigned int)tracks.size());
 
-		for (auto it = bonesKeyframesList.begin(); it != bonesKeyframesList.end(); it++)
+		for (auto it = tracks.begin(); it != tracks.end(); it++)
 		{
 			s.Write(it->first);
-			s.Write((unsigned int)it->second.size());
-			s.Write(it->second.data(), (unsigned int)it->second.size() * sizeof(Keyframe));
+			animclip::WriteTrack(s, it->second);
 		}
 
 		s.Save(newAnimPath);
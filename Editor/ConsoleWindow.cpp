@@ -16,6 +16,8 @@ void ConsoleWindow::Render()
 {
 	if (BeginWindow("Console"))
 	{
+		std::lock_guard<std::mutex> lock(outputsMutex);
+
 		if (ImGui::Button("Clear"))
 		{
 			numOutputs = 0;
@@ -59,6 +61,8 @@ void ConsoleWindow::Render()
 
 void ConsoleWindow::AddOutput(Engine::LogLevel logLevel, const char *output)
 {
+	std::lock_guard<std::mutex> lock(outputsMutex);
+
 	if (numOutputs >= MAX_OUTPUTS)
 	{
 		// Shift all outputs so we put the new output at the end of the array
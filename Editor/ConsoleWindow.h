@@ -4,6 +4,8 @@
 
 #include "Program\Log.h"
 
+#include <mutex>
+
 struct ConsoleOutput
 {
 	char output[2048];
@@ -25,5 +27,6 @@ private:
 	unsigned int outputsIndex = 0;
 	unsigned int numOutputs = 0;
 	bool outputAdded = false;
+	std::mutex outputsMutex;			// The log can add outputs from any thread
 };
 
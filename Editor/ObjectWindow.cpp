@@ -511,6 +511,7 @@ void ObjectWindow::Render()
 		attackRange = aiObj->GetAttackRange();
 		attackDelay = aiObj->GetAttackDelay();
 		fov = aiObj->GetFieldOfView();
+		useFlowField = aiObj->GetUseFlowField();
 	}
 }*/
 
@@ -555,6 +556,7 @@ void ObjectWindow::SetEntity(Engine::Entity entity)
 		psLifetime = selectedPS->GetLifetime();
 		maxParticles = selectedPS->GetMaxParticles();
 		loopPs = selectedPS->IsLooping();
+		gpuSimulatedPs = selectedPS->IsGPUSimulated();
 		duration = selectedPS->GetDuration();
 		velocity = selectedPS->GetVelocity();
 		const Engine::AtlasInfo &info = selectedPS->GetAtlasInfo();
@@ -781,6 +783,8 @@ void ObjectWindow::HandleAI()
 				fov = 0.1f;
 			aiObj->SetFieldOfView(fov);
 		}
+		if (ImGui::Checkbox("Use flow field", &useFlowField))
+			aiObj->SetUseFlowField(useFlowField);
 
 		ImGui::Unindent();
 	}*/
@@ -1222,6 +1226,15 @@ void ObjectWindow::HandleParticleSystem()
 		if (ImGui::Checkbox("Loop", &loopPs))
 			selectedPS->SetIsLooping(loopPs);
 
+		if (ImGui::Checkbox("GPU simulated", &gpuSimulatedPs))
+		{
+			// Stays on the cpu when the renderer doesn't support it or there are no free gpu slots
+			if (!particleManager->SetParticleSystemGPUSimulated(selectedEntity, gpuSimulatedPs))
+				gpuSimulatedPs = selectedPS->IsGPUSimulated();
+
+			maxParticles = selectedPS->GetMaxParticles();		// The limit is different on the gpu
+		}
+
 		ImGui::PushID(12345678);
 		if (ImGui::DragFloat3("Center", glm::value_ptr(psCenter), 0.1f))
 			selectedPS->SetCenter(psCenter);
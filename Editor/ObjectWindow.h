@@ -109,6 +109,7 @@ private:
 	float attackRange;
 	float attackDelay = 0.0f;
 	float fov = 0.0f;
+	bool useFlowField = false;
 
 	// Transform
 	glm::vec3 position;
@@ -147,6 +148,7 @@ private:
 	int emission = 4;
 	int maxParticles = 30;
 	bool loopPs = false;
+	bool gpuSimulatedPs = false;
 	float duration = 0.0f;
 	glm::vec3 velocity;
 	bool useAtlas = false;
@@ -3,6 +3,10 @@
 #include "Game\Game.h"
 #include "EditorManager.h"
 #include "Graphics\Renderer.h"
+#include "Graphics\RenderQueueBenchmark.h"
+#include "Graphics\RenderQueueAllocationCheck.h"
+#include "Graphics\Animation\AnimationBenchmark.h"
+#include "Program\TLSFAllocatorFuzz.h"
 #include "Graphics\Effects\MainView.h"
 #include "Program\Utils.h"
 
@@ -193,6 +197,26 @@ void RenderingWindow::Render()
 			ImGui::EndPopup();
 		}
 
+		if (ImGui::Button("Run render queue sort benchmark"))
+		{
+			Engine::RunRenderQueueSortBenchmark();
+		}
+
+		if (ImGui::Button("Run render queue allocation check"))
+		{
+			Engine::RunRenderQueueAllocationCheck();
+		}
+
+		if (ImGui::Button("Run animation benchmark"))
+		{
+			Engine::RunAnimationBenchmark();
+		}
+
+		if (ImGui::Button("Run gpu memory allocator fuzz test"))
+		{
+			Engine::RunTLSFAllocatorFuzz();
+		}
+
 		ImGui::Separator();
 		ImGui::Checkbox("Enable water", &debugSettings.enableWater);
 
@@ -8,6 +8,8 @@ namespace Engine
 {
 	AIObject::AIObject(Game *game)
 	{
+		this->game = game;
+
 		eyesOffset = glm::vec3(0.0f);
 		eyesRange = 15.0f;
 		attackRange = 1.0f;
@@ -15,6 +17,9 @@ namespace Engine
 		targetInFOV = false;
 
 		followPath = false;
+		useFlowField = false;
+		onFlowField = false;
+		enabled = true;
 		moveSpeed = 0.0f;
 		maxMoveSpeed = 2.0f;
 		turning = false;
@@ -31,6 +36,7 @@ namespace Engine
 		idleTimerMax = 4.0f;
 
 		requestPathTimer = 0.0f;
+		pathQuery = INVALID_PATH_QUERY;
 
 		attackDelay = 1.0f;
 		attackTimer = 0.0f;
@@ -41,8 +47,16 @@ namespace Engine
 		state = IDLE;
 	}
 
+	AIObject::~AIObject()
+	{
+		CancelPathQuery();
+	}
+
 	void AIObject::UpdateInGame(float dt)
 	{
+		if (!enabled)
+			return;
+
 		castSightRayTimer += dt;
 
 		TransformManager &tm = game->GetTransformManager();
@@ -115,24 +129,67 @@ namespace Engine
 			requestPathTimer += dt;
 		}
 
-		if (requestPathTimer >= 1.0f)
+		if (requestPathTimer >= 1.0f && pathQuery == INVALID_PATH_QUERY && !onFlowField)
 		{
 			//Log::Message("AI requested path.");
-			game->GetAISystem().RequestPath(worldPosition, tm.GetWorldPosition(target), pathWaypoints);
+			pathQuery = game->GetAISystem().RequestPath(worldPosition, tm.GetWorldPosition(target));
+			requestPathTimer = 0.0f;
+		}
 
-			followPath = false;
+		if (pathQuery != INVALID_PATH_QUERY)
+		{
+			PathQueryStatus status = game->GetAISystem().GetPathResult(pathQuery, pathWaypoints);
 
-			if (!pathWaypoints.empty())
+			if (status != PathQueryStatus::PENDING)
 			{
-				followPath = true;
-				pathEnded = false;
+				pathQuery = INVALID_PATH_QUERY;
+				followPath = false;
+
+				if (!pathWaypoints.empty())
+				{
+					followPath = true;
+					pathEnded = false;
+				}
+				else if (glm::length2(worldPosition - tm.GetWorldPosition(target)) < 12.0f)
+				{
+					pathEnded = true;
+				}
 			}
-			else if (glm::length2(worldPosition - tm.GetWorldPosition(target)) < 12.0f)
+		}
+
+		onFlowField = false;
+
+		if ((state == CHASING || state == INVESTIGATING) && useFlowField && !pathEnded)
+		{
+			// The field is shared with every other agent chasing the same target and is sampled every frame instead of following waypoints.
+			// Until it's built the agent keeps following paths
+			AStarGrid &grid = game->GetAISystem().GetAStarGrid();
+			const FlowField *field = game->GetAISystem().GetFlowField(targetWorldPosition);
+			const glm::vec2 position = glm::vec2(worldPosition.x, worldPosition.z);
+			glm::vec2 direction;
+
+			if (field && field->Sample(grid, position, direction))
 			{
+				onFlowField = true;
+
+				// The field leads to the target now so the path is not needed anymore
+				CancelPathQuery();
+				pathWaypoints.clear();
+				followPath = false;
+
+				TurnTo(utils::AngleFromPoint(direction));
+
+				if (moveSpeed < maxMoveSpeed)
+					moveSpeed += dt * 2.0f;
+
+				tm.SetLocalPosition(e, worldPosition + glm::vec3(direction.x, 0.0f, direction.y) * dt * moveSpeed);
+				worldPosition = tm.GetWorldPosition(e);
+			}
+			else if (glm::length2(worldPosition - targetWorldPosition) < 12.0f || (field && grid.NodeIndexFromWorldPos(position) == field->GetTargetNode()))
+			{
+				// In the node of the target, or at the end of a field built for where the target was a few nodes ago, go straight to it
 				pathEnded = true;
 			}
-
-			requestPathTimer = 0.0f;
 		}
 
 		if ((state == CHASING || state == INVESTIGATING) && followPath)
@@ -260,6 +317,37 @@ namespace Engine
 			moveSpeed = 0.0f;
 	}
 
+	void AIObject::SetUseFlowField(bool useFlowField)
+	{
+		// The current path is kept until the field is built
+		this->useFlowField = useFlowField;
+
+		if (!useFlowField)
+			onFlowField = false;
+	}
+
+	void AIObject::SetEnabled(bool enabled)
+	{
+		this->enabled = enabled;
+
+		// The path would be stale by the time the object is enabled again so request a new one then
+		if (!enabled)
+		{
+			CancelPathQuery();
+			followPath = false;
+			moveSpeed = 0.0f;
+		}
+	}
+
+	void AIObject::CancelPathQuery()
+	{
+		if (pathQuery != INVALID_PATH_QUERY)
+		{
+			game->GetAISystem().CancelPath(pathQuery);
+			pathQuery = INVALID_PATH_QUERY;
+		}
+	}
+
 	void AIObject::Serialize(Serializer &s)
 	{
 		s.Write(eyesOffset);
@@ -267,6 +355,7 @@ namespace Engine
 		s.Write(attackRange);
 		s.Write(attackDelay);
 		s.Write(fov);
+		s.Write(useFlowField);
 	}
 
 	void AIObject::Deserialize(Serializer &s)
@@ -276,6 +365,7 @@ namespace Engine
 		s.Read(attackRange);
 		s.Read(attackDelay);
 		s.Read(fov);
+		s.Read(useFlowField);
 	}
 
 	void AIObject::TurnTo(float angle)
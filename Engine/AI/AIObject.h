@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Game/EntityManager.h"
+#include "AISystem.h"
 
 namespace Engine
 {
@@ -18,8 +19,12 @@ namespace Engine
 	{
 	public:
 		AIObject(Game *game);
+		~AIObject();
 
 		void UpdateInGame(float dt);
+		// A disabled object doesn't update and gives back its path query slot
+		void SetEnabled(bool enabled);
+		bool IsEnabled() const { return enabled; }
 
 		void SetTarget(Entity e);
 		void SetEyesOffset(const glm::vec3 &offset) { eyesOffset = offset; }
@@ -30,6 +35,9 @@ namespace Engine
 		void SetTargetPosition(const glm::vec3 &pos) { targetWorldPosition = pos; }
 		void SetState(int state);
 		void SetMoveSpeed(float moveSpeed) { maxMoveSpeed = moveSpeed; }
+		// Follows the flow field to the target instead of requesting paths. Better for big groups chasing the same target.
+		// Paths are still used while the field is being built
+		void SetUseFlowField(bool useFlowField);
 		void TurnTo(float angle);
 
 		Entity GetTarget() const { return target; }
@@ -40,6 +48,7 @@ namespace Engine
 		float GetFieldOfView() const { return fov; }
 		float GetMoveSpeed() const { return maxMoveSpeed; }
 		int GetState() const { return (int)state; }
+		bool GetUseFlowField() const { return useFlowField; }
 
 		void Serialize(Serializer &s);
 		void Deserialize(Serializer &s);
@@ -47,6 +56,10 @@ namespace Engine
 		// Script functions
 		//static AIObject *CastFromObject(Object *obj) { if (!obj || obj->GetType() != ObjectType::AI_OBJECT) return nullptr; else { return static_cast<AIObject*>(obj); } }
 
+	private:
+		// Cancels the pending path request so its slot in the ai system can be reused
+		void CancelPathQuery();
+
 	private:
 		Game *game;
 		Entity e;
@@ -59,7 +72,11 @@ namespace Engine
 		bool targetInFOV;
 
 		std::vector<glm::vec2> pathWaypoints;
+		PathQueryHandle pathQuery;			// The current path keeps being followed until the query is solved
 		bool followPath;
+		bool useFlowField;
+		bool onFlowField;					// The field was sampled this update, otherwise the agent falls back to paths
+		bool enabled;
 		float moveSpeed;
 		float maxMoveSpeed;
 		bool turning;
@@ -1,20 +1,33 @@
 #include "AISystem.h"
 
+#include "Game/Game.h"
 #include "Program/Log.h"
 
 #include <chrono>
 #include <iostream>
+#include <algorithm>
+#include <cstdlib>
 
 namespace Engine
 {
 
+	static const unsigned int MAX_PATH_QUERIES = 0xFFFF;
+	static const size_t MAX_FLOW_FIELDS = 8;
+	static const unsigned int FLOW_FIELD_IDLE_UPDATES = 300;		// Fields nobody sampled for this many updates are released
+	static const size_t MAX_FLOW_FIELD_BUILDS = 2;					// Per update, the other requests wait for the next ones
+	static const int FLOW_FIELD_REUSE_DISTANCE = 4;					// In nodes. A field this close to the destination is used instead of building a new one
+
 	AISystem::AISystem()
 	{
+		game = nullptr;
 		showGrid = false;
+		updateCount = 0;
 	}
 
 	void AISystem::Init(Game *game)
 	{
+		this->game = game;
+
 		///aStarGrid.Init(game, aStarGrid.GetGridCenter(), glm::vec2(380.0f, 450.0f), 0.5f);
 
 		/*std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
@@ -33,20 +46,324 @@ namespace Engine
 
 	void AISystem::Update()
 	{
-		///aStarGrid.Update();
+		// Only does something when a rebuild was asked for, the tiled rebuild finishes in this frame
+		aStarGrid.Update();
+
+		updateCount++;
+
+		JobSystem &jobSystem = game->GetJobSystem();
+		JobCounter counter;
+
+		// The flow fields only read the grid so they're built and repaired while the path queries are solved
+		UpdateFlowFields(&counter);
+
+		if (pendingQueries.size() == 0)
+		{
+			jobSystem.Wait(&counter);
+			return;
+		}
+
+		// Nodes changed since the last update are only applied to the cluster graph here, before the searches read it
+		aStarGrid.UpdateClusterGraph();
+
+		if (searches.size() < jobSystem.GetNumThreads())
+			searches.resize(jobSystem.GetNumThreads());
+
+		// The grid doesn't change while the queries are solved so each thread only needs its own search state
+		jobSystem.ParallelFor(static_cast<unsigned int>(pendingQueries.size()), 4, [this](unsigned int start, unsigned int end)
+		{
+			AStarSearch &search = searches[JobSystem::GetThreadIndex()];
+
+			for (unsigned int i = start; i < end; i++)
+			{
+				PathQuery &q = queries[pendingQueries[i]];
+
+				if (q.cancelled)
+					continue;
+
+				if (search.FindPath(aStarGrid, q.startPos, q.targetPos, q.waypoints, q.maxSearch, q.mode))
+					q.status = PathQueryStatus::FOUND;
+				else
+					q.status = PathQueryStatus::NOT_FOUND;
+			}
+		}, &counter);
+
+		jobSystem.Wait(&counter);
+
+		for (size_t i = 0; i < pendingQueries.size(); i++)
+		{
+			if (queries[pendingQueries[i]].cancelled)
+				ReleaseQuery(pendingQueries[i]);
+		}
+
+		pendingQueries.clear();
 	}
 
 	void AISystem::Dispose()
 	{
 		///aStarGrid.Dispose();
 
+		queries.clear();
+		freeQueries.clear();
+		pendingQueries.clear();
+		searches.clear();
+		flowFields.clear();
+		requestedFlowFields.clear();
+		flowFieldsToUpdate.clear();
+		flowFieldsToBuild.clear();
+		changedNodes.clear();
+
 		Log::Print(LogLevel::LEVEL_INFO, "Disposing AI system\n");
 	}
 
-	bool AISystem::RequestPath(const glm::vec3 &startPos, const glm::vec3 &endPos, std::vector<glm::vec2> &nodeWaypoints, int maxSearch)
+	PathQueryHandle AISystem::RequestPath(const glm::vec3 &startPos, const glm::vec3 &endPos, int maxSearch, PathSearchMode mode)
+	{
+		unsigned int index = 0;
+
+		if (freeQueries.size() > 0)
+		{
+			index = freeQueries.back();
+			freeQueries.pop_back();
+		}
+		else
+		{
+			if (queries.size() >= MAX_PATH_QUERIES)
+			{
+				Log::Print(LogLevel::LEVEL_WARNING, "Too many path queries, request ignored\n");
+				return INVALID_PATH_QUERY;
+			}
+
+			index = static_cast<unsigned int>(queries.size());
+			queries.push_back({});
+			queries[index].generation = 1;
+		}
+
+		PathQuery &q = queries[index];
+		q.startPos = glm::vec2(startPos.x, startPos.z);
+		q.targetPos = glm::vec2(endPos.x, endPos.z);
+		q.maxSearch = maxSearch;
+		q.mode = mode;
+		q.waypoints.clear();
+		q.status = PathQueryStatus::PENDING;
+		q.cancelled = false;
+
+		pendingQueries.push_back(index);
+
+		return (q.generation << 16) | index;
+	}
+
+	PathQueryStatus AISystem::GetPathResult(PathQueryHandle handle, std::vector<glm::vec2> &nodeWaypoints)
+	{
+		PathQuery *q = GetQuery(handle);
+		if (!q)
+			return PathQueryStatus::INVALID;
+
+		const PathQueryStatus status = q->status;
+
+		if (status == PathQueryStatus::FOUND || status == PathQueryStatus::NOT_FOUND)
+		{
+			nodeWaypoints.swap(q->waypoints);
+			ReleaseQuery(handle & 0xFFFF);
+		}
+
+		return status;
+	}
+
+	void AISystem::CancelPath(PathQueryHandle handle)
+	{
+		PathQuery *q = GetQuery(handle);
+		if (!q)
+			return;
+
+		// Pending queries are released after the update so they're not reused while still in the pending list
+		if (q->status == PathQueryStatus::PENDING)
+		{
+			q->cancelled = true;
+			q->status = PathQueryStatus::INVALID;
+		}
+		else
+		{
+			ReleaseQuery(handle & 0xFFFF);
+		}
+	}
+
+	bool AISystem::FindPath(const glm::vec3 &startPos, const glm::vec3 &endPos, std::vector<glm::vec2> &nodeWaypoints, int maxSearch, PathSearchMode mode)
+	{
+		return aStarGrid.FindPath(glm::vec2(startPos.x, startPos.z), glm::vec2(endPos.x, endPos.z), nodeWaypoints, maxSearch, mode);
+	}
+
+	const FlowField *AISystem::GetFlowField(const glm::vec3 &destination)
 	{
-		///return aStarGrid.FindPath(glm::vec2(startPos.x, startPos.z), glm::vec2(endPos.x, endPos.z), nodeWaypoints, maxSearch);
-		return false;
+		const int targetNode = aStarGrid.NodeIndexFromWorldPos(glm::vec2(destination.x, destination.z));
+		if (targetNode < 0)
+			return nullptr;
+
+		const int gridWidth = aStarGrid.GetGridSizeXZ().x;
+		const int targetX = targetNode % gridWidth;
+		const int targetZ = targetNode / gridWidth;
+
+		FlowField *nearest = nullptr;
+		FlowField *requested = nullptr;
+		int nearestDistance = 0;
+
+		// The target usually moves to a node next to the old one so the field it had still leads there
+		for (auto it = flowFields.begin(); it != flowFields.end(); it++)
+		{
+			const int distance = std::max(std::abs(it->first % gridWidth - targetX), std::abs(it->first / gridWidth - targetZ));
+			if (distance > FLOW_FIELD_REUSE_DISTANCE)
+				continue;
+
+			if (!it->second.IsBuilt())
+			{
+				requested = &it->second;
+			}
+			else if (!nearest || distance < nearestDistance)
+			{
+				nearest = &it->second;
+				nearestDistance = distance;
+			}
+		}
+
+		if (nearest)
+		{
+			nearest->SetLastUsedUpdate(updateCount);
+			return nearest;
+		}
+
+		if (requested)
+		{
+			requested->SetLastUsedUpdate(updateCount);
+			return nullptr;
+		}
+
+		// Built by the next update, until then the agents keep following paths
+		flowFields[targetNode].SetLastUsedUpdate(updateCount);
+		requestedFlowFields.push_back({ targetNode, aStarGrid.GetVersion() });
+
+		return nullptr;
+	}
+
+	void AISystem::UpdateFlowFields(JobCounter *counter)
+	{
+		// Always taken so the changes don't pile up while there are no fields
+		aStarGrid.TakeChangedNodes(changedNodes);
+
+		if (flowFields.size() == 0)
+			return;
+
+		auto removeRequest = [this](int targetNode)
+		{
+			for (size_t i = 0; i < requestedFlowFields.size(); i++)
+			{
+				if (requestedFlowFields[i].targetNode == targetNode)
+				{
+					requestedFlowFields.erase(requestedFlowFields.begin() + i);
+					return;
+				}
+			}
+		};
+
+		// Fields are only released here so the pointers handed out since the last update stay valid until now.
+		// They are keyed by node index, which points somewhere else once the grid moved, so a new version drops them and the agents request them again on their next sample
+		for (size_t i = 0; i < requestedFlowFields.size();)
+		{
+			if (requestedFlowFields[i].gridVersion != aStarGrid.GetVersion())
+			{
+				flowFields.erase(requestedFlowFields[i].targetNode);
+				requestedFlowFields.erase(requestedFlowFields.begin() + i);
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		for (auto it = flowFields.begin(); it != flowFields.end();)
+		{
+			const FlowField &field = it->second;
+
+			if (updateCount - field.GetLastUsedUpdate() > FLOW_FIELD_IDLE_UPDATES || (field.IsBuilt() && field.GetGridVersion() != aStarGrid.GetVersion()))
+			{
+				removeRequest(it->first);
+				it = flowFields.erase(it);
+			}
+			else
+			{
+				it++;
+			}
+		}
+
+		while (flowFields.size() > MAX_FLOW_FIELDS)
+		{
+			auto oldest = flowFields.begin();
+			for (auto it = flowFields.begin(); it != flowFields.end(); it++)
+			{
+				if (it->second.GetLastUsedUpdate() < oldest->second.GetLastUsedUpdate())
+					oldest = it;
+			}
+
+			removeRequest(oldest->first);
+			flowFields.erase(oldest);
+		}
+
+		flowFieldsToUpdate.clear();
+
+		if (changedNodes.size() > 0)
+		{
+			for (auto it = flowFields.begin(); it != flowFields.end(); it++)
+			{
+				if (it->second.IsBuilt())
+					flowFieldsToUpdate.push_back(&it->second);
+			}
+		}
+
+		// The new fields are built from the current grid so they don't need the changes
+		flowFieldsToBuild.clear();
+
+		const size_t buildCount = std::min(requestedFlowFields.size(), MAX_FLOW_FIELD_BUILDS);
+		for (size_t i = 0; i < buildCount; i++)
+			flowFieldsToBuild.push_back({ &flowFields[requestedFlowFields[i].targetNode], requestedFlowFields[i].targetNode });
+
+		requestedFlowFields.erase(requestedFlowFields.begin(), requestedFlowFields.begin() + buildCount);
+
+		JobSystem &jobSystem = game->GetJobSystem();
+
+		// Each field only writes to itself and the grid is not changed while they update
+		jobSystem.ParallelFor(static_cast<unsigned int>(flowFieldsToUpdate.size()), 1, [this](unsigned int start, unsigned int end)
+		{
+			for (unsigned int i = start; i < end; i++)
+				flowFieldsToUpdate[i]->UpdateNodes(aStarGrid, changedNodes);
+		}, counter);
+
+		jobSystem.ParallelFor(static_cast<unsigned int>(flowFieldsToBuild.size()), 1, [this](unsigned int start, unsigned int end)
+		{
+			for (unsigned int i = start; i < end; i++)
+				flowFieldsToBuild[i].field->Build(aStarGrid, flowFieldsToBuild[i].targetNode);
+		}, counter);
+	}
+
+	AISystem::PathQuery *AISystem::GetQuery(PathQueryHandle handle)
+	{
+		const unsigned int index = handle & 0xFFFF;
+		const unsigned int generation = handle >> 16;
+
+		if (index >= queries.size() || queries[index].generation != generation || queries[index].status == PathQueryStatus::INVALID)
+			return nullptr;
+
+		return &queries[index];
+	}
+
+	void AISystem::ReleaseQuery(unsigned int index)
+	{
+		PathQuery &q = queries[index];
+		q.status = PathQueryStatus::INVALID;
+		q.cancelled = false;
+		q.waypoints.clear();
+
+		// The generation is never 0 so a handle is never INVALID_PATH_QUERY
+		q.generation = q.generation == 0xFFFF ? 1 : q.generation + 1;
+
+		freeQueries.push_back(index);
 	}
 
 	void AISystem::PrepareDebugDraw()
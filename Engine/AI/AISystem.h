@@ -1,13 +1,27 @@
 #pragma once
 
 #include "AStarGrid.h"
+#include "FlowField.h"
 
-#include <queue>
+#include <unordered_map>
 
 namespace Engine
 {
 	class Game;
 	class Renderer;
+	struct JobCounter;
+
+	enum class PathQueryStatus
+	{
+		INVALID,			// The handle was never valid, was cancelled or its result was already taken
+		PENDING,
+		FOUND,
+		NOT_FOUND
+	};
+
+	// Index of the query in the low 16 bits and the generation of the slot in the high 16 bits, so handles of released queries are detected
+	typedef unsigned int PathQueryHandle;
+	static const PathQueryHandle INVALID_PATH_QUERY = 0;
 
 	class AISystem
 	{
@@ -15,10 +29,21 @@ namespace Engine
 		AISystem();
 
 		void Init(Game *game);
+		// Solves the path queries requested since the last update in parallel
 		void Update();
 		void Dispose();
 
-		bool RequestPath(const glm::vec3 &startPos, const glm::vec3 &endPos, std::vector<glm::vec2> &nodeWaypoints, int maxSearch = 99999);
+		// Queues a path query. The result is ready after the next update
+		PathQueryHandle RequestPath(const glm::vec3 &startPos, const glm::vec3 &endPos, int maxSearch = 99999, PathSearchMode mode = PathSearchMode::HIERARCHICAL);
+		// Returns PENDING until the query is solved. Once it returns FOUND or NOT_FOUND the waypoints are moved out and the handle is released
+		PathQueryStatus GetPathResult(PathQueryHandle handle, std::vector<glm::vec2> &nodeWaypoints);
+		void CancelPath(PathQueryHandle handle);
+		// Finds the path right away on the calling thread
+		bool FindPath(const glm::vec3 &startPos, const glm::vec3 &endPos, std::vector<glm::vec2> &nodeWaypoints, int maxSearch = 99999, PathSearchMode mode = PathSearchMode::HIERARCHICAL);
+		// Returns a built flow field that leads to the destination or a few nodes from it, so agents chasing a moving target share the same field
+		// instead of rebuilding it every node. Fields are only built by the update, so it returns nullptr until the field requested here is ready
+		// or if the destination is outside the grid. The pointer is only valid until the next update
+		const FlowField *GetFlowField(const glm::vec3 &destination);
 
 		void PrepareDebugDraw();
 
@@ -28,8 +53,51 @@ namespace Engine
 		bool GetShowGrid() const { return showGrid; }
 
 	private:
+		struct PathQuery
+		{
+			glm::vec2 startPos;
+			glm::vec2 targetPos;
+			int maxSearch;
+			PathSearchMode mode;
+			std::vector<glm::vec2> waypoints;
+			PathQueryStatus status;
+			unsigned int generation;
+			bool cancelled;
+		};
+
+		struct FlowFieldRequest
+		{
+			int targetNode;
+			unsigned int gridVersion;
+		};
+
+		struct FlowFieldBuild
+		{
+			FlowField *field;
+			int targetNode;
+		};
+
+		PathQuery *GetQuery(PathQueryHandle handle);
+		void ReleaseQuery(unsigned int index);
+		// Drops the fields that are not needed anymore, then repairs the others with the nodes changed since the last update and builds the requested ones
+		// with jobs added to the counter
+		void UpdateFlowFields(JobCounter *counter);
+
+	private:
+		Game *game;
 		AStarGrid aStarGrid;
 		bool showGrid;
-		//std::queue<> pathRequests;
+
+		std::vector<PathQuery> queries;
+		std::vector<unsigned int> freeQueries;
+		std::vector<unsigned int> pendingQueries;
+		std::vector<AStarSearch> searches;			// One for each thread of the job system
+
+		std::unordered_map<int, FlowField> flowFields;		// By target node. The requested ones are not built yet
+		std::vector<FlowFieldRequest> requestedFlowFields;	// In the order they were requested
+		std::vector<FlowField*> flowFieldsToUpdate;
+		std::vector<FlowFieldBuild> flowFieldsToBuild;
+		std::vector<int> changedNodes;
+		unsigned int updateCount;
 	};
 }
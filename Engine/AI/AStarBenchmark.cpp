@@ -0,0 +1,123 @@
+#include "AStarBenchmark.h"
+
+#include "AStarGrid.h"
+#include "Program/Log.h"
+
+#include <chrono>
+#include <random>
+
+namespace Engine
+{
+	struct PathBenchmarkStats
+	{
+		unsigned long long expandedNodes;
+		double time;
+	};
+
+	static void RunSearch(AStarGrid &grid, AStarSearch &search, PathSearchMode mode, const glm::vec2 &start, const glm::vec2 &target, std::vector<glm::vec2> &waypoints, PathBenchmarkStats &stats, bool &found, int &cost)
+	{
+		std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+		found = search.FindPath(grid, start, target, waypoints, 0x7FFFFFFF, mode);
+		std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+
+		stats.time += std::chrono::duration<double, std::milli>(t2 - t1).count();
+		stats.expandedNodes += search.GetExpandedNodes();
+		cost = search.GetPathCost();
+	}
+
+	bool RunPathBenchmark(int gridSize, unsigned int mapCount, unsigned int queriesPerMap, unsigned int seed)
+	{
+		std::mt19937 mt(seed);
+		std::uniform_int_distribution<int> nodeDist(0, gridSize - 1);
+		std::uniform_int_distribution<int> percentDist(0, 99);
+		std::uniform_int_distribution<int> wallLengthDist(gridSize / 8, gridSize / 2);
+
+		AStarGrid grid;
+		AStarSearch search;
+		std::vector<bool> walkable(static_cast<size_t>(gridSize * gridSize));
+		std::vector<glm::vec2> waypoints;
+
+		PathBenchmarkStats totalAStar = {};
+		PathBenchmarkStats totalJumpPoint = {};
+		PathBenchmarkStats totalHierarchical = {};
+		unsigned int costMismatches = 0;
+		unsigned int foundMismatches = 0;
+
+		Log::Print(LogLevel::LEVEL_INFO, "Path benchmark: %u maps of %dx%d nodes, %u queries each\n", mapCount, gridSize, gridSize, queriesPerMap);
+
+		for (unsigned int m = 0; m < mapCount; m++)
+		{
+			// From open maps to maps with a lot of scattered obstacles and walls
+			const int obstaclePercent = mapCount > 1 ? static_cast<int>(m * 35 / (mapCount - 1)) : 0;
+			const unsigned int wallCount = m * 4;
+
+			for (size_t i = 0; i < walkable.size(); i++)
+				walkable[i] = percentDist(mt) >= obstaclePercent;
+
+			for (unsigned int w = 0; w < wallCount; w++)
+			{
+				const int x = nodeDist(mt);
+				const int z = nodeDist(mt);
+				const int length = wallLengthDist(mt);
+				const bool alongX = percentDist(mt) < 50;
+
+				for (int i = 0; i < length; i++)
+				{
+					const int wx = alongX ? x + i : x;
+					const int wz = alongX ? z : z + i;
+
+					if (wx < gridSize && wz < gridSize)
+						walkable[wz * gridSize + wx] = false;
+				}
+			}
+
+			grid.InitFromWalkable(glm::ivec2(gridSize), walkable);
+
+			PathBenchmarkStats aStar = {};
+			PathBenchmarkStats jumpPoint = {};
+			PathBenchmarkStats hierarchical = {};
+
+			for (unsigned int q = 0; q < queriesPerMap; q++)
+			{
+				const glm::vec2 start = grid.GetNode(nodeDist(mt) * gridSize + nodeDist(mt)).worldPos;
+				const glm::vec2 target = grid.GetNode(nodeDist(mt) * gridSize + nodeDist(mt)).worldPos;
+
+				bool aStarFound, jumpPointFound, hierarchicalFound;
+				int aStarCost, jumpPointCost, hierarchicalCost;
+
+				RunSearch(grid, search, PathSearchMode::ASTAR, start, target, waypoints, aStar, aStarFound, aStarCost);
+				RunSearch(grid, search, PathSearchMode::JUMP_POINT, start, target, waypoints, jumpPoint, jumpPointFound, jumpPointCost);
+				RunSearch(grid, search, PathSearchMode::HIERARCHICAL, start, target, waypoints, hierarchical, hierarchicalFound, hierarchicalCost);
+
+				// Jump point search must find paths as short as A*. The hierarchical ones can be a bit longer
+				if (aStarFound != jumpPointFound || (aStarFound && aStarCost != jumpPointCost))
+					costMismatches++;
+				// They must still find a path whenever A* does
+				if (aStarFound != hierarchicalFound)
+					foundMismatches++;
+			}
+
+			Log::Print(LogLevel::LEVEL_INFO, "Map %u, %d%% obstacles, %u walls: A* %llu nodes %.2f ms, JPS %llu nodes %.2f ms, HPA* %llu nodes %.2f ms\n", m, obstaclePercent, wallCount,
+				aStar.expandedNodes, aStar.time, jumpPoint.expandedNodes, jumpPoint.time, hierarchical.expandedNodes, hierarchical.time);
+
+			totalAStar.expandedNodes += aStar.expandedNodes;
+			totalAStar.time += aStar.time;
+			totalJumpPoint.expandedNodes += jumpPoint.expandedNodes;
+			totalJumpPoint.time += jumpPoint.time;
+			totalHierarchical.expandedNodes += hierarchical.expandedNodes;
+			totalHierarchical.time += hierarchical.time;
+		}
+
+		grid.Dispose();
+
+		Log::Print(LogLevel::LEVEL_INFO, "Total: A* %llu nodes %.2f ms, JPS %llu nodes %.2f ms, HPA* %llu nodes %.2f ms\n",
+			totalAStar.expandedNodes, totalAStar.time, totalJumpPoint.expandedNodes, totalJumpPoint.time, totalHierarchical.expandedNodes, totalHierarchical.time);
+
+		if (costMismatches > 0)
+			Log::Print(LogLevel::LEVEL_ERROR, "Jump point search and A* found paths with different costs in %u queries\n", costMismatches);
+		if (foundMismatches > 0)
+			Log::Print(LogLevel::LEVEL_ERROR, "Hierarchical search and A* disagreed on whether a path exists in %u queries\n", foundMismatches);
+
+		return costMismatches == 0 && foundMismatches == 0;
+	}
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+namespace Engine
+{
+	// Finds paths between random nodes of random grids with every search mode and logs the nodes expanded and the time they took.
+	// The grids have more obstacles and walls each map. Doesn't need a scene so it can run from the editor or a tool.
+	// Returns false if the search modes disagreed on the cost of a path or on whether one exists
+	bool RunPathBenchmark(int gridSize = 256, unsigned int mapCount = 8, unsigned int queriesPerMap = 100, unsigned int seed = 1);
+}
@@ -0,0 +1,571 @@
+#include "AStarClusterGraph.h"
+
+#include "AStarGrid.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace Engine
+{
+	// Runs of walkable nodes on a border at least this wide get an entrance at each end instead of one in the middle
+	static const int MIN_WIDE_ENTRANCE = 6;
+
+	AStarClusterSearch::AStarClusterSearch()
+	{
+		clusterMin = glm::ivec2(0);
+		clusterMax = glm::ivec2(0);
+		gridWidth = 0;
+		generation = 0;
+
+		for (int i = 0; i < ASTAR_CLUSTER_NODES; i++)
+			nodes[i].generation = 0;
+	}
+
+	void AStarClusterSearch::Search(const AStarGrid &grid, const glm::ivec2 &clusterMin, const glm::ivec2 &clusterMax, int startNode, int targetNode)
+	{
+		this->clusterMin = clusterMin;
+		this->clusterMax = clusterMax;
+		gridWidth = grid.GetGridSizeXZ().x;
+
+		generation++;
+		if (generation == 0)
+		{
+			for (int i = 0; i < ASTAR_CLUSTER_NODES; i++)
+				nodes[i].generation = 0;
+
+			generation = 1;
+		}
+
+		memset(closed, 0, sizeof(closed));
+		openSet.Reset(nodes);
+
+		// Without a target every node is searched so there's no heuristic
+		const glm::ivec2 targetGridPos = targetNode >= 0 ? grid.GetNode(targetNode).gridPos : glm::ivec2(0);
+		const int localTarget = targetNode >= 0 ? LocalIndex(targetNode) : -1;
+		const int localStart = LocalIndex(startNode);
+
+		AStarSearchNode &start = nodes[localStart];
+		start.parent = -1;
+		start.gCost = 0;
+		start.hCost = targetNode >= 0 ? AStarDistance(grid.GetNode(startNode).gridPos, targetGridPos) : 0;
+		start.generation = generation;
+
+		openSet.Add(localStart);
+
+		const int localWidth = clusterMax.x - clusterMin.x;
+
+		while (openSet.Size() > 0)
+		{
+			const int current = openSet.RemoveFirst();
+			closed[current] = true;
+
+			if (current == localTarget)
+				return;
+
+			const int currentX = current % localWidth;
+			const int currentZ = current / localWidth;
+			const int currentGCost = nodes[current].gCost;
+
+			for (int z = -1; z <= 1; z++)
+			{
+				for (int x = -1; x <= 1; x++)
+				{
+					if (x == 0 && z == 0)
+						continue;
+
+					const int checkX = currentX + x;
+					const int checkZ = currentZ + z;
+
+					if (checkX < 0 || checkX >= localWidth || checkZ < 0 || checkZ >= clusterMax.y - clusterMin.y)
+						continue;
+
+					const int neighbour = checkZ * localWidth + checkX;
+					const int neighbourGridNode = (clusterMin.y + checkZ) * gridWidth + clusterMin.x + checkX;
+
+					if (closed[neighbour] || !grid.GetNode(neighbourGridNode).walkable)
+						continue;
+
+					const int newMoveCostToNeighbour = currentGCost + (x != 0 && z != 0 ? 14 : 10);
+
+					AStarSearchNode &n = nodes[neighbour];
+					const bool notInOpenSet = n.generation != generation;
+
+					if (notInOpenSet || newMoveCostToNeighbour < n.gCost)
+					{
+						n.gCost = newMoveCostToNeighbour;
+						n.parent = current;
+
+						if (notInOpenSet)
+						{
+							n.hCost = targetNode >= 0 ? AStarDistance(grid.GetNode(neighbourGridNode).gridPos, targetGridPos) : 0;
+							n.generation = generation;
+							openSet.Add(neighbour);
+						}
+						else
+						{
+							openSet.Update(neighbour);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	int AStarClusterSearch::GetCost(int gridNode) const
+	{
+		const int local = LocalIndex(gridNode);
+		if (local < 0 || !closed[local])
+			return -1;
+
+		return nodes[local].gCost;
+	}
+
+	void AStarClusterSearch::AppendPath(int gridNode, std::vector<int> &path)
+	{
+		localPath.clear();
+
+		int current = LocalIndex(gridNode);
+		if (current < 0 || !closed[current])
+			return;
+
+		while (nodes[current].parent != -1)
+		{
+			localPath.push_back(current);
+			current = nodes[current].parent;
+		}
+
+		const int localWidth = clusterMax.x - clusterMin.x;
+
+		for (size_t i = localPath.size(); i > 0; i--)
+		{
+			const int local = localPath[i - 1];
+			path.push_back((clusterMin.y + local / localWidth) * gridWidth + clusterMin.x + local % localWidth);
+		}
+	}
+
+	int AStarClusterSearch::LocalIndex(int gridNode) const
+	{
+		const int x = gridNode % gridWidth - clusterMin.x;
+		const int z = gridNode / gridWidth - clusterMin.y;
+
+		if (x < 0 || x >= clusterMax.x - clusterMin.x || z < 0 || z >= clusterMax.y - clusterMin.y)
+			return -1;
+
+		return z * (clusterMax.x - clusterMin.x) + x;
+	}
+
+	AStarClusterGraph::AStarClusterGraph()
+	{
+		built = false;
+		gridSizeXZ = glm::ivec2(0);
+		numClusters = glm::ivec2(0);
+		numVerticalBorders = 0;
+	}
+
+	void AStarClusterGraph::Build(const AStarGrid &grid)
+	{
+		Dispose();
+
+		gridSizeXZ = grid.GetGridSizeXZ();
+		if (grid.GetTotalNodes() == 0)
+			return;
+
+		numClusters.x = (gridSizeXZ.x + ASTAR_CLUSTER_SIZE - 1) / ASTAR_CLUSTER_SIZE;
+		numClusters.y = (gridSizeXZ.y + ASTAR_CLUSTER_SIZE - 1) / ASTAR_CLUSTER_SIZE;
+		numVerticalBorders = (numClusters.x - 1) * numClusters.y;
+
+		const int clusterCount = numClusters.x * numClusters.y;
+		const int borderCount = numVerticalBorders + numClusters.x * (numClusters.y - 1);
+
+		clusterEntrances.resize(clusterCount);
+		borderEntrances.resize(borderCount);
+		isClusterDirty.assign(clusterCount, true);
+		isBorderDirty.assign(borderCount, true);
+
+		for (int i = 0; i < clusterCount; i++)
+			dirtyClusters.push_back(i);
+		for (int i = 0; i < borderCount; i++)
+			dirtyBorders.push_back(i);
+
+		built = true;
+
+		Repair(grid);
+	}
+
+	void AStarClusterGraph::Dispose()
+	{
+		built = false;
+		numClusters = glm::ivec2(0);
+		numVerticalBorders = 0;
+
+		entrances.clear();
+		freeEntrances.clear();
+		clusterEntrances.clear();
+		borderEntrances.clear();
+		dirtyClusters.clear();
+		dirtyBorders.clear();
+		isClusterDirty.clear();
+		isBorderDirty.clear();
+	}
+
+	void AStarClusterGraph::MarkDirty(const glm::ivec2 &gridPos)
+	{
+		if (!built || gridPos.x < 0 || gridPos.x >= gridSizeXZ.x || gridPos.y < 0 || gridPos.y >= gridSizeXZ.y)
+			return;
+
+		const int clusterX = gridPos.x / ASTAR_CLUSTER_SIZE;
+		const int clusterZ = gridPos.y / ASTAR_CLUSTER_SIZE;
+		const int localX = gridPos.x % ASTAR_CLUSTER_SIZE;
+		const int localZ = gridPos.y % ASTAR_CLUSTER_SIZE;
+
+		AddDirtyCluster(clusterZ * numClusters.x + clusterX);
+
+		// Nodes on the edge of a cluster can also change the entrances of the border they're on
+		int borders[5];
+		int borderCount = 0;
+
+		if (localX == 0 && clusterX > 0)
+			borders[borderCount++] = clusterZ * (numClusters.x - 1) + clusterX - 1;
+		if (localX == ASTAR_CLUSTER_SIZE - 1 && clusterX < numClusters.x - 1)
+			borders[borderCount++] = clusterZ * (numClusters.x - 1) + clusterX;
+		if (localZ == 0 && clusterZ > 0)
+			borders[borderCount++] = numVerticalBorders + (clusterZ - 1) * numClusters.x + clusterX;
+		if (localZ == ASTAR_CLUSTER_SIZE - 1 && clusterZ < numClusters.y - 1)
+			borders[borderCount++] = numVerticalBorders + clusterZ * numClusters.x + clusterX;
+
+		// And the diagonal crossings of the cluster corner they're on
+		if ((localX == 0 || localX == ASTAR_CLUSTER_SIZE - 1) && (localZ == 0 || localZ == ASTAR_CLUSTER_SIZE - 1))
+		{
+			const int cornerBorder = GetCornerBorder(localX == 0 ? clusterX - 1 : clusterX, localZ == 0 ? clusterZ - 1 : clusterZ);
+			if (cornerBorder >= 0)
+				borders[borderCount++] = cornerBorder;
+		}
+
+		for (int i = 0; i < borderCount; i++)
+			AddDirtyBorder(borders[i]);
+	}
+
+	void AStarClusterGraph::MarkClusterDirty(int cluster)
+	{
+		if (!built || cluster < 0 || cluster >= numClusters.x * numClusters.y)
+			return;
+
+		AddDirtyCluster(cluster);
+
+		const int clusterX = cluster % numClusters.x;
+		const int clusterZ = cluster / numClusters.x;
+
+		int borders[8];
+		int borderCount = 0;
+
+		if (clusterX > 0)
+			borders[borderCount++] = clusterZ * (numClusters.x - 1) + clusterX - 1;
+		if (clusterX < numClusters.x - 1)
+			borders[borderCount++] = clusterZ * (numClusters.x - 1) + clusterX;
+		if (clusterZ > 0)
+			borders[borderCount++] = numVerticalBorders + (clusterZ - 1) * numClusters.x + clusterX;
+		if (clusterZ < numClusters.y - 1)
+			borders[borderCount++] = numVerticalBorders + clusterZ * numClusters.x + clusterX;
+
+		for (int z = clusterZ - 1; z <= clusterZ; z++)
+		{
+			for (int x = clusterX - 1; x <= clusterX; x++)
+			{
+				const int cornerBorder = GetCornerBorder(x, z);
+				if (cornerBorder >= 0)
+					borders[borderCount++] = cornerBorder;
+			}
+		}
+
+		for (int i = 0; i < borderCount; i++)
+			AddDirtyBorder(borders[i]);
+	}
+
+	void AStarClusterGraph::Repair(const AStarGrid &grid)
+	{
+		if (!built || !IsDirty())
+			return;
+
+		// The grid was resized so the clusters don't match anymore
+		if (grid.GetGridSizeXZ() != gridSizeXZ)
+		{
+			Build(grid);
+			return;
+		}
+
+		for (size_t i = 0; i < dirtyBorders.size(); i++)
+			RemoveBorderEntrances(dirtyBorders[i]);
+
+		// The clusters on both sides of a rebuilt border have new entrances to connect, and so do the ones across its corner if it got diagonal entrances there
+		for (size_t i = 0; i < dirtyBorders.size(); i++)
+		{
+			CreateBorderEntrances(grid, dirtyBorders[i]);
+
+			int cluster1, cluster2;
+			GetBorderClusters(dirtyBorders[i], cluster1, cluster2);
+
+			AddDirtyCluster(cluster1);
+			AddDirtyCluster(cluster2);
+
+			const std::vector<int> &borderList = borderEntrances[dirtyBorders[i]];
+			for (size_t j = 0; j < borderList.size(); j++)
+				AddDirtyCluster(entrances[borderList[j]].cluster);
+
+			isBorderDirty[dirtyBorders[i]] = false;
+		}
+
+		for (size_t i = 0; i < dirtyClusters.size(); i++)
+		{
+			ConnectCluster(grid, dirtyClusters[i]);
+			isClusterDirty[dirtyClusters[i]] = false;
+		}
+
+		dirtyBorders.clear();
+		dirtyClusters.clear();
+	}
+
+	void AStarClusterGraph::GetClusterBounds(int cluster, glm::ivec2 &min, glm::ivec2 &max) const
+	{
+		min.x = (cluster % numClusters.x) * ASTAR_CLUSTER_SIZE;
+		min.y = (cluster / numClusters.x) * ASTAR_CLUSTER_SIZE;
+		max.x = std::min(min.x + ASTAR_CLUSTER_SIZE, gridSizeXZ.x);
+		max.y = std::min(min.y + ASTAR_CLUSTER_SIZE, gridSizeXZ.y);
+	}
+
+	void AStarClusterGraph::GetBorderClusters(int border, int &cluster1, int &cluster2) const
+	{
+		if (border < numVerticalBorders)
+		{
+			const int clusterX = border % (numClusters.x - 1);
+			const int clusterZ = border / (numClusters.x - 1);
+			cluster1 = clusterZ * numClusters.x + clusterX;
+			cluster2 = cluster1 + 1;
+		}
+		else
+		{
+			cluster1 = border - numVerticalBorders;
+			cluster2 = cluster1 + numClusters.x;
+		}
+	}
+
+	int AStarClusterGraph::GetCornerBorder(int clusterX, int clusterZ) const
+	{
+		if (clusterX < 0 || clusterX >= numClusters.x - 1 || clusterZ < 0 || clusterZ >= numClusters.y - 1)
+			return -1;
+
+		// The vertical border between the cluster and the next one on x
+		return clusterZ * (numClusters.x - 1) + clusterX;
+	}
+
+	void AStarClusterGraph::AddDirtyBorder(int border)
+	{
+		if (!isBorderDirty[border])
+		{
+			isBorderDirty[border] = true;
+			dirtyBorders.push_back(border);
+		}
+	}
+
+	void AStarClusterGraph::AddDirtyCluster(int cluster)
+	{
+		if (!isClusterDirty[cluster])
+		{
+			isClusterDirty[cluster] = true;
+			dirtyClusters.push_back(cluster);
+		}
+	}
+
+	int AStarClusterGraph::AddEntrance(int gridNode, int cluster, int border)
+	{
+		int index = 0;
+
+		if (freeEntrances.size() > 0)
+		{
+			index = freeEntrances.back();
+			freeEntrances.pop_back();
+		}
+		else
+		{
+			index = static_cast<int>(entrances.size());
+			entrances.push_back({});
+		}
+
+		Entrance &e = entrances[index];
+		e.gridNode = gridNode;
+		e.cluster = cluster;
+		e.pair = -1;
+		e.pairCost = 10;
+		e.edges.clear();
+
+		clusterEntrances[cluster].push_back(index);
+		borderEntrances[border].push_back(index);
+
+		return index;
+	}
+
+	void AStarClusterGraph::AddEntrancePair(const glm::ivec2 &pos1, int cluster1, const glm::ivec2 &pos2, int cluster2, int border)
+	{
+		const int e1 = AddEntrance(pos1.y * gridSizeXZ.x + pos1.x, cluster1, border);
+		const int e2 = AddEntrance(pos2.y * gridSizeXZ.x + pos2.x, cluster2, border);
+		const int cost = pos1.x != pos2.x && pos1.y != pos2.y ? 14 : 10;
+
+		entrances[e1].pair = e2;
+		entrances[e1].pairCost = cost;
+		entrances[e2].pair = e1;
+		entrances[e2].pairCost = cost;
+	}
+
+	void AStarClusterGraph::RemoveBorderEntrances(int border)
+	{
+		std::vector<int> &borderList = borderEntrances[border];
+
+		// The edges pointing to these entrances belong to the clusters they're in, which get connected again
+		for (size_t i = 0; i < borderList.size(); i++)
+		{
+			const int index = borderList[i];
+			AddDirtyCluster(entrances[index].cluster);
+
+			std::vector<int> &clusterList = clusterEntrances[entrances[index].cluster];
+			clusterList.erase(std::find(clusterList.begin(), clusterList.end(), index));
+
+			entrances[index].edges.clear();
+			freeEntrances.push_back(index);
+		}
+
+		borderList.clear();
+	}
+
+	void AStarClusterGraph::CreateBorderEntrances(const AStarGrid &grid, int border)
+	{
+		int cluster1, cluster2;
+		GetBorderClusters(border, cluster1, cluster2);
+
+		glm::ivec2 min, max;
+		GetClusterBounds(cluster1, min, max);
+
+		// Walk along the border with the node of each side
+		glm::ivec2 pos1, step, across;
+		int length = 0;
+
+		if (border < numVerticalBorders)
+		{
+			pos1 = glm::ivec2(max.x - 1, min.y);
+			step = glm::ivec2(0, 1);
+			across = glm::ivec2(1, 0);
+			length = max.y - min.y;
+		}
+		else
+		{
+			pos1 = glm::ivec2(min.x, max.y - 1);
+			step = glm::ivec2(1, 0);
+			across = glm::ivec2(0, 1);
+			length = max.x - min.x;
+		}
+
+		auto isWalkable = [&](const glm::ivec2 &p)
+		{
+			return grid.GetNode(p.y * gridSizeXZ.x + p.x).walkable;
+		};
+
+		int runStart = -1;
+
+		for (int i = 0; i <= length; i++)
+		{
+			bool walkable = false;
+
+			if (i < length)
+			{
+				const glm::ivec2 p = pos1 + step * i;
+				walkable = isWalkable(p) && isWalkable(p + across);
+			}
+
+			if (walkable && runStart < 0)
+			{
+				runStart = i;
+			}
+			else if (!walkable && runStart >= 0)
+			{
+				// Narrow openings get one entrance in the middle, wide ones an entrance at each end so paths don't need to detour to the middle
+				int positions[2];
+				int count = 0;
+
+				if (i - runStart < MIN_WIDE_ENTRANCE)
+				{
+					positions[count++] = (runStart + i - 1) / 2;
+				}
+				else
+				{
+					positions[count++] = runStart;
+					positions[count++] = i - 1;
+				}
+
+				for (int j = 0; j < count; j++)
+				{
+					const glm::ivec2 p = pos1 + step * positions[j];
+					AddEntrancePair(p, cluster1, p + across, cluster2, border);
+				}
+
+				runStart = -1;
+			}
+		}
+
+		// Nodes that only touch diagonally across the border. When either straight crossing next to them is open they're already reached through its run
+		for (int i = 0; i < length; i++)
+		{
+			const glm::ivec2 p = pos1 + step * i;
+			if (!isWalkable(p) || isWalkable(p + across))
+				continue;
+
+			for (int d = -1; d <= 1; d += 2)
+			{
+				if (i + d < 0 || i + d >= length)
+					continue;
+
+				const glm::ivec2 q = p + across + step * d;
+				if (isWalkable(q) && !isWalkable(p + step * d))
+					AddEntrancePair(p, cluster1, q, cluster2, border);
+			}
+		}
+
+		// Vertical borders also own the corner at their end on z, where the clusters that only share the corner can touch diagonally
+		if (border < numVerticalBorders && cluster1 / numClusters.x < numClusters.y - 1)
+		{
+			const glm::ivec2 a = max - 1;
+			const glm::ivec2 b = glm::ivec2(max.x, max.y - 1);
+			const glm::ivec2 c = glm::ivec2(max.x - 1, max.y);
+			const glm::ivec2 d = max;
+
+			if (isWalkable(a) && isWalkable(d) && !isWalkable(b) && !isWalkable(c))
+				AddEntrancePair(a, cluster1, d, cluster2 + numClusters.x, border);
+			if (isWalkable(b) && isWalkable(c) && !isWalkable(a) && !isWalkable(d))
+				AddEntrancePair(b, cluster2, c, cluster1 + numClusters.x, border);
+		}
+	}
+
+	void AStarClusterGraph::ConnectCluster(const AStarGrid &grid, int cluster)
+	{
+		const std::vector<int> &list = clusterEntrances[cluster];
+
+		for (size_t i = 0; i < list.size(); i++)
+			entrances[list[i]].edges.clear();
+
+		glm::ivec2 min, max;
+		GetClusterBounds(cluster, min, max);
+
+		// The costs are the same both ways so each search links its entrance with the ones after it
+		for (size_t i = 0; i < list.size(); i++)
+		{
+			clusterSearch.Search(grid, min, max, entrances[list[i]].gridNode);
+
+			for (size_t j = i + 1; j < list.size(); j++)
+			{
+				const int cost = clusterSearch.GetCost(entrances[list[j]].gridNode);
+				if (cost < 0)
+					continue;
+
+				entrances[list[i]].edges.push_back({ list[j], cost });
+				entrances[list[j]].edges.push_back({ list[i], cost });
+			}
+		}
+	}
+}
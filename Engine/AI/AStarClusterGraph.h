@@ -0,0 +1,112 @@
+#pragma once
+
+#include "AStarNodeHeap.h"
+
+namespace Engine
+{
+	class AStarGrid;
+
+	static const int ASTAR_CLUSTER_SIZE = 16;				// Nodes on each side of a cluster
+	static const int ASTAR_CLUSTER_NODES = ASTAR_CLUSTER_SIZE * ASTAR_CLUSTER_SIZE;
+
+	// Search that never leaves one cluster. Used to link the entrances of a cluster and to turn abstract paths back into grid nodes
+	class AStarClusterSearch
+	{
+	public:
+		AStarClusterSearch();
+
+		// Finds the cost from the start node to the nodes of the cluster. With a target node it stops as soon as the target is reached
+		void Search(const AStarGrid &grid, const glm::ivec2 &clusterMin, const glm::ivec2 &clusterMax, int startNode, int targetNode = -1);
+		// Returns -1 if the node was not reached by the last search
+		int GetCost(int gridNode) const;
+		// Appends the grid nodes of the path from the start of the last search to the node, without the start
+		void AppendPath(int gridNode, std::vector<int> &path);
+
+	private:
+		int LocalIndex(int gridNode) const;
+
+	private:
+		AStarSearchNode nodes[ASTAR_CLUSTER_NODES];
+		bool closed[ASTAR_CLUSTER_NODES];
+		AStarNodeHeap openSet;
+		std::vector<int> localPath;
+		glm::ivec2 clusterMin;
+		glm::ivec2 clusterMax;
+		int gridWidth;
+		unsigned int generation;
+	};
+
+	// Abstract layer over the grid used to find long paths (HPA*). The grid is split in clusters and the walkable nodes on the borders
+	// between clusters become entrances. Each entrance is linked to its pair across the border and to the entrances of its cluster it can reach,
+	// with the cost of the path between them, so a search only visits entrances and then refines the path inside each cluster.
+	// Searches can cut corners, so nodes that only touch diagonally across a border or a cluster corner are also paired.
+	// Changing a node only marks its cluster and border dirty and Repair rebuilds those, so the graph is never rebuilt whole after the first build
+	class AStarClusterGraph
+	{
+	public:
+		struct Edge
+		{
+			int node;
+			int cost;
+		};
+
+		struct Entrance
+		{
+			int gridNode;
+			int cluster;
+			int pair;						// Entrance on the other side of the border
+			int pairCost;					// 14 when the pair is a diagonal step away
+			std::vector<Edge> edges;		// Entrances of the same cluster that can be reached
+		};
+
+		AStarClusterGraph();
+
+		void Build(const AStarGrid &grid);
+		void Dispose();
+		void MarkDirty(const glm::ivec2 &gridPos);
+		// Marks the cluster and all its borders, for when many of its nodes changed
+		void MarkClusterDirty(int cluster);
+		// Rebuilds the entrances of the dirty borders and the edges of the dirty clusters. Must not be called while searches are using the graph
+		void Repair(const AStarGrid &grid);
+
+		bool IsBuilt() const { return built; }
+		bool IsDirty() const { return dirtyClusters.size() > 0 || dirtyBorders.size() > 0; }
+
+		int GetClusterIndex(const glm::ivec2 &gridPos) const { return (gridPos.y / ASTAR_CLUSTER_SIZE) * numClusters.x + gridPos.x / ASTAR_CLUSTER_SIZE; }
+		void GetClusterBounds(int cluster, glm::ivec2 &min, glm::ivec2 &max) const;
+		const std::vector<int> &GetClusterEntrances(int cluster) const { return clusterEntrances[cluster]; }
+		const Entrance &GetEntrance(int index) const { return entrances[index]; }
+		// Includes the released entrances, which are never referenced by the clusters
+		int GetEntranceCount() const { return static_cast<int>(entrances.size()); }
+
+	private:
+		void GetBorderClusters(int border, int &cluster1, int &cluster2) const;
+		// Border that owns the crossings at the corner shared by the cluster and the three clusters after it on x and z. -1 if there is no such corner
+		int GetCornerBorder(int clusterX, int clusterZ) const;
+		void AddDirtyBorder(int border);
+		void AddDirtyCluster(int cluster);
+		int AddEntrance(int gridNode, int cluster, int border);
+		void AddEntrancePair(const glm::ivec2 &pos1, int cluster1, const glm::ivec2 &pos2, int cluster2, int border);
+		void RemoveBorderEntrances(int border);
+		void CreateBorderEntrances(const AStarGrid &grid, int border);
+		void ConnectCluster(const AStarGrid &grid, int cluster);
+
+	private:
+		bool built;
+		glm::ivec2 gridSizeXZ;
+		glm::ivec2 numClusters;
+		int numVerticalBorders;				// Borders between clusters next to each other on x. The ones between clusters on z come after them
+
+		std::vector<Entrance> entrances;
+		std::vector<int> freeEntrances;
+		std::vector<std::vector<int>> clusterEntrances;
+		std::vector<std::vector<int>> borderEntrances;
+
+		std::vector<int> dirtyClusters;
+		std::vector<int> dirtyBorders;
+		std::vector<bool> isClusterDirty;
+		std::vector<bool> isBorderDirty;
+
+		AStarClusterSearch clusterSearch;
+	};
+}
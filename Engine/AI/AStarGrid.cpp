@@ -11,15 +11,33 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cstring>
 //#include <chrono>
 
 namespace Engine
 {
+	// FNV-1a of the bounds, to tell if the obstacles of a tile moved
+	static uint64_t HashBounds(const AABB &bounds)
+	{
+		const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&bounds);
+		uint64_t hash = 14695981039346656037ull;
+
+		for (size_t i = 0; i < sizeof(AABB); i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+
 	AStarGrid::AStarGrid()
 	{
 		grid = nullptr;
+		totalGridNodes = 0;
 		gridSize = glm::vec2(0.0f);
 		gridCenter = glm::vec2(0.0f);
+		tilesGridCenter = glm::vec2(0.0f);
 	}
 
 	void AStarGrid::Init(Game *game, const glm::vec2 &gridCenter, const glm::vec2 &gridSize, float nodeRadius)
@@ -44,14 +62,46 @@ namespace Engine
 		isInit = true;
 	}
 
+	void AStarGrid::InitFromWalkable(const glm::ivec2 &gridSizeXZ, const std::vector<bool> &walkable)
+	{
+		Dispose();
+
+		game = nullptr;
+		nodeRadius = 0.5f;
+		nodeDiameter = 1.0f;
+		this->gridSizeXZ = gridSizeXZ;
+		gridSize = glm::vec2(gridSizeXZ);
+		SetGridCenter(gridSize * 0.5f);
+
+		totalGridNodes = static_cast<unsigned int>(gridSizeXZ.x * gridSizeXZ.y);
+		grid = new AStarNode[totalGridNodes];
+
+		int i = 0;
+		for (int z = 0; z < gridSizeXZ.y; z++)
+		{
+			for (int x = 0; x < gridSizeXZ.x; x++)
+			{
+				AStarNode &node = grid[i];
+				node.worldPos = glm::vec2(x + nodeRadius, z + nodeRadius);
+				node.gridPos = glm::ivec2(x, z);
+				node.walkable = static_cast<size_t>(i) < walkable.size() && walkable[i];
+
+				i++;
+			}
+		}
+
+		isInit = true;
+
+		BumpVersion();
+		clusterGraph.Build(*this);
+	}
+
 	void AStarGrid::Update()
 	{
 		if (!isBuilt)
 		{
-			RebuildGrid(game, gridCenter);
-
-			if (isBuilt)
-				std::cout << "Done building grid\n";
+			RebuildTiled(game, gridCenter);
+			std::cout << "Done building grid\n";
 		}
 	}
 
@@ -65,6 +115,9 @@ namespace Engine
 				grid = nullptr;
 			}
 
+			clusterGraph.Dispose();
+			tiles.clear();
+			BumpVersion();
 		}
 
 		isInit = false;
@@ -74,6 +127,10 @@ namespace Engine
 	{
 		//std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
 
+		// Searches use the nodes directly while the grid is rebuilt a few nodes at a time
+		clusterGraph.Dispose();
+		InvalidateTiles();
+
 		this->gridCenter = newGridCenter;
 		gridCenterI = glm::ivec2(static_cast<int>(gridCenter.x), static_cast<int>(gridCenter.y));
 		glm::vec2 gridBottomLeft = gridCenter - glm::vec2(gridSize.x * 0.5f, gridSize.y * 0.5f);
@@ -106,13 +163,9 @@ namespace Engine
 
 				bool walkable = !game->GetPhysicsManager().CheckSphere(btVector3(worldPos.x, height, worldPos.y), nodeRadius);		// Returns true if there is anything overlapping the sphere		
 
-				grid[gridIndex].parent = nullptr;
 				grid[gridIndex].worldPos = worldPos;
 				grid[gridIndex].gridPos = glm::ivec2(x, z);
-				grid[gridIndex].hCost = 0;
-				grid[gridIndex].gCost = 0;
 				grid[gridIndex].walkable = walkable;
-				grid[gridIndex].heapIndex = 0;
 
 				gridIndex++;
 				rebuildStartIndexX++;
@@ -121,6 +174,12 @@ namespace Engine
 
 		rebuildStopIndexX += nodesRebuiltPerFrame;
 
+		if (isBuilt)
+		{
+			BumpVersion();
+			clusterGraph.Build(*this);
+		}
+
 		/*std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
 
 		auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
@@ -150,17 +209,13 @@ namespace Engine
 				bool walkable = !game->GetPhysicsManager().CheckSphere(btVector3(worldPos.x, height, worldPos.y), nodeRadius);		// Returns true if there is anything overlapping the sphere		
 
 				AStarNode &node = grid[i];
-				node.parent = nullptr;
 				node.worldPos = worldPos;
 				node.gridPos = glm::ivec2(x, z);
-				node.hCost = 0;
-				node.gCost = 0;
 
 				// Prevent the node from being overwritten if there's is no physics object there but there is a tree/rock
 				// But this will cause problems if we were to move a physics object and rebuild the grid again, the node would not be updated
 				if(node.walkable)
 					node.walkable = walkable;
-				node.heapIndex = 0;
 
 				i++;
 			}
@@ -208,6 +263,158 @@ namespace Engine
 					n->walkable = false;
 			}
 		}*/
+
+		InvalidateTiles();
+		BumpVersion();
+		clusterGraph.Build(*this);
+	}
+
+	void AStarGrid::RebuildTiled(Game *game, const glm::vec2 &newGridCenter)
+	{
+		if (!grid)
+			return;
+
+		SetGridCenter(newGridCenter);
+		const glm::vec2 gridBottomLeft = gridCenter - gridSize * 0.5f;
+
+		const glm::ivec2 numTiles = (gridSizeXZ + ASTAR_CLUSTER_SIZE - 1) / ASTAR_CLUSTER_SIZE;
+		const unsigned int tileCount = static_cast<unsigned int>(numTiles.x * numTiles.y);
+
+		// The nodes of a tile are somewhere else once the grid moves
+		if (tiles.size() != tileCount || tilesGridCenter != gridCenter)
+		{
+			tiles.resize(tileCount);
+			InvalidateTiles();
+		}
+
+		tilesGridCenter = gridCenter;
+
+		PhysicsManager &physicsManager = game->GetPhysicsManager();
+
+		// The broadphase can't be queried from many threads so the obstacles of the tiles are gathered here, one query per tile
+		tilesToBuild.clear();
+
+		for (unsigned int i = 0; i < tileCount; i++)
+		{
+			RebuildTile &tile = tiles[i];
+
+			const glm::ivec2 tileMin = glm::ivec2(i % numTiles.x, i / numTiles.x) * ASTAR_CLUSTER_SIZE;
+			const glm::ivec2 tileMax = glm::min(tileMin + ASTAR_CLUSTER_SIZE, gridSizeXZ);
+
+			AABB box;
+			box.min = glm::vec3(gridBottomLeft.x + tileMin.x * nodeDiameter, -10000.0f, gridBottomLeft.y + tileMin.y * nodeDiameter);
+			box.max = glm::vec3(gridBottomLeft.x + tileMax.x * nodeDiameter, 10000.0f, gridBottomLeft.y + tileMax.y * nodeDiameter);
+
+			tile.obstacles.clear();
+			physicsManager.GetOverlappingBounds(box, Layer::OBSTACLE, tile.obstacles);
+
+			// Sum of the hashes of each obstacle so the order the broadphase returns them in doesn't matter
+			uint64_t signature = tile.obstacles.size();
+			for (size_t j = 0; j < tile.obstacles.size(); j++)
+				signature += HashBounds(tile.obstacles[j]);
+
+			if (!tile.valid || tile.signature != signature)
+			{
+				tile.signature = signature;
+				tile.valid = true;
+				tilesToBuild.push_back(i);
+			}
+		}
+
+		isBuilt = true;
+		gridIndex = 0;
+		rebuildStartIndexX = 0;
+		rebuildStartIndexZ = 0;
+		rebuildStopIndexX = nodesRebuiltPerFrame;
+		rebuildStopIndexZ = 1;
+
+		if (tilesToBuild.size() == 0)
+			return;
+
+		Terrain *terrain = game->GetTerrain();
+
+		JobCounter counter;
+		game->GetJobSystem().ParallelFor(static_cast<unsigned int>(tilesToBuild.size()), 1, [this, terrain, numTiles, gridBottomLeft](unsigned int start, unsigned int end)
+		{
+			glm::vec2 positions[ASTAR_CLUSTER_SIZE];
+			float heights[ASTAR_CLUSTER_SIZE];
+
+			for (unsigned int t = start; t < end; t++)
+			{
+				const unsigned int tileIndex = tilesToBuild[t];
+				RebuildTile &tile = tiles[tileIndex];
+				tile.changedNodes.clear();
+
+				const glm::ivec2 tileMin = glm::ivec2(tileIndex % numTiles.x, tileIndex / numTiles.x) * ASTAR_CLUSTER_SIZE;
+				const glm::ivec2 tileMax = glm::min(tileMin + ASTAR_CLUSTER_SIZE, gridSizeXZ);
+				const unsigned int rowCount = static_cast<unsigned int>(tileMax.x - tileMin.x);
+
+				for (int z = tileMin.y; z < tileMax.y; z++)
+				{
+					for (int x = tileMin.x; x < tileMax.x; x++)
+						positions[x - tileMin.x] = gridBottomLeft + glm::vec2(x * nodeDiameter + nodeRadius, z * nodeDiameter + nodeRadius);
+
+					if (terrain)
+						terrain->GetHeightsAt(positions, rowCount, heights);
+					else
+						memset(heights, 0, sizeof(heights));
+
+					for (int x = tileMin.x; x < tileMax.x; x++)
+					{
+						const glm::vec3 center = glm::vec3(positions[x - tileMin.x].x, heights[x - tileMin.x], positions[x - tileMin.x].y);
+
+						// Same as a sphere check against the bounds of the obstacles
+						bool walkable = true;
+						for (size_t i = 0; i < tile.obstacles.size(); i++)
+						{
+							const AABB &o = tile.obstacles[i];
+							const glm::vec3 closest = glm::clamp(center, o.min, o.max);
+
+							if (glm::length2(closest - center) < nodeRadius * nodeRadius)
+							{
+								walkable = false;
+								break;
+							}
+						}
+
+						AStarNode &node = grid[z * gridSizeXZ.x + x];
+						if (node.walkable != walkable)
+							tile.changedNodes.push_back(z * gridSizeXZ.x + x);
+
+						node.worldPos = positions[x - tileMin.x];
+						node.gridPos = glm::ivec2(x, z);
+						node.walkable = walkable;
+					}
+				}
+			}
+		}, &counter);
+
+		game->GetJobSystem().Wait(&counter);
+
+		// Tiles and clusters match so only the clusters of the tiles that changed are repaired
+		if (clusterGraph.IsBuilt())
+		{
+			for (size_t i = 0; i < tilesToBuild.size(); i++)
+			{
+				const std::vector<int> &tileChanges = tiles[tilesToBuild[i]].changedNodes;
+				if (tileChanges.size() > 0)
+				{
+					clusterGraph.MarkClusterDirty(static_cast<int>(tilesToBuild[i]));
+					changedNodes.insert(changedNodes.end(), tileChanges.begin(), tileChanges.end());
+				}
+			}
+		}
+		else
+		{
+			BumpVersion();
+			clusterGraph.Build(*this);
+		}
+	}
+
+	void AStarGrid::InvalidateTiles()
+	{
+		for (size_t i = 0; i < tiles.size(); i++)
+			tiles[i].valid = false;
 	}
 
 	void AStarGrid::SetNeedsRebuild(bool needsRebuild)
@@ -221,6 +428,10 @@ namespace Engine
 
 	void AStarGrid::SetGridCenter(const glm::vec2 &center)
 	{
+		// The same positions map to other nodes now
+		if (center != gridCenter)
+			BumpVersion();
+
 		gridCenter = center;
 		gridCenterI = glm::ivec2(static_cast<int>(gridCenter.x), static_cast<int>(gridCenter.y));
 	}
@@ -252,179 +463,77 @@ namespace Engine
 			m = glm::translate(glm::mat4(1.0f), pos);
 			m = glm::scale(m, glm::vec3(nodeDiameter * 0.7f));		// Scale it down a bit to be able to distingush the cubes
 
-			/*if (std::find(path.begin(), path.end(), &grid[i]) != path.end())
-				game->GetDebugDrawManager()->AddCube(m, glm::vec3(1.0f, 0.0f, 1.0f));
-			else */if (grid[i].walkable)
+			if (grid[i].walkable)
 				game->GetDebugDrawManager()->AddCube(m);
 			else
 				game->GetDebugDrawManager()->AddCube(m, glm::vec3(1.0f, 0.0f, 0.0f));
 		}
 	}
 
-	bool AStarGrid::FindPath(const glm::vec2 &startPos, const glm::vec2 &targetPos, std::vector<glm::vec2> &nodeWaypoints, int maxSearch)
+	bool AStarGrid::FindPath(const glm::vec2 &startPos, const glm::vec2 &targetPos, std::vector<glm::vec2> &nodeWaypoints, int maxSearch, PathSearchMode mode)
 	{
-		AStarNode *startNode = NodeFromWorldPos(startPos);
-		AStarNode *targetNode = NodeFromWorldPos(targetPos);
-		if (!targetNode || !startNode)										// Check for null because the target (player) could be outside the grid
-			return false;
-
-		//AStarNodeHeap openSet(gridSizeXZ.x * gridSizeXZ.y);		// Here we were allocating 171000 nodes per object that requested a path
-		// Because the path are relatively short we don't need that many nodes
-		AStarNodeHeap openSet(100);		// Possible moves. Only allocate enough nodes for the space around what requested the path. 171000 * 0.0006 = ~102
-		std::vector<AStarNode*> closedSet;						// Searched nodes
-
-		openSet.Add(startNode);
-
-		int i = 0;
-		while (openSet.Size() > 0)
-		{
-			// At the beginning we only have one node
-			AStarNode *currentNode = openSet.RemoveFirst();
-			closedSet.push_back(currentNode);
-
-			// Limit the search for the path. Useful for when were always requesting a path. But be careful to not limit too early otherwise the path might end very different from the real path (like starting to go in the wrong direction)
-			if (i >= maxSearch)
-			{
-				RetracePath(startNode, currentNode, nodeWaypoints);
-				//std::cout << "returning early path\n";
-				return true;
-			}
-			
-			if (currentNode == targetNode)		// Path found
-			{
-				RetracePath(startNode, targetNode, nodeWaypoints);
-				//std::cout << "returning full path\n";
-				return true;
-			}
-
-			std::forward_list<AStarNode*> neighbours = GetNeighbours(currentNode);
+		clusterGraph.Repair(*this);
 
-			// If no path is found, loop through all the node neighbours
-			for (AStarNode *neighbour : neighbours)
-			{
-				// If the neighbour is not walkable or was already searched, skip to the next neighbour
-				if (!neighbour->walkable || std::find(closedSet.begin(), closedSet.end(), neighbour) != closedSet.end())
-				{
-					continue;
-				}
-
-				int newMoveCostToNeighbour = currentNode->gCost + GetDistance(currentNode, neighbour);
-
-				bool notInOpenSet = !openSet.Contains(neighbour);
-
-				// If the new path to the neighbour is shorter than the old path or the neighbour is not in the possible moves list
-				if (newMoveCostToNeighbour < neighbour->gCost || notInOpenSet)
-				{
-					neighbour->gCost = newMoveCostToNeighbour;					// Distance from starting node
-					neighbour->hCost = GetDistance(neighbour, targetNode);		// Distance to the target node
-					neighbour->parent = currentNode;
-
-					// Add the neighbour as a possible move if it isn't the list
-					if (notInOpenSet)
-						openSet.Add(neighbour);
-					else
-						openSet.Update(neighbour);
-				}
-			}
-			i++;
-		}
-
-		return false;
+		return search.FindPath(*this, startPos, targetPos, nodeWaypoints, maxSearch, mode);
 	}
 
 	void AStarGrid::UpdateNode(const glm::vec2 &worldPos, bool walkable)
 	{
 		AStarNode *n = NodeFromWorldPos(worldPos);
-		if (n)
+		if (n && n->walkable != walkable)
+		{
 			n->walkable = walkable;
+			clusterGraph.MarkDirty(n->gridPos);
+			changedNodes.push_back(n->gridPos.y * gridSizeXZ.x + n->gridPos.x);
+		}
 	}
 
-	AStarNode *AStarGrid::NodeFromWorldPos(const glm::vec2 &pos)
+	void AStarGrid::TakeChangedNodes(std::vector<int> &nodes)
 	{
-		// 0 on the left, 0.5 on the middle and 1 on the right
-		float percentX = (pos.x - gridCenter.x) / gridSize.x + 0.5f;		// Optimization
-		float percentZ = (pos.y - gridCenter.y) / gridSize.y + 0.5f;
-
-		if (percentX > 1.0f || percentX < 0.0f || percentZ > 1.0f || percentZ < 0.0f)
-			return nullptr;
-
-		percentX = glm::clamp(percentX, 0.0f, 1.0f);
-		percentZ = glm::clamp(percentZ, 0.0f, 1.0f);
-
-		int x = (int)glm::round((gridSizeXZ.x - 1) * percentX);
-		int z = (int)glm::round((gridSizeXZ.y - 1) * percentZ);
-
-		return &grid[z * gridSizeXZ.x + x];
+		nodes.clear();
+		nodes.swap(changedNodes);
 	}
 
-	std::forward_list<AStarNode*> AStarGrid::GetNeighbours(AStarNode *node)
+	void AStarGrid::BumpVersion()
 	{
-		std::forward_list<AStarNode*> neighbours;
-
-		for (int z = -1; z <= 1; z++)
-		{
-			for (int x = -1; x <= 1; x++)
-			{
-				if (x == 0 && z == 0)			// x=0 y=0 is the center node so skip it
-					continue;
-
-				int checkX = node->gridPos.x + x;			// Position is from -gridSize to gridSize so add half gridSize to become 0 to gridSize * 2
-				int checkZ = node->gridPos.y + z;
-				
-				if (checkX >= 0 && checkX < gridSizeXZ.x && checkZ >= 0 && checkZ < gridSizeXZ.y)
-				{
-					neighbours.push_front(&grid[checkZ * gridSizeXZ.x + checkX]);
-				}
-			}
-		}
-
-		return neighbours;
+		// Whoever is behind rebuilds everything so the single changes are not needed anymore
+		version++;
+		changedNodes.clear();
 	}
 
-	int AStarGrid::GetDistance(AStarNode *nodeA, AStarNode *nodeB)
+	void AStarGrid::UpdateClusterGraph()
 	{
-		int distX = glm::abs(nodeA->gridPos.x - nodeB->gridPos.x);
-		int distZ = glm::abs(nodeA->gridPos.y - nodeB->gridPos.y);
-
-		if (distX > distZ)
-			return 14 * distZ + 10 * (distX - distZ);
-
-		return 14 * distX + 10 * (distZ - distX);
+		clusterGraph.Repair(*this);
 	}
 
-	void AStarGrid::RetracePath(AStarNode *startNode, AStarNode *targetNode, std::vector<glm::vec2> &nodeWaypoints)
+	AStarNode *AStarGrid::NodeFromWorldPos(const glm::vec2 &pos)
 	{
-		path.clear();
-
-		AStarNode *currentNode = targetNode;
-
-		while (currentNode != startNode)		// Because the nodes are pointers we can just compare the address
-		{
-			path.push_back(currentNode);
-			currentNode = currentNode->parent;
-		}
+		const int index = NodeIndexFromWorldPos(pos);
+		if (index < 0)
+			return nullptr;
 
-		SimplifyPath(nodeWaypoints);
+		return &grid[index];
 	}
 
-	void AStarGrid::SimplifyPath(std::vector<glm::vec2> &nodeWaypoints)
+	int AStarGrid::NodeIndexFromWorldPos(const glm::vec2 &pos) const
 	{
-		nodeWaypoints.clear();
+		if (!grid)
+			return -1;
 
-		glm::vec2 oldDir = glm::vec2();
+		// 0 on the left, 0.5 on the middle and 1 on the right
+		float percentX = (pos.x - gridCenter.x) / gridSize.x + 0.5f;		// Optimization
+		float percentZ = (pos.y - gridCenter.y) / gridSize.y + 0.5f;
 
-		for (size_t i = 1; i < path.size(); i++)
-		{
-			glm::vec2 newDir = glm::vec2(path[i - 1]->gridPos.x - path[i]->gridPos.x, path[i - 1]->gridPos.y - path[i]->gridPos.y);
+		if (percentX > 1.0f || percentX < 0.0f || percentZ > 1.0f || percentZ < 0.0f)
+			return -1;
 
-			if (newDir != oldDir)
-			{
-				nodeWaypoints.push_back(path[i]->worldPos);
-				//Log::Vec2(path[i]->worldPos);
-			}
+		percentX = glm::clamp(percentX, 0.0f, 1.0f);
+		percentZ = glm::clamp(percentZ, 0.0f, 1.0f);
 
-			oldDir = newDir;
-		}
+		int x = (int)glm::round((gridSizeXZ.x - 1) * percentX);
+		int z = (int)glm::round((gridSizeXZ.y - 1) * percentZ);
+
+		return z * gridSizeXZ.x + x;
 	}
 
 	void AStarGrid::SaveGridToFile()
@@ -471,10 +580,6 @@ namespace Engine
 						s.Read(node.worldPos);
 						s.Read(node.walkable);
 
-						node.gCost = 0;
-						node.hCost = 0;
-						node.heapIndex = 0;
-						node.parent = nullptr;
 						node.gridPos = glm::ivec2(x, z);
 
 						i++;
@@ -494,6 +599,9 @@ namespace Engine
 		}
 
 		s.Close();
+
+		BumpVersion();
+		clusterGraph.Build(*this);
 	}
 
 	void AStarGrid::LoadDefaultGrid()
@@ -506,10 +614,6 @@ namespace Engine
 				AStarNode &node = grid[i];
 				node.worldPos = glm::vec2(static_cast<float>(x), static_cast<float>(z));
 				node.walkable = true;
-				node.gCost = 0;
-				node.hCost = 0;
-				node.heapIndex = 0;
-				node.parent = nullptr;
 				node.gridPos = glm::ivec2(x, z);
 
 				i++;
@@ -1,8 +1,7 @@
 #pragma once
 
-#include "AStarNodeHeap.h"
-
-#include <forward_list>
+#include "AStarSearch.h"
+#include "Physics/BoundingVolumes.h"
 
 namespace Engine
 {
@@ -15,36 +14,62 @@ namespace Engine
 		AStarGrid();
 
 		void Init(Game *game, const glm::vec2 &gridCenter, const glm::vec2 &gridSize, float nodeRadius);
+		// Creates a grid with nodes of size 1 starting at the origin without a scene, for tools and benchmarks
+		void InitFromWalkable(const glm::ivec2 &gridSizeXZ, const std::vector<bool> &walkable);
 		void Update();
 		void Dispose();
 
 		void RebuildGrid(Game *game, const glm::vec2 &newGridCenter);
 		void RebuildImmediate(Game *game, const glm::vec2 &newGridCenter);
+		// Rebuilds the whole grid in one go. The grid is split in tiles the size of the clusters that are built in parallel,
+		// and the tiles whose obstacles didn't change since the last tiled rebuild are skipped
+		void RebuildTiled(Game *game, const glm::vec2 &newGridCenter);
+		// Makes the next tiled rebuild build every tile, eg after the terrain was edited
+		void InvalidateTiles();
 		void SetNeedsRebuild(bool needsRebuild);
 		void SetGridCenter(const glm::vec2 &center);
 
 		void PrepareDebugDraw();
 
-		bool FindPath(const glm::vec2 &startPos, const glm::vec2 &targetPos, std::vector<glm::vec2> &nodeWaypoints, int maxSearch);
+		// Uses the grid's own search so it can only be called from one thread. AISystem queries have their own searches
+		bool FindPath(const glm::vec2 &startPos, const glm::vec2 &targetPos, std::vector<glm::vec2> &nodeWaypoints, int maxSearch, PathSearchMode mode = PathSearchMode::HIERARCHICAL);
 
+		// Only marks the clusters of the node dirty, they're rebuilt on the next UpdateClusterGraph
 		void UpdateNode(const glm::vec2 &worldPos, bool walkable);
+		// Repairs the clusters changed since the last call. Can't be called while searches are running
+		void UpdateClusterGraph();
+		const AStarClusterGraph &GetClusterGraph() const { return clusterGraph; }
+		// Moves out the nodes whose walkability changed since the last call, for the flow fields to repair. Changes to the whole grid
+		// like loading or moving it bump the version instead
+		void TakeChangedNodes(std::vector<int> &nodes);
+		unsigned int GetVersion() const { return version; }
 		AStarNode *NodeFromWorldPos(const glm::vec2 &pos);
+		// Returns -1 if the position is outside the grid
+		int NodeIndexFromWorldPos(const glm::vec2 &pos) const;
+		const AStarNode &GetNode(int index) const { return grid[index]; }
 
 		void SetNodesRebuildPerFrame(int count) { nodesRebuiltPerFrame = count; }
 
 		const glm::vec2 &GetGridCenter() const { return gridCenter; }
+		const glm::ivec2 &GetGridSizeXZ() const { return gridSizeXZ; }
+		unsigned int GetTotalNodes() const { return grid ? totalGridNodes : 0; }
 		unsigned int GetNodesRebuiltPerFrame() const { return nodesRebuiltPerFrame; }
 
 		void SaveGridToFile();
 		void LoadGridFromFile();
 
 	private:	
-		std::forward_list<AStarNode*> GetNeighbours(AStarNode *node);
-		int GetDistance(AStarNode *nodeA, AStarNode *nodeB);
-		void RetracePath(AStarNode *startNode, AStarNode *targetNode, std::vector<glm::vec2> &nodeWaypoints);
-		void SimplifyPath(std::vector<glm::vec2> &nodeWaypoints);
-
 		void LoadDefaultGrid();
+		void BumpVersion();
+
+	private:
+		struct RebuildTile
+		{
+			std::vector<AABB> obstacles;
+			uint64_t signature;				// Of the obstacles found on the last rebuild
+			std::vector<int> changedNodes;	// Nodes whose walkability changed on the last rebuild
+			bool valid;
+		};
 
 	private:
 		bool isInit = false;
@@ -69,6 +94,14 @@ namespace Engine
 		int rebuildStopIndexZ = 1;
 		int gridIndex = 0;
 
-		std::vector<AStarNode*> path;
+		AStarSearch search;
+		AStarClusterGraph clusterGraph;
+
+		std::vector<int> changedNodes;
+		unsigned int version = 1;
+
+		std::vector<RebuildTile> tiles;
+		std::vector<unsigned int> tilesToBuild;
+		glm::vec2 tilesGridCenter;
 	};
 }
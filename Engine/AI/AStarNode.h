@@ -6,25 +6,43 @@ namespace Engine
 {
 	struct AStarNode
 	{
-		AStarNode *parent;		// Used to trace back the path to the starting position
 		glm::vec2 worldPos;
 		glm::ivec2 gridPos;
 		bool walkable;
 		//bool isStatic;			// Is set to true when loading the grid for the first time and the node is an obstacle. If it is true then walkable will always remain false even when a dynamic object tries to update the node as non-walkable
+	};
+
+	// Cost between two nodes moving diagonally first, 10 for a straight step and 14 for a diagonal one
+	inline int AStarDistance(const glm::ivec2 &a, const glm::ivec2 &b)
+	{
+		const int distX = glm::abs(a.x - b.x);
+		const int distZ = glm::abs(a.y - b.y);
+
+		if (distX > distZ)
+			return 14 * distZ + 10 * (distX - distZ);
+
+		return 14 * distX + 10 * (distZ - distX);
+	}
+
+	// The search state of a node. Each search has its own so many searches can run on the same grid at once.
+	// The state is only valid if the generation matches the search generation, that way it doesn't need to be cleared before every search
+	struct AStarSearchNode
+	{
+		int parent;				// Index of the node used to trace back the path to the starting position
 		int gCost;				// Distance from the starting node
 		int hCost;				// (heuristic or manhattan) distance from the end node
-
 		int heapIndex;
+		unsigned int generation;
 
 		int fCost() const { return gCost + hCost; }
 
 		// Returns true if this node has lower fCost than other node. If fCost are the same it checks the hCost. Returns false if the fCost is higher or the hCost is equal or higher
-		bool HasLowerFCost(const AStarNode *other)
+		bool HasLowerFCost(const AStarSearchNode &other) const
 		{
-			if (fCost() < other->fCost())
+			if (fCost() < other.fCost())
 				return true;
-			else if (fCost() == other->fCost())
-				return hCost < other->hCost;
+			else if (fCost() == other.fCost())
+				return hCost < other.hCost;
 
 			return false;
 		}
@@ -2,77 +2,77 @@
 
 namespace Engine
 {
-	AStarNodeHeap::AStarNodeHeap(int maxHeapSize)
+	AStarNodeHeap::AStarNodeHeap()
 	{
-		currentItemCount = 0;
-		items.resize(maxHeapSize);
+		nodes = nullptr;
 	}
 
-	void AStarNodeHeap::Add(AStarNode *item)
+	void AStarNodeHeap::Reset(AStarSearchNode *nodes)
 	{
-		if (currentItemCount == static_cast<int>(items.size()))
-			return;
-		item->heapIndex = currentItemCount;
-		items[currentItemCount] = item;
+		this->nodes = nodes;
+		items.clear();
+	}
+
+	void AStarNodeHeap::Add(int item)
+	{
+		nodes[item].heapIndex = static_cast<int>(items.size());
+		items.push_back(item);
 		SortUp(item);
-		currentItemCount++;
 	}
 
-	AStarNode *AStarNodeHeap::RemoveFirst()
+	int AStarNodeHeap::RemoveFirst()
 	{
-		AStarNode *firstItem = items[0];
+		const int firstItem = items[0];
 
-		currentItemCount--;
-		items[0] = items[currentItemCount];
-		items[0]->heapIndex = 0;
-		SortDown(items[0]);
+		items[0] = items.back();
+		items.pop_back();
+
+		if (items.size() > 0)
+		{
+			nodes[items[0]].heapIndex = 0;
+			SortDown(items[0]);
+		}
 
 		return firstItem;
 	}
 
-	void AStarNodeHeap::Update(AStarNode *item)
+	void AStarNodeHeap::Update(int item)
 	{
 		SortUp(item);
 	}
 
-	bool AStarNodeHeap::Contains(const AStarNode *item)
+	void AStarNodeHeap::Swap(int item1, int item2)
 	{
-		if (item->heapIndex < 0 || item->heapIndex >= (int)items.size())
-			return false;
-
-		return items[item->heapIndex] == item;
+		items[nodes[item1].heapIndex] = item2;
+		items[nodes[item2].heapIndex] = item1;
+		const int item1Index = nodes[item1].heapIndex;
+		nodes[item1].heapIndex = nodes[item2].heapIndex;
+		nodes[item2].heapIndex = item1Index;
 	}
 
-	void AStarNodeHeap::Swap(AStarNode *item1, AStarNode *item2)
+	void AStarNodeHeap::SortDown(int item)
 	{
-		items[item1->heapIndex] = item2;
-		items[item2->heapIndex] = item1;
-		int item1Index = item1->heapIndex;
-		item1->heapIndex = item2->heapIndex;
-		item2->heapIndex = item1Index;
-	}
+		const int count = static_cast<int>(items.size());
 
-	void AStarNodeHeap::SortDown(AStarNode *item)
-	{
 		while (true)
 		{
-			int childIndexLeft = item->heapIndex * 2 + 1;
-			int childIndexRight = item->heapIndex * 2 + 2;
+			const int childIndexLeft = nodes[item].heapIndex * 2 + 1;
+			const int childIndexRight = nodes[item].heapIndex * 2 + 2;
 			int swapIndex = 0;
 
-			if (childIndexLeft < currentItemCount)
+			if (childIndexLeft < count)
 			{
 				swapIndex = childIndexLeft;
 
-				if (childIndexRight < currentItemCount)
+				if (childIndexRight < count)
 				{
-					if (items[childIndexRight]->HasLowerFCost(items[childIndexLeft]))
+					if (nodes[items[childIndexRight]].HasLowerFCost(nodes[items[childIndexLeft]]))
 					{
 						swapIndex = childIndexRight;
 					}
 				}
 
-				if (items[swapIndex]->HasLowerFCost(item))
+				if (nodes[items[swapIndex]].HasLowerFCost(nodes[item]))
 				{
 					Swap(item, items[swapIndex]);
 				}
@@ -84,14 +84,12 @@ namespace Engine
 		}
 	}
 
-	void AStarNodeHeap::SortUp(AStarNode *item)
+	void AStarNodeHeap::SortUp(int item)
 	{
-		int parentIndex = (item->heapIndex - 1) / 2;
-
-		while (true)
+		while (nodes[item].heapIndex > 0)
 		{
-			AStarNode *parentItem = items[parentIndex];
-			if (item->HasLowerFCost(parentItem))
+			const int parentItem = items[(nodes[item].heapIndex - 1) / 2];
+			if (nodes[item].HasLowerFCost(nodes[parentItem]))
 			{
 				Swap(item, parentItem);
 			}
@@ -99,8 +97,6 @@ namespace Engine
 			{
 				break;
 			}
-
-			parentIndex = (item->heapIndex - 1) / 2;
 		}
 	}
 }
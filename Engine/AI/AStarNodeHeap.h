@@ -6,23 +6,27 @@
 
 namespace Engine
 {
+	// Binary heap of node indices ordered by the fCost of their search state
 	class AStarNodeHeap
 	{
 	public:
-		AStarNodeHeap(int maxHeapSize);
+		AStarNodeHeap();
 
-		void Add(AStarNode *item);
-		AStarNode *RemoveFirst();
-		void Update(AStarNode *item);
-		bool Contains(const AStarNode *item);
-		void Swap(AStarNode *item1, AStarNode *item2);
-		void SortDown(AStarNode *item);
-		void SortUp(AStarNode *item);
+		// Empties the heap. The nodes array must stay valid until the next reset
+		void Reset(AStarSearchNode *nodes);
+		void Add(int item);
+		int RemoveFirst();
+		void Update(int item);
 
-		size_t Size() const { return currentItemCount; }
+		size_t Size() const { return items.size(); }
 
 	private:
-		std::vector<AStarNode*> items;
-		int currentItemCount;
+		void Swap(int item1, int item2);
+		void SortDown(int item);
+		void SortUp(int item);
+
+	private:
+		AStarSearchNode *nodes;
+		std::vector<int> items;
 	};
 }
@@ -0,0 +1,660 @@
+#include "AStarSearch.h"
+
+#include "AStarGrid.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace Engine
+{
+	AStarSearch::AStarSearch()
+	{
+		generation = 0;
+		expandedNodes = 0;
+		pathCost = 0;
+	}
+
+	bool AStarSearch::FindPath(const AStarGrid &grid, const glm::vec2 &startPos, const glm::vec2 &targetPos, std::vector<glm::vec2> &nodeWaypoints, int maxSearch, PathSearchMode mode)
+	{
+		nodeWaypoints.clear();
+		expandedNodes = 0;
+		pathCost = 0;
+
+		const int startNode = grid.NodeIndexFromWorldPos(startPos);
+		const int targetNode = grid.NodeIndexFromWorldPos(targetPos);
+		if (startNode < 0 || targetNode < 0)								// Check because the target (player) could be outside the grid
+			return false;
+
+		if (mode == PathSearchMode::JUMP_POINT)
+			return FindPathJumpPoint(grid, startNode, targetNode, nodeWaypoints, maxSearch);
+		if (mode == PathSearchMode::HIERARCHICAL && grid.GetClusterGraph().IsBuilt())
+			return FindPathHierarchical(grid, startNode, targetNode, nodeWaypoints);
+
+		BeginSearch(grid.GetTotalNodes());
+
+		const glm::ivec2 &gridSizeXZ = grid.GetGridSizeXZ();
+		const glm::ivec2 &targetGridPos = grid.GetNode(targetNode).gridPos;
+
+		AStarSearchNode &start = nodes[startNode];
+		start.parent = -1;
+		start.gCost = 0;
+		start.hCost = AStarDistance(grid.GetNode(startNode).gridPos, targetGridPos);
+		start.generation = generation;
+
+		openSet.Add(startNode);
+
+		int i = 0;
+		while (openSet.Size() > 0)
+		{
+			// At the beginning we only have one node
+			const int currentNode = openSet.RemoveFirst();
+			closedSet[currentNode >> 6] |= 1ull << (currentNode & 63);
+			expandedNodes++;
+
+			// Limit the search for the path. Useful for when were always requesting a path. But be careful to not limit too early otherwise the path might end very different from the real path (like starting to go in the wrong direction)
+			if (i >= maxSearch || currentNode == targetNode)
+			{
+				pathCost = nodes[currentNode].gCost;
+				RetracePath(grid, startNode, currentNode, nodeWaypoints);
+				return true;
+			}
+
+			const glm::ivec2 &currentGridPos = grid.GetNode(currentNode).gridPos;
+			const int currentGCost = nodes[currentNode].gCost;
+
+			for (int z = -1; z <= 1; z++)
+			{
+				for (int x = -1; x <= 1; x++)
+				{
+					if (x == 0 && z == 0)			// x=0 y=0 is the center node so skip it
+						continue;
+
+					const int checkX = currentGridPos.x + x;
+					const int checkZ = currentGridPos.y + z;
+
+					if (checkX < 0 || checkX >= gridSizeXZ.x || checkZ < 0 || checkZ >= gridSizeXZ.y)
+						continue;
+
+					const int neighbour = checkZ * gridSizeXZ.x + checkX;
+
+					// If the neighbour is not walkable or was already searched, skip to the next neighbour
+					if (!grid.GetNode(neighbour).walkable || IsClosed(neighbour))
+						continue;
+
+					// Same as AStarDistance for neighbours
+					const int newMoveCostToNeighbour = currentGCost + (x != 0 && z != 0 ? 14 : 10);
+
+					// Nodes leave the open set when they're closed so any node of this search that isn't closed is in the open set
+					AStarSearchNode &n = nodes[neighbour];
+					const bool notInOpenSet = n.generation != generation;
+
+					// If the new path to the neighbour is shorter than the old path or the neighbour is not in the possible moves list
+					if (notInOpenSet || newMoveCostToNeighbour < n.gCost)
+					{
+						n.gCost = newMoveCostToNeighbour;
+						n.parent = currentNode;
+
+						if (notInOpenSet)
+						{
+							n.hCost = AStarDistance(grid.GetNode(neighbour).gridPos, targetGridPos);
+							n.generation = generation;
+							openSet.Add(neighbour);
+						}
+						else
+						{
+							openSet.Update(neighbour);
+						}
+					}
+				}
+			}
+			i++;
+		}
+
+		return false;
+	}
+
+	bool AStarSearch::FindPathJumpPoint(const AStarGrid &grid, int startNode, int targetNode, std::vector<glm::vec2> &nodeWaypoints, int maxSearch)
+	{
+		BeginSearch(grid.GetTotalNodes());
+
+		const glm::ivec2 &gridSizeXZ = grid.GetGridSizeXZ();
+		const glm::ivec2 &targetGridPos = grid.GetNode(targetNode).gridPos;
+
+		AStarSearchNode &start = nodes[startNode];
+		start.parent = -1;
+		start.gCost = 0;
+		start.hCost = AStarDistance(grid.GetNode(startNode).gridPos, targetGridPos);
+		start.generation = generation;
+
+		openSet.Add(startNode);
+
+		int i = 0;
+		while (openSet.Size() > 0)
+		{
+			const int currentNode = openSet.RemoveFirst();
+			closedSet[currentNode >> 6] |= 1ull << (currentNode & 63);
+			expandedNodes++;
+
+			if (i >= maxSearch || currentNode == targetNode)
+			{
+				pathCost = nodes[currentNode].gCost;
+				RetraceJumpPath(grid, startNode, currentNode, nodeWaypoints);
+				return true;
+			}
+
+			const glm::ivec2 &currentGridPos = grid.GetNode(currentNode).gridPos;
+			const int cx = currentGridPos.x;
+			const int cz = currentGridPos.y;
+
+			auto walkable = [&](int checkX, int checkZ)
+			{
+				return checkX >= 0 && checkX < gridSizeXZ.x && checkZ >= 0 && checkZ < gridSizeXZ.y && grid.GetNode(checkZ * gridSizeXZ.x + checkX).walkable;
+			};
+
+			// Only the natural and forced neighbours of the direction we came from can be on a shorter path, the others are reached as fast without going through this node.
+			// Moving diagonally past obstacles is allowed like in the A* search so the forced neighbours are the ones next to an obstacle beside the node
+			int dirs[8][2];
+			int dirCount = 0;
+
+			if (nodes[currentNode].parent == -1)
+			{
+				for (int z = -1; z <= 1; z++)
+				{
+					for (int x = -1; x <= 1; x++)
+					{
+						if (x == 0 && z == 0)
+							continue;
+
+						dirs[dirCount][0] = x;
+						dirs[dirCount][1] = z;
+						dirCount++;
+					}
+				}
+			}
+			else
+			{
+				const glm::ivec2 &parentGridPos = grid.GetNode(nodes[currentNode].parent).gridPos;
+				const int dx = glm::sign(cx - parentGridPos.x);
+				const int dz = glm::sign(cz - parentGridPos.y);
+
+				if (dx != 0 && dz != 0)
+				{
+					dirs[dirCount][0] = dx; dirs[dirCount][1] = dz; dirCount++;
+					dirs[dirCount][0] = dx; dirs[dirCount][1] = 0; dirCount++;
+					dirs[dirCount][0] = 0; dirs[dirCount][1] = dz; dirCount++;
+
+					if (!walkable(cx - dx, cz))
+					{
+						dirs[dirCount][0] = -dx; dirs[dirCount][1] = dz; dirCount++;
+					}
+					if (!walkable(cx, cz - dz))
+					{
+						dirs[dirCount][0] = dx; dirs[dirCount][1] = -dz; dirCount++;
+					}
+				}
+				else if (dx != 0)
+				{
+					dirs[dirCount][0] = dx; dirs[dirCount][1] = 0; dirCount++;
+
+					if (!walkable(cx, cz + 1))
+					{
+						dirs[dirCount][0] = dx; dirs[dirCount][1] = 1; dirCount++;
+					}
+					if (!walkable(cx, cz - 1))
+					{
+						dirs[dirCount][0] = dx; dirs[dirCount][1] = -1; dirCount++;
+					}
+				}
+				else
+				{
+					dirs[dirCount][0] = 0; dirs[dirCount][1] = dz; dirCount++;
+
+					if (!walkable(cx + 1, cz))
+					{
+						dirs[dirCount][0] = 1; dirs[dirCount][1] = dz; dirCount++;
+					}
+					if (!walkable(cx - 1, cz))
+					{
+						dirs[dirCount][0] = -1; dirs[dirCount][1] = dz; dirCount++;
+					}
+				}
+			}
+
+			const int currentGCost = nodes[currentNode].gCost;
+
+			for (int d = 0; d < dirCount; d++)
+			{
+				const int jumpNode = Jump(grid, cx, cz, dirs[d][0], dirs[d][1], targetNode);
+				if (jumpNode < 0 || IsClosed(jumpNode))
+					continue;
+
+				// Jump points are on a straight or diagonal line from the node so the distance is the cost
+				const glm::ivec2 &jumpGridPos = grid.GetNode(jumpNode).gridPos;
+				const int newMoveCostToNeighbour = currentGCost + AStarDistance(currentGridPos, jumpGridPos);
+
+				AStarSearchNode &n = nodes[jumpNode];
+				const bool notInOpenSet = n.generation != generation;
+
+				if (notInOpenSet || newMoveCostToNeighbour < n.gCost)
+				{
+					n.gCost = newMoveCostToNeighbour;
+					n.parent = currentNode;
+
+					if (notInOpenSet)
+					{
+						n.hCost = AStarDistance(jumpGridPos, targetGridPos);
+						n.generation = generation;
+						openSet.Add(jumpNode);
+					}
+					else
+					{
+						openSet.Update(jumpNode);
+					}
+				}
+			}
+			i++;
+		}
+
+		return false;
+	}
+
+	int AStarSearch::Jump(const AStarGrid &grid, int x, int z, int dirX, int dirZ, int targetNode) const
+	{
+		const glm::ivec2 &gridSizeXZ = grid.GetGridSizeXZ();
+
+		auto walkable = [&](int checkX, int checkZ)
+		{
+			return checkX >= 0 && checkX < gridSizeXZ.x && checkZ >= 0 && checkZ < gridSizeXZ.y && grid.GetNode(checkZ * gridSizeXZ.x + checkX).walkable;
+		};
+
+		while (true)
+		{
+			x += dirX;
+			z += dirZ;
+
+			if (!walkable(x, z))
+				return -1;
+
+			const int node = z * gridSizeXZ.x + x;
+			if (node == targetNode)
+				return node;
+
+			if (dirX != 0 && dirZ != 0)
+			{
+				// Forced neighbours
+				if ((!walkable(x - dirX, z) && walkable(x - dirX, z + dirZ)) || (!walkable(x, z - dirZ) && walkable(x + dirX, z - dirZ)))
+					return node;
+
+				// A diagonal step is a jump point if a straight jump from it finds one
+				for (int axis = 0; axis < 2; axis++)
+				{
+					const int stepX = axis == 0 ? dirX : 0;
+					const int stepZ = axis == 0 ? 0 : dirZ;
+					int sx = x;
+					int sz = z;
+
+					while (true)
+					{
+						sx += stepX;
+						sz += stepZ;
+
+						if (!walkable(sx, sz))
+							break;
+
+						if (sz * gridSizeXZ.x + sx == targetNode)
+							return node;
+
+						if (stepX != 0)
+						{
+							if ((!walkable(sx, sz + 1) && walkable(sx + stepX, sz + 1)) || (!walkable(sx, sz - 1) && walkable(sx + stepX, sz - 1)))
+								return node;
+						}
+						else
+						{
+							if ((!walkable(sx + 1, sz) && walkable(sx + 1, sz + stepZ)) || (!walkable(sx - 1, sz) && walkable(sx - 1, sz + stepZ)))
+								return node;
+						}
+					}
+				}
+			}
+			else if (dirX != 0)
+			{
+				if ((!walkable(x, z + 1) && walkable(x + dirX, z + 1)) || (!walkable(x, z - 1) && walkable(x + dirX, z - 1)))
+					return node;
+			}
+			else
+			{
+				if ((!walkable(x + 1, z) && walkable(x + 1, z + dirZ)) || (!walkable(x - 1, z) && walkable(x - 1, z + dirZ)))
+					return node;
+			}
+		}
+	}
+
+	void AStarSearch::BeginSearch(unsigned int nodeCount)
+	{
+		// The same state is used for the grid nodes and for the entrances of the cluster graph so it only grows
+		if (nodes.size() < nodeCount)
+		{
+			nodes.assign(nodeCount, AStarSearchNode());
+			closedSet.resize((nodeCount + 63) / 64);
+			generation = 0;
+		}
+
+		generation++;
+
+		// Only happens after 4 billion searches but the old states would look like they belong to this search
+		if (generation == 0)
+		{
+			for (size_t i = 0; i < nodes.size(); i++)
+				nodes[i].generation = 0;
+
+			generation = 1;
+		}
+
+		memset(closedSet.data(), 0, ((nodeCount + 63) / 64) * sizeof(uint64_t));
+		openSet.Reset(nodes.data());
+	}
+
+	void AStarSearch::RetracePath(const AStarGrid &grid, int startNode, int targetNode, std::vector<glm::vec2> &nodeWaypoints)
+	{
+		path.clear();
+
+		int currentNode = targetNode;
+
+		while (currentNode != startNode)
+		{
+			path.push_back(currentNode);
+			currentNode = nodes[currentNode].parent;
+		}
+
+		SimplifyPath(grid, nodeWaypoints);
+	}
+
+	void AStarSearch::RetraceJumpPath(const AStarGrid &grid, int startNode, int targetNode, std::vector<glm::vec2> &nodeWaypoints)
+	{
+		path.clear();
+
+		const int gridWidth = grid.GetGridSizeXZ().x;
+		int currentNode = targetNode;
+
+		while (currentNode != startNode)
+		{
+			const int parentNode = nodes[currentNode].parent;
+			const glm::ivec2 &parentGridPos = grid.GetNode(parentNode).gridPos;
+			glm::ivec2 pos = grid.GetNode(currentNode).gridPos;
+			const glm::ivec2 step = glm::sign(parentGridPos - pos);
+
+			while (pos != parentGridPos)
+			{
+				path.push_back(pos.y * gridWidth + pos.x);
+				pos += step;
+			}
+
+			currentNode = parentNode;
+		}
+
+		SimplifyPath(grid, nodeWaypoints);
+	}
+
+	bool AStarSearch::FindPathHierarchical(const AStarGrid &grid, int startNode, int targetNode, std::vector<glm::vec2> &nodeWaypoints)
+	{
+		// Nothing can enter the target so don't bother searching
+		if (!grid.GetNode(targetNode).walkable)
+			return false;
+
+		const AStarClusterGraph &graph = grid.GetClusterGraph();
+
+		const glm::ivec2 &targetGridPos = grid.GetNode(targetNode).gridPos;
+		const int targetCluster = graph.GetClusterIndex(targetGridPos);
+
+		// The start and the target come after the entrances
+		const int abstractStart = graph.GetEntranceCount();
+		const int abstractTarget = abstractStart + 1;
+
+		startEdges.clear();
+		startEdgeOrigins.clear();
+
+		if (grid.GetNode(startNode).walkable)
+		{
+			AddStartEdges(grid, startNode, 0, targetNode);
+		}
+		else
+		{
+			// The searches inside a cluster can't leave it, so if the start is an obstacle (like when an agent was pushed into one) step out of it first
+			// to every walkable neighbour, otherwise a start on the edge of a cluster could only be left to the other side
+			const glm::ivec2 &startGridPos = grid.GetNode(startNode).gridPos;
+			const glm::ivec2 &gridSizeXZ = grid.GetGridSizeXZ();
+
+			for (int z = -1; z <= 1; z++)
+			{
+				for (int x = -1; x <= 1; x++)
+				{
+					const int checkX = startGridPos.x + x;
+					const int checkZ = startGridPos.y + z;
+
+					if ((x == 0 && z == 0) || checkX < 0 || checkX >= gridSizeXZ.x || checkZ < 0 || checkZ >= gridSizeXZ.y)
+						continue;
+
+					const int neighbour = checkZ * gridSizeXZ.x + checkX;
+					if (grid.GetNode(neighbour).walkable)
+						AddStartEdges(grid, neighbour, x != 0 && z != 0 ? 14 : 10, targetNode);
+				}
+			}
+		}
+
+		if (startEdges.size() == 0)
+			return false;
+
+		glm::ivec2 min, max;
+
+		targetEdges.clear();
+		graph.GetClusterBounds(targetCluster, min, max);
+		clusterSearch.Search(grid, min, max, targetNode);
+
+		const std::vector<int> &targetEntrances = graph.GetClusterEntrances(targetCluster);
+		for (size_t i = 0; i < targetEntrances.size(); i++)
+		{
+			const int cost = clusterSearch.GetCost(graph.GetEntrance(targetEntrances[i]).gridNode);
+			if (cost >= 0)
+				targetEdges.push_back({ targetEntrances[i], cost });
+		}
+
+		BeginSearch(static_cast<unsigned int>(abstractTarget + 1));
+
+		AStarSearchNode &start = nodes[abstractStart];
+		start.parent = -1;
+		start.gCost = 0;
+		start.hCost = AStarDistance(grid.GetNode(startNode).gridPos, targetGridPos);
+		start.generation = generation;
+
+		openSet.Add(abstractStart);
+
+		auto relax = [&](int current, int neighbour, int cost)
+		{
+			if (IsClosed(neighbour))
+				return;
+
+			const int newMoveCostToNeighbour = nodes[current].gCost + cost;
+
+			AStarSearchNode &n = nodes[neighbour];
+			const bool notInOpenSet = n.generation != generation;
+
+			if (notInOpenSet || newMoveCostToNeighbour < n.gCost)
+			{
+				n.gCost = newMoveCostToNeighbour;
+				n.parent = current;
+
+				if (notInOpenSet)
+				{
+					n.hCost = neighbour == abstractTarget ? 0 : AStarDistance(grid.GetNode(graph.GetEntrance(neighbour).gridNode).gridPos, targetGridPos);
+					n.generation = generation;
+					openSet.Add(neighbour);
+				}
+				else
+				{
+					openSet.Update(neighbour);
+				}
+			}
+		};
+
+		while (openSet.Size() > 0)
+		{
+			const int currentNode = openSet.RemoveFirst();
+			closedSet[currentNode >> 6] |= 1ull << (currentNode & 63);
+			expandedNodes++;
+
+			if (currentNode == abstractTarget)
+			{
+				pathCost = nodes[currentNode].gCost;
+				RefineAbstractPath(grid, startNode, targetNode, nodeWaypoints);
+				return true;
+			}
+
+			if (currentNode == abstractStart)
+			{
+				for (size_t i = 0; i < startEdges.size(); i++)
+					relax(currentNode, startEdges[i].node, startEdges[i].cost);
+
+				continue;
+			}
+
+			const AStarClusterGraph::Entrance &e = graph.GetEntrance(currentNode);
+
+			relax(currentNode, e.pair, e.pairCost);
+
+			for (size_t i = 0; i < e.edges.size(); i++)
+				relax(currentNode, e.edges[i].node, e.edges[i].cost);
+
+			if (e.cluster == targetCluster)
+			{
+				for (size_t i = 0; i < targetEdges.size(); i++)
+				{
+					if (targetEdges[i].node == currentNode)
+					{
+						relax(currentNode, abstractTarget, targetEdges[i].cost);
+						break;
+					}
+				}
+			}
+		}
+
+		return false;
+	}
+
+	void AStarSearch::AddStartEdges(const AStarGrid &grid, int origin, int originCost, int targetNode)
+	{
+		const AStarClusterGraph &graph = grid.GetClusterGraph();
+		const int cluster = graph.GetClusterIndex(grid.GetNode(origin).gridPos);
+
+		glm::ivec2 min, max;
+		graph.GetClusterBounds(cluster, min, max);
+		clusterSearch.Search(grid, min, max, origin);
+
+		const std::vector<int> &clusterList = graph.GetClusterEntrances(cluster);
+		for (size_t i = 0; i < clusterList.size(); i++)
+		{
+			const int cost = clusterSearch.GetCost(graph.GetEntrance(clusterList[i]).gridNode);
+			if (cost >= 0)
+			{
+				startEdges.push_back({ clusterList[i], originCost + cost });
+				startEdgeOrigins.push_back(origin);
+			}
+		}
+
+		// The path might stay inside the cluster but going out could still be shorter so it's just another edge
+		if (cluster == graph.GetClusterIndex(grid.GetNode(targetNode).gridPos))
+		{
+			const int cost = clusterSearch.GetCost(targetNode);
+			if (cost >= 0)
+			{
+				startEdges.push_back({ graph.GetEntranceCount() + 1, originCost + cost });
+				startEdgeOrigins.push_back(origin);
+			}
+		}
+	}
+
+	void AStarSearch::RefineAbstractPath(const AStarGrid &grid, int startNode, int targetNode, std::vector<glm::vec2> &nodeWaypoints)
+	{
+		const AStarClusterGraph &graph = grid.GetClusterGraph();
+		const int abstractStart = graph.GetEntranceCount();
+		const int abstractTarget = abstractStart + 1;
+
+		// Grid nodes of the abstract path from the target to the start
+		abstractPath.clear();
+
+		int currentNode = abstractTarget;
+		int firstNode = abstractTarget;
+
+		while (nodes[currentNode].parent != -1)
+		{
+			abstractPath.push_back(currentNode == abstractTarget ? targetNode : graph.GetEntrance(currentNode).gridNode);
+
+			firstNode = currentNode;
+			currentNode = nodes[currentNode].parent;
+		}
+
+		// The path leaves from the node of the start edge it took, which is the start itself unless the start is an obstacle
+		int searchStart = startNode;
+
+		for (size_t i = 0; i < startEdges.size(); i++)
+		{
+			if (startEdges[i].node == firstNode && startEdges[i].cost == nodes[firstNode].gCost)
+			{
+				searchStart = startEdgeOrigins[i];
+				break;
+			}
+		}
+
+		abstractPath.push_back(searchStart);
+
+		// Consecutive nodes in the same cluster are joined with a search inside the cluster, the others are pairs across a border
+		path.clear();
+
+		if (searchStart != startNode)
+			path.push_back(searchStart);
+
+		glm::ivec2 min, max;
+
+		for (size_t i = abstractPath.size() - 1; i > 0; i--)
+		{
+			const int from = abstractPath[i];
+			const int to = abstractPath[i - 1];
+
+			if (from == to)
+				continue;
+
+			const int cluster = graph.GetClusterIndex(grid.GetNode(from).gridPos);
+
+			if (cluster == graph.GetClusterIndex(grid.GetNode(to).gridPos))
+			{
+				graph.GetClusterBounds(cluster, min, max);
+				clusterSearch.Search(grid, min, max, from, to);
+				clusterSearch.AppendPath(to, path);
+			}
+			else
+			{
+				path.push_back(to);
+			}
+		}
+
+		std::reverse(path.begin(), path.end());
+
+		SimplifyPath(grid, nodeWaypoints);
+	}
+
+	void AStarSearch::SimplifyPath(const AStarGrid &grid, std::vector<glm::vec2> &nodeWaypoints)
+	{
+		// Only keep the nodes where the path changes direction
+		glm::ivec2 oldDir = glm::ivec2(0);
+
+		for (size_t i = 1; i < path.size(); i++)
+		{
+			const glm::ivec2 newDir = grid.GetNode(path[i - 1]).gridPos - grid.GetNode(path[i]).gridPos;
+
+			if (newDir != oldDir)
+				nodeWaypoints.push_back(grid.GetNode(path[i]).worldPos);
+
+			oldDir = newDir;
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "AStarClusterGraph.h"
+
+#include <cstdint>
+
+namespace Engine
+{
+	class AStarGrid;
+
+	enum class PathSearchMode
+	{
+		HIERARCHICAL,			// Uses the cluster graph of the grid, or A* while the graph is not built
+		ASTAR,
+		JUMP_POINT				// Same costs as A* but only expands the nodes where the path can turn
+	};
+
+	// Search state for one path query at a time. The grid is only read so every thread can own a search and find paths on the same grid in parallel
+	class AStarSearch
+	{
+	public:
+		AStarSearch();
+
+		// The searches on the grid nodes stop after maxSearch nodes, the hierarchical search always finds the whole path
+		bool FindPath(const AStarGrid &grid, const glm::vec2 &startPos, const glm::vec2 &targetPos, std::vector<glm::vec2> &nodeWaypoints, int maxSearch, PathSearchMode mode = PathSearchMode::HIERARCHICAL);
+
+		// Stats of the last search
+		unsigned int GetExpandedNodes() const { return expandedNodes; }
+		int GetPathCost() const { return pathCost; }
+
+	private:
+		bool FindPathJumpPoint(const AStarGrid &grid, int startNode, int targetNode, std::vector<glm::vec2> &nodeWaypoints, int maxSearch);
+		// Returns the next jump point from the node in the direction or -1 if there's none
+		int Jump(const AStarGrid &grid, int x, int z, int dirX, int dirZ, int targetNode) const;
+		bool FindPathHierarchical(const AStarGrid &grid, int startNode, int targetNode, std::vector<glm::vec2> &nodeWaypoints);
+		// Links the origin to the entrances of its cluster, and to the target if it's in the same cluster. The origin cost is the step from the start to the origin
+		void AddStartEdges(const AStarGrid &grid, int origin, int originCost, int targetNode);
+		void BeginSearch(unsigned int nodeCount);
+		bool IsClosed(int node) const { return (closedSet[node >> 6] & (1ull << (node & 63))) != 0; }
+		void RetracePath(const AStarGrid &grid, int startNode, int targetNode, std::vector<glm::vec2> &nodeWaypoints);
+		// Same as RetracePath but also adds the nodes skipped between jump points
+		void RetraceJumpPath(const AStarGrid &grid, int startNode, int targetNode, std::vector<glm::vec2> &nodeWaypoints);
+		void RefineAbstractPath(const AStarGrid &grid, int startNode, int targetNode, std::vector<glm::vec2> &nodeWaypoints);
+		// Turns the path, which goes from the target to the start, into the nodes where it changes direction
+		void SimplifyPath(const AStarGrid &grid, std::vector<glm::vec2> &nodeWaypoints);
+
+	private:
+		std::vector<AStarSearchNode> nodes;
+		std::vector<uint64_t> closedSet;		// One bit per node
+		AStarNodeHeap openSet;
+		std::vector<int> path;
+		unsigned int generation;
+		unsigned int expandedNodes;
+		int pathCost;
+
+		// The start and target are linked to the entrances of their clusters only for the search, the graph is never changed
+		AStarClusterSearch clusterSearch;
+		std::vector<AStarClusterGraph::Edge> startEdges;
+		std::vector<int> startEdgeOrigins;		// Node each start edge leaves from
+		std::vector<AStarClusterGraph::Edge> targetEdges;
+		std::vector<int> abstractPath;
+	};
+}
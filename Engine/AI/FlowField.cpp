@@ -0,0 +1,219 @@
+#include "FlowField.h"
+
+#include "AStarGrid.h"
+
+namespace Engine
+{
+	static const unsigned char NO_DIRECTION = 8;
+	static const int DIRECTION_X[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+	static const int DIRECTION_Z[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+
+	FlowField::FlowField()
+	{
+		targetNode = -1;
+		gridVersion = 0;
+		lastUsedUpdate = 0;
+	}
+
+	void FlowField::Build(const AStarGrid &grid, int targetNode)
+	{
+		this->targetNode = targetNode;
+		gridVersion = grid.GetVersion();
+
+		const unsigned int nodeCount = grid.GetTotalNodes();
+		costs.assign(nodeCount, FLOW_FIELD_UNREACHABLE);
+		directions.assign(nodeCount, NO_DIRECTION);
+		invalidated.assign(nodeCount, 0);
+
+		if (targetNode < 0 || targetNode >= static_cast<int>(nodeCount) || !grid.GetNode(targetNode).walkable)
+			return;
+
+		costs[targetNode] = 0;
+		openSet.push(OpenNode(0, targetNode));
+
+		Propagate(grid);
+	}
+
+	void FlowField::UpdateNodes(const AStarGrid &grid, const std::vector<int> &changedNodes)
+	{
+		if (targetNode < 0 || changedNodes.size() == 0)
+			return;
+
+		const glm::ivec2 &gridSizeXZ = grid.GetGridSizeXZ();
+
+		// New obstacles can only make paths longer for the nodes whose path went through them, which are found by following the directions backwards
+		invalidNodes.clear();
+
+		for (size_t i = 0; i < changedNodes.size(); i++)
+		{
+			const int node = changedNodes[i];
+			if (!grid.GetNode(node).walkable && !invalidated[node] && costs[node] != FLOW_FIELD_UNREACHABLE)
+			{
+				invalidated[node] = 1;
+				invalidNodes.push_back(node);
+			}
+		}
+
+		for (size_t i = 0; i < invalidNodes.size(); i++)
+		{
+			const int node = invalidNodes[i];
+			const glm::ivec2 &gridPos = grid.GetNode(node).gridPos;
+
+			for (unsigned char d = 0; d < 8; d++)
+			{
+				const int x = gridPos.x + DIRECTION_X[d];
+				const int z = gridPos.y + DIRECTION_Z[d];
+
+				if (x < 0 || x >= gridSizeXZ.x || z < 0 || z >= gridSizeXZ.y)
+					continue;
+
+				// The neighbour moves to this node if its direction is the opposite of d
+				const int neighbour = z * gridSizeXZ.x + x;
+				if (!invalidated[neighbour] && directions[neighbour] == 7 - d)
+				{
+					invalidated[neighbour] = 1;
+					invalidNodes.push_back(neighbour);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < invalidNodes.size(); i++)
+		{
+			costs[invalidNodes[i]] = FLOW_FIELD_UNREACHABLE;
+			directions[invalidNodes[i]] = NO_DIRECTION;
+		}
+
+		// The invalidated nodes start again from their neighbours that kept their cost
+		for (size_t i = 0; i < invalidNodes.size(); i++)
+		{
+			const int node = invalidNodes[i];
+			if (grid.GetNode(node).walkable)
+				SeedFromNeighbours(grid, node);
+		}
+
+		// New walkable nodes can make paths shorter, which the propagation spreads
+		for (size_t i = 0; i < changedNodes.size(); i++)
+		{
+			const int node = changedNodes[i];
+			if (!grid.GetNode(node).walkable)
+				continue;
+
+			if (node == targetNode)
+			{
+				costs[node] = 0;
+				directions[node] = NO_DIRECTION;
+				openSet.push(OpenNode(0, node));
+			}
+			else
+			{
+				SeedFromNeighbours(grid, node);
+			}
+		}
+
+		for (size_t i = 0; i < invalidNodes.size(); i++)
+			invalidated[invalidNodes[i]] = 0;
+
+		Propagate(grid);
+	}
+
+	bool FlowField::Sample(const AStarGrid &grid, const glm::vec2 &worldPos, glm::vec2 &direction) const
+	{
+		if (gridVersion != grid.GetVersion())
+			return false;
+
+		const int node = grid.NodeIndexFromWorldPos(worldPos);
+		if (node < 0 || directions[node] == NO_DIRECTION)
+			return false;
+
+		const glm::ivec2 &gridPos = grid.GetNode(node).gridPos;
+		const unsigned char d = directions[node];
+		const int next = (gridPos.y + DIRECTION_Z[d]) * grid.GetGridSizeXZ().x + gridPos.x + DIRECTION_X[d];
+
+		// Steer to the centre of the next node so agents don't drift off the path when they're not on a node centre
+		const glm::vec2 toNext = grid.GetNode(next).worldPos - worldPos;
+		const float length = glm::length(toNext);
+
+		if (length > 0.0001f)
+			direction = toNext / length;
+		else
+			direction = glm::normalize(glm::vec2(static_cast<float>(DIRECTION_X[d]), static_cast<float>(DIRECTION_Z[d])));
+
+		return true;
+	}
+
+	bool FlowField::SeedFromNeighbours(const AStarGrid &grid, int node)
+	{
+		const glm::ivec2 &gridSizeXZ = grid.GetGridSizeXZ();
+		const glm::ivec2 &gridPos = grid.GetNode(node).gridPos;
+
+		int bestCost = FLOW_FIELD_UNREACHABLE;
+		unsigned char bestDirection = NO_DIRECTION;
+
+		for (unsigned char d = 0; d < 8; d++)
+		{
+			const int x = gridPos.x + DIRECTION_X[d];
+			const int z = gridPos.y + DIRECTION_Z[d];
+
+			if (x < 0 || x >= gridSizeXZ.x || z < 0 || z >= gridSizeXZ.y)
+				continue;
+
+			const int neighbour = z * gridSizeXZ.x + x;
+			if (invalidated[neighbour] || costs[neighbour] == FLOW_FIELD_UNREACHABLE)
+				continue;
+
+			const int cost = costs[neighbour] + (DIRECTION_X[d] != 0 && DIRECTION_Z[d] != 0 ? 14 : 10);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestDirection = d;
+			}
+		}
+
+		if (bestDirection == NO_DIRECTION || bestCost >= costs[node])
+			return false;
+
+		costs[node] = bestCost;
+		directions[node] = bestDirection;
+		openSet.push(OpenNode(bestCost, node));
+
+		return true;
+	}
+
+	void FlowField::Propagate(const AStarGrid &grid)
+	{
+		const glm::ivec2 &gridSizeXZ = grid.GetGridSizeXZ();
+
+		while (!openSet.empty())
+		{
+			const OpenNode current = openSet.top();
+			openSet.pop();
+
+			// Nodes are pushed again when their cost goes down so skip the old entries
+			if (current.first != costs[current.second])
+				continue;
+
+			const glm::ivec2 &gridPos = grid.GetNode(current.second).gridPos;
+
+			for (unsigned char d = 0; d < 8; d++)
+			{
+				const int x = gridPos.x + DIRECTION_X[d];
+				const int z = gridPos.y + DIRECTION_Z[d];
+
+				if (x < 0 || x >= gridSizeXZ.x || z < 0 || z >= gridSizeXZ.y)
+					continue;
+
+				const int neighbour = z * gridSizeXZ.x + x;
+				if (!grid.GetNode(neighbour).walkable)
+					continue;
+
+				const int cost = current.first + (DIRECTION_X[d] != 0 && DIRECTION_Z[d] != 0 ? 14 : 10);
+				if (cost < costs[neighbour])
+				{
+					costs[neighbour] = cost;
+					directions[neighbour] = 7 - d;			// The neighbour moves back towards this node
+					openSet.push(OpenNode(cost, neighbour));
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "include/glm/glm.hpp"
+
+#include <vector>
+#include <queue>
+#include <functional>
+
+namespace Engine
+{
+	class AStarGrid;
+
+	static const int FLOW_FIELD_UNREACHABLE = 0x7FFFFFFF;
+
+	// Direction towards one destination for every node of the grid, so any number of agents going there share one search.
+	// The costs come from a Dijkstra search from the destination with the same move costs as the A* search, and each node points to the
+	// neighbour it was reached from. When nodes change walkability only the nodes whose cost depends on them are searched again
+	class FlowField
+	{
+	public:
+		FlowField();
+
+		void Build(const AStarGrid &grid, int targetNode);
+		void UpdateNodes(const AStarGrid &grid, const std::vector<int> &changedNodes);
+
+		// Direction to move in from the position to the next node of the path. Returns false if the position is outside the grid,
+		// is the destination or can't reach it
+		bool Sample(const AStarGrid &grid, const glm::vec2 &worldPos, glm::vec2 &direction) const;
+
+		int GetCost(int node) const { return costs[node]; }
+		int GetTargetNode() const { return targetNode; }
+		bool IsBuilt() const { return targetNode >= 0; }
+		unsigned int GetGridVersion() const { return gridVersion; }
+
+		void SetLastUsedUpdate(unsigned int update) { lastUsedUpdate = update; }
+		unsigned int GetLastUsedUpdate() const { return lastUsedUpdate; }
+
+	private:
+		typedef std::pair<int, int> OpenNode;			// Cost and node
+
+		// Takes the cheapest walkable neighbour that is not invalidated as the next node. Returns false if there's none
+		bool SeedFromNeighbours(const AStarGrid &grid, int node);
+		void Propagate(const AStarGrid &grid);
+
+	private:
+		std::vector<int> costs;
+		std::vector<unsigned char> directions;			// Index of the neighbour to move to
+		std::vector<unsigned char> invalidated;
+		std::vector<int> invalidNodes;
+		std::priority_queue<OpenNode, std::vector<OpenNode>, std::greater<OpenNode>> openSet;
+		int targetNode;
+		unsigned int gridVersion;
+		unsigned int lastUsedUpdate;
+	};
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "Program/Allocator.h"
+
+#include <new>
+#include <utility>
+#include <cstddef>
+
+namespace Engine
+{
+	namespace componentarray
+	{
+		static const size_t COLUMN_ALIGNMENT = 16;
+
+		inline size_t AlignColumn(size_t bytes)
+		{
+			return (bytes + COLUMN_ALIGNMENT - 1) & ~(COLUMN_ALIGNMENT - 1);
+		}
+
+		template<unsigned int I, typename T, typename... Ts>
+		struct TypeAt
+		{
+			typedef typename TypeAt<I - 1, Ts...>::type type;
+		};
+
+		template<typename T, typename... Ts>
+		struct TypeAt<0, T, Ts...>
+		{
+			typedef T type;
+		};
+
+		// Applies an operation to every column. I is the index of the column T
+		template<unsigned int I, typename... Ts>
+		struct Columns
+		{
+			static size_t Bytes(unsigned int capacity) { return 0; }
+			static void Layout(void **columns, unsigned char *buffer, unsigned int capacity) {}
+			static void Relocate(void **dst, void **src, unsigned int size) {}
+			static void Construct(void **columns, unsigned int index) {}
+			static void Destroy(void **columns, unsigned int index) {}
+			static void Move(void **columns, unsigned int dst, unsigned int src) {}
+			static void Swap(void **columns, unsigned int a, unsigned int b) {}
+		};
+
+		template<unsigned int I, typename T, typename... Ts>
+		struct Columns<I, T, Ts...>
+		{
+			typedef Columns<I + 1, Ts...> Next;
+
+			static size_t Bytes(unsigned int capacity)
+			{
+				return AlignColumn(sizeof(T) * capacity) + Next::Bytes(capacity);
+			}
+
+			static void Layout(void **columns, unsigned char *buffer, unsigned int capacity)
+			{
+				columns[I] = buffer;
+				Next::Layout(columns, buffer + AlignColumn(sizeof(T) * capacity), capacity);
+			}
+
+			static void Relocate(void **dst, void **src, unsigned int size)
+			{
+				T *d = static_cast<T*>(dst[I]);
+				T *s = static_cast<T*>(src[I]);
+
+				for (unsigned int i = 0; i < size; i++)
+				{
+					new (&d[i]) T(std::move(s[i]));
+					s[i].~T();
+				}
+
+				Next::Relocate(dst, src, size);
+			}
+
+			static void Construct(void **columns, unsigned int index)
+			{
+				new (&static_cast<T*>(columns[I])[index]) T();
+				Next::Construct(columns, index);
+			}
+
+			static void Destroy(void **columns, unsigned int index)
+			{
+				static_cast<T*>(columns[I])[index].~T();
+				Next::Destroy(columns, index);
+			}
+
+			static void Move(void **columns, unsigned int dst, unsigned int src)
+			{
+				T *c = static_cast<T*>(columns[I]);
+				c[dst] = std::move(c[src]);
+				Next::Move(columns, dst, src);
+			}
+
+			static void Swap(void **columns, unsigned int a, unsigned int b)
+			{
+				T *c = static_cast<T*>(columns[I]);
+				std::swap(c[a], c[b]);
+				Next::Swap(columns, a, b);
+			}
+		};
+	}
+
+	// Structure of arrays storage for component data. All the columns live in the same allocation and grow together,
+	// so a manager can keep adding instances without knowing the worst case size up front.
+	// Elements are constructed and destroyed in place so the columns can hold non trivial types
+	template<typename... Ts>
+	class ComponentArray
+	{
+	public:
+		ComponentArray()
+		{
+			allocator = nullptr;
+			tag = MemoryTag::COMPONENTS;
+			buffer = nullptr;
+			size = 0;
+			capacity = 0;
+
+			for (unsigned int i = 0; i < NUM_COLUMNS; i++)
+				columns[i] = nullptr;
+		}
+
+		void Init(Allocator *allocator, unsigned int initialCapacity, MemoryTag tag = MemoryTag::COMPONENTS)
+		{
+			this->allocator = allocator;
+			this->tag = tag;
+			Reserve(initialCapacity);
+		}
+
+		void Dispose()
+		{
+			Clear();
+
+			if (buffer)
+			{
+				allocator->Free(buffer);
+				buffer = nullptr;
+			}
+			capacity = 0;
+		}
+
+		// Adds a default constructed element at the end and returns its index
+		unsigned int Add()
+		{
+			if (size == capacity)
+				Reserve(capacity > 0 ? capacity * 2 : 16);
+
+			ColumnOps::Construct(columns, size);
+			return size++;
+		}
+
+		// Adds or removes elements at the end. The new elements are default constructed
+		void Resize(unsigned int newSize)
+		{
+			if (newSize > capacity)
+				Reserve(newSize > capacity * 2 ? newSize : capacity * 2);
+
+			while (size < newSize)
+				ColumnOps::Construct(columns, size++);
+
+			while (size > newSize)
+				ColumnOps::Destroy(columns, --size);
+		}
+
+		void Reserve(unsigned int newCapacity)
+		{
+			if (newCapacity <= capacity)
+				return;
+
+			unsigned char *newBuffer = static_cast<unsigned char*>(allocator->Allocate(static_cast<unsigned int>(ColumnOps::Bytes(newCapacity)), tag));
+			void *newColumns[NUM_COLUMNS];
+			ColumnOps::Layout(newColumns, newBuffer, newCapacity);
+
+			if (buffer)
+			{
+				ColumnOps::Relocate(newColumns, columns, size);
+				allocator->Free(buffer);
+			}
+
+			buffer = newBuffer;
+			capacity = newCapacity;
+
+			for (unsigned int i = 0; i < NUM_COLUMNS; i++)
+				columns[i] = newColumns[i];
+		}
+
+		// Moves the last element into index to keep the arrays packed. Returns the old index of the moved element
+		// so the owner can update its entity to index map. If index was the last element then index is returned
+		unsigned int SwapRemove(unsigned int index)
+		{
+			const unsigned int last = size - 1;
+
+			if (index != last)
+				ColumnOps::Move(columns, index, last);
+
+			ColumnOps::Destroy(columns, last);
+			size--;
+
+			return last;
+		}
+
+		// Swaps two elements in every column. Used by managers that keep their enabled instances packed at the front
+		void Swap(unsigned int a, unsigned int b)
+		{
+			if (a != b)
+				ColumnOps::Swap(columns, a, b);
+		}
+
+		void Clear()
+		{
+			while (size > 0)
+				ColumnOps::Destroy(columns, --size);
+		}
+
+		template<unsigned int Column>
+		typename componentarray::TypeAt<Column, Ts...>::type *Get() const
+		{
+			return static_cast<typename componentarray::TypeAt<Column, Ts...>::type*>(columns[Column]);
+		}
+
+		unsigned int GetSize() const { return size; }
+		unsigned int GetCapacity() const { return capacity; }
+
+	private:
+		typedef componentarray::Columns<0, Ts...> ColumnOps;
+		static const unsigned int NUM_COLUMNS = sizeof...(Ts);
+
+		Allocator *allocator;
+		MemoryTag tag;
+		unsigned char *buffer;
+		void *columns[NUM_COLUMNS];
+		unsigned int size;
+		unsigned int capacity;
+	};
+}
@@ -22,6 +22,8 @@ namespace Engine
 	{
 		this->transformManager = transformManager;
 
+		pointLightPool.Init(game->GetAllocator(), sizeof(PointLight), POINT_LIGHTS_PER_CHUNK, MemoryTag::COMPONENTS);
+
 		Log::Print(LogLevel::LEVEL_INFO, "Init Light manager\n");
 	}
 
@@ -100,7 +102,7 @@ namespace Engine
 	void LightManager::PartialDispose()
 	{
 		for (size_t i = 0; i < usedPointLights; i++)
-			delete pointLights[i].pl;
+			pointLightPool.Delete(pointLights[i].pl);
 
 		pointLights.clear();
 	}
@@ -108,6 +110,7 @@ namespace Engine
 	void LightManager::Dispose()
 	{
 		PartialDispose();
+		pointLightPool.Dispose();
 
 		Log::Print(LogLevel::LEVEL_INFO, "Disposing Light manager\n");
 	}
@@ -117,7 +120,7 @@ namespace Engine
 		if (HasPointLight(e))
 			return pointLights[plMap.at(e.id)].pl;
 
-		PointLight *light = new PointLight();
+		PointLight *light = pointLightPool.New<PointLight>();
 		light->type = LightType::POINT;
 		light->castShadows = false;
 		light->color = glm::vec3(1.0f);
@@ -141,7 +144,7 @@ namespace Engine
 
 		const PointLight *pl = GetPointLight(e);
 
-		PointLight *newPl = new PointLight();
+		PointLight *newPl = pointLightPool.New<PointLight>();
 		newPl->type = LightType::POINT;
 		newPl->castShadows = pl->castShadows;
 		newPl->color = pl->color;
@@ -215,7 +218,7 @@ namespace Engine
 	{
 		PointLightInstance pli = {};
 		pli.e = e;
-		pli.pl = new PointLight();
+		pli.pl = pointLightPool.New<PointLight>();
 		pli.pl->Deserialize(s);
 
 		InsertPointLightInstance(pli);
@@ -296,7 +299,7 @@ namespace Engine
 				plMap[lastDisabledEntityPli.e.id] = entityToRemoveIndex;
 			}
 
-			delete entityToRemovePli.pl;
+			pointLightPool.Delete(entityToRemovePli.pl);
 			needsSort = true;
 			usedPointLights--;
 		}
@@ -348,7 +351,7 @@ namespace Engine
 			{
 				PointLightInstance pli;
 				s.Read(pli.e.id);
-				pli.pl = new PointLight();
+				pli.pl = pointLightPool.New<PointLight>();
 				pli.pl->Deserialize(s);
 
 				pointLights[i] = pli;
@@ -2,6 +2,7 @@
 
 #include "Graphics/Lights.h"
 #include "Game/EntityManager.h"
+#include "Program/PoolAllocator.h"
 
 #include "Data/Shaders/common.glsl"
 
@@ -60,7 +61,10 @@ namespace Engine
 		void InsertPointLightInstance(const PointLightInstance &pli);
 
 	private:
+		static const unsigned int POINT_LIGHTS_PER_CHUNK = 32;
+
 		TransformManager *transformManager;
+		PoolAllocator pointLightPool;
 
 		std::vector<PointLightInstance> pointLights;						// We can't use this one for sorting otherwise the 
 		std::unordered_map<unsigned int, unsigned int> plMap;
@@ -5,6 +5,7 @@
 #include "Program/StringID.h"
 #include "Program/Log.h"
 #include "Program/Allocator.h"
+#include "Program/JobSystem.h"
 #include "Graphics/VertexArray.h"
 #include "Graphics/Material.h"
 #include "Graphics/MeshDefaults.h"
@@ -24,59 +25,80 @@ namespace Engine
 
 		shadowPassID = SID("csm");
 
-		data = {};
-		//data.buffer = new unsigned char[initialCapacity * (sizeof(Entity) + sizeof(ModelS) + sizeof(unsigned int) + sizeof(bool) + sizeof(float) + sizeof(AABB) + sizeof(AABB))];
-		data.buffer = (unsigned char*)game->GetAllocator()->Allocate(initialCapacity * (sizeof(Entity) + sizeof(ModelS) + sizeof(unsigned int) + sizeof(bool) + sizeof(float) + sizeof(AABB) + sizeof(AABB)));
-		data.capacity = initialCapacity;
-		data.size = 0;
-
-		data.e = (Entity*)data.buffer;
-		data.model = (ModelS*)(data.e + initialCapacity);
-		data.pathIndex = (unsigned int*)(data.model + initialCapacity);
-		data.castShadows = (bool*)(data.pathIndex + initialCapacity);
-		data.lodDistance = (float*)(data.castShadows + initialCapacity);
-		data.originalAABB = (AABB*)(data.lodDistance + initialCapacity);
-		data.worldSpaceAABB = (AABB*)(data.originalAABB + initialCapacity);
+		data.Init(game->GetAllocator(), initialCapacity, MemoryTag::RENDERER);
+		UpdateInstanceDataPointers();
 
 		Log::Print(LogLevel::LEVEL_INFO, "Init Model manager\n");
 	}
 
 	void ModelManager::Update()
 	{
-		// Use transform manager modified transforms on update
-		// update aabb if transform changed
-
+		// Only the models whose transform changed need their aabb recomputed. The tree only changes if a model moves out of its fat aabb
 		const unsigned int numEnabledModels = usedModels - disabledModels;
-		for (unsigned int i = 0; i < numEnabledModels; i++)
+
+		// Resolve everything once so the jobs below only read the transforms
+		// This adds the transforms it updates to the modified list, which can grow, so the list is read after it
+		transformManager->UpdateWorldTransforms(&game->GetJobSystem());
+
+		const unsigned int numModifiedTransforms = transformManager->GetNumModifiedTransforms();
+		const ModifiedTransform *modifiedTransforms = transformManager->GetModifiedTransforms();
+
+		modifiedModels.clear();
+
+		for (unsigned int i = 0; i < numModifiedTransforms; i++)
 		{
-			ModelInstance &mi = models[i];
-			mi.aabb = utils::RecomputeAABB(mi.model->GetOriginalAABB(), transformManager->GetLocalToWorld(mi.e));
+			auto it = map.find(modifiedTransforms[i].e.id);
+			if (it == map.end() || it->second >= numEnabledModels)
+				continue;
 
-			if (mi.model->GetType() == ModelType::ANIMATED)
+			modifiedModels.push_back(it->second);
+		}
+
+		const unsigned int numModifiedModels = static_cast<unsigned int>(modifiedModels.size());
+
+		const TransformManager *transforms = transformManager;
+
+		auto recomputeAABBs = [this, transforms](unsigned int start, unsigned int end)
+		{
+			for (unsigned int i = start; i < end; i++)
 			{
-				AnimatedModel *am = static_cast<AnimatedModel*>(mi.model);
-				am->SetDirty();
-				//am->UpdateController();  update when in game
+				const unsigned int index = modifiedModels[i];
+				instanceData.aabb[index] = utils::RecomputeAABB(instanceData.model[index]->GetOriginalAABB(), transforms->GetLocalToWorld(instanceData.e[index]));
 			}
+		};
+
+		JobSystem &jobSystem = game->GetJobSystem();
+		if (jobSystem.GetNumThreads() > 1 && numModifiedModels > AABB_JOB_GROUP_SIZE)
+		{
+			JobCounter counter;
+			jobSystem.ParallelFor(numModifiedModels, AABB_JOB_GROUP_SIZE, recomputeAABBs, &counter);
+			jobSystem.Wait(&counter);
 		}
-		/*for (unsigned int i = 0; i < usedModels; i++)
+		else
 		{
-			data.worldSpaceAABB[i] = utils::RecomputeAABB(data.originalAABB[i], transformManager->GetLocalToWorld(data.e[i]));
-*/
-			/*if (mi.model->GetType() == ModelType::ANIMATED)
-			{
-				AnimatedModel *am = static_cast<AnimatedModel*>(mi.model);
-				am->SetDirty();
-			}*/
-		//}
+			recomputeAABBs(0, numModifiedModels);
+		}
+
+		// The tree is not thread safe so refit it after all the aabbs are computed
+		for (unsigned int i = 0; i < numModifiedModels; i++)
+		{
+			const unsigned int index = modifiedModels[i];
+			tree.MoveProxy(instanceData.proxyID[index], instanceData.aabb[index]);
+		}
+
+		for (size_t i = 0; i < animatedModels.size(); i++)
+		{
+			animatedModels[i]->SetDirty();
+			//am->UpdateController();  update when in game
+		}
 	}
 
 	void ModelManager::PartialDispose()
 	{
 		for (unsigned int i = 0; i < usedModels; i++)
 		{
-			if (models[i].model->GetType() != ModelType::ANIMATED)
-				models[i].model->RemoveReference();
+			if (instanceData.model[i]->GetType() != ModelType::ANIMATED)
+				instanceData.model[i]->RemoveReference();
 		}
 
 		for (size_t i = 0; i < animatedModels.size(); i++)
@@ -94,117 +116,206 @@ namespace Engine
 	{
 		PartialDispose();
 
-		if (data.buffer)
-			game->GetAllocator()->Free(data.buffer);
+		data.Dispose();
 
 		Log::Print(LogLevel::LEVEL_INFO, "Disposing Model manager\n");
 	}
 
 	void ModelManager::Cull(unsigned int passAndFrustumCount, unsigned int *passIds, const Frustum *frustums, std::vector<VisibilityIndices*> &out)
 	{
-		const unsigned int numEnabledModels = usedModels - disabledModels;
+		if (tree.GetProxyCount() == 0)
+			return;
 
-		/*const glm::vec3 &camPos = game->GetMainCamera()->GetPosition();
+		// The tree leafs store the index of the model so the visibility can be used directly
+		// The queries don't modify the tree and each pass has its own output so every pass can be culled in its own job
+		JobSystem &jobSystem = game->GetJobSystem();
+		if (jobSystem.GetNumThreads() > 1 && passAndFrustumCount > 1)
+		{
+			JobCounter counter;
+			for (unsigned int i = 0; i < passAndFrustumCount; i++)
+			{
+				const Frustum *frustum = &frustums[i];
+				VisibilityIndices *passVisibility = out[i];
+				jobSystem.Run([this, frustum, passVisibility]() { tree.QueryFrustum(*frustum, *passVisibility); }, &counter);
+			}
+			jobSystem.Wait(&counter);
+		}
+		else
+		{
+			for (unsigned int i = 0; i < passAndFrustumCount; i++)
+			{
+				tree.QueryFrustum(frustums[i], *out[i]);
+			}
+		}
+	}
 
-		float lodDist = 100000.0f;
+	void ModelManager::PrepareRenderItems(unsigned int passCount, unsigned int *passIds, const std::vector<const VisibilityIndices*> &visibility)
+	{
+		// Update the bones of the animated models visible in at least one pass. Clearing the dirty flag here makes sure each model is only added once
+		visibleAnimatedModels.clear();
 
-		for (unsigned int i = 0; i < passAndFrustumCount; i++)
+		for (unsigned int i = 0; i < passCount; i++)
 		{
-			for (size_t j = 0; j < numEnabledModels; j++)
+			const VisibilityIndices &v = *visibility[i];
+
+			for (size_t j = 0; j < v.size(); j++)
 			{
-				const ModelInstance &mi = models[j];
-				lodDist = mi.model->GetLODDistance();
+				Model *model = instanceData.model[v[j]];
 
-				if (glm::length2(camPos - transformManager->GetLocalPosition(mi.e)) > lodDist)
+				if (model->GetType() != ModelType::ANIMATED)
 					continue;
 
-				if (frustums[i].BoxInFrustum(mi.aabb.min, mi.aabb.max) != FrustumIntersect::OUTSIDE)
-					out[i]->push_back(j);
+				AnimatedModel *am = static_cast<AnimatedModel*>(model);
+				if (am->IsDirty())
+				{
+					am->ClearDirty();
+					visibleAnimatedModels.push_back(v[j]);
+				}
 			}
-		}*/
+		}
+
+		const unsigned int numAnimatedModels = static_cast<unsigned int>(visibleAnimatedModels.size());
+		if (numAnimatedModels == 0)
+			return;
+
+		const float dt = game->GetDeltaTime();
+
+		auto updatePoses = [this, dt](unsigned int start, unsigned int end)
+		{
+			for (unsigned int i = start; i < end; i++)
+			{
+				static_cast<AnimatedModel*>(instanceData.model[visibleAnimatedModels[i]])->UpdatePose(dt);
+			}
+		};
+
+		JobSystem &jobSystem = game->GetJobSystem();
+		if (jobSystem.GetNumThreads() > 1 && numAnimatedModels > 1)
+		{
+			JobCounter counter;
+			jobSystem.ParallelFor(numAnimatedModels, 1, updatePoses, &counter);
+			jobSystem.Wait(&counter);
+		}
+		else
+		{
+			updatePoses(0, numAnimatedModels);
+		}
 
-		/*if (out.size() > 0)
-			out[0]->push_back(0);*/
+		// Bone attachments modify the transform manager
+		for (unsigned int i = 0; i < numAnimatedModels; i++)
+		{
+			const unsigned int index = visibleAnimatedModels[i];
+			static_cast<AnimatedModel*>(instanceData.model[index])->UpdateBoneAttachments(*transformManager, instanceData.e[index]);
+		}
+
+		// Resolve the attached entities now so the render queues can read the transforms from multiple threads
+		transformManager->UpdateWorldTransforms(&game->GetJobSystem());
 
-		for (unsigned int i = 0; i < passAndFrustumCount; i++)
+		// The attachments moved after Update refit the models, so refit them here otherwise they would be culled with their old aabbs
+		for (unsigned int i = 0; i < numAnimatedModels; i++)
 		{
-			out[i]->push_back(0);
+			const AnimatedModel *am = static_cast<const AnimatedModel*>(instanceData.model[visibleAnimatedModels[i]]);
+			const BoneAttachment *attachments = am->GetBoneAttachments();
+
+			for (unsigned short j = 0; j < am->GetBoneAttachmentsCount(); j++)
+				RefitHierarchy(attachments[j].attachedEntity);
 		}
 	}
 
-	void ModelManager::GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues)
+	void ModelManager::RefitHierarchy(Entity root)
 	{
-		float dt = game->GetDeltaTime();
+		if (!root.IsValid())
+			return;
+
 		const unsigned int numEnabledModels = usedModels - disabledModels;
 
-		if (numEnabledModels > 0)
+		refitStack.clear();
+		refitStack.push_back(root);
+
+		while (refitStack.size() > 0)
 		{
-			for (size_t i = 0; i < numEnabledModels; i++)
+			const Entity e = refitStack.back();
+			refitStack.pop_back();
+
+			auto it = map.find(e.id);
+			if (it != map.end() && it->second < numEnabledModels)
 			{
-				const ModelInstance &mi = models[i];
-				Model *model = mi.model;
+				const unsigned int index = it->second;
+				instanceData.aabb[index] = utils::RecomputeAABB(instanceData.model[index]->GetOriginalAABB(), transformManager->GetLocalToWorld(e));
+				tree.MoveProxy(instanceData.proxyID[index], instanceData.aabb[index]);
+			}
 
-				const glm::mat4 &localToWorld = transformManager->GetLocalToWorld(mi.e);
-				const std::vector<MeshMaterial> &meshesAndMaterials = model->GetMeshesAndMaterials();
+			for (Entity child = transformManager->GetFirstChild(e); child.IsValid(); child = transformManager->GetNextSibling(child))
+				refitStack.push_back(child);
+		}
+	}
+
+	void ModelManager::GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues)
+	{
+		// The queues of the passes are built in parallel so only read the transforms, they were resolved in PrepareRenderItems
+		const TransformManager *transforms = transformManager;
+
+		for (size_t i = 0; i < visibility.size(); i++)
+		{
+			Model *model = instanceData.model[visibility[i]];
+
+			const glm::mat4 &localToWorld = transforms->GetLocalToWorld(instanceData.e[visibility[i]]);
+			const std::vector<MeshMaterial> &meshesAndMaterials = model->GetMeshesAndMaterials();
 				
-				if (model->GetType() == ModelType::ANIMATED)
-				{
-					AnimatedModel *am = static_cast<AnimatedModel*>(model);
-					if (am->IsDirty())
-						am->UpdateBones(*transformManager, mi.e, dt);
+			if (model->GetType() == ModelType::ANIMATED)
+			{
+				// The bones were already updated in PrepareRenderItems
+				const AnimatedModel *am = static_cast<const AnimatedModel*>(model);
+				const std::vector<glm::mat4> &transforms = am->GetBoneTransforms();
 
-					const std::vector<glm::mat4> &transforms = am->GetBoneTransforms();
+				for (size_t j = 0; j < meshesAndMaterials.size(); j++)
+				{
+					const MeshMaterial &mm = meshesAndMaterials[j];
+					const std::vector<ShaderPass> &passes = mm.mat->baseMaterial->GetShaderPasses();
 
-					for (size_t j = 0; j < meshesAndMaterials.size(); j++)
+					for (size_t k = 0; k < passCount; k++)
 					{
-						const MeshMaterial &mm = meshesAndMaterials[j];
-						const std::vector<ShaderPass> &passes = mm.mat->baseMaterial->GetShaderPasses();
-
-						for (size_t k = 0; k < passCount; k++)
+						for (size_t l = 0; l < passes.size(); l++)
 						{
-							for (size_t l = 0; l < passes.size(); l++)
+							if (passIds[k] == passes[l].queueID)
 							{
-								if (passIds[k] == passes[l].queueID)
-								{
-									RenderItem ri = {};
-									ri.mesh = &mm.mesh;
-									ri.matInstance = mm.mat;
-									ri.shaderPass = l;
-									ri.transform = &localToWorld;
-									ri.meshParams = &transforms[0][0].x;
-									ri.meshParamsSize = transforms.size() * sizeof(glm::mat4);
-									outQueues.push_back(ri);
-								}
+								RenderItem ri = {};
+								ri.mesh = &mm.mesh;
+								ri.matInstance = mm.mat;
+								ri.shaderPass = l;
+								ri.transform = &localToWorld;
+								ri.meshParams = &transforms[0][0].x;
+								ri.meshParamsSize = transforms.size() * sizeof(glm::mat4);
+								outQueues.push_back(ri);
 							}
 						}
 					}
 				}
-				else
+			}
+			else
+			{
+				for (size_t j = 0; j < meshesAndMaterials.size(); j++)
 				{
-					for (size_t j = 0; j < meshesAndMaterials.size(); j++)
-					{
-						const MeshMaterial &mm = meshesAndMaterials[j];
-						const std::vector<ShaderPass>& passes = mm.mat->baseMaterial->GetShaderPasses();
+					const MeshMaterial &mm = meshesAndMaterials[j];
+					const std::vector<ShaderPass>& passes = mm.mat->baseMaterial->GetShaderPasses();
 
-						for (size_t k = 0; k < passCount; k++)
+					for (size_t k = 0; k < passCount; k++)
+					{
+						for (size_t l = 0; l < passes.size(); l++)
 						{
-							for (size_t l = 0; l < passes.size(); l++)
+							if (passIds[k] == passes[l].queueID)
 							{
-								if (passIds[k] == passes[l].queueID)
-								{
-									RenderItem ri = {};
-									ri.mesh = &mm.mesh;
-									ri.matInstance = mm.mat;
-									ri.shaderPass = l;
-									ri.transform = &localToWorld;
-									outQueues.push_back(ri);
-								}
+								RenderItem ri = {};
+								ri.mesh = &mm.mesh;
+								ri.matInstance = mm.mat;
+								ri.shaderPass = l;
+								ri.transform = &localToWorld;
+								outQueues.push_back(ri);
 							}
 						}
 					}
 				}
 			}
-		}	
+		}
 
 		/*for (auto m : uniqueModels)
 		{
@@ -542,7 +653,6 @@ namespace Engine
 				if (disabledModels == 1)
 				{
 					disabledModels--;
-					return;
 				}
 				else
 				{
@@ -550,17 +660,18 @@ namespace Engine
 					unsigned int entityIndex = map.at(e.id);
 					unsigned int firstDisabledEntityIndex = usedModels - disabledModels;		// Don't subtract -1 because we want the first disabled entity, otherwise we would get the last enabled entity. Eg 6 used, 2 disabled, 6-2=4 the first disabled entity is at index 4 and the second at 5
 
-					ModelInstance mi1 = models[entityIndex];
-					ModelInstance mi2 = models[firstDisabledEntityIndex];
-
-					models[entityIndex] = mi2;
-					models[firstDisabledEntityIndex] = mi1;
-
-					map[e.id] = firstDisabledEntityIndex;
-					map[mi2.e.id] = entityIndex;
+					SwapModels(entityIndex, firstDisabledEntityIndex);
 
 					disabledModels--;
 				}
+
+				// The transform might have changed while the model was disabled
+				unsigned int entityIndex = map.at(e.id);
+				if (instanceData.proxyID[entityIndex] == AABBTree::NULL_NODE)
+				{
+					instanceData.aabb[entityIndex] = utils::RecomputeAABB(instanceData.model[entityIndex]->GetOriginalAABB(), transformManager->GetLocalToWorld(e));
+					instanceData.proxyID[entityIndex] = tree.CreateProxy(instanceData.aabb[entityIndex], entityIndex);
+				}
 			}
 			else
 			{
@@ -568,16 +679,15 @@ namespace Engine
 				unsigned int entityIndex = map.at(e.id);
 				unsigned int firstDisabledEntityIndex = usedModels - disabledModels - 1;		// Get the first entity disabled or the last entity if none are disabled
 
-				ModelInstance mi1 = models[entityIndex];
-				ModelInstance mi2 = models[firstDisabledEntityIndex];
+				// Disabled models are removed from the tree so they don't get culled
+				if (instanceData.proxyID[entityIndex] != AABBTree::NULL_NODE)
+				{
+					tree.DestroyProxy(instanceData.proxyID[entityIndex]);
+					instanceData.proxyID[entityIndex] = AABBTree::NULL_NODE;
+				}
 
 				// Now swap the entities
-				models[entityIndex] = mi2;
-				models[firstDisabledEntityIndex] = mi1;
-
-				// Swap the indices
-				map[e.id] = firstDisabledEntityIndex;
-				map[mi2.e.id] = entityIndex;
+				SwapModels(entityIndex, firstDisabledEntityIndex);
 
 				disabledModels++;
 			}
@@ -586,24 +696,24 @@ namespace Engine
 
 	void ModelManager::SaveModelPrefab(Serializer &s, Entity e)
 	{
-		const ModelInstance &mi = models[map.at(e.id)];
+		Model *model = instanceData.model[map.at(e.id)];
 
-		ModelType type = mi.model->GetType();
+		ModelType type = model->GetType();
 		s.Write((int)type);
 
 		if (type == ModelType::BASIC)
 		{
-			s.Write(SID(mi.model->GetPath()));
-			mi.model->Serialize(s);
+			s.Write(SID(model->GetPath()));
+			model->Serialize(s);
 		}
 		else if (type == ModelType::ANIMATED)
 		{
-			AnimatedModel *am = static_cast<AnimatedModel*>(mi.model);
+			AnimatedModel *am = static_cast<AnimatedModel*>(model);
 			am->Serialize(s);
 		}
 		else if (type == ModelType::PRIMITIVE_CUBE || type == ModelType::PRIMITIVE_SPHERE)
 		{
-			mi.model->Serialize(s);
+			model->Serialize(s);
 		}
 	}
 
@@ -697,36 +807,72 @@ namespace Engine
 
 	void ModelManager::InsertModelInstance(const ModelInstance &mi)
 	{
-		if (usedModels < models.size())
-		{
-			models[usedModels] = mi;
-			map[mi.e.id] = usedModels;
-		}
-		else
-		{
-			models.push_back(mi);
-			map[mi.e.id] = models.size() - 1;
-		}
+		const unsigned int oldCapacity = data.GetCapacity();
+		const unsigned int index = data.Add();
+
+		if (data.GetCapacity() != oldCapacity)
+			UpdateInstanceDataPointers();
+
+		instanceData.e[index] = mi.e;
+		instanceData.model[index] = mi.model;
+		instanceData.aabb[index] = mi.aabb;
+		instanceData.proxyID[index] = tree.CreateProxy(mi.aabb, index);
+		map[mi.e.id] = index;
 
 		usedModels++;
 
 		// If there is any disabled entity then we need to swap the new one, which was inserted at the end, with the first disabled entity
 		if (disabledModels > 0)
 		{
-			// Get the indices of the entity to disable and the last entity
-			unsigned int newEntityIndex = usedModels - 1;
 			unsigned int firstDisabledEntityIndex = usedModels - disabledModels - 1;		// Get the first entity disabled
+			SwapModels(index, firstDisabledEntityIndex);
+		}
+	}
+
+	void ModelManager::SwapModels(unsigned int a, unsigned int b)
+	{
+		if (a == b)
+			return;
+
+		data.Swap(a, b);
+
+		map[instanceData.e[a].id] = a;
+		map[instanceData.e[b].id] = b;
+
+		UpdateProxyIndex(a);
+		UpdateProxyIndex(b);
+	}
+
+	void ModelManager::UpdateProxyIndex(unsigned int index)
+	{
+		// Keep the index stored in the tree leaf in sync when a model changes position in the models array
+		const int proxyID = instanceData.proxyID[index];
+		if (proxyID != AABBTree::NULL_NODE)
+			tree.SetUserData(proxyID, index);
+	}
+
+	void ModelManager::UpdateInstanceDataPointers()
+	{
+		instanceData.e = data.Get<MODEL_ENTITY>();
+		instanceData.model = data.Get<MODEL_MODEL>();
+		instanceData.aabb = data.Get<MODEL_AABB>();
+		instanceData.proxyID = data.Get<MODEL_PROXY_ID>();
+	}
 
-			ModelInstance mi1 = models[newEntityIndex];
-			ModelInstance mi2 = models[firstDisabledEntityIndex];
+	void ModelManager::RebuildTree()
+	{
+		tree.Clear();
 
-			// Now swap the entities
-			models[newEntityIndex] = mi2;
-			models[firstDisabledEntityIndex] = mi1;
+		const unsigned int numEnabledModels = usedModels - disabledModels;
+
+		for (unsigned int i = 0; i < usedModels; i++)
+		{
+			instanceData.aabb[i] = utils::RecomputeAABB(instanceData.model[i]->GetOriginalAABB(), transformManager->GetLocalToWorld(instanceData.e[i]));
 
-			// Swap the indices
-			map[mi.e.id] = firstDisabledEntityIndex;
-			map[mi2.e.id] = newEntityIndex;
+			if (i < numEnabledModels)
+				instanceData.proxyID[i] = tree.CreateProxy(instanceData.aabb[i], i);
+			else
+				instanceData.proxyID[i] = AABBTree::NULL_NODE;
 		}
 	}
 
@@ -734,61 +880,63 @@ namespace Engine
 	{
 		if (HasModel(e))
 		{
-			// To remove an entity we need to swap it with the last one, but, because there could be disabled entities at the end
-			// we need to first swap the entity to remove with the last ENABLED entity and then if there are any disabled entities, swap the entity to remove again,
-			// but this time with the last disabled entity.
+			// Enabled models are kept before the disabled ones. To remove an enabled model first swap it with the last enabled one and then
+			// remove that spot, which moves the last model, a disabled one if there are any, into it. Disabled models can be removed directly
 			unsigned int entityToRemoveIndex = map.at(e.id);
-			unsigned int lastEnabledEntityIndex = usedModels - disabledModels - 1;
-
-			ModelInstance entityToRemoveMi = models[entityToRemoveIndex];
-			ModelInstance lastEnabledEntityMi = models[lastEnabledEntityIndex];
+			Model *modelToRemove = instanceData.model[entityToRemoveIndex];
 
-			// Swap the entity to remove with the last enabled entity
-			models[lastEnabledEntityIndex] = entityToRemoveMi;
-			models[entityToRemoveIndex] = lastEnabledEntityMi;
-
-			// Now change the index of the last enabled entity, which is now in the spot of the entity to remove, to the entity to remove index
-			map[lastEnabledEntityMi.e.id] = entityToRemoveIndex;
-			map.erase(e.id);
-
-			// If there any disabled entities then swap the entity to remove, which is is the spot of the last enabled entity, with the last disabled entity
-			if (disabledModels > 0)
+			if (instanceData.proxyID[entityToRemoveIndex] != AABBTree::NULL_NODE)
 			{
-				entityToRemoveIndex = lastEnabledEntityIndex;			// The entity to remove is now in the spot of the last enabled entity
-				unsigned int lastDisabledEntityIndex = usedModels - 1;
+				tree.DestroyProxy(instanceData.proxyID[entityToRemoveIndex]);
+				instanceData.proxyID[entityToRemoveIndex] = AABBTree::NULL_NODE;
+			}
 
-				ModelInstance lastDisabledEntityMi = models[lastDisabledEntityIndex];
+			const unsigned int numEnabledModels = usedModels - disabledModels;
 
-				models[lastDisabledEntityIndex] = entityToRemoveMi;
-				models[entityToRemoveIndex] = lastDisabledEntityMi;
+			if (entityToRemoveIndex < numEnabledModels)
+			{
+				SwapModels(entityToRemoveIndex, numEnabledModels - 1);
+				entityToRemoveIndex = numEnabledModels - 1;
+			}
+			else
+			{
+				disabledModels--;
+			}
 
-				map[lastDisabledEntityMi.e.id] = entityToRemoveIndex;
+			const unsigned int movedIndex = data.SwapRemove(entityToRemoveIndex);
+			if (movedIndex != entityToRemoveIndex)
+			{
+				map[instanceData.e[entityToRemoveIndex].id] = entityToRemoveIndex;
+				UpdateProxyIndex(entityToRemoveIndex);
 			}
 
-			if (entityToRemoveMi.model->GetType() == ModelType::ANIMATED)
+			map.erase(e.id);
+
+			if (modelToRemove->GetType() == ModelType::ANIMATED)
 			{
-				AnimatedModel *am = static_cast<AnimatedModel*>(entityToRemoveMi.model);
+				AnimatedModel *am = static_cast<AnimatedModel*>(modelToRemove);
 				am->RemoveBoneAttachments(*transformManager);
 				
 				for (auto it = animatedModels.begin(); it != animatedModels.end(); it++)
 				{
-					if ((*it) == entityToRemoveMi.model)
+					if ((*it) == modelToRemove)
 					{
 						animatedModels.erase(it);
-						delete entityToRemoveMi.model;
+						delete modelToRemove;
+						break;
 					}
 				}
 			}
-			else if (entityToRemoveMi.model->GetType() == ModelType::BASIC)
+			else if (modelToRemove->GetType() == ModelType::BASIC)
 			{
 				for (auto it = uniqueModels.begin(); it != uniqueModels.end(); it++)
 				{
-					if (it->second == entityToRemoveMi.model)
+					if (it->second == modelToRemove)
 					{
 						if (it->second->GetRefCount() == 1)		// Erase when there's only one reference
 							uniqueModels.erase(it);
 
-						entityToRemoveMi.model->RemoveReference();
+						modelToRemove->RemoveReference();
 						break;
 					}
 				}
@@ -800,7 +948,7 @@ namespace Engine
 
 	Model *ModelManager::GetModel(Entity e) const
 	{
-		return models[map.at(e.id)].model;
+		return instanceData.model[map.at(e.id)];
 	}
 
 	AnimatedModel *ModelManager::GetAnimatedModel(Entity e) const
@@ -817,7 +965,7 @@ namespace Engine
 
 	const AABB &ModelManager::GetAABB(Entity e) const
 	{
-		return models[map.at(e.id)].aabb;
+		return instanceData.aabb[map.at(e.id)];
 	}
 
 	bool ModelManager::HasModel(Entity e) const
@@ -837,40 +985,50 @@ namespace Engine
 	{
 		glm::vec3 dir = utils::GetRayDirection(point, camera);
 
-		//std::cout << dir.x << " " << dir.y << " " << dir.z << "\n";
-
 		float closestDist = 10000.0f;
 		int index = -1;
-		int objTested = 0;
 
-		const unsigned int numEnabledModels = usedModels - disabledModels;
+		// The tree gives us the models whose fat aabb is hit by the ray, test them with the real aabb
+		queryResults.clear();
+		tree.QueryRay(camera->GetPosition(), dir, queryResults);
 
-		for (size_t i = 0; i < numEnabledModels; i++)
+		for (size_t i = 0; i < queryResults.size(); i++)
 		{
-			objTested++;
+			const unsigned int modelIndex = queryResults[i];
 
-			if (utils::RayAABBIntersection(camera->GetPosition(), dir, models[i].aabb))
+			if (utils::RayAABBIntersection(camera->GetPosition(), dir, instanceData.aabb[modelIndex]))
 			{
-				float dist = glm::length2(camera->GetPosition() - glm::vec3(transformManager->GetLocalToWorld(models[i].e)[3]));
+				float dist = glm::length2(camera->GetPosition() - glm::vec3(transformManager->GetLocalToWorld(instanceData.e[modelIndex])[3]));
 
 				if (dist < closestDist)
 				{
 					closestDist = dist;
-					index = i;
-					outEntity = models[i].e;
+					index = queryResults[i];
+					outEntity = instanceData.e[modelIndex];
 				}
 			}
 		}
 
-		//std::cout << "Index: " << index << "\n";
-		//std::cout << "Obj tested: " << objTested << "\n";
-
 		if (index >= 0)
 			return true;
 		else
 			return false;
 	}
 
+	void ModelManager::QuerySphere(const glm::vec3 &center, float radius, std::vector<Entity> &outEntities)
+	{
+		queryResults.clear();
+		tree.QuerySphere(center, radius, queryResults);
+
+		for (size_t i = 0; i < queryResults.size(); i++)
+		{
+			const unsigned int modelIndex = queryResults[i];
+
+			if (utils::AABBSphereIntersection(instanceData.aabb[modelIndex], center, radius))
+				outEntities.push_back(instanceData.e[modelIndex]);
+		}
+	}
+
 	Model *ModelManager::LoadModel(const std::string &path, const std::vector<std::string> &matNames, bool isAnimated, bool isInstanced, bool loadVertexColors)
 	{
 		unsigned int id = SID(path);
@@ -927,7 +1085,8 @@ namespace Engine
 		int magic = 0;
 		s.Read(magic);
 
-		if (magic != 315)
+		// 315 are the old uncompressed animations, they get compressed when loaded
+		if (magic != 315 && magic != 316)
 		{
 			Log::Print(LogLevel::LEVEL_ERROR, "ERROR -> Unknown animation file: %s\n", path.c_str());
 			return nullptr;
@@ -946,15 +1105,24 @@ namespace Engine
 
 		std::string boneName;
 		unsigned int numKeyframes = 0;
+		KeyFrameList keyframes;
 
 		for (size_t i = 0; i < size; i++)
 		{
 			s.Read(boneName);
-			s.Read(numKeyframes);
-			KeyFrameList keyframes(numKeyframes);
-			s.Read(keyframes.data(), numKeyframes * sizeof(Keyframe));
 
-			a->bonesKeyframesList[boneName] = keyframes;
+			if (magic == 316)
+			{
+				animclip::ReadTrack(s, a->tracks[boneName]);
+			}
+			else
+			{
+				s.Read(numKeyframes);
+				keyframes.resize(numKeyframes);
+				s.Read(keyframes.data(), numKeyframes * sizeof(Keyframe));
+
+				animclip::CompressTrack(keyframes, a->tracks[boneName]);
+			}
 		}
 		s.Close();
 
@@ -1054,21 +1222,21 @@ namespace Engine
 		s.Write(disabledModels);
 		for (unsigned int i = 0; i < usedModels; i++)
 		{
-			const ModelInstance &mi = models[i];
-			s.Write(mi.e.id);
+			const Model *model = instanceData.model[i];
+			s.Write(instanceData.e[i].id);
 
-			ModelType type = mi.model->GetType();
+			ModelType type = model->GetType();
 			s.Write((int)type);
 
 			if (type == ModelType::BASIC)
 			{
-				s.Write(SID(mi.model->GetPath()));
+				s.Write(SID(model->GetPath()));
 			}
 			else if (type == ModelType::ANIMATED)
 			{
 				for (size_t j = 0; j < animatedModels.size(); j++)			// Stored animated models separately so we don't have to search for the index
 				{
-					if (animatedModels[j] == mi.model)
+					if (animatedModels[j] == model)
 					{
 						s.Write(static_cast<unsigned int>(j));
 						break;
@@ -1077,7 +1245,7 @@ namespace Engine
 			}
 			else if (type == ModelType::PRIMITIVE_CUBE || type == ModelType::PRIMITIVE_SPHERE)
 			{
-				mi.model->Serialize(s);
+				model->Serialize(s);
 			}
 		}
 	}
@@ -1121,11 +1289,13 @@ namespace Engine
 
 			s.Read(usedModels);
 			s.Read(disabledModels);
-			models.resize(usedModels);
+			data.Clear();
+			data.Resize(usedModels);
+			UpdateInstanceDataPointers();
 
 			for (unsigned int i = 0; i < usedModels; i++)
 			{
-				ModelInstance mi;
+				ModelInstance mi = {};
 				s.Read(mi.e.id);
 
 				int type = 0;
@@ -1176,7 +1346,11 @@ namespace Engine
 					//mi.model->Deserialize(s, game, true);			// Use reload true so we don't load the model
 				}
 
-				models[i] = mi;
+				// The tree is rebuilt once everything is loaded
+				instanceData.e[i] = mi.e;
+				instanceData.model[i] = mi.model;
+				instanceData.aabb[i] = mi.aabb;
+				instanceData.proxyID[i] = AABBTree::NULL_NODE;
 				map[mi.e.id] = i;
 			}
 		}
@@ -1218,9 +1392,7 @@ namespace Engine
 				s.Read(eid);
 				unsigned int idx = map[eid];
 
-				ModelInstance &mi = models[idx];			// Check if idx is needed
-				mi.e.id = eid;
-				//s.Read(mi.e.id);
+				instanceData.e[idx].id = eid;			// Check if idx is needed
 
 				int type = 0;
 				s.Read(type);
@@ -1231,13 +1403,13 @@ namespace Engine
 				{
 					unsigned int id;
 					s.Read(id);
-					mi.model = uniqueModels[id];
+					instanceData.model[idx] = uniqueModels[id];
 				}
 				else if(modelType == ModelType::ANIMATED)
 				{
 					unsigned int index;
 					s.Read(index);
-					mi.model = animatedModels[index];
+					instanceData.model[idx] = animatedModels[index];
 				}
 				else if (modelType == ModelType::PRIMITIVE_CUBE || modelType == ModelType::PRIMITIVE_SPHERE)
 				{
@@ -1264,6 +1436,9 @@ namespace Engine
 				}
 			}
 		}
+
+		// The transforms were loaded without being marked as modified so build the tree from scratch
+		RebuildTree();
 	}
 
 	/*void ModelManager::LoadModelNew(unsigned int index, const std::string &path, const std::vector<std::string> &matNames, bool isInstanced, bool loadVertexColors)
@@ -2,6 +2,8 @@
 
 #include "Graphics/RendererStructs.h"
 #include "Physics/BoundingVolumes.h"
+#include "Physics/AABBTree.h"
+#include "ComponentArray.h"
 #include "Graphics/Animation/AnimatedModel.h"
 
 #include <unordered_map>
@@ -20,6 +22,7 @@ namespace Engine
 		//int type;
 		//unsigned int index;
 		AABB aabb;
+		int proxyID;		// Leaf in the models AABB tree. Disabled models are not in the tree
 	};
 
 	class ModelManager : public RenderQueueGenerator
@@ -33,6 +36,7 @@ namespace Engine
 		void Dispose();
 
 		void Cull(unsigned int passAndFrustumCount, unsigned int *passIds, const Frustum *frustums, std::vector<VisibilityIndices*> &out) override;
+		void PrepareRenderItems(unsigned int passCount, unsigned int *passIds, const std::vector<const VisibilityIndices*> &visibility) override;
 		void GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues) override;
 
 		Model *AddModel(Entity e, const std::string &path, bool animated = false);
@@ -52,6 +56,8 @@ namespace Engine
 		bool HasAnimatedModel(Entity e) const;
 
 		bool PerformRaycast(Camera *camera, const glm::vec2 &point, Entity &outEntity);
+		// Returns the enabled entities whose model AABB overlaps the sphere
+		void QuerySphere(const glm::vec3 &center, float radius, std::vector<Entity> &outEntities);
 		
 		Animation *LoadAnimation(const std::string &path);
 
@@ -60,12 +66,16 @@ namespace Engine
 
 		const std::map<unsigned int, Model*> &GetUniqueModels() const { return uniqueModels; }
 		const std::map<unsigned int, Animation*> &GetAnimations() const { return animations; }
-		const std::vector<ModelInstance> &GetModels() const { return models; }
+		// Enabled models come first, then the disabled ones
+		unsigned int GetModelCount() const { return usedModels; }
+		Model *GetModelAt(unsigned int index) const { return instanceData.model[index]; }
 
 		void Serialize(Serializer &s, bool playMode = false);
 		void Deserialize(Serializer &s, bool playMode = false);
 
 	private:
+		static const unsigned int AABB_JOB_GROUP_SIZE = 256;
+
 		Model *LoadModel(const std::string &path, const std::vector<std::string> &matNames, bool isAnimated, bool isInstanced = false, bool loadVertexColors = false);
 		Model *LoadModel(const Mesh &mesh, MaterialInstance *mat, const AABB &aabb);
 		Mesh LoadPrimitive(ModelType type);
@@ -73,36 +83,47 @@ namespace Engine
 		//Mesh ProcessMesh(unsigned int index, const aiMesh *aimesh, const aiScene *aiscene, bool isInstanced, bool loadVertexColors);
 
 		void InsertModelInstance(const ModelInstance &mi);
+		// Swaps two models in the storage and fixes the map and the tree leafs that point to them
+		void SwapModels(unsigned int a, unsigned int b);
+		void UpdateProxyIndex(unsigned int index);
+		void UpdateInstanceDataPointers();
+		void RebuildTree();
+		// Recomputes the aabb and moves the tree proxy of the models in the hierarchy of the entity
+		void RefitHierarchy(Entity root);
 
 	private:
-		struct ModelS
+		enum ModelsDataColumn
 		{
-			std::vector<MeshMaterial> meshes;
+			MODEL_ENTITY,
+			MODEL_MODEL,
+			MODEL_AABB,
+			MODEL_PROXY_ID
 		};
 
-		struct ModelsData
-		{
-			unsigned int size;
-			unsigned int capacity;
-			unsigned char *buffer;
+		typedef ComponentArray<Entity, Model*, AABB, int> ModelsData;
 
+		// Named view of the models columns. The pointers change when the storage grows
+		struct ModelsInstanceData
+		{
 			Entity *e;
-			ModelS *model;
-			unsigned int *pathIndex;
-			bool *castShadows;
-			float *lodDistance;
-			AABB *originalAABB;
-			AABB *worldSpaceAABB;
+			Model **model;
+			AABB *aabb;
+			int *proxyID;
 		};
 
 		Game *game;
 		TransformManager *transformManager;
-		std::vector<ModelInstance> models;
 		std::unordered_map<unsigned int, unsigned int> map;
+		AABBTree tree;
+		std::vector<unsigned int> queryResults;
+		std::vector<unsigned int> modifiedModels;
+		std::vector<unsigned int> visibleAnimatedModels;
+		std::vector<Entity> refitStack;
 		unsigned int usedModels;
 		unsigned int disabledModels;
 
-		ModelsData data;
+		ModelsData data;			// Packed, the size is always usedModels
+		ModelsInstanceData instanceData;
 		//std::vector<std::string> paths;
 
 		std::map<unsigned int, Model*> uniqueModels;
@@ -3,7 +3,12 @@
 #include "Graphics/ParticleSystem.h"
 #include "Game/Game.h"
 #include "Graphics/Material.h"
+#include "Graphics/Renderer.h"
+#include "Graphics/Buffers.h"
+#include "Graphics/MeshDefaults.h"
+#include "Graphics/VertexArray.h"
 #include "Program/Log.h"
+#include "Program/JobSystem.h"
 
 namespace Engine
 {
@@ -15,6 +20,10 @@ namespace Engine
 		this->game = game;
 		transformManager = &game->GetTransformManager();
 
+		particleSystemPool.Init(game->GetAllocator(), sizeof(ParticleSystem), PARTICLE_SYSTEMS_PER_CHUNK, MemoryTag::PARTICLES);
+
+		InitGPUParticles();
+
 		Log::Print(LogLevel::LEVEL_INFO, "Init Particle manager\n");
 	}
 
@@ -22,9 +31,15 @@ namespace Engine
 	{
 		for (size_t i = 0; i < usedParticleSystems; i++)
 		{
-			delete particleSystems[i].ps;
+			if (particleSystems[i].ps->IsGPUSimulated())
+				RemoveGPUParticleSystem(particleSystems[i].ps);
+
+			particleSystemPool.Delete(particleSystems[i].ps);
 		}
 		particleSystems.clear();
+		particleSystemPool.Dispose();
+
+		DisposeGPUParticles();
 
 		Log::Print(LogLevel::LEVEL_INFO, "Disposing Particle manager\n");
 	}
@@ -49,22 +64,129 @@ namespace Engine
 		}
 	}
 
-	void ParticleManager::GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues)
+	void ParticleManager::PrepareRenderItems(unsigned int passCount, unsigned int *passIds, const std::vector<const VisibilityIndices*> &visibility)
 	{
-		float dt = game->GetDeltaTime();
 		const unsigned int numEnabledPS = usedParticleSystems - disabledParticleSystems;
 
-		for (size_t i = 0; i < numEnabledPS; i++)
+		// Only the particle systems visible in at least one pass are simulated
+		renderStates.assign(numEnabledPS, NOT_VISIBLE);
+		visibleSystems.clear();
+
+		for (unsigned int i = 0; i < passCount; i++)
 		{
-			const ParticleInstance &pi = particleSystems[i];
-			ParticleSystem *ps = pi.ps;
+			const VisibilityIndices &v = *visibility[i];
+
+			for (size_t j = 0; j < v.size(); j++)
+			{
+				if (renderStates[v[j]] == NOT_VISIBLE)
+				{
+					renderStates[v[j]] = VISIBLE;
+					visibleSystems.push_back(v[j]);
+				}
+			}
+		}
+
+		gpuDispatchSlots.clear();
+
+		if (visibleSystems.size() == 0)
+			return;
+
+		const float dt = game->GetDeltaTime();
+
+		// Resolve everything once so the jobs only read the transforms
+		transformManager->UpdateWorldTransforms(&game->GetJobSystem());
+		const TransformManager *transforms = transformManager;
+
+		auto simulate = [this, transforms, dt](unsigned int start, unsigned int end)
+		{
+			for (unsigned int i = start; i < end; i++)
+			{
+				const ParticleInstance &pi = particleSystems[visibleSystems[i]];
+				if (pi.ps->IsGPUSimulated())
+					continue;
+
+				pi.ps->SetPosition(transforms->GetLocalToWorld(pi.e)[3]);
+				pi.ps->Update(dt);
+			}
+		};
+
+		JobSystem &jobSystem = game->GetJobSystem();
+		if (jobSystem.GetNumThreads() > 1 && visibleSystems.size() > 1)
+		{
+			JobCounter counter;
+			jobSystem.ParallelFor(static_cast<unsigned int>(visibleSystems.size()), 4, simulate, &counter);
+			jobSystem.Wait(&counter);
+		}
+		else
+		{
+			simulate(0, static_cast<unsigned int>(visibleSystems.size()));
+		}
+
+		// Uploading the instance data has to be done on the main thread
+		unsigned int gpuSystemsCount = 0;
+
+		for (size_t i = 0; i < visibleSystems.size(); i++)
+		{
+			const ParticleInstance &pi = particleSystems[visibleSystems[i]];
+
+			if (pi.ps->IsGPUSimulated())
+			{
+				if (PrepareGPUParticleSystem(pi, dt))
+				{
+					renderStates[visibleSystems[i]] = READY;
+					gpuSystemsCount = glm::max(gpuSystemsCount, pi.ps->gpuSlot + 1);
+				}
+			}
+			else if (pi.ps->PrepareRender(transformManager->GetLocalToWorld(pi.e)))
+			{
+				renderStates[visibleSystems[i]] = READY;
+			}
+		}
 
-			const glm::mat4 &localToWorld = transformManager->GetLocalToWorld(pi.e);
+		// One upload for the parameters of all the gpu systems
+		if (gpuSystemsCount > 0)
+		{
+			gpuSystemsSSBO->Update(gpuSystemsData, gpuSystemsCount * sizeof(GPUParticleSystemData), 0);
+			gpuFrame++;
+		}
+	}
 
-			ps->SetPosition(localToWorld[3]);
+	void ParticleManager::GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues)
+	{
+		for (size_t i = 0; i < visibility.size(); i++)
+		{
+			if (renderStates[visibility[i]] != READY)
+				continue;
+
+			ParticleSystem *ps = particleSystems[visibility[i]].ps;
+
+			if (ps->IsGPUSimulated())
+			{
+				const GPUParticleSystem &gs = gpuSystems[ps->gpuSlot];
+
+				const std::vector<ShaderPass> &passes = gs.matInstance->baseMaterial->GetShaderPasses();
+				for (size_t j = 0; j < passCount; j++)
+				{
+					for (size_t k = 0; k < passes.size(); k++)
+					{
+						if (passIds[j] == passes[k].queueID)
+						{
+							// The instance count is written by the simulation compute shader
+							RenderItem ri = {};
+							ri.mesh = &gpuQuadMesh;
+							ri.matInstance = gs.matInstance;
+							ri.shaderPass = k;
+							ri.materialData = &gs.drawData;
+							ri.materialDataSize = sizeof(gs.drawData);
+							ri.indirectBuffer = gpuIndirectBuffer;
+							ri.indirectOffset = ps->gpuSlot * 5 * sizeof(unsigned int);
 
-			bool renderPrepared = false;
-			bool submit = false;
+							outQueues.push_back(ri);
+						}
+					}
+				}
+				continue;
+			}
 
 			const Mesh &mesh = ps->GetMesh();
 			MaterialInstance *matInstance = ps->GetMaterialInstance();
@@ -76,28 +198,18 @@ namespace Engine
 				{
 					if (passIds[j] == passes[k].queueID)
 					{
-						if (!renderPrepared)
-						{
-							ps->Update(dt);
-							submit = ps->PrepareRender(localToWorld);
-							renderPrepared = true;
-						}
-
-						if (submit)
-						{
-							RenderItem ri = {};
-							ri.mesh = &mesh;
-							ri.matInstance = matInstance;
-							ri.shaderPass = k;
+						RenderItem ri = {};
+						ri.mesh = &mesh;
+						ri.matInstance = matInstance;
+						ri.shaderPass = k;
 
-							glm::vec4 &params = ps->GetParams();
+						glm::vec4 &params = ps->GetParams();
 
-							ri.materialData = &params;
-							ri.materialDataSize = sizeof(params);
+						ri.materialData = &params;
+						ri.materialDataSize = sizeof(params);
 
-							//outQueues[j].push_back(ri);
-							outQueues.push_back(ri);
-						}
+						//outQueues[j].push_back(ri);
+						outQueues.push_back(ri);
 					}
 				}
 			}
@@ -109,7 +221,7 @@ namespace Engine
 		if (map.find(e.id) != map.end())
 			return particleSystems[map.at(e.id)].ps;
 
-		ParticleSystem *ps = new ParticleSystem();
+		ParticleSystem *ps = particleSystemPool.New<ParticleSystem>();
 		ps->Init(game, "Data/Resources/Materials/particlesDefault.mat");
 		ps->SetColor(glm::vec4(1.0f, 1.0f, 1.0f, 0.0f));
 		ps->SetSize(1.0f);
@@ -193,7 +305,7 @@ namespace Engine
 
 		const ParticleSystem *ps = GetParticleSystem(e);
 
-		ParticleSystem *newPS = new ParticleSystem();
+		ParticleSystem *newPS = particleSystemPool.New<ParticleSystem>();
 		newPS->Init(game, ps->GetMaterialInstance()->path);
 		newPS->Create(ps->GetMaxParticles());
 		newPS->SetSize(ps->GetSize());
@@ -238,12 +350,20 @@ namespace Engine
 		std::string matPath;
 		s.Read(matPath);
 
-		pi.ps = new ParticleSystem();
+		pi.ps = particleSystemPool.New<ParticleSystem>();
 		pi.ps->Deserialize(s);
 		pi.ps->Init(game, matPath);
 		pi.ps->Create(pi.ps->GetMaxParticles());
 
+		// Prefabs older than patch 6 don't have the flag
+		bool gpuSimulated = false;
+		if (s.GetPatchVersion() >= 6)
+			s.Read(gpuSimulated);
+
 		InsertParticleSystem(pi);
+
+		if (gpuSimulated)
+			SetParticleSystemGPUSimulated(e, true);
 	}
 
 	void ParticleManager::InsertParticleSystem(const ParticleInstance &pi)
@@ -316,7 +436,10 @@ namespace Engine
 				map[lastDisabledEntityPi.e.id] = entityToRemoveIndex;
 			}
 
-			delete entityToRemovePi.ps;
+			if (entityToRemovePi.ps->IsGPUSimulated())
+				RemoveGPUParticleSystem(entityToRemovePi.ps);
+
+			particleSystemPool.Delete(entityToRemovePi.ps);
 			usedParticleSystems--;
 		}
 	}
@@ -326,6 +449,378 @@ namespace Engine
 		return map.find(e.id) != map.end();
 	}
 
+	bool ParticleManager::SetParticleSystemGPUSimulated(Entity e, bool gpu)
+	{
+		if (!HasParticleSystem(e))
+			return false;
+
+		ParticleSystem *ps = GetParticleSystem(e);
+
+		if (ps->IsGPUSimulated() == gpu)
+			return true;
+
+		if (gpu)
+		{
+			if (!SupportsGPUParticles())
+			{
+				Log::Print(LogLevel::LEVEL_WARNING, "GPU particles are not supported by the renderer\n");
+				return false;
+			}
+
+			ps->SetGPUSimulated(true);
+
+			if (!AddGPUParticleSystem(ps))
+			{
+				ps->SetGPUSimulated(false);
+				return false;
+			}
+		}
+		else
+		{
+			RemoveGPUParticleSystem(ps);
+			ps->SetGPUSimulated(false);
+		}
+
+		return true;
+	}
+
+	void ParticleManager::InitGPUParticles()
+	{
+		gpuParticlesSSBO = nullptr;
+		gpuAliveListSSBO = nullptr;
+		gpuSystemsSSBO = nullptr;
+		gpuIndirectBuffer = nullptr;
+		gpuSimMat = nullptr;
+		gpuResetPass = 0;
+		gpuSimulatePass = 0;
+		gpuQuadMesh = {};
+		gpuFrame = 0;
+
+		for (unsigned int i = 0; i < MAX_GPU_PARTICLE_SYSTEMS; i++)
+		{
+			gpuSystems[i] = {};
+			gpuSystemsData[i] = {};
+		}
+
+		Renderer *renderer = game->GetRenderer();
+
+		// Renderers without compute shaders don't create the buffers. The D3D11 renderer creates SSBOs but has no compute or indirect draws
+		if (Renderer::GetCurrentAPI() == GraphicsAPI::D3D11)
+			return;
+
+		gpuParticlesSSBO = renderer->CreateSSBO(MAX_GPU_PARTICLES * 4 * sizeof(glm::vec4), nullptr, 4 * sizeof(glm::vec4), BufferUsage::STATIC);
+		if (!gpuParticlesSSBO)
+			return;
+
+		gpuParticlesSSBO->AddReference();
+
+		gpuAliveListSSBO = renderer->CreateSSBO(MAX_GPU_PARTICLES * sizeof(unsigned int), nullptr, sizeof(unsigned int), BufferUsage::STATIC);
+		gpuAliveListSSBO->AddReference();
+
+		gpuSystemsSSBO = renderer->CreateSSBO(sizeof(gpuSystemsData), gpuSystemsData, sizeof(GPUParticleSystemData), BufferUsage::DYNAMIC);
+		gpuSystemsSSBO->AddReference();
+
+		struct DrawElementsIndirectCommand
+		{
+			unsigned int indexCount;
+			unsigned int instanceCount;
+			unsigned int firstIndex;
+			unsigned int baseVertex;
+			unsigned int baseInstance;
+		};
+
+		DrawElementsIndirectCommand cmds[MAX_GPU_PARTICLE_SYSTEMS] = {};
+		for (unsigned int i = 0; i < MAX_GPU_PARTICLE_SYSTEMS; i++)
+			cmds[i].indexCount = 6;
+
+		gpuIndirectBuffer = renderer->CreateDrawIndirectBuffer(sizeof(cmds), cmds);
+		gpuIndirectBuffer->AddReference();
+
+		gpuQuadMesh = MeshDefaults::CreateQuad(renderer);
+
+		GPUParticleRange range = {};
+		range.first = 0;
+		range.count = MAX_GPU_PARTICLES;
+		gpuFreeRanges.push_back(range);
+	}
+
+	void ParticleManager::DisposeGPUParticles()
+	{
+		if (gpuQuadMesh.vao)
+		{
+			delete gpuQuadMesh.vao;
+			gpuQuadMesh.vao = nullptr;
+		}
+
+		if (gpuSimMat)
+		{
+			game->GetRenderer()->RemoveMaterialInstance(gpuSimMat);
+			gpuSimMat = nullptr;
+		}
+
+		Buffer **buffers[] = { &gpuParticlesSSBO, &gpuAliveListSSBO, &gpuSystemsSSBO, &gpuIndirectBuffer };
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			if (*buffers[i])
+			{
+				(*buffers[i])->RemoveReference();
+				*buffers[i] = nullptr;
+			}
+		}
+
+		gpuFreeRanges.clear();
+		gpuDispatchSlots.clear();
+	}
+
+	void ParticleManager::CreateGPUParticlesMat()
+	{
+		if (!SupportsGPUParticles() || gpuSimMat)
+			return;
+
+		gpuSimMat = game->GetRenderer()->CreateMaterialInstanceFromBaseMat(game->GetScriptManager(), "Data/Resources/Materials/particles_gpu_sim_mat.lua", {});
+		gpuResetPass = gpuSimMat->baseMaterial->GetShaderPassIndex("reset");
+		gpuSimulatePass = gpuSimMat->baseMaterial->GetShaderPassIndex("simulate");
+	}
+
+	bool ParticleManager::AddGPUParticleSystem(ParticleSystem *ps)
+	{
+		unsigned int slot = MAX_GPU_PARTICLE_SYSTEMS;
+		for (unsigned int i = 0; i < MAX_GPU_PARTICLE_SYSTEMS; i++)
+		{
+			if (!gpuSystems[i].ps)
+			{
+				slot = i;
+				break;
+			}
+		}
+
+		if (slot == MAX_GPU_PARTICLE_SYSTEMS)
+		{
+			Log::Print(LogLevel::LEVEL_WARNING, "Can't simulate more than %u particle systems on the gpu\n", MAX_GPU_PARTICLE_SYSTEMS);
+			return false;
+		}
+
+		unsigned int first = 0;
+		if (!AllocateGPUParticles(ps->maxParticles, first))
+		{
+			Log::Print(LogLevel::LEVEL_WARNING, "Not enough space in the gpu particles pool for %u particles\n", ps->maxParticles);
+			return false;
+		}
+
+		Renderer *renderer = game->GetRenderer();
+
+		GPUParticleSystem &gs = gpuSystems[slot];
+		gs.ps = ps;
+		gs.firstParticle = first;
+		gs.maxParticles = ps->maxParticles;
+		gs.emitCursor = 0;
+		gs.reset = true;
+		gs.matInstance = renderer->CreateMaterialInstanceFromBaseMat(game->GetScriptManager(), "Data/Resources/Materials/particles_gpu_mat.lua", gpuQuadMesh.vao->GetVertexInputDescs());
+
+		// Draw with the particle system's texture
+		const MaterialInstance *psMat = ps->GetMaterialInstance();
+		if (psMat->textures.size() > 0 && gs.matInstance->textures.size() > 0)
+		{
+			gs.matInstance->textures[0] = psMat->textures[0];
+			renderer->UpdateMaterialInstance(gs.matInstance);
+		}
+
+		ps->gpuSlot = slot;
+
+		return true;
+	}
+
+	void ParticleManager::RemoveGPUParticleSystem(ParticleSystem *ps)
+	{
+		if (ps->gpuSlot >= MAX_GPU_PARTICLE_SYSTEMS)
+			return;
+
+		GPUParticleSystem &gs = gpuSystems[ps->gpuSlot];
+
+		FreeGPUParticles(gs.firstParticle, gs.maxParticles);
+
+		// The texture belongs to the particle system's material
+		if (gs.matInstance)
+			game->GetRenderer()->RemoveMaterialInstance(gs.matInstance);
+
+		gs = {};
+		ps->gpuSlot = ~0u;
+	}
+
+	bool ParticleManager::AllocateGPUParticles(unsigned int count, unsigned int &first)
+	{
+		if (count == 0)
+		{
+			first = 0;
+			return true;
+		}
+
+		// First fit, the ranges are kept sorted so the start of the pool is reused first
+		for (size_t i = 0; i < gpuFreeRanges.size(); i++)
+		{
+			GPUParticleRange &r = gpuFreeRanges[i];
+
+			if (r.count >= count)
+			{
+				first = r.first;
+				r.first += count;
+				r.count -= count;
+
+				if (r.count == 0)
+					gpuFreeRanges.erase(gpuFreeRanges.begin() + i);
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void ParticleManager::FreeGPUParticles(unsigned int first, unsigned int count)
+	{
+		if (count == 0)
+			return;
+
+		size_t i = 0;
+		while (i < gpuFreeRanges.size() && gpuFreeRanges[i].first < first)
+			i++;
+
+		GPUParticleRange range = {};
+		range.first = first;
+		range.count = count;
+		gpuFreeRanges.insert(gpuFreeRanges.begin() + i, range);
+
+		// Merge with the next and the previous range
+		if (i + 1 < gpuFreeRanges.size() && gpuFreeRanges[i].first + gpuFreeRanges[i].count == gpuFreeRanges[i + 1].first)
+		{
+			gpuFreeRanges[i].count += gpuFreeRanges[i + 1].count;
+			gpuFreeRanges.erase(gpuFreeRanges.begin() + i + 1);
+		}
+		if (i > 0 && gpuFreeRanges[i - 1].first + gpuFreeRanges[i - 1].count == gpuFreeRanges[i].first)
+		{
+			gpuFreeRanges[i - 1].count += gpuFreeRanges[i].count;
+			gpuFreeRanges.erase(gpuFreeRanges.begin() + i);
+		}
+	}
+
+	bool ParticleManager::PrepareGPUParticleSystem(const ParticleInstance &pi, float dt)
+	{
+		ParticleSystem *ps = pi.ps;
+		const unsigned int slot = ps->gpuSlot;
+		GPUParticleSystem &gs = gpuSystems[slot];
+
+		// The max particles can change after the range was assigned, eg when the system is deserialized
+		if (ps->maxParticles != gs.maxParticles)
+		{
+			FreeGPUParticles(gs.firstParticle, gs.maxParticles);
+
+			if (!AllocateGPUParticles(ps->maxParticles, gs.firstParticle))
+			{
+				Log::Print(LogLevel::LEVEL_WARNING, "Not enough space in the gpu particles pool for %u particles, simulating the particle system on the cpu\n", ps->maxParticles);
+				gs.maxParticles = 0;
+				RemoveGPUParticleSystem(ps);
+				ps->SetGPUSimulated(false);
+				return false;
+			}
+
+			gs.maxParticles = ps->maxParticles;
+			gs.emitCursor = 0;
+			gs.reset = true;
+		}
+
+		const glm::mat4 &transform = transformManager->GetLocalToWorld(pi.e);
+
+		ps->SetPosition(transform[3]);
+		unsigned int spawnCount = ps->UpdateGPU(dt);
+
+		if (!ps->playing || gs.maxParticles == 0)
+			return false;
+
+		if (spawnCount > gs.maxParticles)
+			spawnCount = gs.maxParticles;
+
+		GPUParticleSystemData &data = gpuSystemsData[slot];
+		data.transform = transform;
+		data.transform[0] = glm::normalize(data.transform[0]);
+		data.transform[1] = glm::normalize(data.transform[1]);
+		data.transform[2] = glm::normalize(data.transform[2]);
+		data.firstParticle = gs.firstParticle;
+		data.maxParticles = gs.maxParticles;
+		data.emitStart = gs.emitCursor;
+		data.emitCount = spawnCount;
+		data.reset = gs.reset ? 1 : 0;
+		data.seed = gpuFrame * MAX_GPU_PARTICLE_SYSTEMS + slot;
+		data.simParams = glm::vec4(dt, ps->startLifeTime, -9.8f * ps->gravityModifier * dt, ps->fadeAlphaOverLifetime ? 1.0f : 0.0f);
+		data.limitParams = glm::vec4(ps->speedLimit, ps->speedLimit / ps->dampen, ps->limitVelocity ? 1.0f : 0.0f, 0.0f);
+		data.emissionCenter = glm::vec4(ps->center, 0.0f);
+		data.emissionBox = glm::vec4(ps->emissionBox, 0.0f);
+		data.velocityLow = glm::vec4(ps->useRandomVelocity ? ps->velocityLow : ps->startVelocity, 0.0f);
+		data.velocityHigh = glm::vec4(ps->useRandomVelocity ? ps->velocityHigh : ps->startVelocity, 0.0f);
+		data.startColor = ps->startColor;
+		data.atlas = glm::vec4(ps->atlasInfo.nColumns, ps->atlasInfo.nRows, ps->atlasInfo.cycles, ps->useAtlas ? 1.0f : 0.0f);
+
+		gs.emitCursor = (gs.emitCursor + spawnCount) % gs.maxParticles;
+		gs.reset = false;
+
+		gs.drawData.params = ps->GetParams();
+		gs.drawData.slot = slot;
+		gs.drawData.firstParticle = gs.firstParticle;
+
+		gpuDispatchSlots.push_back(slot);
+
+		return true;
+	}
+
+	void ParticleManager::DispatchGPUParticles()
+	{
+		if (gpuDispatchSlots.size() == 0 || !gpuSimMat)
+			return;
+
+		static const unsigned int groupSize = 64;		// Same as the local size of the compute shaders
+
+		Renderer *renderer = game->GetRenderer();
+
+		// Set the instance count of every draw command to zero, the simulation then adds each alive particle to it
+		const glm::uvec4 resetParams = glm::uvec4(MAX_GPU_PARTICLE_SYSTEMS, 0, 0, 0);
+
+		DispatchItem item = {};
+		item.numGroupsX = (MAX_GPU_PARTICLE_SYSTEMS + groupSize - 1) / groupSize;
+		item.numGroupsY = 1;
+		item.numGroupsZ = 1;
+		item.matInstance = gpuSimMat;
+		item.shaderPass = gpuResetPass;
+		item.materialData = &resetParams;
+		item.materialDataSize = sizeof(resetParams);
+
+		renderer->Dispatch(item);
+
+		BarrierBuffer bb = {};
+		bb.buffer = gpuIndirectBuffer;
+		bb.readToWrite = false;
+
+		Barrier b = {};
+		b.buffers.push_back(bb);
+		b.srcStage = PipelineStage::COMPUTE;
+		b.dstStage = PipelineStage::COMPUTE;
+
+		renderer->PerformBarrier(b);
+
+		// Each system only touches its own range of the pool so the dispatches don't need barriers between them
+		item.shaderPass = gpuSimulatePass;
+
+		for (size_t i = 0; i < gpuDispatchSlots.size(); i++)
+		{
+			const unsigned int slot = gpuDispatchSlots[i];
+			const glm::uvec4 simParams = glm::uvec4(slot, 0, 0, 0);
+
+			item.numGroupsX = (gpuSystems[slot].maxParticles + groupSize - 1) / groupSize;
+			item.materialData = &simParams;
+			item.materialDataSize = sizeof(simParams);
+
+			renderer->Dispatch(item);
+		}
+	}
+
 	void ParticleManager::Serialize(Serializer &s, bool playMode)
 	{
 		// Store the map, otherwise we have problems with play/stop when we enable/disable entities
@@ -346,6 +841,7 @@ namespace Engine
 			const ParticleInstance &pi = particleSystems[i];
 			s.Write(pi.e.id);
 			pi.ps->Serialize(s);
+			s.Write(pi.ps->IsGPUSimulated());
 		}
 	}
 
@@ -365,13 +861,21 @@ namespace Engine
 				s.Read(pi.e.id);
 
 				s.Read(matPath);
-				pi.ps = new ParticleSystem();
+				pi.ps = particleSystemPool.New<ParticleSystem>();
 				pi.ps->Deserialize(s);
 				pi.ps->Init(game, matPath);
 				pi.ps->Create(pi.ps->GetMaxParticles());
 
 				particleSystems[i] = pi;
 				map[pi.e.id] = i;
+
+				// Older scenes don't store where the particles are simulated
+				bool gpuSimulated = false;
+				if (s.GetPatchVersion() >= 6)
+					s.Read(gpuSimulated);
+
+				if (gpuSimulated)
+					SetParticleSystemGPUSimulated(pi.e, true);
 			}
 		}
 		else
@@ -401,6 +905,10 @@ namespace Engine
 				ParticleInstance &pi = particleSystems[idx];
 				pi.e.id = eid;
 				pi.ps->Deserialize(s);
+
+				bool gpuSimulated = false;
+				s.Read(gpuSimulated);
+				SetParticleSystemGPUSimulated(pi.e, gpuSimulated);
 			}		
 		}
 	}
@@ -2,6 +2,10 @@
 
 #include "Game/EntityManager.h"
 #include "Graphics/RendererStructs.h"
+#include "Graphics/Mesh.h"
+#include "Program/PoolAllocator.h"
+
+#include "include/glm/glm.hpp"
 
 #include <vector>
 #include <unordered_map>
@@ -11,6 +15,8 @@ namespace Engine
 	class ParticleSystem;
 	class Game;
 	class TransformManager;
+	class Buffer;
+	struct MaterialInstance;
 
 	struct ParticleInstance
 	{
@@ -18,6 +24,32 @@ namespace Engine
 		ParticleSystem *ps;
 	};
 
+	// Mirrors GPUParticleSystem in Data/Shaders/<API>/include/gpu_particles.glsl (std430)
+	struct GPUParticleSystemData
+	{
+		glm::mat4 transform;				// Particle system transform without the scale
+		unsigned int firstParticle;
+		unsigned int maxParticles;
+		unsigned int emitStart;
+		unsigned int emitCount;
+		unsigned int reset;					// Kills every particle in the range before emitting, set when the range is assigned to the system
+		unsigned int seed;
+		unsigned int pad[2];
+		glm::vec4 simParams;				// x - delta time, y - life time, z - gravity velocity change, w - fade alpha over lifetime
+		glm::vec4 limitParams;				// x - speed limit, y - speed limit / dampen, z - limit velocity
+		glm::vec4 emissionCenter;
+		glm::vec4 emissionBox;
+		glm::vec4 velocityLow;
+		glm::vec4 velocityHigh;
+		glm::vec4 startColor;
+		glm::vec4 atlas;					// x - columns, y - rows, z - cycles, w - use atlas
+	};
+
+	// Particle systems simulated in a compute shader share one pool of particles. Each system gets a range of the pool and the compute shader
+	// writes the alive particles of each range to a list and their count to the system's indirect draw command, so nothing is read back
+	static const unsigned int MAX_GPU_PARTICLES = 32768;
+	static const unsigned int MAX_GPU_PARTICLE_SYSTEMS = 64;
+
 	class ParticleManager : public RenderQueueGenerator
 	{
 	public:
@@ -25,6 +57,7 @@ namespace Engine
 		void Dispose();
 
 		void Cull(unsigned int passAndFrustumCount, unsigned int *passIds, const Frustum *frustums, std::vector<VisibilityIndices*> &out) override;
+		void PrepareRenderItems(unsigned int passCount, unsigned int *passIds, const std::vector<const VisibilityIndices*> &visibility) override;
 		void GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues) override;
 
 		ParticleSystem *AddParticleSystem(Entity e);
@@ -34,19 +67,91 @@ namespace Engine
 		void LoadParticleSystemFromPrefab(Serializer &s, Entity e);
 		void RemoveParticleSystem(Entity e);
 		bool HasParticleSystem(Entity e) const;
+		// Moves the simulation of the particle system to a compute shader. Returns false if the renderer doesn't support it or the gpu pool is full
+		bool SetParticleSystemGPUSimulated(Entity e, bool gpu);
+
+		// Called by the gpu particles compute pass
+		void CreateGPUParticlesMat();
+		void DispatchGPUParticles();
+		// False on renderers without compute shaders and on D3D11
+		bool SupportsGPUParticles() const { return gpuParticlesSSBO != nullptr; }
+		Buffer *GetGPUParticlesBuffer() const { return gpuParticlesSSBO; }
+		Buffer *GetGPUParticlesAliveListBuffer() const { return gpuAliveListSSBO; }
+		Buffer *GetGPUParticleSystemsBuffer() const { return gpuSystemsSSBO; }
+		Buffer *GetGPUParticlesIndirectBuffer() const { return gpuIndirectBuffer; }
 
 		void Serialize(Serializer &s, bool playMode = false);
 		void Deserialize(Serializer &s, bool playMode = false);
 
 	private:
+		static const unsigned int PARTICLE_SYSTEMS_PER_CHUNK = 16;
+
+		enum RenderState : unsigned char
+		{
+			NOT_VISIBLE,
+			VISIBLE,
+			READY
+		};
+
 		void InsertParticleSystem(const ParticleInstance &pi);
 
+		void InitGPUParticles();
+		void DisposeGPUParticles();
+		bool AddGPUParticleSystem(ParticleSystem *ps);
+		void RemoveGPUParticleSystem(ParticleSystem *ps);
+		bool AllocateGPUParticles(unsigned int count, unsigned int &first);
+		void FreeGPUParticles(unsigned int first, unsigned int count);
+		bool PrepareGPUParticleSystem(const ParticleInstance &pi, float dt);
+
+		struct GPUParticleRange
+		{
+			unsigned int first;
+			unsigned int count;
+		};
+
+		struct GPUParticleDrawData
+		{
+			glm::vec4 params;				// Same as the cpu particles material data
+			unsigned int slot;
+			unsigned int firstParticle;
+			unsigned int pad[2];
+		};
+
+		struct GPUParticleSystem
+		{
+			ParticleSystem *ps;
+			MaterialInstance *matInstance;		// Draws the particles from the pool with the texture of the system's material
+			unsigned int firstParticle;
+			unsigned int maxParticles;
+			unsigned int emitCursor;			// Particles are emitted in a ring over the system's range, so the oldest ones are replaced first
+			bool reset;
+			GPUParticleDrawData drawData;
+		};
+
 	private:
 		Game *game;
 		TransformManager *transformManager;
 		std::vector<ParticleInstance> particleSystems;
+		PoolAllocator particleSystemPool;
 		std::unordered_map<unsigned int, unsigned int> map;
 		unsigned int usedParticleSystems;
 		unsigned int disabledParticleSystems;
+		std::vector<unsigned char> renderStates;
+		std::vector<unsigned int> visibleSystems;
+
+		// GPU particles
+		Buffer *gpuParticlesSSBO;
+		Buffer *gpuAliveListSSBO;
+		Buffer *gpuSystemsSSBO;
+		Buffer *gpuIndirectBuffer;
+		MaterialInstance *gpuSimMat;
+		unsigned int gpuResetPass;
+		unsigned int gpuSimulatePass;
+		Mesh gpuQuadMesh;
+		GPUParticleSystem gpuSystems[MAX_GPU_PARTICLE_SYSTEMS];
+		GPUParticleSystemData gpuSystemsData[MAX_GPU_PARTICLE_SYSTEMS];
+		std::vector<GPUParticleRange> gpuFreeRanges;
+		std::vector<unsigned int> gpuDispatchSlots;
+		unsigned int gpuFrame;
 	};
 }
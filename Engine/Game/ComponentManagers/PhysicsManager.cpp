@@ -37,6 +37,10 @@ namespace Engine
 		this->game = game;
 		this->transformManager = &game->GetTransformManager();
 
+		rigidBodyPool.Init(game->GetAllocator(), sizeof(RigidBody), COMPONENTS_PER_CHUNK, MemoryTag::PHYSICS);
+		colliderPool.Init(game->GetAllocator(), sizeof(Collider), COMPONENTS_PER_CHUNK, MemoryTag::PHYSICS);
+		triggerPool.Init(game->GetAllocator(), sizeof(Trigger), COMPONENTS_PER_CHUNK, MemoryTag::PHYSICS);
+
 		broadphase = new btDbvtBroadphase();
 		collisionConfiguration = new btDefaultCollisionConfiguration();
 		dispatcher = new btCollisionDispatcher(collisionConfiguration);
@@ -251,7 +255,7 @@ namespace Engine
 			delete rb;
 			rb = nullptr;
 
-			delete rigidBodies[i].rb;
+			rigidBodyPool.Delete(rigidBodies[i].rb);
 			rigidBodies[i].rb = nullptr;
 		}
 
@@ -262,7 +266,7 @@ namespace Engine
 			delete col;
 			col = nullptr;
 
-			delete colliders[i].col;
+			colliderPool.Delete(colliders[i].col);
 			colliders[i].col = nullptr;
 		}
 
@@ -273,7 +277,7 @@ namespace Engine
 			dynamicsWorld->removeCollisionObject(ghost);
 			delete ghost;
 			ghost = nullptr;
-			delete triggers[i].tr;
+			triggerPool.Delete(triggers[i].tr);
 			triggers[i].tr = nullptr;
 		}
 
@@ -310,6 +314,10 @@ namespace Engine
 
 		PartialDispose();
 
+		rigidBodyPool.Dispose();
+		colliderPool.Dispose();
+		triggerPool.Dispose();
+
 		//if (ghostCallback)
 		//	delete ghostCallback;
 		if (dynamicsWorld)
@@ -374,7 +382,7 @@ namespace Engine
 		if (!shape)
 			return;
 
-		RigidBody *newRB = new RigidBody(shape, rb->GetMass());
+		RigidBody *newRB = rigidBodyPool.New<RigidBody>(shape, rb->GetMass());
 		newRB->DebugView(rb->WantsDebugView());
 		newRB->SetKinematic(rb->IsKinematic());
 		newRB->SetRestitution(rb->GetRestitution());
@@ -436,7 +444,7 @@ namespace Engine
 
 		dynamicsWorld->addCollisionObject(colObject, Layer::DEFAULT, Layer::DEFAULT | Layer::OBSTACLE | Layer::ENEMY);
 
-		Collider *newCol = new Collider(colObject, shape);
+		Collider *newCol = colliderPool.New<Collider>(colObject, shape);
 		//newCol->SetTransform(col->GetTransform());
 		newCol->SetCenter(col->GetCenter());	
 
@@ -490,7 +498,7 @@ namespace Engine
 		// Ghost objects colliding with the terrain were causing a huge lag. Terrain is now on a separate layer and doesn't work with triggers
 		dynamicsWorld->addCollisionObject(ghost, Layer::DEFAULT, Layer::DEFAULT | Layer::OBSTACLE | Layer::ENEMY);
 
-		Trigger *newTr = new Trigger(this, ghost);
+		Trigger *newTr = triggerPool.New<Trigger>(this, ghost);
 		newTr->SetCenter(transformManager->GetLocalToWorld(newE), tr->GetCenter());	
 
 		TriggerInstance ti = {};
@@ -504,7 +512,7 @@ namespace Engine
 	{
 		RigidBodyInstance rbi = {};
 		rbi.e = e;
-		rbi.rb = new RigidBody();
+		rbi.rb = rigidBodyPool.New<RigidBody>();
 		rbi.rb->Deserialize(*this, s);
 
 		glm::mat4 m = transformManager->GetLocalToWorld(rbi.e);
@@ -524,7 +532,7 @@ namespace Engine
 	{
 		ColliderInstance ci = {};
 		ci.e = e;
-		ci.col = new Collider();
+		ci.col = colliderPool.New<Collider>();
 		ci.col->Deserialize(*this, s);
 
 		glm::mat4 m = transformManager->GetLocalToWorld(ci.e);
@@ -544,7 +552,7 @@ namespace Engine
 	{
 		TriggerInstance ti = {};
 		ti.e = e;
-		ti.tr = new Trigger();
+		ti.tr = triggerPool.New<Trigger>();
 		ti.tr->Deserialize(*this, s);
 		ti.tr->GetHandle()->setUserIndex((int)ti.e.id);
 
@@ -704,7 +712,7 @@ namespace Engine
 			dynamicsWorld->removeRigidBody(rigidBody);
 			delete rigidBody->getMotionState();
 			delete rigidBody;
-			delete entityToRemoveRbi.rb;
+			rigidBodyPool.Delete(entityToRemoveRbi.rb);
 			usedRigidBodies--;
 		}
 	}
@@ -747,7 +755,7 @@ namespace Engine
 			btCollisionObject *collider = entityToRemoveCi.col->GetHandle();
 			dynamicsWorld->removeCollisionObject(collider);
 			delete collider;
-			delete entityToRemoveCi.col;
+			colliderPool.Delete(entityToRemoveCi.col);
 			usedColliders--;
 		}
 	}
@@ -791,7 +799,7 @@ namespace Engine
 			btPairCachingGhostObject *ghostTrigger = entityToRemoveTi.tr->GetHandle();
 			dynamicsWorld->removeCollisionObject(ghostTrigger);
 			delete ghostTrigger;
-			delete entityToRemoveTi.tr;
+			triggerPool.Delete(entityToRemoveTi.tr);
 			usedTriggers--;
 		}
 	}
@@ -803,7 +811,7 @@ namespace Engine
 
 		btCollisionShape *shape = GetBoxShape(halfExtents);
 
-		RigidBody *rb = new RigidBody(shape, mass);
+		RigidBody *rb = rigidBodyPool.New<RigidBody>(shape, mass);
 		dynamicsWorld->addRigidBody(rb->GetHandle(), layer, Layer::DEFAULT | Layer::OBSTACLE | Layer::TERRAIN | Layer::ENEMY);
 
 		rb->GetHandle()->setUserIndex((int)e.id);
@@ -824,7 +832,7 @@ namespace Engine
 
 		btCollisionShape *shape = GetSphereShape(radius);
 
-		RigidBody *rb = new RigidBody(shape, mass);
+		RigidBody *rb = rigidBodyPool.New<RigidBody>(shape, mass);
 		dynamicsWorld->addRigidBody(rb->GetHandle(), layer, Layer::DEFAULT | Layer::OBSTACLE | Layer::TERRAIN | Layer::ENEMY);
 		
 		rb->GetHandle()->setUserIndex((int)e.id);
@@ -849,7 +857,7 @@ namespace Engine
 
 		btCollisionShape *shape = GetCapsuleShape(radius, cylinderHeight);
 
-		RigidBody *rb = new RigidBody(shape, mass);
+		RigidBody *rb = rigidBodyPool.New<RigidBody>(shape, mass);
 		dynamicsWorld->addRigidBody(rb->GetHandle(), layer, Layer::DEFAULT | Layer::OBSTACLE | Layer::TERRAIN | Layer::ENEMY);
 		
 		rb->GetHandle()->setUserIndex((int)e.id);
@@ -957,7 +965,7 @@ namespace Engine
 
 		dynamicsWorld->addCollisionObject(colObject, layer, Layer::DEFAULT | Layer::OBSTACLE | Layer::ENEMY);
 
-		Collider *col = new Collider(colObject, box);
+		Collider *col = colliderPool.New<Collider>(colObject, box);
 
 		ColliderInstance ci = {};
 		ci.e = e;
@@ -982,7 +990,7 @@ namespace Engine
 
 		dynamicsWorld->addCollisionObject(colObject, layer, Layer::DEFAULT | Layer::OBSTACLE | Layer::ENEMY);
 
-		Collider *col = new Collider(colObject, sphere);
+		Collider *col = colliderPool.New<Collider>(colObject, sphere);
 
 		ColliderInstance ci = {};
 		ci.e = e;
@@ -1011,7 +1019,7 @@ namespace Engine
 
 		dynamicsWorld->addCollisionObject(colObject, layer, Layer::DEFAULT | Layer::OBSTACLE | Layer::ENEMY);
 
-		Collider *col = new Collider(colObject, capsule);
+		Collider *col = colliderPool.New<Collider>(colObject, capsule);
 
 		ColliderInstance ci = {};
 		ci.e = e;
@@ -1032,7 +1040,7 @@ namespace Engine
 
 		dynamicsWorld->addCollisionObject(colObject, layer, Layer::DEFAULT | Layer::OBSTACLE | Layer::ENEMY);
 
-		Collider *col = new Collider(colObject, box);
+		Collider *col = colliderPool.New<Collider>(colObject, box);
 
 		ColliderInstance ci = {};
 		ci.e = { std::numeric_limits<unsigned int>::max() };
@@ -1111,7 +1119,7 @@ namespace Engine
 		// Ghost objects colliding with the terrain were causing a huge lag. Terrain is now on a separate layer and doesn't work with triggers
 		dynamicsWorld->addCollisionObject(ghost, Layer::DEFAULT, Layer::DEFAULT | Layer::OBSTACLE | Layer::ENEMY);
 
-		Trigger *tr = new Trigger(this, ghost);
+		Trigger *tr = triggerPool.New<Trigger>(this, ghost);
 
 		TriggerInstance ti = {};
 		ti.e = e;
@@ -1141,7 +1149,7 @@ namespace Engine
 		// Ghost objects colliding with the terrain were causing a huge lag. Terrain is now on a separate layer and doesn't work with triggers
 		dynamicsWorld->addCollisionObject(ghost, Layer::DEFAULT, Layer::DEFAULT | Layer::OBSTACLE | Layer::ENEMY);
 
-		Trigger *tr = new Trigger(this, ghost);
+		Trigger *tr = triggerPool.New<Trigger>(this, ghost);
 
 		TriggerInstance ti = {};
 		ti.e = e;
@@ -1175,7 +1183,7 @@ namespace Engine
 		// Ghost objects colliding with the terrain were causing a huge lag. Terrain is now on a separate layer and doesn't work with triggers
 		dynamicsWorld->addCollisionObject(ghost, Layer::DEFAULT, Layer::DEFAULT | Layer::OBSTACLE | Layer::ENEMY);
 
-		Trigger *tr = new Trigger(this, ghost);
+		Trigger *tr = triggerPool.New<Trigger>(this, ghost);
 
 		TriggerInstance ti = {};
 		ti.e = e;
@@ -1507,6 +1515,34 @@ namespace Engine
 		return overlaps;
 	}
 
+	struct OverlappingBoundsCallback : public btBroadphaseAabbCallback
+	{
+		int layerMask;
+		std::vector<AABB> *bounds;
+
+		bool process(const btBroadphaseProxy *proxy) override
+		{
+			if (proxy->m_collisionFilterGroup & layerMask)
+			{
+				AABB aabb;
+				aabb.min = glm::vec3(proxy->m_aabbMin.x(), proxy->m_aabbMin.y(), proxy->m_aabbMin.z());
+				aabb.max = glm::vec3(proxy->m_aabbMax.x(), proxy->m_aabbMax.y(), proxy->m_aabbMax.z());
+				bounds->push_back(aabb);
+			}
+
+			return true;
+		}
+	};
+
+	void PhysicsManager::GetOverlappingBounds(const AABB &box, int layerMask, std::vector<AABB> &bounds)
+	{
+		OverlappingBoundsCallback callback;
+		callback.layerMask = layerMask;
+		callback.bounds = &bounds;
+
+		broadphase->aabbTest(btVector3(box.min.x, box.min.y, box.min.z), btVector3(box.max.x, box.max.y, box.max.z), callback);
+	}
+
 	void PhysicsManager::Serialize(Serializer &s, bool playMode) const
 	{
 		// Store the map, otherwise we have problems with play/stop when we enable/disable entities
@@ -1576,7 +1612,7 @@ namespace Engine
 				RigidBodyInstance rbi;
 				s.Read(rbi.e.id);
 
-				rbi.rb = new RigidBody();
+				rbi.rb = rigidBodyPool.New<RigidBody>();
 				rbi.rb->Deserialize(*this, s);
 
 				glm::mat4 m = transformManager->GetLocalToWorld(rbi.e);
@@ -1602,7 +1638,7 @@ namespace Engine
 				ColliderInstance ci;
 				s.Read(ci.e.id);
 
-				ci.col = new Collider();
+				ci.col = colliderPool.New<Collider>();
 				ci.col->Deserialize(*this, s);
 
 				glm::mat4 m = transformManager->GetLocalToWorld(ci.e);
@@ -1628,7 +1664,7 @@ namespace Engine
 				TriggerInstance ti;
 				s.Read(ti.e.id);
 
-				ti.tr = new Trigger();
+				ti.tr = triggerPool.New<Trigger>();
 				ti.tr->Deserialize(*this, s);
 				
 				glm::mat4 m = transformManager->GetLocalToWorld(ti.e);
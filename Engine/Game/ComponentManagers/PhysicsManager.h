@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Physics/Ray.h"
+#include "Physics/BoundingVolumes.h"
 #include "Game/EntityManager.h"
+#include "Program/PoolAllocator.h"
 
 #include "include/bullet/btBulletDynamicsCommon.h"
 #include "include/bullet/btBulletCollisionCommon.h"
@@ -135,11 +137,15 @@ namespace Engine
 		RaycastResult PerformRaycast(const glm::vec3 &rayOrigin, const glm::vec3 &rayDir, float maxRayDistance);
 		//btCollisionWorld::ClosestRayResultCallback PerformRaycast(const glm::vec3 &origin, const glm::vec3 &dir, float maxDistance = 50.0f);
 		bool CheckSphere(const btVector3 &center, float radius);
+		// Adds the bounds of the objects in any of the layers of the mask that overlap the box. Only the broadphase is queried so a whole area costs one query
+		void GetOverlappingBounds(const AABB &box, int layerMask, std::vector<AABB> &bounds);
 
 		void Serialize(Serializer &s, bool playMode = false) const;
 		void Deserialize(Serializer &s, bool playMode = false);
 
 	private:
+		static const unsigned int COMPONENTS_PER_CHUNK = 32;
+
 		int RecreateTerrainShape(int shapeID, int newResolution, const void *newData, float newMaxHeight);
 
 		void InsertRigidBodyInstance(const RigidBodyInstance &rbi);
@@ -164,6 +170,9 @@ namespace Engine
 		std::vector<RigidBodyInstance> rigidBodies;
 		std::vector<TriggerInstance> triggers;
 		std::vector<ColliderInstance> colliders;
+		PoolAllocator rigidBodyPool;
+		PoolAllocator colliderPool;
+		PoolAllocator triggerPool;
 		std::unordered_map<unsigned int, unsigned int> rbMap;
 		std::unordered_map<unsigned int, unsigned int> trMap;
 		std::unordered_map<unsigned int, unsigned int> colMap;
@@ -2,6 +2,7 @@
 
 #include "Program/Log.h"
 #include "Program/Allocator.h"
+#include "Program/JobSystem.h"
 
 #include "include/glm/gtc/matrix_transform.hpp"
 
@@ -15,20 +16,8 @@ namespace Engine
 		this->allocator = allocator;
 
 		instanceData = {};
-		//instanceData.buffer = new unsigned char[initialCapacity * (sizeof(glm::mat4) + sizeof(glm::vec3) + sizeof(glm::quat) + sizeof(glm::vec3) + sizeof(Entity) * 4 + sizeof(bool))];
-		instanceData.buffer = (unsigned char*)allocator->Allocate(initialCapacity * (sizeof(glm::mat4) + sizeof(glm::vec3) + sizeof(glm::quat) + sizeof(glm::vec3) + sizeof(Entity) * 4 + sizeof(bool)));
-		instanceData.capacity = initialCapacity;
-		instanceData.size = 0;
-
-		instanceData.localToWorld = (glm::mat4*)instanceData.buffer;
-		instanceData.localPosition = (glm::vec3*)(instanceData.localToWorld + initialCapacity);
-		instanceData.localRotation = (glm::quat*)(instanceData.localPosition + initialCapacity);
-		instanceData.localScale = (glm::vec3*)(instanceData.localRotation + initialCapacity);
-		instanceData.parent = (Entity*)(instanceData.localScale + initialCapacity);
-		instanceData.firstChild = (Entity*)(instanceData.parent + initialCapacity);
-		instanceData.prevSibling = (Entity*)(instanceData.firstChild + initialCapacity);
-		instanceData.nextSibling = (Entity*)(instanceData.prevSibling + initialCapacity);
-		instanceData.modified = (bool*)(instanceData.nextSibling + initialCapacity);
+		instances.Init(allocator, initialCapacity);
+		UpdateInstanceDataPointers();
 
 		isInit = true;
 
@@ -37,21 +26,72 @@ namespace Engine
 
 	void TransformManager::Dispose()
 	{
-		if (instanceData.buffer)
-			allocator->Free(instanceData.buffer);
+		instances.Dispose();
+		instanceData = {};
 
 		Log::Print(LogLevel::LEVEL_INFO, "Disposing Transform manager\n");
 	}
 
-	void TransformManager::ClearModifiedTransforms()
+	void TransformManager::UpdateWorldTransforms(JobSystem *jobSystem)
 	{
-		numModifiedTransforms = 0;
+		if (numDirty == 0)
+			return;
+
+		if (hierarchyChanged)
+			SortByDepth();
+
+		// The instances of a level only read their parent's world transform which is in the previous level, so each level can be split into jobs
+		for (size_t i = 0; i + 1 < levelOffsets.size(); i++)
+		{
+			const unsigned int start = levelOffsets[i];
+			const unsigned int count = levelOffsets[i + 1] - start;
+
+			if (jobSystem && jobSystem->GetNumThreads() > 1 && count > TRANSFORM_JOB_GROUP_SIZE)
+			{
+				JobCounter counter;
+				jobSystem->ParallelFor(count, TRANSFORM_JOB_GROUP_SIZE, [this, start](unsigned int first, unsigned int last)
+				{
+					for (unsigned int j = first; j < last; j++)
+						UpdateInstance(depthOrder[start + j]);
+				}, &counter);
+				jobSystem->Wait(&counter);
+			}
+			else
+			{
+				for (unsigned int j = 0; j < count; j++)
+					UpdateInstance(depthOrder[start + j]);
+			}
+		}
 
-		// Try memset 0 to put everything to false
 		for (unsigned int i = 0; i < instanceData.size; i++)
 		{
-			instanceData.modified[i] = false;
+			if (!instanceData.dirty[i])
+				continue;
+
+			if (instanceData.modified[i] == false)
+			{
+				ModifiedTransform mt;
+				mt.e = { i };
+				mt.localToWorld = &instanceData.localToWorld[i];
+				modifiedTransforms.push_back(mt);
+				instanceData.modified[i] = true;
+			}
+
+			instanceData.dirty[i] = false;
 		}
+
+		numDirty = 0;
+	}
+
+	void TransformManager::ClearModifiedTransforms()
+	{
+		// Only the transforms in the list have the flag set
+		for (size_t i = 0; i < modifiedTransforms.size(); i++)
+		{
+			instanceData.modified[modifiedTransforms[i].e.id] = false;
+		}
+
+		modifiedTransforms.clear();
 	}
 
 	void TransformManager::AddTransform(Entity e)
@@ -60,31 +100,27 @@ namespace Engine
 		if (e.id < instanceData.size)
 			return;
 
-		if (instanceData.size == instanceData.capacity)
-		{
-			// resize
-		}
+		const unsigned int index = AddInstance();
 		
-		instanceData.localToWorld[instanceData.size] = glm::mat4(1.0f);
-		instanceData.localPosition[instanceData.size] = glm::vec3(0.0f);
-		instanceData.localRotation[instanceData.size] = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
-		instanceData.localScale[instanceData.size] = glm::vec3(1.0f);
-		instanceData.parent[instanceData.size] = { std::numeric_limits<unsigned int>::max() };
-		instanceData.firstChild[instanceData.size] = { std::numeric_limits<unsigned int>::max() };
-		instanceData.prevSibling[instanceData.size] = { std::numeric_limits<unsigned int>::max() };
-		instanceData.nextSibling[instanceData.size] = { std::numeric_limits<unsigned int>::max() };
-
-		instanceData.size++;
+		instanceData.localToWorld[index] = glm::mat4(1.0f);
+		instanceData.localPosition[index] = glm::vec3(0.0f);
+		instanceData.localRotation[index] = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		instanceData.localScale[index] = glm::vec3(1.0f);
+		instanceData.parent[index] = { std::numeric_limits<unsigned int>::max() };
+		instanceData.firstChild[index] = { std::numeric_limits<unsigned int>::max() };
+		instanceData.prevSibling[index] = { std::numeric_limits<unsigned int>::max() };
+		instanceData.nextSibling[index] = { std::numeric_limits<unsigned int>::max() };
+		instanceData.modified[index] = false;
+		instanceData.dirty[index] = false;
+
+		hierarchyChanged = true;
 	}
 
 	void TransformManager::DuplicateTransform(Entity e, Entity newE)
 	{
-		if (instanceData.size == instanceData.capacity)
-		{
-			// resize
-		}
+		const unsigned int index = AddInstance();
 
-		glm::mat4 localToWorld = instanceData.localToWorld[e.id];
+		glm::mat4 localToWorld = GetLocalToWorld(e);
 		glm::vec3 worldPos = localToWorld[3];
 		glm::vec3 worldScale = glm::vec3(glm::length(localToWorld[0]), glm::length(localToWorld[1]), glm::length(localToWorld[2]));
 
@@ -96,18 +132,20 @@ namespace Engine
 		worldRot = glm::normalize(worldRot);
 		
 
-		instanceData.localToWorld[instanceData.size] = instanceData.localToWorld[e.id];
-		/*instanceData.localPosition[instanceData.size] = instanceData.localPosition[e.id];
-		instanceData.localRotation[instanceData.size] = instanceData.localRotation[e.id];
-		instanceData.localScale[instanceData.size] = instanceData.localScale[e.id];*/
-		instanceData.localPosition[instanceData.size] = worldPos;
-		instanceData.localRotation[instanceData.size] = worldRot;
-		instanceData.localScale[instanceData.size] = worldScale;
-
-		instanceData.parent[instanceData.size] = { std::numeric_limits<unsigned int>::max() };
-		instanceData.firstChild[instanceData.size] = { std::numeric_limits<unsigned int>::max() };
-		instanceData.prevSibling[instanceData.size] = { std::numeric_limits<unsigned int>::max() };
-		instanceData.nextSibling[instanceData.size] = { std::numeric_limits<unsigned int>::max() };
+		instanceData.localToWorld[index] = GetLocalToWorld(e);
+		/*instanceData.localPosition[index] = instanceData.localPosition[e.id];
+		instanceData.localRotation[index] = instanceData.localRotation[e.id];
+		instanceData.localScale[index] = instanceData.localScale[e.id];*/
+		instanceData.localPosition[index] = worldPos;
+		instanceData.localRotation[index] = worldRot;
+		instanceData.localScale[index] = worldScale;
+
+		instanceData.parent[index] = { std::numeric_limits<unsigned int>::max() };
+		instanceData.firstChild[index] = { std::numeric_limits<unsigned int>::max() };
+		instanceData.prevSibling[index] = { std::numeric_limits<unsigned int>::max() };
+		instanceData.nextSibling[index] = { std::numeric_limits<unsigned int>::max() };
+		instanceData.modified[index] = false;
+		instanceData.dirty[index] = false;
 
 		/*if (instanceData.modified[instanceData.size] == false)
 		{
@@ -117,11 +155,15 @@ namespace Engine
 			numModifiedTransforms++;
 		}*/
 
-		instanceData.size++;
+		hierarchyChanged = true;
 	}
 
 	void TransformManager::SetParent(Entity e, Entity parent)
 	{
+		// The current world transforms are needed to make the child relative to the new parent
+		ResolveWorldTransform(e);
+		ResolveWorldTransform(parent);
+
 		Entity oldParent = instanceData.parent[e.id];
 
 		// Remove the instance from the parent children list
@@ -158,8 +200,6 @@ namespace Engine
 			instanceData.prevSibling[firstChild.id] = e;
 
 
-		glm::mat4 parentT = instanceData.localToWorld[parent.id];
-
 		// Update the child local position, rotation and scale to be relative to the parent
 		glm::mat4 t = glm::inverse(instanceData.localToWorld[parent.id]) * instanceData.localToWorld[e.id];
 
@@ -170,7 +210,8 @@ namespace Engine
 		rotation = glm::normalize(rotation);
 		instanceData.localRotation[e.id] = rotation;
 
-		CalcTransform(e, parentT);
+		hierarchyChanged = true;
+		MarkDirty(e);
 	}
 
 	void TransformManager::RemoveParent(Entity e)
@@ -178,6 +219,8 @@ namespace Engine
 		if (!HasParent(e))
 			return;
 
+		ResolveWorldTransform(e);
+
 		Entity parent = instanceData.parent[e.id];
 		Entity prevSibling = instanceData.prevSibling[e.id];
 		Entity nextSibling = instanceData.nextSibling[e.id];
@@ -215,64 +258,55 @@ namespace Engine
 
 		instanceData.localRotation[e.id] = q;
 
-		CalcTransform(e, glm::mat4(1.0f));
+		hierarchyChanged = true;
+		MarkDirty(e);
 	}
 
 	void TransformManager::SetLocalPosition(Entity e, const glm::vec3 &position)
 	{
 		instanceData.localPosition[e.id] = position;
-		CalcTransform(e);
+		MarkDirty(e);
 	}
 
 	void TransformManager::SetLocalRotation(Entity e, const glm::quat &rotation)
 	{
 		instanceData.localRotation[e.id] = rotation;
-		CalcTransform(e);
+		MarkDirty(e);
 	}
 
 	void TransformManager::SetLocalRotationEuler(Entity e, const glm::vec3 &euler)
 	{
 		instanceData.localRotation[e.id] = glm::quat(glm::vec3(glm::radians(euler.x), glm::radians(euler.y), glm::radians(euler.z)));
-		CalcTransform(e);
+		MarkDirty(e);
 	}
 
 	void TransformManager::SetLocalScale(Entity e, const glm::vec3 &scale)
 	{
 		instanceData.localScale[e.id] = scale;
-		CalcTransform(e);
+		MarkDirty(e);
 	}
 
 	void TransformManager::SetLocalToWorld(Entity e, const glm::mat4 &localToWorld)
 	{
 		Entity parent = instanceData.parent[e.id];
-		glm::mat4 parentT = parent.IsValid() ? instanceData.localToWorld[parent.id] : glm::mat4(1.0f);
+		glm::mat4 parentT = parent.IsValid() ? GetLocalToWorld(parent) : glm::mat4(1.0f);
 
 		glm::mat4 m = glm::inverse(parentT) * localToWorld;
 
+		instanceData.localPosition[e.id] = m[3];
+		instanceData.localScale[e.id] = glm::vec3(glm::length(m[0]), glm::length(m[1]), glm::length(m[2]));
+
+		// Remove the scale before extracting the rotation
+		m[0] = glm::normalize(m[0]);
+		m[1] = glm::normalize(m[1]);
+		m[2] = glm::normalize(m[2]);
+
 		glm::quat r = glm::quat_cast(m);
 		r = glm::normalize(r);
 
-		instanceData.localPosition[e.id] = m[3];
-		instanceData.localScale[e.id] = glm::vec3(glm::length(localToWorld[0]), glm::length(localToWorld[1]), glm::length(localToWorld[2]));	// Should it be m instead of local to world?
 		instanceData.localRotation[e.id] = r;
 
-		if (instanceData.modified[e.id] == false)
-		{
-			ModifiedTransform &mt = modifiedTransforms[numModifiedTransforms];
-			mt.e = e;
-			mt.localToWorld = &instanceData.localToWorld[e.id];
-			numModifiedTransforms++;
-		}
-
-		instanceData.localToWorld[e.id] = localToWorld;
-		instanceData.modified[e.id] = true;
-
-		Entity child = instanceData.firstChild[e.id];
-		while (child.IsValid())
-		{
-			CalcTransform(child, instanceData.localToWorld[e.id]);
-			child = instanceData.nextSibling[child.id];
-		}
+		MarkDirty(e);
 	}
 
 	void TransformManager::SetLocalToParent(Entity e, const glm::mat4 &localToParent)
@@ -284,7 +318,7 @@ namespace Engine
 		instanceData.localScale[e.id] = glm::vec3(glm::length(localToParent[0]), glm::length(localToParent[1]), glm::length(localToParent[2]));
 		instanceData.localRotation[e.id] = r;
 
-		CalcTransform(e);
+		MarkDirty(e);
 	}
 
 	void TransformManager::Rotate(Entity e, const glm::vec3 &rot)
@@ -293,11 +327,14 @@ namespace Engine
 
 		instanceData.localRotation[e.id] *= q;
 		
-		CalcTransform(e);
+		MarkDirty(e);
 	}
 
-	const glm::mat4 &TransformManager::GetLocalToWorld(Entity e) const
+	const glm::mat4 &TransformManager::GetLocalToWorld(Entity e)
 	{
+		if (numDirty > 0)
+			ResolveWorldTransform(e);
+
 		return instanceData.localToWorld[e.id];
 	}
 
@@ -326,37 +363,128 @@ namespace Engine
 		return instanceData.nextSibling[e.id];
 	}
 
-	void TransformManager::CalcTransform(Entity e)
+	unsigned int TransformManager::AddInstance()
 	{
+		const unsigned int oldCapacity = instances.GetCapacity();
+		const unsigned int index = instances.Add();
+
+		UpdateInstanceDataPointers();
+
+		// The modified transforms point into the old storage
+		if (instances.GetCapacity() != oldCapacity)
+		{
+			for (size_t i = 0; i < modifiedTransforms.size(); i++)
+				modifiedTransforms[i].localToWorld = &instanceData.localToWorld[modifiedTransforms[i].e.id];
+		}
+
+		return index;
+	}
+
+	void TransformManager::UpdateInstanceDataPointers()
+	{
+		instanceData.size = instances.GetSize();
+		instanceData.capacity = instances.GetCapacity();
+
+		instanceData.localToWorld = instances.Get<LOCAL_TO_WORLD>();
+		instanceData.localPosition = instances.Get<LOCAL_POSITION>();
+		instanceData.localRotation = instances.Get<LOCAL_ROTATION>();
+		instanceData.localScale = instances.Get<LOCAL_SCALE>();
+		instanceData.parent = instances.Get<PARENT>();
+		instanceData.firstChild = instances.Get<FIRST_CHILD>();
+		instanceData.prevSibling = instances.Get<PREV_SIBLING>();
+		instanceData.nextSibling = instances.Get<NEXT_SIBLING>();
+		instanceData.modified = instances.Get<MODIFIED>();
+		instanceData.dirty = instances.Get<DIRTY>();
+	}
+
+	void TransformManager::MarkDirty(Entity e)
+	{
+		if (instanceData.dirty[e.id])
+			return;
+
+		instanceData.dirty[e.id] = true;
+		numDirty++;
+	}
+
+	glm::mat4 TransformManager::CalcLocalToParent(unsigned int index) const
+	{
+		glm::mat4 localToParent = glm::mat4_cast(instanceData.localRotation[index]);
+		localToParent = glm::scale(localToParent, instanceData.localScale[index]);
+		localToParent[3] = glm::vec4(instanceData.localPosition[index], 1.0f);
+
+		return localToParent;
+	}
+
+	bool TransformManager::ResolveWorldTransform(Entity e)
+	{
+		// Walk up to the root and recompute the world transforms on the way down if this transform or a parent is dirty.
+		// Dirty flags are kept so UpdateWorldTransforms still updates the other children and adds them to the modified list
 		Entity parent = instanceData.parent[e.id];
-		glm::mat4 parentT = parent.IsValid() ? instanceData.localToWorld[parent.id] : glm::mat4(1.0f);
+		bool parentChanged = parent.IsValid() && ResolveWorldTransform(parent);
+
+		if (!parentChanged && !instanceData.dirty[e.id])
+			return false;
 
-		CalcTransform(e, parentT);
+		glm::mat4 localToParent = CalcLocalToParent(e.id);
+		instanceData.localToWorld[e.id] = parent.IsValid() ? instanceData.localToWorld[parent.id] * localToParent : localToParent;
+
+		return true;
 	}
 
-	void TransformManager::CalcTransform(Entity e, const glm::mat4 &parent)
+	void TransformManager::UpdateInstance(unsigned int index)
 	{
-		glm::mat4 localToParent = glm::mat4_cast(instanceData.localRotation[e.id]);
-		localToParent = glm::scale(localToParent, instanceData.localScale[e.id]);
-		localToParent[3] = glm::vec4(instanceData.localPosition[e.id], 1.0f);
+		// The dirty flag propagates down the hierarchy
+		Entity parent = instanceData.parent[index];
+		if (parent.IsValid() && instanceData.dirty[parent.id])
+			instanceData.dirty[index] = true;
 
-		if (instanceData.modified[e.id] == false)
-		{
-			ModifiedTransform &mt = modifiedTransforms[numModifiedTransforms];
-			mt.e = e;
-			mt.localToWorld = &instanceData.localToWorld[e.id];
-			numModifiedTransforms++;
-		}
+		if (!instanceData.dirty[index])
+			return;
 
-		instanceData.localToWorld[e.id] = parent * localToParent;
-		instanceData.modified[e.id] = true;
+		glm::mat4 localToParent = CalcLocalToParent(index);
+		instanceData.localToWorld[index] = parent.IsValid() ? instanceData.localToWorld[parent.id] * localToParent : localToParent;
+	}
 
-		Entity child = instanceData.firstChild[e.id];
-		while (child.IsValid())
+	void TransformManager::SortByDepth()
+	{
+		const unsigned int size = instanceData.size;
+
+		depths.resize(size);
+		unsigned int maxDepth = 0;
+
+		for (unsigned int i = 0; i < size; i++)
 		{
-			CalcTransform(child, instanceData.localToWorld[e.id]);
-			child = instanceData.nextSibling[child.id];
+			unsigned int depth = 0;
+			Entity parent = instanceData.parent[i];
+			while (parent.IsValid())
+			{
+				depth++;
+				parent = instanceData.parent[parent.id];
+			}
+
+			depths[i] = depth;
+			maxDepth = glm::max(maxDepth, depth);
 		}
+
+		// Counting sort by depth
+		levelOffsets.assign(maxDepth + 2, 0);
+
+		for (unsigned int i = 0; i < size; i++)
+			levelOffsets[depths[i] + 1]++;
+
+		for (size_t i = 1; i < levelOffsets.size(); i++)
+			levelOffsets[i] += levelOffsets[i - 1];
+
+		depthOrder.resize(size);
+		for (unsigned int i = 0; i < size; i++)
+			depthOrder[levelOffsets[depths[i]]++] = i;
+
+		// Filling depthOrder moved each offset to the start of the next level, shift them back
+		for (size_t i = levelOffsets.size() - 1; i > 0; i--)
+			levelOffsets[i] = levelOffsets[i - 1];
+		levelOffsets[0] = 0;
+
+		hierarchyChanged = false;
 	}
 
 	void TransformManager::RemoveTransform(Entity e)
@@ -390,6 +518,8 @@ namespace Engine
 		}
 
 		// Reset the slot where the entity is
+		hierarchyChanged = true;
+		MarkDirty(e);
 		instanceData.localToWorld[e.id] = glm::mat4(1.0f);
 		instanceData.localPosition[e.id] = glm::vec3(0.0f);
 		instanceData.localRotation[e.id] = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
@@ -405,7 +535,7 @@ namespace Engine
 		s.Write(instanceData.size);
 		for (unsigned int i = 0; i < instanceData.size; i++)
 		{
-			s.Write(instanceData.localToWorld[i]);
+			s.Write(GetLocalToWorld({ i }));
 			s.Write(instanceData.localPosition[i]);
 			s.Write(instanceData.localRotation[i]);
 			s.Write(instanceData.localScale[i]);
@@ -420,14 +550,13 @@ namespace Engine
 	{
 		Log::Print(LogLevel::LEVEL_INFO, "Deserializing transform manager\n");
 
-		s.Read(instanceData.size);
+		unsigned int size = 0;
+		s.Read(size);
 
-		Log::Print(LogLevel::LEVEL_INFO, "Size: %u\n", instanceData.size);
+		Log::Print(LogLevel::LEVEL_INFO, "Size: %u\n", size);
 
-		if (instanceData.size >= instanceData.capacity)
-		{
-			// resize
-		}
+		instances.Resize(size);
+		UpdateInstanceDataPointers();
 
 		for (unsigned int i = 0; i < instanceData.size; i++)
 		{
@@ -439,6 +568,12 @@ namespace Engine
 			s.Read(instanceData.firstChild[i].id);
 			s.Read(instanceData.prevSibling[i].id);
 			s.Read(instanceData.nextSibling[i].id);
+			instanceData.modified[i] = false;
+			instanceData.dirty[i] = false;
 		}
+
+		modifiedTransforms.clear();
+		numDirty = 0;
+		hierarchyChanged = true;
 	}
 }
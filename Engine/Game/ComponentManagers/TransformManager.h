@@ -1,22 +1,25 @@
 #pragma once
 
 #include "Game/EntityManager.h"
+#include "ComponentArray.h"
 
 #include "include/glm/glm.hpp"
 #include "include/glm/gtc/quaternion.hpp"
 
 #include <unordered_map>
+#include <vector>
 
 namespace Engine
 {
 	class Transform;
 	class Allocator;
+	class JobSystem;
 
+	// Named view of the transform columns. The pointers change when the storage grows
 	struct TransformInstanceData
 	{
 		unsigned int size;
 		unsigned int capacity;
-		unsigned char *buffer;
 
 		glm::mat4 *localToWorld;
 		glm::vec3 *localPosition;
@@ -26,7 +29,8 @@ namespace Engine
 		Entity *firstChild;
 		Entity *prevSibling;
 		Entity *nextSibling;
-		bool *modified;
+		bool *modified;			// Already in the modified transforms list this frame
+		bool *dirty;			// Local transform changed and the world transform needs to be recomputed
 	};
 
 	struct ModifiedTransform
@@ -40,6 +44,9 @@ namespace Engine
 	public:
 		void Init(Allocator *allocator, unsigned int initialCapacity);
 		void Dispose();
+		// Recomputes the world transform of every dirty instance and their children. The instances are processed sorted by their depth in the hierarchy
+		// so the parents are always computed before the children. Each depth level can be split into jobs
+		void UpdateWorldTransforms(JobSystem *jobSystem = nullptr);
 		void ClearModifiedTransforms();
 
 		void AddTransform(Entity e);
@@ -56,7 +63,10 @@ namespace Engine
 		void SetLocalToParent(Entity e, const glm::mat4 &localToParent);
 		void Rotate(Entity e, const glm::vec3 &rot);
 
-		const glm::mat4 &GetLocalToWorld(Entity e) const;
+		// If the transform or any of its parents is dirty the world transform is computed on demand
+		const glm::mat4 &GetLocalToWorld(Entity e);
+		// Only reads the world transform so it can be used from jobs. Returns the transform computed by the last UpdateWorldTransforms
+		const glm::mat4 &GetLocalToWorld(Entity e) const { return instanceData.localToWorld[e.id]; }
 
 		bool HasParent(Entity e) const;
 		bool HasChildren(Entity e) const;
@@ -66,28 +76,54 @@ namespace Engine
 		glm::quat &GetLocalRotation(Entity e) const { return instanceData.localRotation[e.id]; }
 		glm::vec3 &GetLocalScale(Entity e) const { return instanceData.localScale[e.id]; }
 
-		glm::vec3 GetWorldPosition(Entity e) const { return instanceData.localToWorld[e.id][3]; }
+		glm::vec3 GetWorldPosition(Entity e) { return GetLocalToWorld(e)[3]; }
 
 		Entity GetParent(Entity e);
 		Entity GetFirstChild(Entity e);
 		Entity GetNextSibling(Entity e);
 
-		unsigned int GetNumModifiedTransforms() const { return numModifiedTransforms; }
-		const ModifiedTransform *GetModifiedTransforms() const { return modifiedTransforms; }
+		// Transforms whose world transform was recomputed by UpdateWorldTransforms since the last ClearModifiedTransforms
+		unsigned int GetNumModifiedTransforms() const { return static_cast<unsigned int>(modifiedTransforms.size()); }
+		const ModifiedTransform *GetModifiedTransforms() const { return modifiedTransforms.data(); }
 
 		void Serialize(Serializer &s);
 		void Deserialize(Serializer &s);
 
 	private:
-		void CalcTransform(Entity e);
-		void CalcTransform(Entity e, const glm::mat4 &parent);
+		static const unsigned int TRANSFORM_JOB_GROUP_SIZE = 512;
+
+		enum Column
+		{
+			LOCAL_TO_WORLD,
+			LOCAL_POSITION,
+			LOCAL_ROTATION,
+			LOCAL_SCALE,
+			PARENT,
+			FIRST_CHILD,
+			PREV_SIBLING,
+			NEXT_SIBLING,
+			MODIFIED,
+			DIRTY
+		};
+
+		unsigned int AddInstance();
+		void UpdateInstanceDataPointers();
+		void MarkDirty(Entity e);
+		glm::mat4 CalcLocalToParent(unsigned int index) const;
+		bool ResolveWorldTransform(Entity e);
+		void UpdateInstance(unsigned int index);
+		void SortByDepth();
 
 	private:
 		Allocator *allocator;
 		bool isInit = false;
+		ComponentArray<glm::mat4, glm::vec3, glm::quat, glm::vec3, Entity, Entity, Entity, Entity, bool, bool> instances;
 		TransformInstanceData instanceData;
-		static const unsigned int MAX_MODIFIED_TRANSFORMS = 4096;
-		unsigned int numModifiedTransforms = 0;
-		ModifiedTransform modifiedTransforms[MAX_MODIFIED_TRANSFORMS];
+		unsigned int numDirty = 0;
+		bool hierarchyChanged = true;
+		std::vector<unsigned int> depthOrder;		// Instance indices sorted by their depth in the hierarchy
+		std::vector<unsigned int> levelOffsets;		// Where each depth level starts in depthOrder
+		std::vector<unsigned int> depths;
+		std::vector<ModifiedTransform> modifiedTransforms;
 	};
 }
@@ -36,6 +36,12 @@
 
 namespace Engine
 {
+	// Grows on its own if a frame needs more
+	static const unsigned int FRAME_ALLOCATOR_SIZE = 1024 * 1024;
+	static const unsigned int QUEUE_ALLOCATION_FRAMES_WARNING = 60;
+	// Starts the prefab version header. As a float it's a NaN, so it can't be confused with the local position older prefabs start with
+	static const unsigned int PREFAB_ID = 0x7FC0FAB0;
+
 	Game::Game()
 	{
 		allocator = nullptr;
@@ -71,6 +77,11 @@ namespace Engine
 		this->fileManager = fileManager;
 		this->inputManager = inputManager;
 
+		jobSystem.Init();
+		renderer->SetJobSystem(&jobSystem);
+		frameAllocator.Init(allocator, FRAME_ALLOCATOR_SIZE);
+		renderer->SetFrameAllocator(&frameAllocator);
+
 		transformManager.Init(allocator, 50);
 		scriptManager.Init(this);
 		aiSystem.Init(this);
@@ -156,7 +167,24 @@ namespace Engine
 
 	void Game::Update(float dt)
 	{
-		transformManager.ClearModifiedTransforms();
+		// Everything allocated from the frame allocator during the last frame is no longer used
+		frameAllocator.Reset();
+
+		// The render queues keep their memory so they only allocate when a frame needs more than the ones before.
+		// Allocating in many frames in a row means something in the queue path allocates every frame
+		const unsigned int queueAllocations = renderer->GetQueueAllocations();
+		if (queueAllocations != lastQueueAllocations)
+		{
+			framesWithQueueAllocations++;
+			if (framesWithQueueAllocations == QUEUE_ALLOCATION_FRAMES_WARNING)
+				Log::Print(LogLevel::LEVEL_WARNING, "Render queues allocated memory in each of the last %u frames\n", QUEUE_ALLOCATION_FRAMES_WARNING);
+		}
+		else
+		{
+			framesWithQueueAllocations = 0;
+		}
+		lastQueueAllocations = queueAllocations;
+
 		sceneChanged = false;
 		deltaTime = dt;
 
@@ -171,9 +199,8 @@ namespace Engine
 			markedForLoadSceneID = -1;
 		}
 
-		modelManager.Update();
 		soundManager.Update(mainCamera->GetPosition());
-		//aiSystem.Update();
+		aiSystem.Update();
 		
 		if (gameState == GameState::PLAYING)
 		{
@@ -210,11 +237,16 @@ namespace Engine
 
 	void Game::Render(Renderer *renderer)
 	{
+		// Resolve all the transforms modified by the editor, physics and scripts in one batch
+		transformManager.UpdateWorldTransforms(&jobSystem);
+
 #ifndef VITA
 		//aiSystem.PrepareDebugDraw();
 		physicsManager.PrepareDebugDraw(debugDrawManager);		
 		debugDrawManager->Update();
 #endif
+		// Update the models here so the transforms modified by the editor, physics and scripts are all picked up
+		modelManager.Update();
 		lightManager.Update(mainCamera);
 
 		if (terrain)
@@ -231,6 +263,8 @@ namespace Engine
 #ifndef VITA
 		debugDrawManager->Clear();
 #endif
+
+		transformManager.ClearModifiedTransforms();
 	}
 
 	void Game::PartialDispose()
@@ -296,6 +330,11 @@ namespace Engine
 		uiManager.Dispose();
 		transformManager.Dispose();
 
+		renderer->SetJobSystem(nullptr);
+		jobSystem.Dispose();
+		renderer->SetFrameAllocator(nullptr);
+		frameAllocator.Dispose();
+
 		Log::Print(LogLevel::LEVEL_INFO, "Game disposed\n");
 	}
 
@@ -548,6 +587,8 @@ namespace Engine
 
 			if (major == MAJOR_VERSION && minor == MINOR_VERSION)
 			{
+				s.SetPatchVersion(patch);
+
 				entityManager.Deserialize(s);
 				transformManager.Deserialize(s);
 				lightManager.Deserialize(s);
@@ -717,6 +758,12 @@ namespace Engine
 
 		Serializer s(fileManager);
 		s.OpenForWriting();
+
+		s.Write(PREFAB_ID);
+		s.Write(MAJOR_VERSION);
+		s.Write(MINOR_VERSION);
+		s.Write(PATCH_VERSION);
+
 		SaveEntityPrefabRecursively(s, e);
 		s.Save(path);
 		s.Close();
@@ -763,7 +810,10 @@ namespace Engine
 		bool hasPs = particleManager.HasParticleSystem(e);
 		s.Write(hasPs);
 		if (hasPs)
+		{
 			particleManager.GetParticleSystem(e)->Serialize(s);
+			s.Write(particleManager.GetParticleSystem(e)->IsGPUSimulated());
+		}
 
 		bool hasPl = lightManager.HasPointLight(e);
 		s.Write(hasPl);
@@ -806,6 +856,25 @@ namespace Engine
 
 		if (s.IsOpen())
 		{
+			unsigned int id = 0;
+			s.Read(id);
+
+			if (id == PREFAB_ID)
+			{
+				unsigned int major, minor, patch = 0;
+				s.Read(major);
+				s.Read(minor);
+				s.Read(patch);
+				s.SetPatchVersion(patch);
+			}
+			else
+			{
+				// Prefabs saved before the header was added start with the transform, so read them again from the beginning
+				s.Close();
+				s.OpenForReading(path);
+				s.SetPatchVersion(5);
+			}
+
 			LoadEntityPrefabRecursively(s, e);
 			s.Close();
 		}
@@ -14,6 +14,8 @@
 #include "AI/AISystem.h"
 #include "Graphics/Terrain/Terrain.h"
 #include "Graphics/Effects/RenderingPath.h"
+#include "Program/JobSystem.h"
+#include "Program/LinearAllocator.h"
 
 namespace Engine
 {
@@ -87,6 +89,8 @@ namespace Engine
 		const std::vector<Scene> &GetScenes() const { return scenes; }
 
 		Allocator*				GetAllocator() const { return allocator; }
+		JobSystem&				GetJobSystem() { return jobSystem; }
+		LinearAllocator&		GetFrameAllocator() { return frameAllocator; }
 		DebugDrawManager*		GetDebugDrawManager() const { return debugDrawManager; }
 		Renderer*				GetRenderer() const { return renderer; }
 		FileManager*			GetFileManager() const { return fileManager; }
@@ -136,6 +140,8 @@ namespace Engine
 		unsigned int playebleHeight;
 
 		Allocator			*allocator;
+		JobSystem			jobSystem;
+		LinearAllocator		frameAllocator;
 		Renderer			*renderer;		
 		FileManager			*fileManager;
 		InputManager		*inputManager;
@@ -172,5 +178,8 @@ namespace Engine
 		int markedForLoadSceneID = -1;
 
 		bool isPaused = false;
+
+		unsigned int lastQueueAllocations = 0;
+		unsigned int framesWithQueueAllocations = 0;
 	};
 }
@@ -27,6 +27,8 @@ namespace Engine
 		originalAABB.max = glm::vec3(-100000.0f);
 		lodDistance = 10000.0f;
 		rootBone = new Bone;
+		rootBone->parent = nullptr;
+		rootBone->index = 0;
 
 		for (unsigned short i = 0; i < MAX_BONES_CONNECTIONS; i++)
 		{
@@ -47,6 +49,8 @@ namespace Engine
 		originalAABB.max = glm::vec3(-100000.0f);
 		lodDistance = 10000.0f;
 		rootBone = new Bone;
+		rootBone->parent = nullptr;
+		rootBone->index = 0;
 
 		for (unsigned short i = 0; i < MAX_BONES_CONNECTIONS; i++)
 		{
@@ -195,10 +199,25 @@ namespace Engine
 		}
 
 		ReadBoneTree(s, rootBone);
+		BuildSkeleton();
 
 		s.Close();
 	}
 
+	void AnimatedModel::BuildSkeleton()
+	{
+		skeleton.clear();
+		FlattenBoneTree(rootBone, -1);
+		nodeTransforms.resize(skeleton.size());
+		curPose.resize(skeleton.size());
+		nextPose.resize(skeleton.size());
+
+		// Animations might have been added before the skeleton was loaded
+		animationTracks.clear();
+		for (size_t i = 0; i < animations.size(); i++)
+			BindAnimation(animations[i]);
+	}
+
 	void AnimatedModel::ReadBoneTree(Serializer &s, Bone *bone)
 	{
 		s.Read(bone->name);
@@ -219,144 +238,237 @@ namespace Engine
 		}
 	}
 
-	unsigned int AnimatedModel::FindKeyFrame(float animTime, const KeyFrameList &keyFrameList)
+	void AnimatedModel::FlattenBoneTree(Bone *bone, int parent)
+	{
+		bone->index = static_cast<unsigned int>(skeleton.size());
+
+		SkeletonNode node = {};
+		node.bindTransform = bone->transformation;
+		node.parent = parent;
+
+		auto it = boneMap.find(bone->name);
+		node.boneIndex = it != boneMap.end() ? static_cast<int>(it->second) : -1;
+
+		skeleton.push_back(node);
+
+		const int index = static_cast<int>(bone->index);
+		for (size_t i = 0; i < bone->children.size(); i++)
+		{
+			FlattenBoneTree(bone->children[i], index);
+		}
+	}
+
+	// Names can be repeated in the skeleton so every node is resolved instead of going from the animation's bones to the nodes
+	void AnimatedModel::BindAnimation(const Animation *anim)
 	{
-		for (unsigned int i = 0; i < keyFrameList.size() - 1; i++)
+		AnimationTracks tracks = {};
+		tracks.boneTracks.resize(skeleton.size(), nullptr);
+		tracks.cursors.resize(skeleton.size(), 0);
+
+		if (skeleton.size() > 0)
 		{
-			if (animTime < (float)keyFrameList[i + 1].time)
-				return i;
+			std::vector<const Bone*> stack;
+			stack.push_back(rootBone);
+
+			while (stack.empty() == false)
+			{
+				const Bone *bone = stack.back();
+				stack.pop_back();
+
+				// Don't use operator[] because the animations are shared between models and it would insert into the map when the bone has no keyframes
+				auto it = anim->tracks.find(bone->name);
+				if (it != anim->tracks.end() && it->second.keyframes.size() > 0)
+					tracks.boneTracks[bone->index] = &it->second;
+
+				for (size_t i = 0; i < bone->children.size(); i++)
+					stack.push_back(bone->children[i]);
+			}
 		}
 
-		return 0;
+		animationTracks.push_back(tracks);
 	}
 
-	void AnimatedModel::Interpolate(float animTime, glm::vec3 &position, glm::quat &rot, glm::vec3 &scale, const KeyFrameList &keyFrameList)
+	unsigned int AnimatedModel::FindKeyFrame(float animTime, const AnimationTrack &track, unsigned int &cursor)
 	{
-		if (keyFrameList.size() == 1)
+		const std::vector<CompressedKeyframe> &keyFrameList = track.keyframes;
+		const unsigned int last = static_cast<unsigned int>(keyFrameList.size()) - 1;
+
+		// The time usually moves forward by less than a keyframe between updates, so check the keyframe we found last time and the one after it before searching
+		unsigned int index = cursor < last ? cursor : 0;
+
+		if (index == 0 || animTime >= keyFrameList[index].time)
 		{
-			position = keyFrameList[0].position;
-			rot = keyFrameList[0].rotation;
-			scale = keyFrameList[0].scale;
+			if (animTime < keyFrameList[index + 1].time)
+				return index;
+
+			if (index + 2 <= last && animTime < keyFrameList[index + 2].time)
+			{
+				cursor = index + 1;
+				return cursor;
+			}
+		}
+
+		// Binary search for the first keyframe after animTime. The keyframe we want is the one before it
+		unsigned int first = 1;
+		unsigned int count = last;
+		while (count > 0)
+		{
+			const unsigned int step = count / 2;
+			const unsigned int mid = first + step;
+
+			if (keyFrameList[mid].time <= animTime)
+			{
+				first = mid + 1;
+				count -= step + 1;
+			}
+			else
+			{
+				count = step;
+			}
+		}
+
+		// Past the last keyframe
+		if (first > last)
+			return 0;
+
+		cursor = first - 1;
+		return cursor;
+	}
+
+	void AnimatedModel::Interpolate(float animTime, glm::vec3 &position, glm::quat &rot, const AnimationTrack &track, unsigned int &cursor)
+	{
+		if (track.keyframes.size() == 1)
+		{
+			animclip::DecodeKeyframe(track, 0, position, rot);
 			return;
 		}
 
-		unsigned int index = FindKeyFrame(animTime, keyFrameList);
+		unsigned int index = FindKeyFrame(animTime, track, cursor);
 		unsigned int nextIndex = index + 1;
 
 		curKeyFrame = static_cast<unsigned short>(index);
 
-		float deltaTime = (float)(keyFrameList[nextIndex].time - keyFrameList[index].time);
-		float factor = (animTime - (float)keyFrameList[index].time) / deltaTime;
+		const float startTime = track.keyframes[index].time;
+		float deltaTime = track.keyframes[nextIndex].time - startTime;
+		float factor = (animTime - startTime) / deltaTime;
 
-		// Position
-		const glm::vec3 &startPos = keyFrameList[index].position;
-		const glm::vec3 &endPos = keyFrameList[nextIndex].position;
+		glm::vec3 startPos, endPos;
+		glm::quat startRot, endRot;
+		animclip::DecodeKeyframe(track, index, startPos, startRot);
+		animclip::DecodeKeyframe(track, nextIndex, endPos, endRot);
 
+		// Position
 		glm::vec3 deltaPos = endPos - startPos;
 		position = startPos + factor * deltaPos;
 
 		// Rotation
-		const glm::quat &startRot = keyFrameList[index].rotation;
-		const glm::quat &endRot = keyFrameList[nextIndex].rotation;
 		rot = glm::slerp(startRot, endRot, factor);
 		rot = glm::normalize(rot);
-
-		// Scale
-		const glm::vec3 &startScale = keyFrameList[index].scale;
-		const glm::vec3 &endScale = keyFrameList[nextIndex].scale;
-
-		glm::vec3 deltaScale = endScale - startScale;
-		scale = startScale + factor * deltaScale;
 	}
 
-	void AnimatedModel::UpdateBoneTree(float curAnimTime, float nextAnimTime, const Bone *bone, const glm::mat4 &parentTransform)
+	// The pose is evaluated in stages that each go linearly over the skeleton: sample the animations into local poses,
+	// blend them if we're transitioning and then go from local to model space and compute the skinning matrices
+	void AnimatedModel::UpdateSkeleton(float curAnimTime, float nextAnimTime)
 	{
-		glm::mat4 nodeTransformation = bone->transformation;
-
-		glm::vec3 curAnimPos = glm::vec3(0.0f);
-		glm::vec3 curAnimScale = glm::vec3(1.0f);
-		glm::quat curAnimRot = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		AnimationTracks &curTracks = animationTracks[currentAnimation];
 
-		glm::vec3 nextAnimPos = glm::vec3(0.0f);
-		glm::vec3 nextAnimScale = glm::vec3(1.0f);
-		glm::quat nextAnimRot = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		SamplePose(curAnimTime, curTracks, curPose);
 
 		if (shouldTransition || shouldRevert)
 		{
-			bool can = false;
-			bool can2 = false;
-			const KeyFrameList &curAnimKeyframes = animations[currentAnimation]->bonesKeyframesList[bone->name];
-			const KeyFrameList &nextAnimKeyframes = animations[nextAnim]->bonesKeyframesList[bone->name];
+			AnimationTracks &nextTracks = animationTracks[nextAnim];
 
-			if (curAnimKeyframes.size() >= 1)
-			{
-				Interpolate(curAnimTime, curAnimPos, curAnimRot, curAnimScale, curAnimKeyframes);
-				can = true;
-			}
-			if (nextAnimKeyframes.size() >= 1)
-			{
-				Interpolate(nextAnimTime, nextAnimPos, nextAnimRot, nextAnimScale, nextAnimKeyframes);
-				can2 = true;
-			}
-
-			if (can && can2)
-			{
-				glm::vec3 interpPos = glm::mix(curAnimPos, nextAnimPos, blendFactor);
-				glm::quat intertRot = glm::slerp(curAnimRot, nextAnimRot, blendFactor);
-				intertRot = glm::normalize(intertRot);
-				//glm::vec3 interpScale = glm::mix(curAnimScale, nextAnimScale, blendFactor);
-
-				glm::mat4 transM = glm::translate(glm::mat4(1.0f), interpPos);
-				glm::mat4 rotM = glm::mat4_cast(intertRot);
-				//glm::mat4 scaleM = glm::scale(glm::mat4(1.0f), interpScale);
-
-				nodeTransformation = transM * rotM;
-			}
+			SamplePose(nextAnimTime, nextTracks, nextPose);
+			BlendPoses(curTracks, nextTracks);
+			ComputeSkinningMatrices(curTracks, &nextTracks);
 		}
 		else
 		{
-			const KeyFrameList &curAnimKeyframes = animations[currentAnimation]->bonesKeyframesList[bone->name];
-
-			if (curAnimKeyframes.size() >= 1)
-			{
-				Interpolate(curAnimTime, curAnimPos, curAnimRot, curAnimScale, curAnimKeyframes);
+			ComputeSkinningMatrices(curTracks, nullptr);
+		}
+	}
 
-				glm::mat4 transM = glm::translate(glm::mat4(1.0f), curAnimPos);
-				glm::mat4 rotM = glm::mat4_cast(curAnimRot);
-				//glm::mat4 scaleM = glm::scale(glm::mat4(1.0f), curAnimScale);
+	void AnimatedModel::SamplePose(float animTime, AnimationTracks &tracks, std::vector<JointPose> &pose)
+	{
+		for (size_t i = 0; i < skeleton.size(); i++)
+		{
+			const AnimationTrack *track = tracks.boneTracks[i];
 
-				nodeTransformation = transM * rotM;
-			}
+			if (track)
+				Interpolate(animTime, pose[i].position, pose[i].rotation, *track, tracks.cursors[i]);
 		}
+	}
 
-		glm::mat4 globalTransformation = parentTransform * nodeTransformation;
-
-		if (boneMap.find(bone->name) != boneMap.end())
+	void AnimatedModel::BlendPoses(const AnimationTracks &curTracks, const AnimationTracks &nextTracks)
+	{
+		for (size_t i = 0; i < skeleton.size(); i++)
 		{
-			unsigned int boneIndex = boneMap[bone->name];
-			// Multiply with the offset matrix to bring the bone from local space to bone space
-			// Then multiply this bone's transformation and all it's parents
-			boneTransforms[boneIndex] = globalInvTransform * globalTransformation * boneOffsetMatrices[boneIndex];
-			//boneTransforms[boneIndex] = glm::mat4(1.0f);
+			// Only the nodes animated by both animations are blended, the others stay in the bind pose
+			if (curTracks.boneTracks[i] == nullptr || nextTracks.boneTracks[i] == nullptr)
+				continue;
+
+			JointPose &p = curPose[i];
+			p.position = glm::mix(p.position, nextPose[i].position, blendFactor);
+			p.rotation = glm::normalize(glm::slerp(p.rotation, nextPose[i].rotation, blendFactor));
 		}
+	}
 
-		for (unsigned int i = 0; i < bone->children.size(); i++)
+	void AnimatedModel::ComputeSkinningMatrices(const AnimationTracks &curTracks, const AnimationTracks *nextTracks)
+	{
+		// Parents come before their children so their model space transform is always ready
+		for (size_t i = 0; i < skeleton.size(); i++)
 		{
-			UpdateBoneTree(curAnimTime, nextAnimTime, bone->children[i], globalTransformation);
+			const SkeletonNode &node = skeleton[i];
+
+			bool animated = curTracks.boneTracks[i] != nullptr;
+			if (nextTracks)
+				animated = animated && nextTracks->boneTracks[i] != nullptr;
+
+			glm::mat4 nodeTransformation;
+
+			if (animated)
+			{
+				// Same as translate * mat4_cast(rotation) without the matrix multiplication
+				const JointPose &p = curPose[i];
+				nodeTransformation = glm::mat4_cast(p.rotation);
+				nodeTransformation[3] = glm::vec4(p.position, 1.0f);
+			}
+			else
+			{
+				nodeTransformation = node.bindTransform;
+			}
+
+			if (node.parent >= 0)
+				nodeTransforms[i] = nodeTransforms[node.parent] * nodeTransformation;
+			else
+				nodeTransforms[i] = nodeTransformation;
+
+			if (node.boneIndex >= 0)
+			{
+				// Multiply with the offset matrix to bring the bone from local space to bone space
+				// Then multiply this bone's transformation and all it's parents
+				boneTransforms[node.boneIndex] = globalInvTransform * nodeTransforms[i] * boneOffsetMatrices[node.boneIndex];
+			}
 		}
 	}
 
-	void AnimatedModel::GetBoneTransform(const Bone *bone, glm::mat4 &transform)
+	void AnimatedModel::GetBoneTransform(unsigned int node, glm::mat4 &transform)
 	{
-		if (boneMap.find(bone->name) != boneMap.end())
+		int index = static_cast<int>(node);
+
+		while (index >= 0)
 		{
-			glm::mat4 m = bone->transformation;				// The bone's x position is flipped. Handedness different?
-			m[3].x = -m[3].x;
-			transform = globalInvTransform * m * transform;
-		}
+			const SkeletonNode &n = skeleton[index];
+
+			if (n.boneIndex >= 0)
+			{
+				glm::mat4 m = n.bindTransform;				// The bone's x position is flipped. Handedness different?
+				m[3].x = -m[3].x;
+				transform = globalInvTransform * m * transform;
+			}
 
-		if (bone->parent)
-			GetBoneTransform(bone->parent, transform);
+			index = n.parent;
+		}
 	}
 
 	void AnimatedModel::AddAnimation(Animation *anim)
@@ -366,6 +478,7 @@ namespace Engine
 
 		animations.push_back(anim);
 		anim->AddReference();
+		BindAnimation(anim);
 	}
 
 	void AnimatedModel::SetAnimationController(FileManager *fileManager, const std::string &controllerPath, ModelManager *modelManager)
@@ -509,6 +622,12 @@ namespace Engine
 	{
 		isDirty = false;
 
+		UpdatePose(deltaTime);
+		UpdateBoneAttachments(transformManager, self);
+	}
+
+	void AnimatedModel::UpdatePose(float deltaTime)
+	{
 		if (animations.size() > 0 && !isPaused)
 		{
 			elapsedTime += deltaTime;
@@ -583,18 +702,22 @@ namespace Engine
 				isAnimationFinished = true;				
 			}
 
-			glm::mat4 identity = glm::mat4(1.0f);
-			UpdateBoneTree(curAnimTime, nextAnimTime, rootBone, identity);
+			UpdateSkeleton(curAnimTime, nextAnimTime);
 		}
+	}
 
-		// Update bone attachments
+	void AnimatedModel::UpdateBoneAttachments(TransformManager &transformManager, Entity self)
+	{
 		for (unsigned short i = 0; i < curBoneAttachments; i++)
 		{
-			unsigned int boneIndex = boneMap[boneAttachments[i].bone->name];
+			const unsigned int node = boneAttachments[i].bone->index;
+			const int boneIndex = skeleton[node].boneIndex;
 			glm::mat4 curBoneTransform = glm::mat4(1.0f);
 
-			GetBoneTransform(boneAttachments[i].bone, curBoneTransform);
-			curBoneTransform = /*self->GetLocalToWorldTransform() **/ boneTransforms[boneIndex] * curBoneTransform;
+			GetBoneTransform(node, curBoneTransform);
+
+			if (boneIndex >= 0)
+				curBoneTransform = /*self->GetLocalToWorldTransform() **/ boneTransforms[boneIndex] * curBoneTransform;
 
 			if (transformManager.HasParent(boneAttachments[i].boneTransformEntity) == false)
 				transformManager.SetParent(boneAttachments[i].boneTransformEntity, self);
@@ -768,6 +891,7 @@ namespace Engine
 				Animation *a = game->GetModelManager().LoadAnimation(path);
 				a->AddReference();
 				animations.push_back(a);
+				BindAnimation(a);
 			}
 		}
 
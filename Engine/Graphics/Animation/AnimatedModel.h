@@ -3,7 +3,7 @@
 #include "Game/ComponentManagers/TransformManager.h"
 #include "Graphics/Model.h"
 #include "AnimationController.h"
-#include "AnimationController.h"
+#include "AnimationClip.h"
 
 #include "Program/Utils.h"
 
@@ -19,22 +19,13 @@ struct aiNode;
 
 namespace Engine
 {
-	struct Keyframe
-	{
-		glm::vec3 position;
-		glm::quat rotation;
-		glm::vec3 scale;
-		float time;
-	};
-
-	typedef std::vector<Keyframe> KeyFrameList;
-
 	struct Bone
 	{
 		std::string name;
 		glm::mat4 transformation;			// Bone transformation relative to parent
 		std::vector<Bone*> children;
 		Bone *parent;
+		unsigned int index;					// Index of this bone in the flattened skeleton
 
 		~Bone()
 		{
@@ -46,6 +37,22 @@ namespace Engine
 		}
 	};
 
+	// Bone of the flattened skeleton. The nodes are stored in depth first order so a parent always comes before its children
+	// and the whole hierarchy can be evaluated with a single pass over the array
+	struct SkeletonNode
+	{
+		glm::mat4 bindTransform;			// Transformation relative to the parent when the bone is not animated
+		int parent;							// -1 for the root
+		int boneIndex;						// Index into the bone transforms or -1 if no vertex is skinned to this bone
+	};
+
+	// Local transformation of a skeleton node sampled from an animation
+	struct JointPose
+	{
+		glm::quat rotation;
+		glm::vec3 position;
+	};
+
 	struct BoneAttachment
 	{
 		Bone *bone;
@@ -61,7 +68,7 @@ namespace Engine
 		float ticksPerSecond;
 		//bool loadedSeparately;
 		//bool useRootMotion;
-		std::map<std::string, KeyFrameList> bonesKeyframesList;	// Maps a bone name to a list of all those bone's keyframes for this animation
+		std::map<std::string, AnimationTrack> tracks;			// Maps a bone name to the compressed keyframes of that bone for this animation
 
 		unsigned int refCount;
 
@@ -86,6 +93,8 @@ namespace Engine
 		std::map<std::string, unsigned int> &GetBoneMap() { return boneMap; }
 		std::vector<glm::mat4> &GetBoneTransforms() { return boneTransforms; }
 		std::vector<glm::mat4> &GetBoneOffsetMatrices() { return boneOffsetMatrices; }
+		// Flattens the bone tree under the root bone and resolves the animations to it. Must be called again if the bones or the bone map change
+		void BuildSkeleton();
 
 		unsigned short AddBoneAttachment(Game *game, Bone *bone, Entity attachedEntity);
 		unsigned short AddBoneAttachment(Game *game, const std::string &boneName, Entity attachedEntity);
@@ -98,10 +107,15 @@ namespace Engine
 		void Dispose(Game *game);
 
 		void SetDirty() { isDirty = true; }
+		void ClearDirty() { isDirty = false; }
 		bool IsDirty() const { return isDirty; }
 
 		void UpdateController();
 		void UpdateBones(TransformManager &transformManager, Entity self, float deltaTime);
+		// Only touches this model's data so different models can update their pose in parallel
+		void UpdatePose(float deltaTime);
+		// Modifies the transform manager so it has to run on a single thread
+		void UpdateBoneAttachments(TransformManager &transformManager, Entity self);
 		void PlayAnimationStr(const std::string &name);
 		void PlayAnimation(unsigned int index);
 		void PauseAnimation(bool pause);
@@ -128,20 +142,38 @@ namespace Engine
 		void ReplaceBoneAttachmentEntity(unsigned int boneAttachID, Entity newAttachedEntity);
 
 	private:
+		// The keyframes of an animation resolved to the skeleton nodes of this model, so the update doesn't need to look up the bones by name.
+		// Animations are shared between models with different skeletons which is why this lives in the model
+		struct AnimationTracks
+		{
+			std::vector<const AnimationTrack*> boneTracks;	// Null if the animation doesn't move the node
+			std::vector<unsigned int> cursors;				// Last keyframe found for each node
+		};
+
 		//bool FindBone(aiAnimation *anim, const std::string &nodeName);
 
 		void LoadModel(Renderer *renderer, ScriptManager &scriptManager, const std::vector<std::string> &matNames);
 		void ReadBoneTree(Serializer &s, Bone *bone);
+		void FlattenBoneTree(Bone *bone, int parent);
+		void BindAnimation(const Animation *anim);
 
-		unsigned int FindKeyFrame(float animTime, const KeyFrameList &keyFrameList);
-		void Interpolate(float animTime, glm::vec3 &position, glm::quat &rot, glm::vec3 &scale, const KeyFrameList &keyFrameList);
-		void UpdateBoneTree(float curAnimTime, float nextAnimTime, const Bone *bone, const glm::mat4 &parentTransform);
+		unsigned int FindKeyFrame(float animTime, const AnimationTrack &track, unsigned int &cursor);
+		void Interpolate(float animTime, glm::vec3 &position, glm::quat &rot, const AnimationTrack &track, unsigned int &cursor);
+		void UpdateSkeleton(float curAnimTime, float nextAnimTime);
+		void SamplePose(float animTime, AnimationTracks &tracks, std::vector<JointPose> &pose);
+		void BlendPoses(const AnimationTracks &curTracks, const AnimationTracks &nextTracks);
+		void ComputeSkinningMatrices(const AnimationTracks &curTracks, const AnimationTracks *nextTracks);
 
-		void GetBoneTransform(const Bone *bone, glm::mat4 &transform);
+		void GetBoneTransform(unsigned int node, glm::mat4 &transform);
 		void FindBoneByName(Bone *startingBone, const std::string &boneName, Bone **outBone);
 
 	private:
 		Bone *rootBone;
+		std::vector<SkeletonNode> skeleton;
+		std::vector<glm::mat4> nodeTransforms;				// Model space transform of each skeleton node, reused every update
+		std::vector<JointPose> curPose;						// Sampled from the current animation. Holds the blended pose when transitioning
+		std::vector<JointPose> nextPose;					// Sampled from the animation we're transitioning to
+		std::vector<AnimationTracks> animationTracks;		// One for each animation
 		AnimationController *animController;
 		std::vector<glm::mat4> boneTransforms;
 		std::vector<glm::mat4> boneOffsetMatrices;
@@ -0,0 +1,178 @@
+#include "AnimationBenchmark.h"
+
+#include "AnimatedModel.h"
+#include "Program/JobSystem.h"
+#include "Program/Log.h"
+
+#include "include/glm/gtc/matrix_transform.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <thread>
+
+namespace Engine
+{
+	static const unsigned int BENCHMARK_KEYFRAMES = 30;
+	static const float BENCHMARK_TICKS_PER_SECOND = 30.0f;
+	static const float BENCHMARK_FRAME_TIME = 1.0f / 60.0f;
+
+	// Every bone moves in each animation, with a different speed and phase so the compression can't remove most of the keyframes
+	static Animation *CreateBenchmarkAnimation(const std::string &name, unsigned int boneCount, float speed, std::mt19937 &mt)
+	{
+		std::uniform_real_distribution<float> phaseDist(0.0f, 6.2831853f);
+
+		Animation *anim = new Animation;
+		anim->refCount = 0;
+		anim->AddReference();
+		anim->name = name;
+		anim->duration = static_cast<float>(BENCHMARK_KEYFRAMES);
+		anim->ticksPerSecond = BENCHMARK_TICKS_PER_SECOND;
+
+		KeyFrameList keyframes(BENCHMARK_KEYFRAMES + 1);
+
+		for (unsigned int b = 0; b < boneCount; b++)
+		{
+			const float phase = phaseDist(mt);
+			const glm::vec3 axis = glm::normalize(glm::vec3(1.0f, static_cast<float>(b % 3), static_cast<float>(b % 5)));
+
+			for (unsigned int k = 0; k < keyframes.size(); k++)
+			{
+				const float t = static_cast<float>(k) / BENCHMARK_KEYFRAMES * 6.2831853f * speed + phase;
+
+				keyframes[k].time = static_cast<float>(k);
+				keyframes[k].rotation = glm::angleAxis(0.4f * sinf(t), axis);
+				keyframes[k].position = glm::vec3(0.0f, 0.1f + 0.01f * cosf(t), 0.0f);
+				keyframes[k].scale = glm::vec3(1.0f);
+			}
+
+			animclip::CompressTrack(keyframes, anim->tracks["bone" + std::to_string(b)]);
+		}
+
+		return anim;
+	}
+
+	// Bones are in a binary tree so the hierarchy has the depth of a humanoid skeleton, around 6 levels for 64 bones
+	static AnimatedModel *CreateBenchmarkCharacter(unsigned int boneCount, Animation *walk, Animation *run, unsigned int index)
+	{
+		AnimatedModel *model = new AnimatedModel();
+
+		std::vector<Bone*> bones(boneCount);
+		bones[0] = model->GetRootBone();
+
+		for (unsigned int b = 0; b < boneCount; b++)
+		{
+			if (b > 0)
+			{
+				Bone *parent = bones[(b - 1) / 2];
+				bones[b] = new Bone;
+				bones[b]->parent = parent;
+				bones[b]->index = 0;
+				parent->children.push_back(bones[b]);
+			}
+
+			bones[b]->name = "bone" + std::to_string(b);
+			bones[b]->transformation = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.1f, 0.0f));
+
+			model->GetBoneMap()[bones[b]->name] = b;
+			model->AddBoneOffsetMatrix(glm::mat4(1.0f));
+			model->AddBoneTransform(glm::mat4(1.0f));
+		}
+
+		model->SetGlobalInvTransform(glm::mat4(1.0f));
+		model->BuildSkeleton();
+		model->AddAnimation(walk);
+		model->AddAnimation(run);
+		model->PlayAnimation(0);
+
+		// Start each character at a different time of the animation
+		model->UpdatePose(static_cast<float>(index % BENCHMARK_KEYFRAMES) / BENCHMARK_TICKS_PER_SECOND);
+
+		if (index % 2 == 1)
+			model->TransitionTo(1, 1000.0f, true);		// Long enough to keep blending for the whole benchmark
+
+		return model;
+	}
+
+	bool RunAnimationBenchmark(unsigned int characterCount, unsigned int boneCount, unsigned int frames, unsigned int seed)
+	{
+		if (characterCount == 0 || boneCount == 0 || frames == 0)
+			return true;
+
+		std::mt19937 mt(seed);
+		Animation *walk = CreateBenchmarkAnimation("walk", boneCount, 1.0f, mt);
+		Animation *run = CreateBenchmarkAnimation("run", boneCount, 2.0f, mt);
+
+		const unsigned int hardwareThreads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+
+		std::vector<unsigned int> threadCounts;
+		for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2)
+			threadCounts.push_back(threads);
+		threadCounts.push_back(hardwareThreads);
+
+		std::vector<AnimatedModel*> characters(characterCount);
+		std::vector<glm::mat4> referenceTransforms;
+		double singleThreadTime = 0.0;
+		unsigned int poseMismatches = 0;
+
+		Log::Print(LogLevel::LEVEL_INFO, "Animation benchmark: %u characters with %u bones, %u frames\n", characterCount, boneCount, frames);
+
+		for (size_t t = 0; t < threadCounts.size(); t++)
+		{
+			// New characters for each run so every run computes the same poses
+			for (unsigned int i = 0; i < characterCount; i++)
+				characters[i] = CreateBenchmarkCharacter(boneCount, walk, run, i);
+
+			JobSystem jobSystem;
+			jobSystem.Init(static_cast<int>(threadCounts[t]) - 1);
+
+			AnimatedModel **models = characters.data();
+			auto updatePoses = [models](unsigned int start, unsigned int end)
+			{
+				for (unsigned int i = start; i < end; i++)
+					models[i]->UpdatePose(BENCHMARK_FRAME_TIME);
+			};
+
+			std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+
+			for (unsigned int f = 0; f < frames; f++)
+			{
+				// Same group size as the model manager uses for the visible animated models
+				JobCounter counter;
+				jobSystem.ParallelFor(characterCount, 1, updatePoses, &counter);
+				jobSystem.Wait(&counter);
+			}
+
+			std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+			jobSystem.Dispose();
+
+			const double time = std::chrono::duration<double, std::milli>(t2 - t1).count();
+			if (t == 0)
+				singleThreadTime = time;
+
+			Log::Print(LogLevel::LEVEL_INFO, "%u threads: %.3f ms/frame, %.2fx\n", threadCounts[t], time / frames, singleThreadTime / time);
+
+			// The poses can't depend on how the characters were split between the threads
+			for (unsigned int i = 0; i < characterCount; i++)
+			{
+				const std::vector<glm::mat4> &boneTransforms = characters[i]->GetBoneTransforms();
+
+				if (t == 0)
+					referenceTransforms.insert(referenceTransforms.end(), boneTransforms.begin(), boneTransforms.end());
+				else if (std::memcmp(boneTransforms.data(), &referenceTransforms[i * boneCount], boneCount * sizeof(glm::mat4)) != 0)
+					poseMismatches++;
+
+				characters[i]->RemoveReference();
+			}
+		}
+
+		walk->RemoveReference();
+		run->RemoveReference();
+
+		if (poseMismatches > 0)
+			Log::Print(LogLevel::LEVEL_ERROR, "Animation benchmark computed different poses with more threads in %u characters\n", poseMismatches);
+
+		return poseMismatches == 0;
+	}
+}
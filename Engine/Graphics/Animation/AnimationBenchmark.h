@@ -0,0 +1,9 @@
+#pragma once
+
+namespace Engine
+{
+	// Updates the pose of characters with a synthetic skeleton and two animations through the job system with different thread counts
+	// and logs the time per frame. Half of the characters are blending between the animations. Doesn't need a renderer so it can run from the editor or a tool.
+	// Returns false if the poses computed with more threads don't match the single thread ones
+	bool RunAnimationBenchmark(unsigned int characterCount = 500, unsigned int boneCount = 64, unsigned int frames = 120, unsigned int seed = 1);
+}
@@ -0,0 +1,216 @@
+#include "AnimationClip.h"
+
+#include "Program/Serializer.h"
+
+#include <cmath>
+#include <cstdint>
+
+namespace Engine
+{
+	namespace animclip
+	{
+		static const float SQRT2 = 1.41421356f;
+		static const float QUAT_COMPONENT_MAX = 32767.0f;		// 15 bits
+		static const float POSITION_MAX = 65535.0f;				// 16 bits
+
+		// For small angles the distance between two unit quaternions is half the angle between the rotations. Comparing the dot product
+		// against the cosine of the tolerance would be more direct but it's too close to 1 for the precision of a float
+		static bool IsRotationWithinTolerance(const glm::quat &a, const glm::quat &b, float maxDistance)
+		{
+			const float sign = glm::dot(a, b) < 0.0f ? -1.0f : 1.0f;
+			const glm::vec4 d = glm::vec4(a.x, a.y, a.z, a.w) - sign * glm::vec4(b.x, b.y, b.z, b.w);
+			return glm::dot(d, d) <= maxDistance * maxDistance;
+		}
+
+		static bool IsPositionWithinTolerance(const glm::vec3 &a, const glm::vec3 &b, float tolerance)
+		{
+			const glm::vec3 d = glm::abs(a - b);
+			return d.x <= tolerance && d.y <= tolerance && d.z <= tolerance;
+		}
+
+		// Checks if every keyframe between first and last can be rebuilt by interpolating first and last, the same way the animated model does it
+		static bool CanRemoveKeyframes(const KeyFrameList &keyframes, unsigned int first, unsigned int last, float positionTolerance, float maxRotationDistance)
+		{
+			const Keyframe &a = keyframes[first];
+			const Keyframe &b = keyframes[last];
+			const float deltaTime = b.time - a.time;
+
+			for (unsigned int i = first + 1; i < last; i++)
+			{
+				const Keyframe &k = keyframes[i];
+				const float factor = deltaTime > 0.0f ? (k.time - a.time) / deltaTime : 0.0f;
+
+				const glm::vec3 position = a.position + factor * (b.position - a.position);
+				const glm::quat rotation = glm::normalize(glm::slerp(a.rotation, b.rotation, factor));
+
+				if (!IsPositionWithinTolerance(position, k.position, positionTolerance) || !IsRotationWithinTolerance(rotation, k.rotation, maxRotationDistance))
+					return false;
+			}
+
+			return true;
+		}
+
+		void CompressTrack(const KeyFrameList &keyframes, AnimationTrack &track, float positionTolerance, float rotationTolerance)
+		{
+			track.keyframes.clear();
+			track.positionMin = glm::vec3(0.0f);
+			track.positionExtent = glm::vec3(0.0f);
+
+			if (keyframes.size() == 0)
+				return;
+
+			const unsigned int numKeyframes = static_cast<unsigned int>(keyframes.size());
+
+			const float maxRotationDistance = rotationTolerance * 0.5f;
+
+			std::vector<unsigned int> kept;
+
+			// Bones that don't move only need one keyframe
+			bool constant = true;
+			for (unsigned int i = 1; i < numKeyframes; i++)
+			{
+				if (!IsPositionWithinTolerance(keyframes[0].position, keyframes[i].position, positionTolerance) || !IsRotationWithinTolerance(keyframes[0].rotation, keyframes[i].rotation, maxRotationDistance))
+				{
+					constant = false;
+					break;
+				}
+			}
+
+			kept.push_back(0);
+
+			if (!constant)
+			{
+				// Keep extending the segment from the last kept keyframe until the keyframes in between can't be interpolated anymore
+				unsigned int first = 0;
+				for (unsigned int last = 2; last < numKeyframes; last++)
+				{
+					if (!CanRemoveKeyframes(keyframes, first, last, positionTolerance, maxRotationDistance))
+					{
+						first = last - 1;
+						kept.push_back(first);
+					}
+				}
+
+				kept.push_back(numKeyframes - 1);
+			}
+
+			glm::vec3 positionMax = keyframes[kept[0]].position;
+			track.positionMin = positionMax;
+
+			for (size_t i = 1; i < kept.size(); i++)
+			{
+				track.positionMin = glm::min(track.positionMin, keyframes[kept[i]].position);
+				positionMax = glm::max(positionMax, keyframes[kept[i]].position);
+			}
+
+			track.positionExtent = positionMax - track.positionMin;
+
+			track.keyframes.resize(kept.size());
+
+			for (size_t i = 0; i < kept.size(); i++)
+			{
+				const Keyframe &k = keyframes[kept[i]];
+				CompressedKeyframe &ck = track.keyframes[i];
+
+				ck.time = k.time;
+				PackQuaternion(k.rotation, ck.rotation);
+
+				for (int j = 0; j < 3; j++)
+				{
+					const float range = track.positionExtent[j];
+					const float n = range > 0.0f ? (k.position[j] - track.positionMin[j]) / range : 0.0f;
+					ck.position[j] = static_cast<unsigned short>(glm::clamp(n, 0.0f, 1.0f) * POSITION_MAX + 0.5f);
+				}
+			}
+		}
+
+		void DecodeKeyframe(const AnimationTrack &track, unsigned int index, glm::vec3 &position, glm::quat &rotation)
+		{
+			const CompressedKeyframe &ck = track.keyframes[index];
+
+			const glm::vec3 n = glm::vec3(ck.position[0], ck.position[1], ck.position[2]) * (1.0f / POSITION_MAX);
+			position = track.positionMin + n * track.positionExtent;
+			rotation = UnpackQuaternion(ck.rotation);
+		}
+
+		void PackQuaternion(const glm::quat &q, unsigned short *packed)
+		{
+			const glm::quat nq = glm::normalize(q);
+			const float c[4] = { nq.x, nq.y, nq.z, nq.w };
+
+			unsigned int largest = 0;
+			for (unsigned int i = 1; i < 4; i++)
+			{
+				if (std::fabs(c[i]) > std::fabs(c[largest]))
+					largest = i;
+			}
+
+			// q and -q are the same rotation so flip it to make the largest component positive, then it can be rebuilt from the other three
+			const float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+			uint64_t bits = largest;
+
+			for (unsigned int i = 0; i < 4; i++)
+			{
+				if (i == largest)
+					continue;
+
+				// The other components are in [-1/sqrt(2), 1/sqrt(2)]
+				const float v = glm::clamp(c[i] * sign * SQRT2, -1.0f, 1.0f);
+				const uint64_t u = static_cast<uint64_t>((v * 0.5f + 0.5f) * QUAT_COMPONENT_MAX + 0.5f);
+				bits = (bits << 15) | u;
+			}
+
+			packed[0] = static_cast<unsigned short>((bits >> 32) & 0xFFFF);
+			packed[1] = static_cast<unsigned short>((bits >> 16) & 0xFFFF);
+			packed[2] = static_cast<unsigned short>(bits & 0xFFFF);
+		}
+
+		glm::quat UnpackQuaternion(const unsigned short *packed)
+		{
+			uint64_t bits = (static_cast<uint64_t>(packed[0]) << 32) | (static_cast<uint64_t>(packed[1]) << 16) | static_cast<uint64_t>(packed[2]);
+
+			const unsigned int largest = static_cast<unsigned int>((bits >> 45) & 0x3);
+
+			float c[4];
+			float sum = 0.0f;
+
+			// The components were packed in order so the last one is in the lowest bits
+			for (int i = 3; i >= 0; i--)
+			{
+				if (i == static_cast<int>(largest))
+					continue;
+
+				const float v = (static_cast<float>(bits & 0x7FFF) / QUAT_COMPONENT_MAX * 2.0f - 1.0f) / SQRT2;
+				bits >>= 15;
+
+				c[i] = v;
+				sum += v * v;
+			}
+
+			c[largest] = std::sqrt(glm::max(0.0f, 1.0f - sum));
+
+			return glm::quat(c[3], c[0], c[1], c[2]);
+		}
+
+		void WriteTrack(Serializer &s, const AnimationTrack &track)
+		{
+			s.Write(track.positionMin);
+			s.Write(track.positionExtent);
+			s.Write(static_cast<unsigned int>(track.keyframes.size()));
+			s.Write(track.keyframes.data(), static_cast<unsigned int>(track.keyframes.size() * sizeof(CompressedKeyframe)));
+		}
+
+		void ReadTrack(Serializer &s, AnimationTrack &track)
+		{
+			unsigned int numKeyframes = 0;
+
+			s.Read(track.positionMin);
+			s.Read(track.positionExtent);
+			s.Read(numKeyframes);
+
+			track.keyframes.resize(numKeyframes);
+			s.Read(track.keyframes.data(), static_cast<unsigned int>(numKeyframes * sizeof(CompressedKeyframe)));
+		}
+	}
+}
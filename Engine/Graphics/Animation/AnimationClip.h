@@ -0,0 +1,54 @@
+#pragma once
+
+#include "include/glm/glm.hpp"
+#include "include/glm/gtc/quaternion.hpp"
+
+#include <vector>
+
+namespace Engine
+{
+	class Serializer;
+
+	// Uncompressed keyframe as it comes from the importer
+	struct Keyframe
+	{
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+		float time;
+	};
+
+	typedef std::vector<Keyframe> KeyFrameList;
+
+	// 16 bytes instead of the 44 of a Keyframe. Scale is dropped because the importer always sets it to 1
+	struct CompressedKeyframe
+	{
+		float time;
+		unsigned short rotation[3];				// Smallest three quaternion in 48 bits. 2 bits for the index of the largest component and 15 bits for each of the others
+		unsigned short position[3];				// Quantized to 16 bits in the position range of the track
+	};
+
+	// Keyframes of a single bone. Sampled directly by the animated models
+	struct AnimationTrack
+	{
+		glm::vec3 positionMin;
+		glm::vec3 positionExtent;
+		std::vector<CompressedKeyframe> keyframes;
+	};
+
+	namespace animclip
+	{
+		static const float DEFAULT_POSITION_TOLERANCE = 0.0005f;
+		static const float DEFAULT_ROTATION_TOLERANCE = 0.001f;		// In radians
+
+		// Removes the keyframes that can be rebuilt by interpolating their neighbours within the tolerances and quantizes the rest
+		void CompressTrack(const KeyFrameList &keyframes, AnimationTrack &track, float positionTolerance = DEFAULT_POSITION_TOLERANCE, float rotationTolerance = DEFAULT_ROTATION_TOLERANCE);
+		void DecodeKeyframe(const AnimationTrack &track, unsigned int index, glm::vec3 &position, glm::quat &rotation);
+
+		void PackQuaternion(const glm::quat &q, unsigned short *packed);
+		glm::quat UnpackQuaternion(const unsigned short *packed);
+
+		void WriteTrack(Serializer &s, const AnimationTrack &track);
+		void ReadTrack(Serializer &s, AnimationTrack &track);
+	}
+}
@@ -1,5 +1,13 @@
 #include "Frustum.h"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_CULL_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FRUSTUM_CULL_NEON
+#include <arm_neon.h>
+#endif
+
 namespace Engine
 {
 	void Frustum::UpdateProjection(float left, float right, float bottom, float top, float near, float far)
@@ -87,6 +95,12 @@ namespace Engine
 		return result;
 	}
 
+	void Frustum::GetPlanes(glm::vec4 *out) const
+	{
+		for (int i = 0; i < 6; i++)
+			out[i] = glm::vec4(planes[i].normal, planes[i].d);
+	}
+
 	glm::vec3 Frustum::GetVertexPositive(const glm::vec3 &normal, const glm::vec3 &min, const glm::vec3 &max) const
 	{
 		glm::vec3 minn(min.x, min.y, min.z);
@@ -103,15 +117,190 @@ namespace Engine
 
 	glm::vec3 Frustum::GetVertexNegative(const glm::vec3 &normal, const glm::vec3 &min, const glm::vec3 &max) const
 	{
+		// The negative vertex is the one furthest along the opposite direction of the normal
 		glm::vec3 maxx(max.x, max.y, max.z);
 
-		if (normal.x <= 0)
+		if (normal.x >= 0)
 			maxx.x = min.x;
-		if (normal.y <= 0)
+		if (normal.y >= 0)
 			maxx.y = min.y;
-		if (normal.z <= 0)
+		if (normal.z >= 0)
 			maxx.z = min.z;
 
 		return maxx;
 	}
+
+	unsigned int Frustum::CullSpheres(const float *centerX, const float *centerY, const float *centerZ, unsigned int count, float radius, unsigned int *out) const
+	{
+		// A sphere is outside if for any plane the distance from its center is less than -radius
+		unsigned int numVisible = 0;
+		unsigned int i = 0;
+
+#if defined(FRUSTUM_CULL_SSE)
+		const unsigned int simdCount = count & ~3u;
+		const __m128 negRadius = _mm_set1_ps(-radius);
+
+		for (; i < simdCount; i += 4)
+		{
+			const __m128 cx = _mm_loadu_ps(centerX + i);
+			const __m128 cy = _mm_loadu_ps(centerY + i);
+			const __m128 cz = _mm_loadu_ps(centerZ + i);
+			__m128 outside = _mm_setzero_ps();
+
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 dist = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].normal.x), cx), _mm_set1_ps(planes[p].d));
+				dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(planes[p].normal.y), cy));
+				dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(planes[p].normal.z), cz));
+
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negRadius));
+			}
+
+			const int visibleMask = ~_mm_movemask_ps(outside) & 0xF;
+			if (visibleMask & 1) out[numVisible++] = i;
+			if (visibleMask & 2) out[numVisible++] = i + 1;
+			if (visibleMask & 4) out[numVisible++] = i + 2;
+			if (visibleMask & 8) out[numVisible++] = i + 3;
+		}
+#elif defined(FRUSTUM_CULL_NEON)
+		const unsigned int simdCount = count & ~3u;
+		const float32x4_t negRadius = vdupq_n_f32(-radius);
+
+		for (; i < simdCount; i += 4)
+		{
+			const float32x4_t cx = vld1q_f32(centerX + i);
+			const float32x4_t cy = vld1q_f32(centerY + i);
+			const float32x4_t cz = vld1q_f32(centerZ + i);
+			uint32x4_t outside = vdupq_n_u32(0);
+
+			for (int p = 0; p < 6; p++)
+			{
+				float32x4_t dist = vmlaq_f32(vdupq_n_f32(planes[p].d), vdupq_n_f32(planes[p].normal.x), cx);
+				dist = vmlaq_f32(dist, vdupq_n_f32(planes[p].normal.y), cy);
+				dist = vmlaq_f32(dist, vdupq_n_f32(planes[p].normal.z), cz);
+
+				outside = vorrq_u32(outside, vcltq_f32(dist, negRadius));
+			}
+
+			if (vgetq_lane_u32(outside, 0) == 0) out[numVisible++] = i;
+			if (vgetq_lane_u32(outside, 1) == 0) out[numVisible++] = i + 1;
+			if (vgetq_lane_u32(outside, 2) == 0) out[numVisible++] = i + 2;
+			if (vgetq_lane_u32(outside, 3) == 0) out[numVisible++] = i + 3;
+		}
+#endif
+
+		// Remaining spheres, or all of them if there's no SIMD support
+		for (; i < count; i++)
+		{
+			if (SphereInFrustum(glm::vec3(centerX[i], centerY[i], centerZ[i]), radius) != FrustumIntersect::OUTSIDE)
+				out[numVisible++] = i;
+		}
+
+		return numVisible;
+	}
+
+	unsigned int Frustum::CullBoxes(const BoxesSoA &boxes, unsigned int *out) const
+	{
+		// A box is outside if for any plane the distance from its center plus the projected half extents is negative. This is the same as testing the positive vertex
+		unsigned int numVisible = 0;
+		unsigned int i = 0;
+
+#if defined(FRUSTUM_CULL_SSE)
+		const unsigned int simdCount = boxes.count & ~3u;
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+
+		for (; i < simdCount; i += 4)
+		{
+			const __m128 cx = _mm_loadu_ps(boxes.centerX + i);
+			const __m128 cy = _mm_loadu_ps(boxes.centerY + i);
+			const __m128 cz = _mm_loadu_ps(boxes.centerZ + i);
+			const __m128 ex = _mm_loadu_ps(boxes.extentX + i);
+			const __m128 ey = _mm_loadu_ps(boxes.extentY + i);
+			const __m128 ez = _mm_loadu_ps(boxes.extentZ + i);
+			__m128 outside = zero;
+
+			for (int p = 0; p < 6; p++)
+			{
+				const __m128 nx = _mm_set1_ps(planes[p].normal.x);
+				const __m128 ny = _mm_set1_ps(planes[p].normal.y);
+				const __m128 nz = _mm_set1_ps(planes[p].normal.z);
+
+				__m128 dist = _mm_add_ps(_mm_mul_ps(nx, cx), _mm_set1_ps(planes[p].d));
+				dist = _mm_add_ps(dist, _mm_mul_ps(ny, cy));
+				dist = _mm_add_ps(dist, _mm_mul_ps(nz, cz));
+
+				__m128 radius = _mm_mul_ps(_mm_andnot_ps(signMask, nx), ex);
+				radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey));
+				radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+			}
+
+			const int visibleMask = ~_mm_movemask_ps(outside) & 0xF;
+			if (visibleMask & 1) out[numVisible++] = i;
+			if (visibleMask & 2) out[numVisible++] = i + 1;
+			if (visibleMask & 4) out[numVisible++] = i + 2;
+			if (visibleMask & 8) out[numVisible++] = i + 3;
+		}
+#elif defined(FRUSTUM_CULL_NEON)
+		const unsigned int simdCount = boxes.count & ~3u;
+		const float32x4_t zero = vdupq_n_f32(0.0f);
+
+		for (; i < simdCount; i += 4)
+		{
+			const float32x4_t cx = vld1q_f32(boxes.centerX + i);
+			const float32x4_t cy = vld1q_f32(boxes.centerY + i);
+			const float32x4_t cz = vld1q_f32(boxes.centerZ + i);
+			const float32x4_t ex = vld1q_f32(boxes.extentX + i);
+			const float32x4_t ey = vld1q_f32(boxes.extentY + i);
+			const float32x4_t ez = vld1q_f32(boxes.extentZ + i);
+			uint32x4_t outside = vdupq_n_u32(0);
+
+			for (int p = 0; p < 6; p++)
+			{
+				const float32x4_t nx = vdupq_n_f32(planes[p].normal.x);
+				const float32x4_t ny = vdupq_n_f32(planes[p].normal.y);
+				const float32x4_t nz = vdupq_n_f32(planes[p].normal.z);
+
+				float32x4_t dist = vmlaq_f32(vdupq_n_f32(planes[p].d), nx, cx);
+				dist = vmlaq_f32(dist, ny, cy);
+				dist = vmlaq_f32(dist, nz, cz);
+
+				float32x4_t radius = vmulq_f32(vabsq_f32(nx), ex);
+				radius = vmlaq_f32(radius, vabsq_f32(ny), ey);
+				radius = vmlaq_f32(radius, vabsq_f32(nz), ez);
+
+				outside = vorrq_u32(outside, vcltq_f32(vaddq_f32(dist, radius), zero));
+			}
+
+			if (vgetq_lane_u32(outside, 0) == 0) out[numVisible++] = i;
+			if (vgetq_lane_u32(outside, 1) == 0) out[numVisible++] = i + 1;
+			if (vgetq_lane_u32(outside, 2) == 0) out[numVisible++] = i + 2;
+			if (vgetq_lane_u32(outside, 3) == 0) out[numVisible++] = i + 3;
+		}
+#endif
+
+		// Remaining boxes, or all of them if there's no SIMD support
+		for (; i < boxes.count; i++)
+		{
+			const glm::vec3 c = glm::vec3(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+			const glm::vec3 e = glm::vec3(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+			bool outside = false;
+
+			for (int p = 0; p < 6; p++)
+			{
+				if (planes[p].Distance(c) + glm::dot(glm::abs(planes[p].normal), e) < 0.0f)
+				{
+					outside = true;
+					break;
+				}
+			}
+
+			if (!outside)
+				out[numVisible++] = i;
+		}
+
+		return numVisible;
+	}
 }
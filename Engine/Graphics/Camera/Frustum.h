@@ -2,6 +2,8 @@
 
 #include "include/glm/glm.hpp"
 
+#include <vector>
+
 namespace Engine
 {
 	struct Plane
@@ -76,6 +78,18 @@ namespace Engine
 		glm::vec3 fbr;
 	};
 
+	// Boxes stored as structure of arrays (center and half extents) so several of them can be tested against the frustum planes at once
+	struct BoxesSoA
+	{
+		const float *centerX;
+		const float *centerY;
+		const float *centerZ;
+		const float *extentX;
+		const float *extentY;
+		const float *extentZ;
+		unsigned int count;
+	};
+
 	class Frustum
 	{
 	public:
@@ -86,6 +100,16 @@ namespace Engine
 		FrustumIntersect SphereInFrustum(const glm::vec3 &sphereCenter, float radius) const;
 		FrustumIntersect BoxInFrustum(const glm::vec3 &min, const glm::vec3 &max) const;
 
+		// Writes the index of every sphere that is not outside the frustum into out and returns how many were written. All the spheres have the same radius
+		// Same as calling SphereInFrustum for each sphere but processes 4 at a time with SIMD when available
+		unsigned int CullSpheres(const float *centerX, const float *centerY, const float *centerZ, unsigned int count, float radius, unsigned int *out) const;
+		// Writes the index of every box that is not outside the frustum into out and returns how many were written
+		// Same as calling BoxInFrustum for each box but processes 4 at a time with SIMD when available
+		unsigned int CullBoxes(const BoxesSoA &boxes, unsigned int *out) const;
+
+		// Writes the 6 planes as (normal, d) so they can be used in shaders
+		void GetPlanes(glm::vec4 *out) const;
+
 		const FrustumCorners &GetCorners() const { return corners; }
 
 		FrustumType GetType() const { return frustumType; }
@@ -98,9 +98,18 @@ namespace Engine
 		frustums[5] = mainCamera->GetFrustum();
 		frustums[6] = uiCamera.GetFrustum();
 		
-		std::vector<VisibilityIndices> visibility = renderer->Cull(7, queueIDs, frustums);
-
-		renderer->CreateRenderQueues(7, queueIDs, visibility, renderQueues);
+		RenderQueueSortParams sortParams[7];
+		sortParams[0] = { RenderQueueSortMode::FRONT_TO_BACK, csmInfo.cameras[0].GetPosition(), true };
+		sortParams[1] = { RenderQueueSortMode::FRONT_TO_BACK, csmInfo.cameras[1].GetPosition(), true };
+		sortParams[2] = { RenderQueueSortMode::FRONT_TO_BACK, csmInfo.cameras[2].GetPosition(), true };
+		sortParams[3] = { RenderQueueSortMode::FRONT_TO_BACK, camPos, true };
+		sortParams[4] = { RenderQueueSortMode::FRONT_TO_BACK, camPos, true };
+		sortParams[5] = { RenderQueueSortMode::BACK_TO_FRONT, camPos, false };
+		sortParams[6] = { RenderQueueSortMode::NONE, camPos, false };			// The ui is drawn in the order it was added
+
+		VisibilityList visibility = renderer->Cull(7, queueIDs, frustums);
+
+		renderer->CreateRenderQueues(7, queueIDs, visibility, renderQueues, sortParams);
 		//renderer->CreateRenderQueues(7, queueIDs, frustums, renderQueues);
 
 		vctgi.EndFrame();
@@ -135,6 +144,20 @@ namespace Engine
 		hdrPass.AddImageInput("voxelTextureMipmapped", true);
 		hdrPass.AddBufferInput("voxelsIndirectBuffer", vctgi.GetIndirectBuffer());
 		hdrPass.AddBufferInput("voxelPositionsBuffer", vctgi.GetVoxelPositionsBuffer());
+
+		ParticleManager &particleManager = game->GetParticleManager();
+		if (particleManager.SupportsGPUParticles())
+		{
+			hdrPass.AddBufferInput("gpuParticlesBuffer", particleManager.GetGPUParticlesBuffer());
+			hdrPass.AddBufferInput("gpuParticlesAliveListBuffer", particleManager.GetGPUParticlesAliveListBuffer());
+			hdrPass.AddBufferInput("gpuParticlesIndirectBuffer", particleManager.GetGPUParticlesIndirectBuffer());
+		}
+
+		if (vegetationCulling.IsSupported())
+		{
+			hdrPass.AddBufferInput("vegetationVisibleInstancesBuffer", vegetationCulling.GetVisibleInstancesBuffer());
+			hdrPass.AddBufferInput("vegetationIndirectBuffer", vegetationCulling.GetIndirectBuffer());
+		}
 		hdrPass.AddDepthInput("shadowMap");
 		hdrPass.AddTextureInput("reflectionTex");
 		hdrPass.AddTextureInput("refractionTex");
@@ -187,6 +210,8 @@ namespace Engine
 			b.srcStage = PipelineStage::COMPUTE;
 			b.dstStage = PipelineStage::INDIRECT | PipelineStage::VERTEX;
 
+			AddGPUParticlesBarriers(b);
+
 			renderer->PerformBarrier(b);
 		});
 
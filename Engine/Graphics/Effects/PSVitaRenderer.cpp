@@ -99,8 +99,13 @@ namespace Engine
 
 		unsigned int queueIDs[] = { csmQueueID, opaqueQueueID };
 
-		std::vector<VisibilityIndices> visibility = renderer->Cull(2, queueIDs, &mainCamera->GetFrustum());
-		renderer->CreateRenderQueues(2, queueIDs, visibility, renderQueues);
+		const glm::vec3 &camPos = mainCamera->GetPosition();
+		RenderQueueSortParams sortParams[2];
+		sortParams[0] = { RenderQueueSortMode::FRONT_TO_BACK, camPos, false };
+		sortParams[1] = { RenderQueueSortMode::FRONT_TO_BACK, camPos, false };
+
+		VisibilityList visibility = renderer->Cull(2, queueIDs, &mainCamera->GetFrustum());
+		renderer->CreateRenderQueues(2, queueIDs, visibility, renderQueues, sortParams);
 		frameGraph.Execute(renderer);
 	}
 
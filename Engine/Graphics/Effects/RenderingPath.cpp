@@ -81,14 +81,23 @@ namespace Engine
 
 		quadMesh = MeshDefaults::CreateQuad(renderer);
 
-		volumetricClouds.Init(renderer, game->GetScriptManager(), frameGraph, quadMesh);
+		volumetricClouds.Init(renderer, game->GetScriptManager(), frameGraph, quadMesh, &game->GetJobSystem());
 		vctgi.Init(renderer, frameGraph, game->GetScriptManager());
+		vegetationCulling.Init(renderer);
+
+		// Needs to be added before the csm pass which reads the culled vegetation
+		if (vegetationCulling.IsSupported())
+			SetupVegetationCullingPass();
 
 		SetupCSMPass();
 		SetupVoxelizationPass();
 		SetupBloomPasses();
 		//SetupFXAAPass();
 
+		ParticleManager &particleManager = game->GetParticleManager();
+		if (particleManager.SupportsGPUParticles())
+			SetupGPUParticlesPass();
+
 		if (renderingPathType == RenderingPathType::FORWARD || renderingPathType == RenderingPathType::FORWARD_PLUS)
 		{
 			SetupReflectionPass();
@@ -107,6 +116,23 @@ namespace Engine
 		renderer->AddBufferResourceToSlot(DEBUG_VOXELS_INDIRECT_DRAW, vctgi.GetIndirectBuffer(), PipelineStage::COMPUTE);
 		renderer->AddBufferResourceToSlot(DEBUG_VOXELS_POSITION_SSBO, vctgi.GetVoxelPositionsBuffer(), PipelineStage::VERTEX | PipelineStage::COMPUTE);
 
+		if (particleManager.SupportsGPUParticles())
+		{
+			renderer->AddBufferResourceToSlot(GPU_PARTICLES_SSBO, particleManager.GetGPUParticlesBuffer(), PipelineStage::VERTEX | PipelineStage::COMPUTE);
+			renderer->AddBufferResourceToSlot(GPU_PARTICLES_ALIVE_LIST_SSBO, particleManager.GetGPUParticlesAliveListBuffer(), PipelineStage::VERTEX | PipelineStage::COMPUTE);
+			renderer->AddBufferResourceToSlot(GPU_PARTICLE_SYSTEMS_SSBO, particleManager.GetGPUParticleSystemsBuffer(), PipelineStage::VERTEX | PipelineStage::COMPUTE);
+			renderer->AddBufferResourceToSlot(GPU_PARTICLES_INDIRECT_DRAW, particleManager.GetGPUParticlesIndirectBuffer(), PipelineStage::COMPUTE);
+		}
+
+		if (vegetationCulling.IsSupported())
+		{
+			renderer->AddBufferResourceToSlot(VEGETATION_INSTANCES_SSBO, vegetationCulling.GetInstancesBuffer(), PipelineStage::COMPUTE);
+			renderer->AddBufferResourceToSlot(VEGETATION_CULL_PARAMS_SSBO, vegetationCulling.GetParamsBuffer(), PipelineStage::COMPUTE);
+			renderer->AddBufferResourceToSlot(VEGETATION_CULL_COUNTERS_SSBO, vegetationCulling.GetCountersBuffer(), PipelineStage::COMPUTE);
+			renderer->AddBufferResourceToSlot(VEGETATION_VISIBLE_INSTANCES_SSBO, vegetationCulling.GetVisibleInstancesBuffer(), PipelineStage::COMPUTE);
+			renderer->AddBufferResourceToSlot(VEGETATION_INDIRECT_DRAW, vegetationCulling.GetIndirectBuffer(), PipelineStage::COMPUTE);
+		}
+
 		Texture* voxelTexture = vctgi.GetVoxelTexture();
 
 		// Use the voxel texture as a storage image here with a different format than it was created with
@@ -139,6 +165,7 @@ namespace Engine
 		volumetricClouds.Dispose();
 		projectedGridWater.Dispose();
 		vctgi.Dispose();
+		vegetationCulling.Dispose();
 	}
 
 	void RenderingPath::Resize(unsigned int width, unsigned int  height)
@@ -500,6 +527,12 @@ namespace Engine
 		shadowMap.params = { TextureWrap::CLAMP_TO_BORDER, TextureFilter::LINEAR, TextureFormat::DEPTH_COMPONENT, TextureInternalFormat::DEPTH_COMPONENT24, TextureDataType::FLOAT, false, true };
 		csmPass.AddDepthOutput("shadowMap", shadowMap);
 
+		if (vegetationCulling.IsSupported())
+		{
+			csmPass.AddBufferInput("vegetationVisibleInstancesBuffer", vegetationCulling.GetVisibleInstancesBuffer());
+			csmPass.AddBufferInput("vegetationIndirectBuffer", vegetationCulling.GetIndirectBuffer());
+		}
+
 		csmPass.OnSetup([this](const Pass *thisPass)
 		{
 			//debugMatInstance->textures[0] = thisPass->GetFramebuffer()->GetDepthTexture();
@@ -882,6 +915,113 @@ namespace Engine
 		});
 	}
 
+	void RenderingPath::SetupGPUParticlesPass()
+	{
+		ParticleManager &particleManager = game->GetParticleManager();
+
+		Pass &p = frameGraph.AddPass("gpuParticles");
+		p.SetIsCompute(true);
+		p.AddBufferOutput("gpuParticlesBuffer", particleManager.GetGPUParticlesBuffer());
+		p.AddBufferOutput("gpuParticlesAliveListBuffer", particleManager.GetGPUParticlesAliveListBuffer());
+		p.AddBufferOutput("gpuParticlesIndirectBuffer", particleManager.GetGPUParticlesIndirectBuffer());
+
+		p.OnSetup([this](const Pass *thisPass)
+		{
+			game->GetParticleManager().CreateGPUParticlesMat();
+		});
+
+		p.OnBarriers([this]()
+		{
+			// Make sure the previous frame has finished drawing the particles before simulating them again
+			ParticleManager &pm = game->GetParticleManager();
+
+			BarrierBuffer bb1 = {};
+			bb1.buffer = pm.GetGPUParticlesBuffer();
+			bb1.readToWrite = true;
+			BarrierBuffer bb2 = {};
+			bb2.buffer = pm.GetGPUParticlesAliveListBuffer();
+			bb2.readToWrite = true;
+			BarrierBuffer bb3 = {};
+			bb3.buffer = pm.GetGPUParticlesIndirectBuffer();
+			bb3.readToWrite = true;
+
+			Barrier b = {};
+			b.buffers.push_back(bb1);
+			b.buffers.push_back(bb2);
+			b.buffers.push_back(bb3);
+			b.srcStage = PipelineStage::VERTEX | PipelineStage::INDIRECT;
+			b.dstStage = PipelineStage::COMPUTE;
+
+			renderer->PerformBarrier(b);
+		});
+
+		p.OnExecute([this]()
+		{
+			game->GetParticleManager().DispatchGPUParticles();
+		});
+	}
+
+	void RenderingPath::SetupVegetationCullingPass()
+	{
+		Pass &p = frameGraph.AddPass("vegetationCulling");
+		p.SetIsCompute(true);
+		p.AddBufferOutput("vegetationVisibleInstancesBuffer", vegetationCulling.GetVisibleInstancesBuffer());
+		p.AddBufferOutput("vegetationIndirectBuffer", vegetationCulling.GetIndirectBuffer());
+
+		p.OnSetup([this](const Pass *thisPass)
+		{
+			vegetationCulling.CreateMaterial(game->GetScriptManager());
+		});
+
+		p.OnBarriers([this]()
+		{
+			// Make sure the previous frame has finished drawing the vegetation before writing the visible instances again
+			BarrierBuffer bb1 = {};
+			bb1.buffer = vegetationCulling.GetVisibleInstancesBuffer();
+			bb1.readToWrite = true;
+			BarrierBuffer bb2 = {};
+			bb2.buffer = vegetationCulling.GetIndirectBuffer();
+			bb2.readToWrite = true;
+
+			Barrier b = {};
+			b.buffers.push_back(bb1);
+			b.buffers.push_back(bb2);
+			b.srcStage = PipelineStage::VERTEX_INPUT | PipelineStage::INDIRECT;
+			b.dstStage = PipelineStage::COMPUTE;
+
+			renderer->PerformBarrier(b);
+		});
+
+		p.OnExecute([this]()
+		{
+			vegetationCulling.Dispatch();
+		});
+	}
+
+	void RenderingPath::AddGPUParticlesBarriers(Barrier &barrier)
+	{
+		ParticleManager &particleManager = game->GetParticleManager();
+		if (!particleManager.SupportsGPUParticles())
+			return;
+
+		// Wait for the simulation to write the particles and the draw commands
+		BarrierBuffer bb1 = {};
+		bb1.buffer = particleManager.GetGPUParticlesBuffer();
+		bb1.readToWrite = false;
+		BarrierBuffer bb2 = {};
+		bb2.buffer = particleManager.GetGPUParticlesAliveListBuffer();
+		bb2.readToWrite = false;
+		BarrierBuffer bb3 = {};
+		bb3.buffer = particleManager.GetGPUParticlesIndirectBuffer();
+		bb3.readToWrite = false;
+
+		barrier.buffers.push_back(bb1);
+		barrier.buffers.push_back(bb2);
+		barrier.buffers.push_back(bb3);
+		barrier.srcStage |= PipelineStage::COMPUTE;
+		barrier.dstStage |= PipelineStage::INDIRECT | PipelineStage::VERTEX;
+	}
+
 	void RenderingPath::PerformCSMPass()
 	{
 		for (size_t i = 0; i < CASCADE_COUNT; i++)
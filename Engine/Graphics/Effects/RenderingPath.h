@@ -8,12 +8,14 @@
 #include "TimeOfDayManager.h"
 #include "VCTGI.h"
 #include "ProjectedGridWater.h"
+#include "Graphics/Terrain/GPUVegetationCulling.h"
 
 namespace Engine
 {
 	class Game;
 	class Renderer;
 	class Buffer;
+	struct Barrier;
 
 	enum class DebugType
 	{
@@ -67,6 +69,7 @@ namespace Engine
 		VolumetricClouds &GetVolumetricClouds() { return volumetricClouds; }
 		VCTGI &GetVCTGI() { return vctgi; }
 		ProjectedGridWater &GetProjectedGridWater() { return projectedGridWater; }
+		GPUVegetationCulling &GetVegetationCulling() { return vegetationCulling; }
 		FrameGraph &GetFrameGraph() { return frameGraph; }
 		Font &GetFont() { return font; }
 
@@ -84,6 +87,10 @@ namespace Engine
 		void SetBaseLightShaftsIntensity(float val) { baseLightShaftsIntensity = val; }
 		float GetBaseLightShaftsIntensity() const { return baseLightShaftsIntensity; }
 
+	protected:
+		// Adds the gpu particles buffers to a barrier before they're drawn
+		void AddGPUParticlesBarriers(Barrier &barrier);
+
 	private:
 		void SetupCSMPass();
 		void SetupBloomPasses();
@@ -92,6 +99,8 @@ namespace Engine
 		void SetupVoxelizationPass();
 		void SetupFXAAPass();
 		void SetupTerrainEditPass();
+		void SetupGPUParticlesPass();
+		void SetupVegetationCullingPass();
 
 		void PerformCSMPass();
 		void PerformBrightPass();
@@ -128,6 +137,7 @@ namespace Engine
 		VolumetricClouds volumetricClouds;
 		VCTGI vctgi;
 		ProjectedGridWater projectedGridWater;
+		GPUVegetationCulling vegetationCulling;
 
 		RenderQueue renderQueues[8];
 
@@ -4,9 +4,57 @@
 #include "Program/Random.h"
 #include "Program/Log.h"
 
+#include <cstdio>
+#include <vector>
+
 namespace Engine
 {
-	void VolumetricClouds::Init(Renderer *renderer, ScriptManager &scriptManager, FrameGraph &frameGraph, const Mesh &quadMesh)
+	// Bump when the way the noise is generated changes so the cached volumes are baked again
+	static const unsigned int NOISE_CACHE_VERSION = 1;
+
+	// The cached volumes are named after a hash of their generation parameters, so changing a parameter bakes a new volume instead of loading a stale one
+	static std::string GetNoiseCachePath(const char *name, const float *params, unsigned int count)
+	{
+		// FNV-1a
+		unsigned int hash = 2166136261u;
+		const unsigned char *bytes = reinterpret_cast<const unsigned char*>(params);
+		for (unsigned int i = 0; i < count * sizeof(float); i++)
+		{
+			hash ^= bytes[i];
+			hash *= 16777619u;
+		}
+
+		char path[128];
+		snprintf(path, sizeof(path), "Data/Resources/Textures/clouds/%s_%08x.data", name, hash);
+		return std::string(path);
+	}
+
+	static bool LoadNoiseCache(const std::string &path, void *data, unsigned int size)
+	{
+		FILE *file = fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+
+		const size_t read = fread(data, 1, size, file);
+		fclose(file);
+
+		return read == size;
+	}
+
+	static void SaveNoiseCache(const std::string &path, const void *data, unsigned int size)
+	{
+		FILE *file = fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			Log::Print(LogLevel::LEVEL_WARNING, "Failed to save the noise cache %s\n", path.c_str());
+			return;
+		}
+
+		fwrite(data, 1, size, file);
+		fclose(file);
+	}
+
+	void VolumetricClouds::Init(Renderer *renderer, ScriptManager &scriptManager, FrameGraph &frameGraph, const Mesh &quadMesh, JobSystem *jobSystem)
 	{
 		baseNoiseTexture = nullptr;
 		highFreqNoiseTexture = nullptr;
@@ -88,65 +136,69 @@ namespace Engine
 		const unsigned int resolution = 128;
 		TexData *noise = new TexData[resolution * resolution * resolution];
 
-		FILE *file = nullptr;
-		file = fopen("Data/Resources/Textures/clouds/noise.data", "rb");
+		// Everything that changes the generated noise goes in the cache key
+		const float baseCellCount = 4.0f;
+		const float baseNoiseParams[] = { static_cast<float>(NOISE_CACHE_VERSION), static_cast<float>(resolution), baseCellCount, 8.0f, 3.0f, 2.0f, 0.5f };
+		const std::string noisePath = GetNoiseCachePath("noise", baseNoiseParams, sizeof(baseNoiseParams) / sizeof(float));
 
-		// When we don't have the file we generate it below, but it is really slow
-		if (file == nullptr)
+		// When we don't have the file we generate it below. Each thread bakes whole slices and the noise is computed a row at a time
+		if (!LoadNoiseCache(noisePath, noise, resolution * resolution * resolution * sizeof(TexData)))
 		{
-			// Generate the noise if the file doesn't exist and save it to file
-			float stepSize = 1.0f / resolution;
-			unsigned int index = 0;
-			glm::vec3 coord = glm::vec3(0.0f);
-			const float cellCount = 4;
+			Log::Print(LogLevel::LEVEL_INFO, "Baking clouds noise\n");
+
+			const float stepSize = 1.0f / resolution;
+			const float cellCount = baseCellCount;
 
-			for (unsigned int z = 0; z < resolution; z++)
+			Random::BakeVolume(jobSystem, resolution, [this, noise, resolution, stepSize, cellCount](unsigned int z)
 			{
+				std::vector<float> rows(resolution * 6);
+				float *perlin = &rows[0];
+				float *worleyRow2 = &rows[resolution];
+				float *worleyRow4 = &rows[resolution * 2];
+				float *worleyRow8 = &rows[resolution * 3];
+				float *worleyRow14 = &rows[resolution * 4];
+				float *worleyRow16 = &rows[resolution * 5];
+
 				for (unsigned int y = 0; y < resolution; y++)
 				{
+					const glm::vec3 rowStart = glm::vec3(0.0f, y * stepSize, z * stepSize);
+
+					Random::Perlin3DRow(rowStart, stepSize, resolution, 8.0f, 3.0f, 2.0f, 0.5f, perlin);
+					Random::WorleyNoiseRow(rowStart, stepSize, resolution, cellCount * 2.0f, worleyRow2);
+					Random::WorleyNoiseRow(rowStart, stepSize, resolution, cellCount * 4.0f, worleyRow4);
+					Random::WorleyNoiseRow(rowStart, stepSize, resolution, cellCount * 8.0f, worleyRow8);
+					Random::WorleyNoiseRow(rowStart, stepSize, resolution, cellCount * 14.0f, worleyRow14);
+					Random::WorleyNoiseRow(rowStart, stepSize, resolution, cellCount * 16.0f, worleyRow16);
+
 					for (unsigned int x = 0; x < resolution; x++)
 					{
-						coord.x = x * stepSize;
-						coord.y = y * stepSize;
-						coord.z = z * stepSize;
-
-						float r = Random::Perlin3D(coord.x, coord.y, coord.z, 8.0f, 3.0f, 2.0f, 0.5f);
-						//float g = Random::Perlin3D(coord.x, coord.y, coord.z, 16.0f, 4.0f, 2.0f, 0.5f);
-						float worley0 = 1.0f - Random::WorleyNoise(coord, cellCount * 2.0f);
-						float worley1 = 1.0f - Random::WorleyNoise(coord, cellCount * 8.0f);
-						float worley2 = 1.0f - Random::WorleyNoise(coord, cellCount * 14.0f);
+						float worley0 = 1.0f - worleyRow2[x];
+						float worley1 = 1.0f - worleyRow8[x];
+						float worley2 = 1.0f - worleyRow14[x];
 
 						float worleyFBM = worley0 * 0.625f + worley1 * 0.25f + worley2 * 0.125f;
 
-						float perlinWorley = Remap(r, 0.0f, 1.0f, worleyFBM, 1.0f);
+						float perlinWorley = Remap(perlin[x], 0.0f, 1.0f, worleyFBM, 1.0f);
 
-						//worley0 = 1.0f - Random::WorleyNoise(coord, cellCount);
-						worley1 = 1.0f - Random::WorleyNoise(coord, cellCount * 2);
-						worley2 = 1.0f - Random::WorleyNoise(coord, cellCount * 4);
-						float worley3 = 1.0f - Random::WorleyNoise(coord, cellCount * 8);
-						float worley4 = 1.0f - Random::WorleyNoise(coord, cellCount * 16);
+						worley1 = 1.0f - worleyRow2[x];
+						worley2 = 1.0f - worleyRow4[x];
+						float worley3 = 1.0f - worleyRow8[x];
+						float worley4 = 1.0f - worleyRow16[x];
 
 						float worleyFBM0 = worley1 * 0.625f + worley2 * 0.25f + worley3 * 0.125f;
 						float worleyFBM1 = worley2 * 0.625f + worley3 * 0.25f + worley3 * 0.125f;
 						float worleyFBM2 = worley3 * 0.75f + worley4 * 0.25f;
 
-						index = z * resolution*resolution + y * resolution + x;
+						unsigned int index = z * resolution * resolution + y * resolution + x;
 						noise[index].r = static_cast<unsigned char>(perlinWorley * 255.0f);
 						noise[index].g = static_cast<unsigned char>(worleyFBM0 * 255.0f);
 						noise[index].b = static_cast<unsigned char>(worleyFBM1 * 255.0f);
 						noise[index].a = static_cast<unsigned char>(worleyFBM2 * 255.0f);
 					}
 				}
-			}
+			});
 
-			std::fstream file = std::fstream("Data/Resources/Textures/clouds/noise.data", std::ios::out | std::ios::binary);
-			file.write((char*)&noise[0], resolution * resolution * resolution * sizeof(TexData));
-			file.close();
-		}
-		else
-		{
-			fread(noise, 1, resolution * resolution * resolution * sizeof(TexData), file);
-			fclose(file);
+			SaveNoiseCache(noisePath, noise, resolution * resolution * resolution * sizeof(TexData));
 		}
 
 		struct HighFreqNoise
@@ -159,52 +211,53 @@ namespace Engine
 		const unsigned int highFreqRes = 32;
 		HighFreqNoise *highFreqNoise = new HighFreqNoise[highFreqRes * highFreqRes * highFreqRes];
 
-		file = fopen("Data/Resources/Textures/clouds/highFreqNoise.data", "rb");
+		const float highFreqCellCount = 2.0f;
+		const float highFreqNoiseParams[] = { static_cast<float>(NOISE_CACHE_VERSION), static_cast<float>(highFreqRes), highFreqCellCount };
+		const std::string highFreqNoisePath = GetNoiseCachePath("highFreqNoise", highFreqNoiseParams, sizeof(highFreqNoiseParams) / sizeof(float));
 
-		if (file == nullptr)
+		if (!LoadNoiseCache(highFreqNoisePath, highFreqNoise, highFreqRes * highFreqRes * highFreqRes * sizeof(HighFreqNoise)))
 		{
-			// Generate the noise if the file doesn't exist and save it to file
-			float stepSize = 1.0f / highFreqRes;
-			unsigned int index = 0;
-			glm::vec3 coord = glm::vec3(0.0f);
-			const float cellCount = 2;
+			const float stepSize = 1.0f / highFreqRes;
+			const float cellCount = highFreqCellCount;
 
-			for (unsigned int z = 0; z < highFreqRes; z++)
+			Random::BakeVolume(jobSystem, highFreqRes, [highFreqNoise, highFreqRes, stepSize, cellCount](unsigned int z)
 			{
+				std::vector<float> rows(highFreqRes * 4);
+				float *worleyRow1 = &rows[0];
+				float *worleyRow2 = &rows[highFreqRes];
+				float *worleyRow4 = &rows[highFreqRes * 2];
+				float *worleyRow8 = &rows[highFreqRes * 3];
+
 				for (unsigned int y = 0; y < highFreqRes; y++)
 				{
+					const glm::vec3 rowStart = glm::vec3(0.0f, y * stepSize, z * stepSize);
+
+					Random::WorleyNoiseRow(rowStart, stepSize, highFreqRes, cellCount, worleyRow1);
+					Random::WorleyNoiseRow(rowStart, stepSize, highFreqRes, cellCount * 2.0f, worleyRow2);
+					Random::WorleyNoiseRow(rowStart, stepSize, highFreqRes, cellCount * 4.0f, worleyRow4);
+					Random::WorleyNoiseRow(rowStart, stepSize, highFreqRes, cellCount * 8.0f, worleyRow8);
+
 					for (unsigned int x = 0; x < highFreqRes; x++)
 					{
-						coord.x = x * stepSize;
-						coord.y = y * stepSize;
-						coord.z = z * stepSize;
-
-						float worley0 = 1.0f - Random::WorleyNoise(coord, cellCount);
-						float worley1 = 1.0f - Random::WorleyNoise(coord, cellCount * 2.0f);
-						float worley2 = 1.0f - Random::WorleyNoise(coord, cellCount * 4.0f);
-						float worley3 = 1.0f - Random::WorleyNoise(coord, cellCount * 8.0f);
+						float worley0 = 1.0f - worleyRow1[x];
+						float worley1 = 1.0f - worleyRow2[x];
+						float worley2 = 1.0f - worleyRow4[x];
+						float worley3 = 1.0f - worleyRow8[x];
 
 						float worleyFBM0 = worley0 * 0.625f + worley1 * 0.25f + worley2 * 0.125f;
 						float worleyFBM1 = worley1 * 0.625f + worley2 * 0.25f + worley3 * 0.125f;
 						float worleyFBM2 = worley2 * 0.75f + worley3 * 0.25f;
 
-						index = z * highFreqRes * highFreqRes + y * highFreqRes + x;
+						unsigned int index = z * highFreqRes * highFreqRes + y * highFreqRes + x;
 						highFreqNoise[index].r = static_cast<unsigned char>(worleyFBM0 * 255.0f);
 						highFreqNoise[index].g = static_cast<unsigned char>(worleyFBM1 * 255.0f);
 						highFreqNoise[index].b = static_cast<unsigned char>(worleyFBM2 * 255.0f);
 						highFreqNoise[index].a = 255;
 					}
 				}
-			}
+			});
 
-			std::fstream file = std::fstream("Data/Resources/Textures/clouds/highFreqNoise.data", std::ios::out | std::ios::binary);
-			file.write((char*)&highFreqNoise[0], highFreqRes * highFreqRes * highFreqRes * sizeof(HighFreqNoise));
-			file.close();
-		}
-		else
-		{
-			fread(highFreqNoise, 1, highFreqRes * highFreqRes * highFreqRes * sizeof(HighFreqNoise), file);
-			fclose(file);
+			SaveNoiseCache(highFreqNoisePath, highFreqNoise, highFreqRes * highFreqRes * highFreqRes * sizeof(HighFreqNoise));
 		}
 
 		TextureParams noiseParams = { TextureWrap::MIRRORED_REPEAT, TextureFilter::LINEAR, TextureFormat::RGBA,TextureInternalFormat::RGBA8, TextureDataType::UNSIGNED_BYTE, false, false };
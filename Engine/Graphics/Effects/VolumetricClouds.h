@@ -8,6 +8,8 @@
 
 namespace Engine
 {
+	class JobSystem;
+
 	struct VolumetricCloudsData
 	{
 		float cloudCoverage;
@@ -32,7 +34,8 @@ namespace Engine
 	class VolumetricClouds
 	{
 	public:
-		void Init(Renderer *renderer, ScriptManager &scriptManager, FrameGraph &frameGraph, const Mesh &quadMesh);
+		// The noise volumes are baked with the job system when they're not cached
+		void Init(Renderer *renderer, ScriptManager &scriptManager, FrameGraph &frameGraph, const Mesh &quadMesh, JobSystem *jobSystem);
 		void Dispose();
 		void Resize(unsigned int width, unsigned int height, FrameGraph &frameGraph);
 		void EndFrame();
@@ -30,6 +30,12 @@
 
 namespace Engine
 {
+	// Size of each frame region of the upload buffer, it holds the instance data and the material data of every draw in a frame
+	static const unsigned int UPLOAD_BUFFER_FRAME_SIZE = 4 * 1024 * 1024;
+	static const unsigned int UPLOAD_BUFFER_FRAMES = 3;
+	// Size of the material properties block. Ranges bound to it are never smaller so the shader can't read past the range
+	static const unsigned int MATERIAL_UBO_SIZE = 128;
+
 	GLRenderer::GLRenderer(FileManager *fileManager, GLuint width, GLuint height)
 	{
 		this->width = width;
@@ -89,8 +95,6 @@ namespace Engine
 			return false;
 		}
 
-		unsigned int initialSize = 256000;		// bytes
-
 		/*meshParamsUBO = new GLUniformBuffer(nullptr, initialSize);
 		meshParamsUBO->BindTo(OBJECT_UBO_BINDING);
 		meshParamsData.resize(2048 * 6);*/
@@ -109,20 +113,17 @@ namespace Engine
 		//std::cout << "Min UBO offset alignment: " << alignment << '\n';
 		//std::cout << "Min block data size: " << size << '\n';
 
-		// Instance buffer
-		initialSize = 1024 * 512; // 512 kib
-		glGenBuffers(1, &instanceDataSSBO);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceDataSSBO);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, initialSize, nullptr, GL_DYNAMIC_COPY);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_DATA_SSBO, instanceDataSSBO);
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		ssboMinOffsetAlignment = (unsigned int)alignment;
 
-		instanceData.resize(2048 * 4);
+		// Instance and material data
+		if (!uploadBuffer.Init(UPLOAD_BUFFER_FRAME_SIZE, UPLOAD_BUFFER_FRAMES))
+			return false;
 
 		cameraUBO = new GLUniformBuffer(nullptr, sizeof(CameraUBO));
 		cameraUBO->BindTo(CAMERA_UBO);
 
-		materialUBO = new GLUniformBuffer(nullptr, 128);
+		materialUBO = new GLUniformBuffer(nullptr, MATERIAL_UBO_SIZE);
 		materialUBO->BindTo(MAT_PROPERTIES_UBO_BINDING);
 		return true;
 	}
@@ -425,65 +426,74 @@ namespace Engine
 
 	void GLRenderer::Submit(const RenderQueue &renderQueue)
 	{
-		//meshParamsOffset = 0;
-		instanceDataOffset = 0;
+		unsigned int instanceDataSize = 0;
 		for (size_t i = 0; i < renderQueue.size(); i++)
 		{
 			const RenderItem &ri = renderQueue[i];
+			if (ri.instanceData)
+				instanceDataSize += ri.instanceDataSize;
+			if (ri.meshParams)
+				instanceDataSize += ri.meshParamsSize;
+		}
 
-			/*if (ri.meshParams != nullptr)
-			{
-				if (meshParamsOffset > meshParamsData.size())
-					meshParamsData.resize(meshParamsData.size() * 2);
-
-				std::memcpy(buffer + meshParamsOffset / 4, ri.meshParams, ri.meshParamsSize);			// Size must be in bytes
-				meshParamsOffset += ri.meshParamsSize;		// Offset must be in elements
-				meshParamsOffset += (uboMinOffsetAlignment - (meshParamsOffset % uboMinOffsetAlignment));
-			}*/
+		// Write the instance data of the whole queue straight into the upload buffer, in the same order Submit(renderItem) reads it.
+		// The offsets the shaders get are relative to the start of the bound range
+		if (instanceDataSize > 0)
+		{
+			unsigned int offset = 0;
+			unsigned char *dst = static_cast<unsigned char*>(uploadBuffer.Allocate(instanceDataSize, ssboMinOffsetAlignment, offset));
+			const bool useFallback = dst == nullptr;
 
-			if (ri.instanceData)
+			// The ring is full this frame so stage the data and upload it to a separate buffer, which is slower but still draws the queue
+			if (useFallback)
 			{
-				if (instanceDataOffset > instanceData.size())
-					instanceData.resize(instanceData.size() * 2);
+				if (fallbackInstanceData.size() < instanceDataSize)
+					fallbackInstanceData.resize(instanceDataSize);
 
-				memcpy(instanceBuffer + instanceDataOffset / 4, ri.instanceData, ri.instanceDataSize);
-				instanceDataOffset += ri.instanceDataSize;
+				dst = fallbackInstanceData.data();
 			}
-			if (ri.meshParams)
+
+			for (size_t i = 0; i < renderQueue.size(); i++)
 			{
-				// handle resize
-				memcpy(instanceBuffer + instanceDataOffset / 4, ri.meshParams, ri.meshParamsSize);
-				instanceDataOffset += ri.meshParamsSize;
-			}
-		}
+				const RenderItem &ri = renderQueue[i];
 
-		// TODO: Check if the data won't fit in the buffer and resize it
-		//if (meshParamsOffset > 0)
-		//	meshParamsUBO->Update(buffer, meshParamsOffset * 4, 0);			// Size must be in bytes
+				if (ri.instanceData)
+				{
+					memcpy(dst, ri.instanceData, ri.instanceDataSize);
+					dst += ri.instanceDataSize;
+				}
+				if (ri.meshParams)
+				{
+					memcpy(dst, ri.meshParams, ri.meshParamsSize);
+					dst += ri.meshParamsSize;
+				}
+			}
 
-		if (instanceDataOffset > 0)
-		{
-			glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceDataSSBO);
-			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instanceDataOffset, instanceBuffer);
-			//glNamedBufferSubData(instanceDataSSBO, 0, instanceDataOffset, instanceBuffer);
+			if (useFallback)
+				UploadFallbackInstanceData(instanceDataSize);
+			else
+				glBindBufferRange(GL_SHADER_STORAGE_BUFFER, INSTANCE_DATA_SSBO, uploadBuffer.GetID(), offset, instanceDataSize);
 		}
 
-		//meshParamsOffset = 0;
 		instanceDataOffset = 0;
 
 		for (size_t i = 0; i < renderQueue.size(); i++)
 		{
 			Submit(renderQueue[i]);
 		}
-		//meshParamsOffset = 0;
 		instanceDataOffset = 0;
 	}
 
 	void GLRenderer::Submit(const RenderItem &renderItem)
 	{
-		// TODO: Sort by material and use one big ubo to store material data and then use glBindBufferRange for each material change to access it's data
+		if (renderItem.indirectBuffer)
+		{
+			SubmitIndirect(renderItem, renderItem.indirectBuffer);
+			return;
+		}
+
 		if (renderItem.materialData)
-			materialUBO->Update(renderItem.materialData, renderItem.materialDataSize, 0);		// TODO: Check what's faster - Update the UBO for every ri or use one BIG UBO and use glBindBufferRange()
+			BindMaterialData(renderItem.materialData, renderItem.materialDataSize);
 
 		/*if (renderItem.meshParams != nullptr)
 		{
@@ -562,7 +572,7 @@ namespace Engine
 	void GLRenderer::SubmitIndirect(const RenderItem &renderItem, Buffer *indirectBuffer)
 	{
 		if (renderItem.materialData)
-			materialUBO->Update(renderItem.materialData, renderItem.materialDataSize, 0);
+			BindMaterialData(renderItem.materialData, renderItem.materialDataSize);
 
 		/*if (renderItem.meshParams != nullptr)
 		{
@@ -618,9 +628,9 @@ namespace Engine
 		glBindVertexArray(static_cast<GLVertexArray*>(renderItem.mesh->vao)->GetID());
 
 		if (renderItem.mesh->vertexCount > 0)
-			glDrawArraysIndirect(GL_TRIANGLES, nullptr);
+			glDrawArraysIndirect(GL_TRIANGLES, (void*)renderItem.indirectOffset);
 		else
-			glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr);
+			glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)renderItem.indirectOffset);
 
 		/*if (renderItem.mesh->instanceCount > 0)
 		{
@@ -649,7 +659,7 @@ namespace Engine
 		}*/
 
 		if (item.materialData)
-			materialUBO->Update(item.materialData, item.materialDataSize, 0);
+			BindMaterialData(item.materialData, item.materialDataSize);
 
 		const ShaderPass &pass = item.matInstance->baseMaterial->GetShaderPass(item.shaderPass);
 
@@ -798,10 +808,15 @@ namespace Engine
 			// Only perform the barrier when we go from write to read
 			if (bb.readToWrite == false)
 			{
+				// Indirect buffers are written as storage buffers so they also need the storage barrier when another compute shader reads them
 				if (bb.buffer->GetType() == BufferType::DrawIndirectBuffer)
-					barrierBits |= GL_COMMAND_BARRIER_BIT;
+					barrierBits |= GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT;
 				else if (bb.buffer->GetType() == BufferType::ShaderStorageBuffer)
+				{
 					barrierBits |= GL_SHADER_STORAGE_BARRIER_BIT;
+					if (barrier.dstStage & PipelineStage::VERTEX_INPUT)
+						barrierBits |= GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+				}
 			}
 		}
 
@@ -891,6 +906,47 @@ namespace Engine
 	void GLRenderer::BeginFrame()
 	{
 		renderStats = {};
+		uploadBuffer.BeginFrame();
+	}
+
+	void GLRenderer::UploadFallbackInstanceData(unsigned int size)
+	{
+		if (fallbackSSBO == 0)
+		{
+			Log::Print(LogLevel::LEVEL_WARNING, "Instance data doesn't fit in the upload ring buffer, falling back to buffer updates\n");
+			glGenBuffers(1, &fallbackSSBO);
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, fallbackSSBO);
+
+		if (size > fallbackSSBOSize)
+		{
+			fallbackSSBOSize = size;
+			glBufferData(GL_SHADER_STORAGE_BUFFER, fallbackSSBOSize, nullptr, GL_DYNAMIC_DRAW);
+		}
+
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, fallbackInstanceData.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, INSTANCE_DATA_SSBO, fallbackSSBO, 0, size);
+	}
+
+	void GLRenderer::BindMaterialData(const void *data, unsigned int size)
+	{
+		const unsigned int rangeSize = size > MATERIAL_UBO_SIZE ? size : MATERIAL_UBO_SIZE;
+
+		unsigned int offset = 0;
+		void *dst = uploadBuffer.Allocate(rangeSize, uboMinOffsetAlignment, offset);
+		if (dst)
+		{
+			memcpy(dst, data, size);
+			glBindBufferRange(GL_UNIFORM_BUFFER, MAT_PROPERTIES_UBO_BINDING, uploadBuffer.GetID(), offset, rangeSize);
+		}
+		else
+		{
+			// Out of space this frame, go back to updating the material UBO
+			materialUBO->Update(data, size, 0);
+			materialUBO->BindTo(MAT_PROPERTIES_UBO_BINDING);
+		}
 	}
 
 	void GLRenderer::Dispose()
@@ -918,6 +974,15 @@ namespace Engine
 		cameraUBO = nullptr;
 		materialUBO = nullptr;
 
+		if (fallbackSSBO)
+		{
+			glDeleteBuffers(1, &fallbackSSBO);
+			fallbackSSBO = 0;
+			fallbackSSBOSize = 0;
+		}
+
+		uploadBuffer.Dispose();
+
 		/*if (meshParamsUBO)
 		{
 			delete meshParamsUBO;
@@ -4,6 +4,7 @@
 
 #include "Graphics/Renderer.h"
 #include "Graphics/GL/GLFramebuffer.h"
+#include "Graphics/GL/GLUploadRingBuffer.h"
 
 namespace Engine
 {
@@ -88,12 +89,23 @@ namespace Engine
 
 		void Dispose() override;
 
+	private:
+		// Writes the material data to the upload buffer and binds its range to the material properties binding
+		void BindMaterialData(const void *data, unsigned int size);
+		// Uploads the staged instance data to a separate buffer, for when the upload buffer is full
+		void UploadFallbackInstanceData(unsigned int size);
+
 	private:
 		unsigned int uboMinOffsetAlignment;
+		unsigned int ssboMinOffsetAlignment;
 		GLUniformBuffer *cameraUBO;
 		GLUniformBuffer *materialUBO;
 
-		GLuint instanceDataSSBO;
+		GLUploadRingBuffer uploadBuffer;
+		// Used when the instance data of a queue doesn't fit in the upload buffer
+		std::vector<unsigned char> fallbackInstanceData;
+		GLuint fallbackSSBO = 0;
+		unsigned int fallbackSSBOSize = 0;
 
 		BlendState blendState;
 		DepthStencilState depthStencilState;
@@ -110,7 +122,5 @@ namespace Engine
 		//void* buffer[16000];
 
 		unsigned int instanceDataOffset = 0;
-		std::vector<const void*> instanceData;
-		void* instanceBuffer[16000];
 	};
 }
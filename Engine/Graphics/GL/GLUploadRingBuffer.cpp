@@ -0,0 +1,113 @@
+#include "GLUploadRingBuffer.h"
+
+#include "Program/Log.h"
+
+namespace Engine
+{
+	GLUploadRingBuffer::GLUploadRingBuffer()
+	{
+		id = 0;
+		mapped = nullptr;
+		frameSize = 0;
+		numFrames = 0;
+		currentFrame = 0;
+		frameOffset = 0;
+		overflowLogged = false;
+
+		for (unsigned int i = 0; i < MAX_FRAMES; i++)
+			fences[i] = nullptr;
+	}
+
+	bool GLUploadRingBuffer::Init(unsigned int frameSize, unsigned int numFrames)
+	{
+		this->frameSize = frameSize;
+		overflowLogged = false;
+		this->numFrames = numFrames < MAX_FRAMES ? numFrames : MAX_FRAMES;
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glCreateBuffers(1, &id);
+		glNamedBufferStorage(id, frameSize * this->numFrames, nullptr, flags);
+		mapped = static_cast<unsigned char*>(glMapNamedBufferRange(id, 0, frameSize * this->numFrames, flags));
+
+		if (!mapped)
+		{
+			Log::Print(LogLevel::LEVEL_ERROR, "Failed to map upload ring buffer\n");
+			return false;
+		}
+
+		currentFrame = 0;
+		frameOffset = 0;
+
+		return true;
+	}
+
+	void GLUploadRingBuffer::Dispose()
+	{
+		for (unsigned int i = 0; i < MAX_FRAMES; i++)
+		{
+			if (fences[i])
+			{
+				glDeleteSync(fences[i]);
+				fences[i] = nullptr;
+			}
+		}
+
+		if (id > 0)
+		{
+			glUnmapNamedBuffer(id);
+			glDeleteBuffers(1, &id);
+			id = 0;
+		}
+		mapped = nullptr;
+	}
+
+	void GLUploadRingBuffer::BeginFrame()
+	{
+		if (fences[currentFrame])
+			glDeleteSync(fences[currentFrame]);
+
+		fences[currentFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		currentFrame = (currentFrame + 1) % numFrames;
+		frameOffset = 0;
+
+		if (fences[currentFrame])
+		{
+			// Flush on the first wait so the fence is guaranteed to signal
+			GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+			while (true)
+			{
+				GLenum result = glClientWaitSync(fences[currentFrame], waitFlags, 1000000);
+				if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+					break;
+
+				waitFlags = 0;
+			}
+
+			glDeleteSync(fences[currentFrame]);
+			fences[currentFrame] = nullptr;
+		}
+	}
+
+	void *GLUploadRingBuffer::Allocate(unsigned int size, unsigned int alignment, unsigned int &offset)
+	{
+		const unsigned int start = (frameOffset + alignment - 1) / alignment * alignment;
+
+		if (start + size > frameSize)
+		{
+			// The size doesn't change after Init so only warn the first time, the callers fall back to another buffer
+			if (!overflowLogged)
+			{
+				Log::Print(LogLevel::LEVEL_WARNING, "Upload ring buffer full, %u bytes per frame\n", frameSize);
+				overflowLogged = true;
+			}
+			return nullptr;
+		}
+
+		frameOffset = start + size;
+		offset = currentFrame * frameSize + start;
+
+		return mapped + offset;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "include/glew/glew.h"
+
+namespace Engine
+{
+	// Persistently mapped buffer split in one region per frame in flight. Per draw data is written straight into the mapped memory
+	// and bound with glBindBufferRange, so there's no buffer update call per draw. A fence per region makes sure the gpu
+	// finished reading a region before the cpu writes to it again
+	class GLUploadRingBuffer
+	{
+	public:
+		GLUploadRingBuffer();
+
+		bool Init(unsigned int frameSize, unsigned int numFrames);
+		void Dispose();
+
+		// Fences the region used by the last frame and moves to the next one, waiting for the gpu if it's still using it
+		void BeginFrame();
+
+		// Returns a pointer to write size bytes and their offset in the buffer, or nullptr if the frame region is full
+		void *Allocate(unsigned int size, unsigned int alignment, unsigned int &offset);
+
+		GLuint GetID() const { return id; }
+
+	private:
+		static const unsigned int MAX_FRAMES = 4;
+
+		GLuint id;
+		unsigned char *mapped;
+		unsigned int frameSize;
+		unsigned int numFrames;
+		unsigned int currentFrame;
+		unsigned int frameOffset;
+		bool overflowLogged;
+		GLsync fences[MAX_FRAMES];
+	};
+}
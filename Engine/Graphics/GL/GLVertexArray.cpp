@@ -4,6 +4,7 @@
 
 #include "GLIndexBuffer.h"
 #include "GLVertexBuffer.h"
+#include "GLSSBO.h"
 
 namespace Engine
 {
@@ -130,7 +131,11 @@ namespace Engine
 
 		unsigned int attribLocation = lastAttribLocation;
 
-		glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLVertexBuffer*>(vertexBuffer)->GetID());
+		// Storage buffers written by compute shaders can also be used for the instance data
+		if (vertexBuffer->GetType() == BufferType::ShaderStorageBuffer)
+			glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLSSBO*>(vertexBuffer)->GetID());
+		else
+			glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLVertexBuffer*>(vertexBuffer)->GetID());
 
 		const VertexInputDesc &desc = vertexInputDescs[nextInputDesc];
 		for (size_t i = 0; i < desc.attribs.size(); i++)
@@ -64,6 +64,7 @@ namespace Engine
 					pass.topology = Renderer::GetTopologyValue(Topology::TRIANGLES);
 					pass.queueID = 0;
 					pass.isCompute = false;
+					pass.batchable = false;
 
 					std::string shaderName;
 					std::string vertexName;
@@ -188,6 +189,10 @@ namespace Engine
 						pass.rasterizerState.frontFace = Renderer::GetFrontFace(s);
 					}
 
+					ref = pair.second["batchable"];
+					if (ref.isBoolean())
+						pass.batchable = ref.cast<bool>();
+
 					if (pass.isCompute)
 					{
 						pass.shader = renderer->CreateComputeShader(shaderName, defines);
@@ -12,11 +12,49 @@
 
 #include <iostream>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define PARTICLES_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PARTICLES_NEON
+#include <arm_neon.h>
+#endif
+
 namespace Engine
 {
+	void ParticleData::Resize(unsigned int count)
+	{
+		posX.resize(count);
+		posY.resize(count);
+		posZ.resize(count);
+		velX.resize(count);
+		velY.resize(count);
+		velZ.resize(count);
+		life.resize(count);
+		color.resize(count);
+		blendFactor.resize(count);
+		texOffsets.resize(count);
+	}
+
+	void ParticleData::Move(unsigned int dst, unsigned int src)
+	{
+		posX[dst] = posX[src];
+		posY[dst] = posY[src];
+		posZ[dst] = posZ[src];
+		velX[dst] = velX[src];
+		velY[dst] = velY[src];
+		velZ[dst] = velZ[src];
+		life[dst] = life[src];
+		color[dst] = color[src];
+		blendFactor[dst] = blendFactor[src];
+		texOffsets[dst] = texOffsets[src];
+	}
+
 	ParticleSystem::ParticleSystem()
 	{
-		lastUsedParticle = 0;
+		maxParticles = 0;
+		aliveCount = 0;
+		gpuSlot = ~0u;
 		accumulator = 0.0f;
 		velocityLow = glm::vec3(0.0f);
 		velocityHigh = glm::vec3(1.0f);
@@ -67,7 +105,7 @@ namespace Engine
 		unsigned short indices[] = { 0,1,2, 0,2,3 };
 
 		Buffer *vb = renderer->CreateVertexBuffer(vertices, sizeof(vertices), BufferUsage::STATIC);
-		instanceVB = renderer->CreateVertexBuffer(nullptr, 100 * sizeof(PSInstanceData), BufferUsage::DYNAMIC);		// Allocate space for 100 particles. Allocate more when in editor and allocate just enough when in game
+		instanceVB = renderer->CreateVertexBuffer(nullptr, MAX_PARTICLES_PER_SYSTEM * sizeof(PSInstanceData), BufferUsage::DYNAMIC);		// Allocate more when in editor and allocate just enough when in game
 		Buffer *ib = renderer->CreateIndexBuffer(indices, sizeof(indices), BufferUsage::STATIC);
 
 		std::vector<Buffer*> vbs = { vb, instanceVB };
@@ -108,16 +146,15 @@ namespace Engine
 
 	void ParticleSystem::Create(int maxParticles)
 	{
-		if (maxParticles == 0)
+		if (maxParticles <= 0)
 			return;
 
-		this->maxParticles = maxParticles;
-		particles.resize(maxParticles);
+		SetMaxParticles(static_cast<unsigned int>(maxParticles));
 
-		if (particles.size() > 0)
-		{
-			RespawnParticle(particles[0]);		// Spawn one particle so they get update initially
-		}
+		aliveCount = 0;
+
+		if (!gpuSimulated)
+			SpawnParticle();		// Spawn one particle so they get update initially
 	}
 
 	void ParticleSystem::Update(float dt)
@@ -128,126 +165,310 @@ namespace Engine
 
 		if (playing || particlesAlive)
 		{
-			// Reset the aabb because if the particle's were to increase in size and then decrease the aabb max would retain the largest size/would not update to the new size. Similar thing for min
-			// But we have to take into account if there are any particles alive, otherwise the aabb would bet set to 10000/-10000 and the update would never be called again (because it would not be in the frustum)
-			// So store the previous min/max and check after the for loop if there are no particles alive to put the aabb back to what it was
-			glm::vec3 prevMin = aabb.min;
-			glm::vec3 prevMax = aabb.max;
-			
-			aabb.min = glm::vec3(10000.0f, 10000.0f, 10000.0f);
-			aabb.max = glm::vec3(-10000.0f, -10000.0f, -10000.0f);
-
-			particlesAlive = false;
-
-			for (unsigned int i = 0; i < maxParticles; i++)
+			// Age the particles and remove the dead ones by moving the last alive particle into their slot, so the rest of the update only touches alive particles
+			const float lifeStep = dt / startLifeTime;
+			unsigned int i = 0;
+			while (i < aliveCount)
 			{
-				Particle &p = particles[i];
+				particles.life[i] -= lifeStep;
 
-				p.life -= dt / startLifeTime;
+				if (particles.life[i] > 0.0f)
+				{
+					i++;
+					continue;
+				}
 
-				float lifeFactor = (startLifeTime - p.life) / startLifeTime;			// Goes from 0 to 1 over the particle's life time
+				// The moved particle hasn't been aged yet, so don't advance i
+				aliveCount--;
+				if (i != aliveCount)
+					particles.Move(i, aliveCount);
+			}
 
-				if (p.life > 0.0f)
+			particlesAlive = aliveCount > 0;
+
+			// The aabb is rebuilt from the alive particles so it shrinks when they do. If there aren't any keep the previous one,
+			// otherwise the system would not be in the frustum and the update would never be called again
+			if (particlesAlive)
+				Integrate(dt);
+
+			for (i = 0; i < aliveCount; i++)
+			{
+				// If the particle system is using a texture atlas update the texture coords info
+				if (useAtlas)
 				{
-					particlesAlive = true;
-					// If the particle system is using a texture atlas update the texture coords info
-					if (useAtlas)
-					{
-						//float lifeFactor = (startLifeTime - p.life) / startLifeTime;		// startLifeTime - life, because the particle's life is decreasing we would start at the end of
-						lifeFactor *= atlasInfo.cycles;																	// the atlas and this makes it so that we start at the beginning of the atlas
-
-						int stageCount = atlasInfo.nColumns * atlasInfo.nRows;
-						float atlasProgression = (lifeFactor * stageCount);
-
-						int index1 = (int)glm::floor(atlasProgression);
-						int index2 = index1 < stageCount - 1 ? index1 + 1 : index1;
-
-						p.blendFactor = fmodf(atlasProgression, 1.0f);
-						p.texOffset1 = SetTextureOffset(index1);
-						p.texOffset2 = SetTextureOffset(index2);
-					}
-
-					// Update position
-					if (limitVelocity)
-					{
-						if (p.velocity.x > speedLimit)
-						{
-							p.velocity.x = p.velocity.x * speedLimit / dampen * (1.0f - lifeFactor);
-							if (p.velocity.x < 0.0f)
-								p.velocity.x = 0.0f;
-						}
-						if (p.velocity.y > speedLimit)
-						{
-							p.velocity.y = p.velocity.y * speedLimit / dampen * (1.0f - lifeFactor);
-							if (p.velocity.y < 0.0f)
-								p.velocity.y = 0.0f;
-						}
-						if (p.velocity.z > speedLimit)
-						{
-							p.velocity.z = p.velocity.z * speedLimit / dampen * (1.0f - lifeFactor);
-							if (p.velocity.z < 0.0f)
-								p.velocity.z = 0.0f;
-						}
-					}
-
-					p.velocity.y += -9.8f * gravityModifier * dt;
-
-					p.position += p.velocity * dt;
-					
-					aabb.max = glm::max(aabb.max, p.position + worldPos);
-					aabb.min = glm::min(aabb.min, p.position + worldPos);
-
-					//p.zRotation += dt;
-
-					if (fadeAlphaOverLifetime)
-					{
-						// Calculate alpha between 0 to 1 and to 0 again
-						// Divide the cur particle life by startlifetime to get the value in [0,1]. Because the particle's life starts at 1 and goes to 0, so we need to invert it so it goes from 0 to 1
-						// Multiply it by 2pi so we cover the whole cos range:   x:0 -> y:0     x:pi -> y:1     x:2pi -> y:0
-						float lifetime01 = (1.0f - p.life / startLifeTime) * 6.28f;
-
-						// Plot it in desmos calc to see the graph  (-cos x + 1) * 0.5
-						// It goes from 0 to 1 and then to 0
-						p.color.w = (-glm::cos(lifetime01) + 1.0f) * 0.5f;
-					}
+					float lifeFactor = (startLifeTime - particles.life[i]) / startLifeTime;		// startLifeTime - life, because the particle's life is decreasing we would start at the end of
+					lifeFactor *= atlasInfo.cycles;																		// the atlas and this makes it so that we start at the beginning of the atlas
+
+					int stageCount = atlasInfo.nColumns * atlasInfo.nRows;
+					float atlasProgression = (lifeFactor * stageCount);
+
+					int index1 = (int)glm::floor(atlasProgression);
+					int index2 = index1 < stageCount - 1 ? index1 + 1 : index1;
+
+					particles.blendFactor[i] = fmodf(atlasProgression, 1.0f);
+					particles.texOffsets[i] = glm::vec4(SetTextureOffset(index1), SetTextureOffset(index2));
 				}
+
+				if (fadeAlphaOverLifetime)
+				{
+					// Calculate alpha between 0 to 1 and to 0 again
+					// Divide the cur particle life by startlifetime to get the value in [0,1]. Because the particle's life starts at 1 and goes to 0, so we need to invert it so it goes from 0 to 1
+					// Multiply it by 2pi so we cover the whole cos range:   x:0 -> y:0     x:pi -> y:1     x:2pi -> y:0
+					float lifetime01 = (1.0f - particles.life[i] / startLifeTime) * 6.28f;
+
+					// Plot it in desmos calc to see the graph  (-cos x + 1) * 0.5
+					// It goes from 0 to 1 and then to 0
+					particles.color[i].w = (-glm::cos(lifetime01) + 1.0f) * 0.5f;
+				}
+			}
+
+			const unsigned int spawnCount = Emit(dt);
+			for (i = 0; i < spawnCount; i++)
+			{
+				if (aliveCount < maxParticles)
+					SpawnParticle();
+			}
+
+			timePlaying += dt;
+		}
+	}
+
+	unsigned int ParticleSystem::UpdateGPU(float dt)
+	{
+		if (!isLooping && timePlaying >= duration && !particlesAlive)
+			Stop();
+
+		if (!playing && !particlesAlive)
+			return 0;
+
+		const unsigned int spawnCount = Emit(dt);
+		timePlaying += dt;
+
+		// The particles are only on the gpu so use the time since the last emission to know if there are any alive.
+		// The life decreases by dt / startLifeTime every frame, so a particle lives for startLifeTime * startLifeTime seconds
+		const float particleLifeTime = startLifeTime * startLifeTime;
+
+		if (spawnCount > 0)
+			timeSinceEmit = 0.0f;
+		else
+			timeSinceEmit += dt;
+
+		particlesAlive = timeSinceEmit < particleLifeTime;
+
+		// The particles can't be read back to rebuild the aabb, so use the furthest a particle can go in its life time in any direction.
+		// The limit velocity only slows the particles down so it can be ignored
+		const glm::vec3 maxVelocity = useRandomVelocity ? glm::max(glm::abs(velocityLow), glm::abs(velocityHigh)) : glm::abs(startVelocity);
+		const float gravityDistance = 0.5f * 9.8f * glm::abs(gravityModifier) * particleLifeTime * particleLifeTime;
+		const float radius = glm::length(glm::abs(center) + emissionBox * 0.5f + maxVelocity * particleLifeTime) + gravityDistance;
+
+		aabb.min = worldPos - glm::vec3(radius);
+		aabb.max = worldPos + glm::vec3(radius);
+
+		return spawnCount;
+	}
+
+	unsigned int ParticleSystem::Emit(float dt)
+	{
+		// Only spawn particles if we're below this particle's system duration or we're looping
+		if (timePlaying > duration && !isLooping)
+			return 0;
+
+		accumulator += dt;							// This line and the while are used to spawn newParticles (emission) per second and not per frame
+		float denom = 1.0f / emission;
+
+		unsigned int count = 0;
+		while (accumulator > denom)
+		{
+			accumulator -= denom;
+			count++;
+		}
+
+		return count;
+	}
+
+	void ParticleSystem::Integrate(float dt)
+	{
+		// Limit velocity: a component above the speed limit is scaled by speedLimit / dampen and fades to 0 over the particle's life
+		const float limitScale = speedLimit / dampen;
+		const float gravity = -9.8f * gravityModifier * dt;
+
+		float *posX = particles.posX.data();
+		float *posY = particles.posY.data();
+		float *posZ = particles.posZ.data();
+		float *velX = particles.velX.data();
+		float *velY = particles.velY.data();
+		float *velZ = particles.velZ.data();
+		const float *life = particles.life.data();
+
+		glm::vec3 aabbMin = glm::vec3(10000.0f, 10000.0f, 10000.0f);
+		glm::vec3 aabbMax = glm::vec3(-10000.0f, -10000.0f, -10000.0f);
+
+		unsigned int i = 0;
+
+#if defined(PARTICLES_SSE)
+		const unsigned int simdCount = aliveCount & ~3u;
+
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 limit = _mm_set1_ps(speedLimit);
+		const __m128 scale = _mm_set1_ps(limitScale);
+		const __m128 invLifeTime = _mm_set1_ps(1.0f / startLifeTime);
+		const __m128 lifeTime = _mm_set1_ps(startLifeTime);
+		const __m128 vdt = _mm_set1_ps(dt);
+		const __m128 g = _mm_set1_ps(gravity);
+		const __m128 wx = _mm_set1_ps(worldPos.x);
+		const __m128 wy = _mm_set1_ps(worldPos.y);
+		const __m128 wz = _mm_set1_ps(worldPos.z);
+
+		__m128 minX = _mm_set1_ps(aabbMin.x), minY = _mm_set1_ps(aabbMin.y), minZ = _mm_set1_ps(aabbMin.z);
+		__m128 maxX = _mm_set1_ps(aabbMax.x), maxY = _mm_set1_ps(aabbMax.y), maxZ = _mm_set1_ps(aabbMax.z);
+
+		for (; i < simdCount; i += 4)
+		{
+			__m128 vx = _mm_loadu_ps(velX + i);
+			__m128 vy = _mm_loadu_ps(velY + i);
+			__m128 vz = _mm_loadu_ps(velZ + i);
+
+			if (limitVelocity)
+			{
+				// (startLifeTime - life) / startLifeTime goes from 0 to 1 over the particle's life time
+				const __m128 lifeFactor = _mm_mul_ps(_mm_sub_ps(lifeTime, _mm_loadu_ps(life + i)), invLifeTime);
+				const __m128 factor = _mm_mul_ps(scale, _mm_sub_ps(one, lifeFactor));
+
+				__m128 mask = _mm_cmpgt_ps(vx, limit);
+				vx = _mm_or_ps(_mm_and_ps(mask, _mm_max_ps(_mm_mul_ps(vx, factor), zero)), _mm_andnot_ps(mask, vx));
+				mask = _mm_cmpgt_ps(vy, limit);
+				vy = _mm_or_ps(_mm_and_ps(mask, _mm_max_ps(_mm_mul_ps(vy, factor), zero)), _mm_andnot_ps(mask, vy));
+				mask = _mm_cmpgt_ps(vz, limit);
+				vz = _mm_or_ps(_mm_and_ps(mask, _mm_max_ps(_mm_mul_ps(vz, factor), zero)), _mm_andnot_ps(mask, vz));
 			}
 
-			if (particlesAlive == false)
+			vy = _mm_add_ps(vy, g);
+
+			const __m128 px = _mm_add_ps(_mm_loadu_ps(posX + i), _mm_mul_ps(vx, vdt));
+			const __m128 py = _mm_add_ps(_mm_loadu_ps(posY + i), _mm_mul_ps(vy, vdt));
+			const __m128 pz = _mm_add_ps(_mm_loadu_ps(posZ + i), _mm_mul_ps(vz, vdt));
+
+			_mm_storeu_ps(velX + i, vx);
+			_mm_storeu_ps(velY + i, vy);
+			_mm_storeu_ps(velZ + i, vz);
+			_mm_storeu_ps(posX + i, px);
+			_mm_storeu_ps(posY + i, py);
+			_mm_storeu_ps(posZ + i, pz);
+
+			minX = _mm_min_ps(minX, _mm_add_ps(px, wx));
+			minY = _mm_min_ps(minY, _mm_add_ps(py, wy));
+			minZ = _mm_min_ps(minZ, _mm_add_ps(pz, wz));
+			maxX = _mm_max_ps(maxX, _mm_add_ps(px, wx));
+			maxY = _mm_max_ps(maxY, _mm_add_ps(py, wy));
+			maxZ = _mm_max_ps(maxZ, _mm_add_ps(pz, wz));
+		}
+
+		float lanes[4];
+		_mm_storeu_ps(lanes, minX); aabbMin.x = glm::min(glm::min(lanes[0], lanes[1]), glm::min(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, minY); aabbMin.y = glm::min(glm::min(lanes[0], lanes[1]), glm::min(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, minZ); aabbMin.z = glm::min(glm::min(lanes[0], lanes[1]), glm::min(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, maxX); aabbMax.x = glm::max(glm::max(lanes[0], lanes[1]), glm::max(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, maxY); aabbMax.y = glm::max(glm::max(lanes[0], lanes[1]), glm::max(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, maxZ); aabbMax.z = glm::max(glm::max(lanes[0], lanes[1]), glm::max(lanes[2], lanes[3]));
+#elif defined(PARTICLES_NEON)
+		const unsigned int simdCount = aliveCount & ~3u;
+
+		const float32x4_t zero = vdupq_n_f32(0.0f);
+		const float32x4_t one = vdupq_n_f32(1.0f);
+		const float32x4_t limit = vdupq_n_f32(speedLimit);
+		const float32x4_t scale = vdupq_n_f32(limitScale);
+		const float32x4_t invLifeTime = vdupq_n_f32(1.0f / startLifeTime);
+		const float32x4_t lifeTime = vdupq_n_f32(startLifeTime);
+		const float32x4_t vdt = vdupq_n_f32(dt);
+		const float32x4_t g = vdupq_n_f32(gravity);
+		const float32x4_t wx = vdupq_n_f32(worldPos.x);
+		const float32x4_t wy = vdupq_n_f32(worldPos.y);
+		const float32x4_t wz = vdupq_n_f32(worldPos.z);
+
+		float32x4_t minX = vdupq_n_f32(aabbMin.x), minY = vdupq_n_f32(aabbMin.y), minZ = vdupq_n_f32(aabbMin.z);
+		float32x4_t maxX = vdupq_n_f32(aabbMax.x), maxY = vdupq_n_f32(aabbMax.y), maxZ = vdupq_n_f32(aabbMax.z);
+
+		for (; i < simdCount; i += 4)
+		{
+			float32x4_t vx = vld1q_f32(velX + i);
+			float32x4_t vy = vld1q_f32(velY + i);
+			float32x4_t vz = vld1q_f32(velZ + i);
+
+			if (limitVelocity)
 			{
-				aabb.min = prevMin;
-				aabb.max = prevMax;
+				// (startLifeTime - life) / startLifeTime goes from 0 to 1 over the particle's life time
+				const float32x4_t lifeFactor = vmulq_f32(vsubq_f32(lifeTime, vld1q_f32(life + i)), invLifeTime);
+				const float32x4_t factor = vmulq_f32(scale, vsubq_f32(one, lifeFactor));
+
+				vx = vbslq_f32(vcgtq_f32(vx, limit), vmaxq_f32(vmulq_f32(vx, factor), zero), vx);
+				vy = vbslq_f32(vcgtq_f32(vy, limit), vmaxq_f32(vmulq_f32(vy, factor), zero), vy);
+				vz = vbslq_f32(vcgtq_f32(vz, limit), vmaxq_f32(vmulq_f32(vz, factor), zero), vz);
 			}
 
+			vy = vaddq_f32(vy, g);
+
+			const float32x4_t px = vmlaq_f32(vld1q_f32(posX + i), vx, vdt);
+			const float32x4_t py = vmlaq_f32(vld1q_f32(posY + i), vy, vdt);
+			const float32x4_t pz = vmlaq_f32(vld1q_f32(posZ + i), vz, vdt);
+
+			vst1q_f32(velX + i, vx);
+			vst1q_f32(velY + i, vy);
+			vst1q_f32(velZ + i, vz);
+			vst1q_f32(posX + i, px);
+			vst1q_f32(posY + i, py);
+			vst1q_f32(posZ + i, pz);
+
+			minX = vminq_f32(minX, vaddq_f32(px, wx));
+			minY = vminq_f32(minY, vaddq_f32(py, wy));
+			minZ = vminq_f32(minZ, vaddq_f32(pz, wz));
+			maxX = vmaxq_f32(maxX, vaddq_f32(px, wx));
+			maxY = vmaxq_f32(maxY, vaddq_f32(py, wy));
+			maxZ = vmaxq_f32(maxZ, vaddq_f32(pz, wz));
+		}
 
-			// Only spawn particles if we're below this particle's system duration or we're looping
-			if (timePlaying <= duration || isLooping)
+		float lanes[4];
+		vst1q_f32(lanes, minX); aabbMin.x = glm::min(glm::min(lanes[0], lanes[1]), glm::min(lanes[2], lanes[3]));
+		vst1q_f32(lanes, minY); aabbMin.y = glm::min(glm::min(lanes[0], lanes[1]), glm::min(lanes[2], lanes[3]));
+		vst1q_f32(lanes, minZ); aabbMin.z = glm::min(glm::min(lanes[0], lanes[1]), glm::min(lanes[2], lanes[3]));
+		vst1q_f32(lanes, maxX); aabbMax.x = glm::max(glm::max(lanes[0], lanes[1]), glm::max(lanes[2], lanes[3]));
+		vst1q_f32(lanes, maxY); aabbMax.y = glm::max(glm::max(lanes[0], lanes[1]), glm::max(lanes[2], lanes[3]));
+		vst1q_f32(lanes, maxZ); aabbMax.z = glm::max(glm::max(lanes[0], lanes[1]), glm::max(lanes[2], lanes[3]));
+#endif
+
+		// Remaining particles, or all of them if there's no SIMD support
+		for (; i < aliveCount; i++)
+		{
+			glm::vec3 v = glm::vec3(velX[i], velY[i], velZ[i]);
+
+			if (limitVelocity)
 			{
-				accumulator += dt;							// This line and the while are used to spawn newParticles (emission) per second and not per frame
-				float denom = 1.0f / emission;
+				const float factor = limitScale * (1.0f - (startLifeTime - life[i]) / startLifeTime);
 
-				while (accumulator > denom)
+				for (int c = 0; c < 3; c++)
 				{
-					int unusedParticle = FirstUnusedParticle();
-					if (unusedParticle == 0 && particles[0].life <= 0.0f)		// This is used in the case that there is only one particle to let its life reach 0
-					{
-						RespawnParticle(particles[0]);
-					}
-					else if (unusedParticle > 0)
-					{
-						RespawnParticle(particles[unusedParticle]);
-					}
-					accumulator -= denom;
+					if (v[c] > speedLimit)
+						v[c] = glm::max(v[c] * factor, 0.0f);
 				}
-			}		
-			
-			timePlaying += dt;
-			//if (useGlobalRotation && useRotation)
-				//zRotation += dt;
+			}
 
-			//std::cout << "x: " << aabb.min.x << "y: " << aabb.min.y << "z: " << aabb.min.z << '\n';
-			//std::cout << "x: " << aabb.max.x << "y: " << aabb.max.y << "z: " << aabb.max.z << '\n';
+			v.y += gravity;
+
+			const glm::vec3 p = glm::vec3(posX[i], posY[i], posZ[i]) + v * dt;
+
+			velX[i] = v.x;
+			velY[i] = v.y;
+			velZ[i] = v.z;
+			posX[i] = p.x;
+			posY[i] = p.y;
+			posZ[i] = p.z;
+
+			aabbMin = glm::min(aabbMin, p + worldPos);
+			aabbMax = glm::max(aabbMax, p + worldPos);
 		}
+
+		aabb.min = aabbMin;
+		aabb.max = aabbMax;
 	}
 
 	bool ParticleSystem::PrepareRender(const glm::mat4 &transform)
@@ -255,58 +476,36 @@ namespace Engine
 		if (!playing)
 			return false;
 
-		quadMesh.instanceOffset = instanceData.size();
-
 		glm::mat4 m = transform;
 		m[0] = glm::normalize(m[0]);
 		m[1] = glm::normalize(m[1]);
 		m[2] = glm::normalize(m[2]);
 
-		glm::mat4 t = glm::mat4(1.0f);
+		// The alive particles are packed at the start so they're written straight into the instance data without checking each particle
+		PSInstanceData *inst = instanceData.data();
 
-		for (unsigned int i = 0; i < maxParticles; i++)
+		for (unsigned int i = 0; i < aliveCount; i++)
 		{
-			const Particle &p = particles[i];
-
-			if (p.life > 0.0f)
-			{
-				PSInstanceData inst;
-				//inst.posBlendFactor = glm::vec4(particles[i].position + worldPos, particles[i].blendFactor);
-				
-				t = glm::mat4(1.0f);
-				t[3] = glm::vec4(p.position, 1.0f);
+			const glm::vec4 pos = m[0] * particles.posX[i] + m[1] * particles.posY[i] + m[2] * particles.posZ[i] + m[3];
 
-				t = m * t;
-
-				inst.posBlendFactor = glm::vec4(t[3].x, t[3].y, t[3].z, p.blendFactor);
-
-				inst.color = p.color;
-				inst.texOffsets = glm::vec4(p.texOffset1, p.texOffset2);
-				//inst.rotation = glm::vec4(0.0f, 0.0f, particles[i].zRotation, 0.0f);
-
-				instanceData.push_back(inst);
-			}
+			inst[i].posBlendFactor = glm::vec4(pos.x, pos.y, pos.z, particles.blendFactor[i]);
+			inst[i].color = particles.color[i];
+			inst[i].texOffsets = particles.texOffsets[i];
 		}
 
-		quadMesh.instanceCount = instanceData.size();
+		quadMesh.instanceOffset = 0;
+		quadMesh.instanceCount = aliveCount;
 
 		if (quadMesh.instanceCount > 0)
-		{
-			/*if (materialUBOChanged)
-			{
-				glm::vec4 params = glm::vec4(atlasInfo.nColumns, atlasInfo.nRows, startSize, useAtlas);
-				matInstance->baseMaterial->GetMaterialUBO()->Update(glm::value_ptr(params), sizeof(glm::vec4), 0);
-				materialUBOChanged = false;
-			}*/
-			instanceVB->Update(instanceData.data(), instanceData.size() * sizeof(PSInstanceData), 0);
-			instanceData.clear();
-		}
+			instanceVB->Update(instanceData.data(), aliveCount * sizeof(PSInstanceData), 0);
 
 		return true;
 	}
 
-	void ParticleSystem::RespawnParticle(Particle &particle)
+	void ParticleSystem::SpawnParticle()
 	{
+		const unsigned int i = aliveCount++;
+
 		// Convert the random float which is in [0,1] to [-1,1]
 		float x = Random::Float() * 2.0f - 1.0f;
 		float y = Random::Float() * 2.0f - 1.0f;
@@ -317,59 +516,38 @@ namespace Engine
 		y *= 0.5f;
 		z *= 0.5f;
 
+		glm::vec3 pos = center;
+
 		if (emissionShape == EmissionShape::BOX)
 		{
-			glm::vec3 pos = glm::vec3(x, y, z);
-			pos *= emissionBox;
-
-			//particle.position = pos + startPosition + center;
-			particle.position = pos + center;
-			//particle.position = pos;
+			pos += glm::vec3(x, y, z) * emissionBox;
 		}
 		else if (emissionShape == EmissionShape::SPHERE)
 		{
 
 		}
 
+		particles.posX[i] = pos.x;
+		particles.posY[i] = pos.y;
+		particles.posZ[i] = pos.z;
+
 		if (useRandomVelocity)
 		{
-			x = Random::Float() * (velocityHigh.x - velocityLow.x) + velocityLow.x;
-			y = Random::Float() * (velocityHigh.y - velocityLow.y) + velocityLow.y;
-			z = Random::Float() * (velocityHigh.z - velocityLow.z) + velocityLow.z;
-
-			particle.velocity = glm::vec3(x, y, z);
+			particles.velX[i] = Random::Float() * (velocityHigh.x - velocityLow.x) + velocityLow.x;
+			particles.velY[i] = Random::Float() * (velocityHigh.y - velocityLow.y) + velocityLow.y;
+			particles.velZ[i] = Random::Float() * (velocityHigh.z - velocityLow.z) + velocityLow.z;
 		}
 		else
 		{
-			particle.velocity = startVelocity;
+			particles.velX[i] = startVelocity.x;
+			particles.velY[i] = startVelocity.y;
+			particles.velZ[i] = startVelocity.z;
 		}
 
-		particle.life = startLifeTime;
-		particle.color = startColor;
-	}
-
-	int ParticleSystem::FirstUnusedParticle()
-	{
-		for (unsigned int i = lastUsedParticle; i < maxParticles; ++i)
-		{
-			if (particles[i].life <= 0.0f)
-			{
-				lastUsedParticle = i;
-				return i;
-			}
-		}
-
-		for (int i = 0; i < lastUsedParticle; i++)
-		{
-			if (particles[i].life <= 0.0f)
-			{
-				lastUsedParticle = i;
-				return i;
-			}
-		}
-
-		lastUsedParticle = 0;
-		return 0;
+		particles.life[i] = startLifeTime;
+		particles.color[i] = startColor;
+		particles.blendFactor[i] = 0.0f;
+		particles.texOffsets[i] = glm::vec4(0.0f);
 	}
 
 	glm::vec2 ParticleSystem::SetTextureOffset(int index)
@@ -407,11 +585,29 @@ namespace Engine
 
 	void ParticleSystem::SetMaxParticles(unsigned int maxParticles)
 	{
-		if (maxParticles > 100)		// Don't use hardcoded number
-			maxParticles = 100;
+		const unsigned int limit = gpuSimulated ? MAX_GPU_PARTICLES_PER_SYSTEM : MAX_PARTICLES_PER_SYSTEM;
+		if (maxParticles > limit)
+			maxParticles = limit;
 
 		this->maxParticles = maxParticles;
-		particles.resize(maxParticles);
+
+		// The gpu simulated systems don't use the cpu side particles
+		const unsigned int cpuParticles = gpuSimulated ? 0 : maxParticles;
+		particles.Resize(cpuParticles);
+		instanceData.resize(cpuParticles);
+
+		if (aliveCount > cpuParticles)
+			aliveCount = cpuParticles;
+	}
+
+	void ParticleSystem::SetGPUSimulated(bool gpu)
+	{
+		if (gpuSimulated == gpu)
+			return;
+
+		gpuSimulated = gpu;
+		timeSinceEmit = 0.0f;
+		SetMaxParticles(maxParticles);		// The limit depends on where the particles are simulated
 	}
 
 	void ParticleSystem::SetEmissionBox(const glm::vec3 &box)
@@ -39,18 +39,30 @@ namespace Engine
 		float cycles;			// How many times the texture atlas will be looped in the lifetime of a particle
 	};
 
-	struct Particle
+	// Particle data stored as a structure of arrays so the simulation can update several particles at once with SIMD.
+	// The alive particles are always packed in [0, aliveCount), when a particle dies the last alive one is moved into its slot
+	struct ParticleData
 	{
-		glm::vec3 position;
-		glm::vec3 velocity;
-		glm::vec4 color;
-		//float zRotation;
-		float life;
-		float blendFactor;
-		glm::vec2 texOffset1;
-		glm::vec2 texOffset2;
+		void Resize(unsigned int count);
+		void Move(unsigned int dst, unsigned int src);
+
+		std::vector<float> posX;
+		std::vector<float> posY;
+		std::vector<float> posZ;
+		std::vector<float> velX;
+		std::vector<float> velY;
+		std::vector<float> velZ;
+		std::vector<float> life;
+		std::vector<glm::vec4> color;
+		std::vector<float> blendFactor;
+		std::vector<glm::vec4> texOffsets;
 	};
 
+	// The vertex buffer with the instance data has space for this many particles
+	static const unsigned int MAX_PARTICLES_PER_SYSTEM = 100;
+	// Particle systems simulated in a compute shader keep their particles in a pool on the gpu, so they can have a lot more
+	static const unsigned int MAX_GPU_PARTICLES_PER_SYSTEM = 4096;
+
 	class ParticleSystem
 	{
 	private:
@@ -63,6 +75,8 @@ namespace Engine
 		void Create(int maxParticles);
 		void Update(float dt);
 		bool PrepareRender(const glm::mat4 &transform);
+		// Used instead of Update when the particles are simulated on the gpu. Only advances the emission and the aabb, returns how many particles to spawn this frame
+		unsigned int UpdateGPU(float dt);
 
 		void SetMaterialInstance(MaterialInstance *mat);
 		void SetCenter(const glm::vec3 &center);
@@ -81,6 +95,7 @@ namespace Engine
 		void SetEmissionBox(const glm::vec3 &box);
 		void SetEmissionRadius(float radius);
 		void SetFadeAlphaOverLifetime(bool fade) { fadeAlphaOverLifetime = fade; }
+		void SetGPUSimulated(bool gpu);
 
 		void SetGravityModifier(float value) { gravityModifier = value; }
 
@@ -100,11 +115,13 @@ namespace Engine
 		bool UsesRandomVelocity() const { return useRandomVelocity; }
 
 		int GetMaxParticles() const { return maxParticles; }
+		unsigned int GetAliveParticles() const { return aliveCount; }
 		int GetEmission() const { return emission; }
 
 		bool UsesAtlas() const { return useAtlas; }
 		bool IsLooping() const { return isLooping; }
 		bool GetFadeAlphaOverLifeTime() const { return fadeAlphaOverLifetime; }
+		bool IsGPUSimulated() const { return gpuSimulated; }
 
 		bool GetLimitVelocityOverLifetime() const { return limitVelocity; }
 		float GetSpeedLimit()const { return speedLimit; }
@@ -128,8 +145,9 @@ namespace Engine
 		void Play();
 
 	private:
-		void RespawnParticle(Particle &particle);
-		int FirstUnusedParticle();
+		unsigned int Emit(float dt);
+		void SpawnParticle();
+		void Integrate(float dt);
 		glm::vec2 SetTextureOffset(int index);
 
 	private:
@@ -153,6 +171,9 @@ namespace Engine
 		bool isLooping = true;
 		bool particlesAlive = false;
 		bool fadeAlphaOverLifetime = true;
+		bool gpuSimulated = false;
+		unsigned int gpuSlot;				// Index of the system in the ParticleManager gpu systems
+		float timeSinceEmit = 0.0f;
 		//bool useGlobalRotation = true;
 		//float zRotation = 0.0f;
 
@@ -160,7 +181,6 @@ namespace Engine
 		glm::vec3 emissionBox;
 		float emissionRadius;
 
-		int lastUsedParticle;
 		int emission;
 		float accumulator;
 
@@ -182,6 +202,7 @@ namespace Engine
 
 		float gravityModifier = 0.0f;
 
-		std::vector<Particle> particles;
+		ParticleData particles;
+		unsigned int aliveCount;
 	};
 }
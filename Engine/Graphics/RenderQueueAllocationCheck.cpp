@@ -0,0 +1,241 @@
+#include "RenderQueueAllocationCheck.h"
+
+#include "Renderer.h"
+#include "Camera/Frustum.h"
+#include "Program/Allocator.h"
+#include "Program/JobSystem.h"
+#include "Program/LinearAllocator.h"
+#include "Program/Log.h"
+
+#include "include/glm/gtc/constants.hpp"
+
+#include <cmath>
+#include <random>
+
+namespace Engine
+{
+	static const unsigned int CHECK_QUEUE_COUNT = 3;
+	static const unsigned int CHECK_MAX_ITEMS_PER_OBJECT = 3;
+	static const unsigned int CHECK_FRAME_ALLOCATOR_SIZE = 1024 * 1024;
+	static const float CHECK_SCENE_HALF_SIZE = 100.0f;
+	static const float CHECK_ORBIT_RADIUS = 60.0f;
+
+	// Only the culling and queue building of the base renderer run, everything that would talk to a gpu does nothing
+	class AllocationCheckRenderer : public Renderer
+	{
+	public:
+		bool Init() override { return true; }
+		bool PostLoad(ScriptManager &scriptManager) override { return true; }
+		void Resize(unsigned int width, unsigned int height) override {}
+		void SetCamera(Camera *camera, const glm::vec4 &clipPlane) override {}
+		void UpdateBuffer(Buffer *ubo, const void *data, unsigned int size, unsigned int offset) override {}
+
+		VertexArray *CreateVertexArray(const VertexInputDesc &desc, Buffer *vertexBuffer, Buffer *indexBuffer) override { return nullptr; }
+		VertexArray *CreateVertexArray(const VertexInputDesc *descs, unsigned int descCount, const std::vector<Buffer*> &vertexBuffers, Buffer *indexBuffer) override { return nullptr; }
+		Buffer *CreateVertexBuffer(const void *data, unsigned int size, BufferUsage usage) override { return nullptr; }
+		Buffer *CreateIndexBuffer(const void *data, unsigned int size, BufferUsage usage) override { return nullptr; }
+		Buffer *CreateUniformBuffer(const void *data, unsigned int size) override { return nullptr; }
+		Buffer *CreateDrawIndirectBuffer(unsigned int size, const void *data) override { return nullptr; }
+		Buffer *CreateSSBO(unsigned int size, const void *data, unsigned int stride, BufferUsage usage) override { return nullptr; }
+		Framebuffer *CreateFramebuffer(const FramebufferDesc &desc) override { return nullptr; }
+
+		ShaderProgram *CreateShader(const std::string &vertexName, const std::string &fragmentName, const std::string &defines, const std::vector<VertexInputDesc> &descs, const BlendState &blendState) override { return nullptr; }
+		ShaderProgram *CreateShader(const std::string &vertexName, const std::string &fragmentName, const std::vector<VertexInputDesc> &descs, const BlendState &blendState) override { return nullptr; }
+		ShaderProgram *CreateShaderWithGeometry(const std::string &vertexPath, const std::string &geometryPath, const std::string &fragmentPath, const std::string &defines, const std::vector<VertexInputDesc> &descs) override { return nullptr; }
+		ShaderProgram *CreateShaderWithGeometry(const std::string &vertexPath, const std::string &geometryPath, const std::string &fragmentPath, const std::vector<VertexInputDesc> &descs) override { return nullptr; }
+		ShaderProgram *CreateComputeShader(const std::string &defines, const std::string &computePath) override { return nullptr; }
+		ShaderProgram *CreateComputeShader(const std::string &computePath) override { return nullptr; }
+
+		MaterialInstance *CreateMaterialInstance(ScriptManager &scriptManager, const std::string &matInstPath, const std::vector<VertexInputDesc> &inputDescs) override { return nullptr; }
+		MaterialInstance *CreateMaterialInstanceFromBaseMat(ScriptManager &scriptManager, const std::string &baseMatPath, const std::vector<VertexInputDesc> &inputDescs) override { return nullptr; }
+
+		Texture *CreateTexture2D(const std::string &path, const TextureParams &params, bool storeTextureData) override { return nullptr; }
+		Texture *CreateTexture3D(const std::string &path, const void *data, unsigned int width, unsigned int height, unsigned int depth, const TextureParams &params) override { return nullptr; }
+		Texture *CreateTextureCube(const std::vector<std::string> &faces, const TextureParams &params) override { return nullptr; }
+		Texture *CreateTextureCube(const std::string &path, const TextureParams &params) override { return nullptr; }
+		Texture *CreateTexture2DFromData(unsigned int width, unsigned int height, const TextureParams &params, const void *data) override { return nullptr; }
+		Texture *CreateTexture3DFromData(unsigned int width, unsigned int height, unsigned int depth, const TextureParams &params, const void *data) override { return nullptr; }
+
+		void SetDefaultRenderTarget() override {}
+		void SetRenderTarget(Framebuffer *rt) override {}
+		void SetRenderTargetAndClear(Framebuffer *rt) override {}
+		void EndRenderTarget(Framebuffer *rt) override {}
+		void EndDefaultRenderTarget() override {}
+		void ClearRenderTarget(Framebuffer *rt) override {}
+		void SetViewport(const Viewport &viewport) override {}
+		void Submit(const RenderQueue &renderQueue) override {}
+		void Submit(const RenderItem &renderItem) override {}
+		void SubmitIndirect(const RenderItem &renderItem, Buffer *indirectBuffer) override {}
+		void Dispatch(const DispatchItem &item) override {}
+
+		void AddTextureResourceToSlot(unsigned int binding, Texture *texture, bool useStorage, unsigned int stages, TextureInternalFormat viewFormat, bool separateMipViews) override {}
+		void AddBufferResourceToSlot(unsigned int binding, Buffer *buffer, unsigned int stages) override {}
+		void SetupResources() override {}
+		void UpdateTextureResourceOnSlot(unsigned int binding, Texture *texture, bool useStorage, bool separateMipViews) override {}
+
+		void PerformBarrier(const Barrier &barrier) override {}
+		void CopyImage(Texture *src, Texture *dst) override {}
+		void ClearImage(Texture *tex) override {}
+
+		void UpdateMaterialInstance(MaterialInstance *matInst) override {}
+		void ReloadShaders() override {}
+		void RemoveTexture(Texture *t) override {}
+
+	private:
+		void Dispose() override {}
+	};
+
+	// Boxes spread over the scene, each one emits a few items to every queue it's visible in.
+	// The items are never drawn or dereferenced so their mesh and material only have to be different pointers
+	class AllocationCheckGenerator : public RenderQueueGenerator
+	{
+	public:
+		void Init(unsigned int objectCount, unsigned int seed)
+		{
+			std::mt19937 mt(seed);
+			std::uniform_real_distribution<float> posDist(-CHECK_SCENE_HALF_SIZE, CHECK_SCENE_HALF_SIZE);
+			std::uniform_real_distribution<float> sizeDist(0.5f, 4.0f);
+			std::uniform_int_distribution<unsigned int> itemDist(1, CHECK_MAX_ITEMS_PER_OBJECT);
+
+			boxes.resize(objectCount);
+			itemCounts.resize(objectCount);
+			transforms.resize(objectCount);
+
+			for (unsigned int i = 0; i < objectCount; i++)
+			{
+				const glm::vec3 center = glm::vec3(posDist(mt), posDist(mt) * 0.1f, posDist(mt));
+				const glm::vec3 halfSize = glm::vec3(sizeDist(mt));
+
+				boxes[i].min = center - halfSize;
+				boxes[i].max = center + halfSize;
+				itemCounts[i] = itemDist(mt);
+				transforms[i] = glm::mat4(1.0f);
+				transforms[i][3] = glm::vec4(center, 1.0f);
+			}
+		}
+
+		void Cull(unsigned int passAndFrustumCount, unsigned int *passIds, const Frustum *frustums, std::vector<VisibilityIndices*> &out) override
+		{
+			for (unsigned int i = 0; i < passAndFrustumCount; i++)
+			{
+				for (size_t j = 0; j < boxes.size(); j++)
+				{
+					if (frustums[i].BoxInFrustum(boxes[j].min, boxes[j].max) != FrustumIntersect::OUTSIDE)
+						out[i]->push_back(static_cast<unsigned int>(j));
+				}
+			}
+		}
+
+		void GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues) override
+		{
+			for (size_t i = 0; i < visibility.size(); i++)
+			{
+				const unsigned int index = visibility[i];
+
+				for (unsigned int j = 0; j < itemCounts[index]; j++)
+				{
+					RenderItem ri = {};
+					ri.mesh = reinterpret_cast<const Mesh*>(&meshes[j]);
+					ri.matInstance = reinterpret_cast<const MaterialInstance*>(&materials[index % CHECK_MAX_ITEMS_PER_OBJECT]);
+					ri.transform = &transforms[index];
+					ri.meshParams = &transforms[index];
+					ri.meshParamsSize = sizeof(glm::mat4);
+
+					outQueues.push_back(ri);
+				}
+			}
+		}
+
+	private:
+		std::vector<AABB> boxes;
+		std::vector<unsigned int> itemCounts;
+		std::vector<glm::mat4> transforms;
+		unsigned char meshes[CHECK_MAX_ITEMS_PER_OBJECT];
+		unsigned char materials[CHECK_MAX_ITEMS_PER_OBJECT];
+	};
+
+	bool RunRenderQueueAllocationCheck(unsigned int objectCount, unsigned int framesPerOrbit, unsigned int orbits, unsigned int seed)
+	{
+		if (objectCount == 0 || framesPerOrbit == 0 || orbits < 2)
+			return true;
+
+		Allocator allocator;
+		LinearAllocator frameAllocator;
+		frameAllocator.Init(&allocator, CHECK_FRAME_ALLOCATOR_SIZE);
+
+		// Build the queues in parallel like the rendering paths do
+		JobSystem jobSystem;
+		jobSystem.Init();
+
+		AllocationCheckGenerator generator;
+		generator.Init(objectCount, seed);
+
+		AllocationCheckRenderer renderer;
+		renderer.SetFrameAllocator(&frameAllocator);
+		renderer.SetJobSystem(&jobSystem);
+		renderer.AddRenderQueueGenerator(&generator);
+
+		// The queues are kept between frames like the ones of the rendering paths
+		RenderQueue renderQueues[CHECK_QUEUE_COUNT];
+		unsigned int queueIDs[CHECK_QUEUE_COUNT] = { 0, 1, 2 };
+
+		// Items aren't sorted because the sort key needs a loaded material. The queues and visibility are what this checks
+		RenderQueueSortParams sortParams[CHECK_QUEUE_COUNT] = {};
+
+		unsigned int warmUpAllocations = 0;
+		unsigned int maxQueueSize = 0;
+
+		Log::Print(LogLevel::LEVEL_INFO, "Render queue allocation check: %u objects, %u frames per orbit, %u orbits\n", objectCount, framesPerOrbit, orbits);
+
+		for (unsigned int orbit = 0; orbit < orbits; orbit++)
+		{
+			for (unsigned int f = 0; f < framesPerOrbit; f++)
+			{
+				frameAllocator.Reset();
+
+				const float angle = glm::two_pi<float>() * f / framesPerOrbit;
+				const glm::vec3 camPos = glm::vec3(std::cos(angle), 0.3f, std::sin(angle)) * CHECK_ORBIT_RADIUS;
+
+				// A main view looking at the center, a narrow one looking out of the scene and an orthographic one from above
+				Frustum frustums[CHECK_QUEUE_COUNT];
+				frustums[0].UpdateProjection(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+				frustums[0].Update(camPos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+				frustums[1].UpdateProjection(glm::radians(30.0f), 1.0f, 0.1f, 150.0f);
+				frustums[1].Update(camPos, camPos * 2.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+				frustums[2].UpdateProjection(-40.0f, 40.0f, -40.0f, 40.0f, 0.1f, 200.0f);
+				frustums[2].Update(glm::vec3(camPos.x, 100.0f, camPos.z), glm::vec3(camPos.x, 0.0f, camPos.z), glm::vec3(0.0f, 0.0f, 1.0f));
+
+				VisibilityList visibility = renderer.Cull(CHECK_QUEUE_COUNT, queueIDs, frustums);
+				renderer.CreateRenderQueues(CHECK_QUEUE_COUNT, queueIDs, visibility, renderQueues, sortParams);
+
+				for (unsigned int i = 0; i < CHECK_QUEUE_COUNT; i++)
+				{
+					if (renderQueues[i].size() > maxQueueSize)
+						maxQueueSize = static_cast<unsigned int>(renderQueues[i].size());
+				}
+			}
+
+			// The first orbit has seen every view the next ones will see
+			if (orbit == 0)
+				warmUpAllocations = renderer.GetQueueAllocations();
+		}
+
+		const unsigned int allocations = renderer.GetQueueAllocations();
+
+		renderer.RemoveRenderQueueGenerator(&generator);
+		renderer.SetFrameAllocator(nullptr);
+		renderer.SetJobSystem(nullptr);
+		jobSystem.Dispose();
+		frameAllocator.Dispose();
+
+		Log::Print(LogLevel::LEVEL_INFO, "Largest queue %u items, %u allocations during warm up, %u after\n", maxQueueSize, warmUpAllocations, allocations - warmUpAllocations);
+
+		if (allocations > warmUpAllocations)
+		{
+			Log::Print(LogLevel::LEVEL_ERROR, "The render queues allocated %u times after the warm up\n", allocations - warmUpAllocations);
+			return false;
+		}
+
+		return true;
+	}
+}
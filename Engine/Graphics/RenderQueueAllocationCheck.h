@@ -0,0 +1,9 @@
+#pragma once
+
+namespace Engine
+{
+	// Culls and builds the render queues of a synthetic scene for several frames with a renderer that doesn't draw anything.
+	// The camera orbits the scene once to warm up the queues and then repeats the same orbit, which must not allocate anymore.
+	// Returns false if the queue allocations grew after the warm up. Doesn't need a window or a gpu so it can run from the editor or a tool
+	bool RunRenderQueueAllocationCheck(unsigned int objectCount = 5000, unsigned int framesPerOrbit = 60, unsigned int orbits = 3, unsigned int seed = 1);
+}
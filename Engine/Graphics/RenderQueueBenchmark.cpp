@@ -0,0 +1,124 @@
+#include "RenderQueueBenchmark.h"
+
+#include "RenderQueueSorter.h"
+#include "Program/Log.h"
+
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+namespace Engine
+{
+	static const unsigned int BENCHMARK_SHADER_COUNT = 32;
+	static const unsigned int BENCHMARK_MATERIAL_COUNT = 512;
+	static const unsigned int BENCHMARK_MESH_COUNT = 1024;
+
+	struct StateChanges
+	{
+		unsigned int shaderChanges;
+		unsigned int materialChanges;
+		unsigned int meshChanges;
+	};
+
+	// The items only point into these arrays so the changes can be counted, nothing is dereferenced
+	static unsigned char benchmarkMaterials[BENCHMARK_MATERIAL_COUNT];
+	static unsigned char benchmarkMeshes[BENCHMARK_MESH_COUNT];
+
+	static unsigned int GetMaterialIndex(const RenderItem &ri)
+	{
+		return static_cast<unsigned int>(reinterpret_cast<const unsigned char*>(ri.matInstance) - benchmarkMaterials);
+	}
+
+	static StateChanges CountStateChanges(const RenderQueue &queue)
+	{
+		StateChanges changes = {};
+
+		for (size_t i = 1; i < queue.size(); i++)
+		{
+			const unsigned int prevMaterial = GetMaterialIndex(queue[i - 1]);
+			const unsigned int material = GetMaterialIndex(queue[i]);
+
+			if (prevMaterial % BENCHMARK_SHADER_COUNT != material % BENCHMARK_SHADER_COUNT)
+				changes.shaderChanges++;
+			if (prevMaterial != material)
+				changes.materialChanges++;
+			if (queue[i - 1].mesh != queue[i].mesh)
+				changes.meshChanges++;
+		}
+
+		return changes;
+	}
+
+	bool RunRenderQueueSortBenchmark(unsigned int itemCount, unsigned int iterations, unsigned int seed)
+	{
+		std::mt19937 mt(seed);
+		std::uniform_int_distribution<unsigned int> materialDist(0, BENCHMARK_MATERIAL_COUNT - 1);
+		std::uniform_int_distribution<unsigned int> meshDist(0, BENCHMARK_MESH_COUNT - 1);
+		std::uniform_real_distribution<float> distanceDist(0.0f, 500.0f);
+
+		// Each material uses one shader and the items are in random order, like a scene where nothing is grouped
+		RenderQueue sceneQueue(itemCount);
+		for (unsigned int i = 0; i < itemCount; i++)
+		{
+			RenderItem &ri = sceneQueue[i];
+			ri = {};
+
+			const unsigned int material = materialDist(mt);
+			const unsigned int mesh = meshDist(mt);
+			const float distance = distanceDist(mt);
+
+			ri.matInstance = reinterpret_cast<const MaterialInstance*>(&benchmarkMaterials[material]);
+			ri.mesh = reinterpret_cast<const Mesh*>(&benchmarkMeshes[mesh]);
+			ri.sortKey = RenderQueueSorter::ComposeSortKey(material % BENCHMARK_SHADER_COUNT, material, mesh, distance * distance, RenderQueueSortMode::FRONT_TO_BACK);
+		}
+
+		RenderQueueSorter sorter;
+		RenderQueue queue;
+		double radixTime = 0.0;
+		double stdSortTime = 0.0;
+
+		Log::Print(LogLevel::LEVEL_INFO, "Render queue sort benchmark: %u items, %u iterations\n", itemCount, iterations);
+
+		for (unsigned int i = 0; i < iterations; i++)
+		{
+			queue = sceneQueue;
+
+			std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+			sorter.SortByKey(queue);
+			std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+			radixTime += std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+			queue = sceneQueue;
+
+			t1 = std::chrono::high_resolution_clock::now();
+			std::sort(queue.begin(), queue.end(), [](const RenderItem &a, const RenderItem &b) { return a.sortKey < b.sortKey; });
+			t2 = std::chrono::high_resolution_clock::now();
+			stdSortTime += std::chrono::duration<double, std::milli>(t2 - t1).count();
+		}
+
+		queue = sceneQueue;
+		sorter.SortByKey(queue);
+
+		bool sorted = true;
+		for (size_t i = 1; i < queue.size(); i++)
+		{
+			if (queue[i - 1].sortKey > queue[i].sortKey)
+			{
+				sorted = false;
+				break;
+			}
+		}
+
+		const StateChanges before = CountStateChanges(sceneQueue);
+		const StateChanges after = CountStateChanges(queue);
+
+		Log::Print(LogLevel::LEVEL_INFO, "Radix sort %.3f ms, std::sort %.3f ms per queue\n", radixTime / iterations, stdSortTime / iterations);
+		Log::Print(LogLevel::LEVEL_INFO, "Scene order: %u shader changes, %u material changes, %u mesh changes\n", before.shaderChanges, before.materialChanges, before.meshChanges);
+		Log::Print(LogLevel::LEVEL_INFO, "Sorted: %u shader changes, %u material changes, %u mesh changes\n", after.shaderChanges, after.materialChanges, after.meshChanges);
+
+		if (!sorted)
+			Log::Print(LogLevel::LEVEL_ERROR, "The radix sort didn't sort the queue by key\n");
+
+		return sorted;
+	}
+}
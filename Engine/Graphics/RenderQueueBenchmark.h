@@ -0,0 +1,9 @@
+#pragma once
+
+namespace Engine
+{
+	// Sorts a synthetic queue in random scene order with the render queue sorter and with std::sort, and logs the time they took
+	// and the shader, material and mesh changes before and after sorting. Doesn't need a renderer so it can run from the editor or a tool.
+	// Returns false if the radix sort didn't sort the queue
+	bool RunRenderQueueSortBenchmark(unsigned int itemCount = 50000, unsigned int iterations = 20, unsigned int seed = 1);
+}
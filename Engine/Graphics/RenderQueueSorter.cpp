@@ -0,0 +1,226 @@
+#include "RenderQueueSorter.h"
+
+#include "Material.h"
+#include "Mesh.h"
+#include "Program/LinearAllocator.h"
+
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+namespace Engine
+{
+	// Number of bits of each field of the key
+	static const unsigned int SHADER_BITS = 14;
+	static const unsigned int MATERIAL_BITS = 14;
+	static const unsigned int MESH_BITS = 12;
+	static const unsigned int DEPTH_BITS = 24;
+
+	static const unsigned int RADIX_BITS = 8;
+	static const unsigned int RADIX_BUCKETS = 1 << RADIX_BITS;
+	static const unsigned int RADIX_PASSES = 64 / RADIX_BITS;
+
+	static const size_t MIN_BATCH_SIZE = 2;
+	// Keeps a batch from taking too much of the renderers instance data buffer
+	static const size_t MAX_BATCH_SIZE = 256;
+
+	// Maps a pointer to a small id. Two pointers can end up with the same id but that only makes the grouping a bit worse
+	static unsigned long long HashPointer(const void *ptr, unsigned int bits)
+	{
+		unsigned long long x = static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(ptr)) >> 4;
+		return (x * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+	}
+
+	unsigned long long RenderQueueSorter::BuildSortKey(const RenderItem &ri, const RenderQueueSortParams &params)
+	{
+		const ShaderPass &pass = ri.matInstance->baseMaterial->GetShaderPass(ri.shaderPass);
+
+		// Vulkan has pipeline ids, the other apis only have the shader
+		unsigned long long shader = 0;
+		if (pass.pipelineID != 0xFFFFFFFF)
+			shader = pass.pipelineID & ((1ULL << SHADER_BITS) - 1);
+		else
+			shader = HashPointer(pass.shader, SHADER_BITS);
+
+		const unsigned long long material = HashPointer(ri.matInstance, MATERIAL_BITS);
+		const unsigned long long mesh = HashPointer(ri.mesh, MESH_BITS);
+
+		float distSqr = 0.0f;
+		if (ri.transform)
+		{
+			const glm::vec3 d = glm::vec3((*ri.transform)[3]) - params.viewPos;
+			distSqr = glm::dot(d, d);
+		}
+
+		return ComposeSortKey(shader, material, mesh, distSqr, params.mode);
+	}
+
+	unsigned long long RenderQueueSorter::ComposeSortKey(unsigned long long shader, unsigned long long material, unsigned long long mesh, float distSqr, RenderQueueSortMode mode)
+	{
+		shader &= (1ULL << SHADER_BITS) - 1;
+		material &= (1ULL << MATERIAL_BITS) - 1;
+		mesh &= (1ULL << MESH_BITS) - 1;
+
+		// The bits of a positive float sort in the same order as the float, so the top bits can be used as the depth
+		unsigned int bits;
+		memcpy(&bits, &distSqr, sizeof(float));
+		unsigned long long depth = bits >> (32 - DEPTH_BITS);
+
+		if (mode == RenderQueueSortMode::BACK_TO_FRONT)
+		{
+			// Far to near first, the state only breaks ties
+			depth = ((1ULL << DEPTH_BITS) - 1) - depth;
+			return (depth << (SHADER_BITS + MATERIAL_BITS + MESH_BITS)) | (shader << (MATERIAL_BITS + MESH_BITS)) | (material << MESH_BITS) | mesh;
+		}
+
+		return (shader << (MATERIAL_BITS + MESH_BITS + DEPTH_BITS)) | (material << (MESH_BITS + DEPTH_BITS)) | (mesh << DEPTH_BITS) | depth;
+	}
+
+	void RenderQueueSorter::Sort(RenderQueue &queue, const RenderQueueSortParams &params)
+	{
+		if (params.mode == RenderQueueSortMode::NONE || queue.size() < 2)
+			return;
+
+		for (size_t i = 0; i < queue.size(); i++)
+			queue[i].sortKey = BuildSortKey(queue[i], params);
+
+		SortByKey(queue);
+	}
+
+	void RenderQueueSorter::SortByKey(RenderQueue &queue)
+	{
+		if (queue.size() < 2)
+			return;
+
+		const unsigned int count = static_cast<unsigned int>(queue.size());
+
+		keys.resize(count);
+		tempKeys.resize(count);
+		indices.resize(count);
+		tempIndices.resize(count);
+
+		unsigned int histograms[RADIX_PASSES][RADIX_BUCKETS];
+		memset(histograms, 0, sizeof(histograms));
+
+		// Gather the keys and build the histograms of every digit in one go
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const unsigned long long key = queue[i].sortKey;
+			keys[i] = key;
+			indices[i] = i;
+
+			for (unsigned int p = 0; p < RADIX_PASSES; p++)
+				histograms[p][(key >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+		}
+
+		unsigned long long *srcKeys = keys.data();
+		unsigned long long *dstKeys = tempKeys.data();
+		unsigned int *srcIndices = indices.data();
+		unsigned int *dstIndices = tempIndices.data();
+
+		for (unsigned int p = 0; p < RADIX_PASSES; p++)
+		{
+			unsigned int *histogram = histograms[p];
+			const unsigned int shift = p * RADIX_BITS;
+
+			// Every key has the same digit so this pass wouldn't change the order
+			if (histogram[(srcKeys[0] >> shift) & (RADIX_BUCKETS - 1)] == count)
+				continue;
+
+			unsigned int offset = 0;
+			for (unsigned int b = 0; b < RADIX_BUCKETS; b++)
+			{
+				const unsigned int bucketCount = histogram[b];
+				histogram[b] = offset;
+				offset += bucketCount;
+			}
+
+			for (unsigned int i = 0; i < count; i++)
+			{
+				const unsigned int dst = histogram[(srcKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+				dstKeys[dst] = srcKeys[i];
+				dstIndices[dst] = srcIndices[i];
+			}
+
+			std::swap(srcKeys, dstKeys);
+			std::swap(srcIndices, dstIndices);
+		}
+
+		// Sort the indices and move the items once at the end because the render items are much bigger than the keys
+		sortedQueue.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+			sortedQueue[i] = queue[srcIndices[i]];
+
+		// The output queues use the heap like the sorted queue so the buffers can just be swapped
+		if (queue.get_allocator() == sortedQueue.get_allocator())
+			queue.swap(sortedQueue);
+		else
+			std::copy(sortedQueue.begin(), sortedQueue.end(), queue.begin());
+	}
+
+	static bool CanInstance(const RenderItem &ri)
+	{
+		if (!ri.transform || !ri.mesh || ri.mesh->instanceCount > 0 || ri.instanceData || ri.meshParams)
+			return false;
+
+		// Only shaders that read the transform of each instance can draw a batch, the others would draw every instance with the same transform
+		return ri.matInstance->baseMaterial->GetShaderPass(ri.shaderPass).batchable;
+	}
+
+	static bool IsSameBatch(const RenderItem &a, const RenderItem &b)
+	{
+		return a.mesh == b.mesh && a.matInstance == b.matInstance && a.shaderPass == b.shaderPass && a.materialData == b.materialData && a.materialDataSize == b.materialDataSize;
+	}
+
+	void RenderQueueSorter::Batch(RenderQueue &queue, LinearAllocator *frameAllocator)
+	{
+		if (!frameAllocator)
+			return;
+
+		const size_t count = queue.size();
+		size_t dst = 0;
+		size_t i = 0;
+
+		// The sort key groups the items by mesh and material so the items of a batch are next to each other
+		while (i < count)
+		{
+			size_t end = i + 1;
+
+			if (CanInstance(queue[i]))
+			{
+				while (end < count && end - i < MAX_BATCH_SIZE && CanInstance(queue[end]) && IsSameBatch(queue[i], queue[end]))
+					end++;
+			}
+
+			const size_t batchSize = end - i;
+
+			if (batchSize >= MIN_BATCH_SIZE)
+			{
+				glm::mat4 *transforms = static_cast<glm::mat4*>(frameAllocator->Allocate(static_cast<unsigned int>(batchSize * sizeof(glm::mat4))));
+				for (size_t j = 0; j < batchSize; j++)
+					transforms[j] = *queue[i + j].transform;
+
+				Mesh *mesh = static_cast<Mesh*>(frameAllocator->Allocate(sizeof(Mesh)));
+				*mesh = *queue[i].mesh;
+				mesh->instanceCount = static_cast<unsigned int>(batchSize);
+				mesh->instanceOffset = 0;
+
+				RenderItem ri = queue[i];
+				ri.mesh = mesh;
+				ri.transform = nullptr;
+				ri.instanceData = transforms;
+				ri.instanceDataSize = static_cast<unsigned int>(batchSize * sizeof(glm::mat4));
+				queue[dst++] = ri;
+			}
+			else
+			{
+				for (size_t j = i; j < end; j++)
+					queue[dst++] = queue[j];
+			}
+
+			i = end;
+		}
+
+		queue.resize(dst);
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "RendererStructs.h"
+
+#include "include/glm/glm.hpp"
+
+#include <vector>
+
+namespace Engine
+{
+	enum class RenderQueueSortMode
+	{
+		NONE,				// Keep the generator order, eg for the UI
+		FRONT_TO_BACK,		// Group by shader, material and mesh and then front to back. For opaque geometry
+		BACK_TO_FRONT		// Back to front and then by state. For transparent geometry
+	};
+
+	struct RenderQueueSortParams
+	{
+		RenderQueueSortMode mode;
+		glm::vec3 viewPos;
+		bool instancing;			// Merge the items that share mesh, material and shader pass into one instanced item. Needs front to back sorting
+	};
+
+	// Builds the sort key of every item in a queue and sorts it with a LSD radix sort.
+	// It keeps its buffers between frames so it doesn't allocate once they are big enough. Use one per queue sorted in parallel
+	class LinearAllocator;
+
+	class RenderQueueSorter
+	{
+	public:
+		void Sort(RenderQueue &queue, const RenderQueueSortParams &params);
+		// Sorts the items by the sort key they already have
+		void SortByKey(RenderQueue &queue);
+		// Must be called after sorting. Each group of items with the same mesh, material and shader pass is replaced by one instanced item
+		// whose transforms and mesh copy live in the frame allocator. Items that already use instance data or mesh params are left alone,
+		// as are the items whose shader pass isn't marked as batchable in the material
+		void Batch(RenderQueue &queue, LinearAllocator *frameAllocator);
+
+		static unsigned long long BuildSortKey(const RenderItem &ri, const RenderQueueSortParams &params);
+		// Packs the shader, material and mesh ids and the squared distance to the camera. The ids are cut to the bits of their field
+		static unsigned long long ComposeSortKey(unsigned long long shader, unsigned long long material, unsigned long long mesh, float distSqr, RenderQueueSortMode mode);
+
+		// Elements the buffers can hold without allocating, so the caller can tell when they grew
+		size_t GetCapacity() const { return keys.capacity() + tempKeys.capacity() + indices.capacity() + tempIndices.capacity() + sortedQueue.capacity(); }
+
+	private:
+		std::vector<unsigned long long> keys;
+		std::vector<unsigned long long> tempKeys;
+		std::vector<unsigned int> indices;
+		std::vector<unsigned int> tempIndices;
+		RenderQueue sortedQueue;
+	};
+}
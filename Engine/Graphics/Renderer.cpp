@@ -16,6 +16,7 @@
 #endif
 
 #include "Material.h"
+#include "Program/JobSystem.h"
 
 #ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
@@ -199,23 +200,44 @@ namespace Engine
 #endif
 	}
 
-	std::vector<VisibilityIndices> Renderer::Cull(unsigned int queueAndFrustumCount, unsigned int *queueIDs, const Frustum *frustums)
+	VisibilityList Renderer::Cull(unsigned int queueAndFrustumCount, unsigned int *queueIDs, const Frustum *frustums)
 	{
-		std::vector<VisibilityIndices> visibility(renderQueueGenerators.size() * queueAndFrustumCount);
-		std::vector<VisibilityIndices*> visibilityTemp(queueAndFrustumCount);
+		const VisibilityIndices emptyIndices = VisibilityIndices(StlLinearAllocator<unsigned int>(frameAllocator));
+		VisibilityList visibility(renderQueueGenerators.size() * queueAndFrustumCount, emptyIndices, StlLinearAllocator<VisibilityIndices>(frameAllocator));
+
+		if (cullVisibility.capacity() < queueAndFrustumCount)
+			queueAllocations++;
+		cullVisibility.resize(queueAndFrustumCount);
+
+		// Reserve the largest size seen so far so the lists don't grow during culling and waste frame allocator memory
+		if (visibilityHighWaterMarks.size() < visibility.size())
+		{
+			if (visibilityHighWaterMarks.capacity() < visibility.size())
+				queueAllocations++;
+			visibilityHighWaterMarks.resize(visibility.size(), 0);
+		}
+
+		for (size_t i = 0; i < visibility.size(); i++)
+			visibility[i].reserve(visibilityHighWaterMarks[i]);
 
 		for (size_t i = 0; i < renderQueueGenerators.size(); i++)
 		{
 			for (unsigned int j = 0; j < queueAndFrustumCount; j++)
-				visibilityTemp[j] = &visibility[j * renderQueueGenerators.size() + i];
+				cullVisibility[j] = &visibility[j * renderQueueGenerators.size() + i];
 
-			renderQueueGenerators[i]->Cull(queueAndFrustumCount, queueIDs, frustums, visibilityTemp);
+			renderQueueGenerators[i]->Cull(queueAndFrustumCount, queueIDs, frustums, cullVisibility);
+		}
+
+		for (size_t i = 0; i < visibility.size(); i++)
+		{
+			if (visibility[i].size() > visibilityHighWaterMarks[i])
+				visibilityHighWaterMarks[i] = static_cast<unsigned int>(visibility[i].size());
 		}
 
 		return visibility;
 	}
 
-	void Renderer::CopyVisibilityToQueue(std::vector<VisibilityIndices> &visibility, unsigned int srcQueueIndex, unsigned int dstQueueIndex)
+	void Renderer::CopyVisibilityToQueue(VisibilityList &visibility, unsigned int srcQueueIndex, unsigned int dstQueueIndex)
 	{
 		if (dstQueueIndex * renderQueueGenerators.size() >= (unsigned int)visibility.size())
 		{
@@ -235,7 +257,7 @@ namespace Engine
 		}
 	}
 
-	void Renderer::CreateRenderQueues(unsigned int passAndFrustumCount, unsigned int *passIds, const std::vector<VisibilityIndices> &visibility, RenderQueue *outQueues)
+	void Renderer::CreateRenderQueues(unsigned int passAndFrustumCount, unsigned int *passIds, const VisibilityList &visibility, RenderQueue *outQueues, const RenderQueueSortParams *sortParams)
 	{
 		/*std::vector<VisibilityIndices> visibility(renderQueueGenerators.size() * passAndFrustumCount);
 		std::vector<VisibilityIndices*> visibilityTemp(passAndFrustumCount);
@@ -248,47 +270,70 @@ namespace Engine
 			renderQueueGenerators[i]->Cull(passAndFrustumCount, passIds, frustums, visibilityTemp);
 		}*/
 
-		std::vector<std::vector<RenderQueue>> queues(renderQueueGenerators.size());
-		static const unsigned short MAX_PASSES = 8;
-		unsigned int totalRenderItems[MAX_PASSES] = { 0 };
+		const size_t generatorCount = renderQueueGenerators.size();
 
+		if (generatorVisibility.capacity() < passAndFrustumCount)
+			queueAllocations++;
+		generatorVisibility.resize(passAndFrustumCount);
 
-		for (size_t i = 0; i < renderQueueGenerators.size(); i++)
+		if (queueSorters.size() < passAndFrustumCount)
 		{
-			queues[i].resize(passAndFrustumCount);
+			queueAllocations++;
+			queueSorters.resize(passAndFrustumCount);
+		}
 
+		// Let the generators do the work that can't run in parallel, like updating gpu buffers
+		for (size_t i = 0; i < generatorCount; i++)
+		{
 			for (unsigned int j = 0; j < passAndFrustumCount; j++)
-			{
-				if (visibility[j * renderQueueGenerators.size() + i].size() > 0)
-					renderQueueGenerators[i]->GetRenderItems(1, &passIds[j], visibility[j * renderQueueGenerators.size() + i], queues[i][j]);
-			}
+				generatorVisibility[j] = &visibility[j * generatorCount + i];
+
+			renderQueueGenerators[i]->PrepareRenderItems(passAndFrustumCount, passIds, generatorVisibility);
 		}
 
-		for (size_t j = 0; j < renderQueueGenerators.size(); j++)
+		// Each pass only writes to its own queue so they can be built in parallel. The generators append straight to the output queue,
+		// which is cleared but keeps its memory, so once it reaches the largest size needed it doesn't allocate anymore
+		auto createPassQueue = [&](unsigned int j)
 		{
-			for (unsigned int k = 0; k < passAndFrustumCount; k++)
+			RenderQueue &queue = outQueues[j];
+			queue.clear();
+
+			// The sorter can swap its buffer with the queue so check both together
+			const size_t capacity = queue.capacity() + queueSorters[j].GetCapacity();
+
+			for (size_t i = 0; i < generatorCount; i++)
 			{
-				totalRenderItems[k] += queues[j][k].size();
+				if (visibility[j * generatorCount + i].size() > 0)
+					renderQueueGenerators[i]->GetRenderItems(1, &passIds[j], visibility[j * generatorCount + i], queue);
 			}
-		}
 
-		for (unsigned int j = 0; j < passAndFrustumCount; j++)
-		{
-			outQueues[j].clear();
-			if (totalRenderItems[j] > 0 && outQueues[j].size() == 0)
-				outQueues[j].resize(totalRenderItems[j]);
-		}
+			// Sort to reduce the state changes when the queue is submitted
+			if (sortParams)
+			{
+				queueSorters[j].Sort(queue, sortParams[j]);
 
-		for (unsigned int j = 0; j < passAndFrustumCount; j++)
-		{
-			size_t offset = 0;
+				// The D3D11 renderer and shaders don't read the instance data of items without a transform
+				if (sortParams[j].instancing && currentAPI != GraphicsAPI::D3D11)
+					queueSorters[j].Batch(queue, frameAllocator);
+			}
 
-			for (size_t k = 0; k < renderQueueGenerators.size(); k++)
+			if (queue.capacity() + queueSorters[j].GetCapacity() > capacity)
+				queueAllocations++;
+		};
+
+		if (jobSystem && jobSystem->GetNumThreads() > 1 && passAndFrustumCount > 1)
+		{
+			JobCounter counter;
+			for (unsigned int j = 0; j < passAndFrustumCount; j++)
 			{
-				size_t queueSize = queues[k][j].size();
-				memcpy(outQueues[j].data() + offset, queues[k][j].data(), sizeof(RenderItem) * queueSize);
-				offset += queueSize;
+				jobSystem->Run([&createPassQueue, j]() { createPassQueue(j); }, &counter);
 			}
+			jobSystem->Wait(&counter);
+		}
+		else
+		{
+			for (unsigned int j = 0; j < passAndFrustumCount; j++)
+				createPassQueue(j);
 		}
 	}
 
@@ -4,15 +4,20 @@
 #include "Font.h"
 #include "Framebuffer.h"
 #include "RendererStructs.h"
+#include "RenderQueueSorter.h"
 #include "Physics/BoundingVolumes.h"
 #include "MaterialInfo.h"
 #include "UniformBufferTypes.h"
 
+#include <atomic>
+
 struct GLFWwindow;
 
 namespace Engine
 {
 	class FileManager;
+	class JobSystem;
+	class LinearAllocator;
 
 	enum class GraphicsAPI : unsigned short
 	{
@@ -42,6 +47,7 @@ namespace Engine
 		FRAGMENT = (1 << 3),
 		DEPTH_STENCIL_WRITE = (1 << 4),
 		COMPUTE = (1 << 5),
+		VERTEX_INPUT = (1 << 6),			// Storage buffers that are also read as instanced vertex buffers
 	};
 
 	struct BarrierImage
@@ -135,18 +141,28 @@ namespace Engine
 		virtual void CopyImage(Texture *src, Texture *dst) = 0;
 		virtual void ClearImage(Texture *tex) = 0;
 
-		std::vector<VisibilityIndices> Cull(unsigned int queueAndFrustumCount, unsigned int *queueIDs, const Frustum *frustums);
-		void CopyVisibilityToQueue(std::vector<VisibilityIndices> &visibility, unsigned int srcQueueIndex, unsigned int dstQueueIndex);
-		void CreateRenderQueues(unsigned int queueCount, unsigned int *queueIDs, const std::vector<VisibilityIndices> &visibility, RenderQueue *outQueues);
+		// The returned visibility is allocated from the frame allocator, it's only valid until the end of the frame
+		VisibilityList Cull(unsigned int queueAndFrustumCount, unsigned int *queueIDs, const Frustum *frustums);
+		void CopyVisibilityToQueue(VisibilityList &visibility, unsigned int srcQueueIndex, unsigned int dstQueueIndex);
+		// When sortParams is given every queue is sorted with the params at the same index
+		void CreateRenderQueues(unsigned int queueCount, unsigned int *queueIDs, const VisibilityList &visibility, RenderQueue *outQueues, const RenderQueueSortParams *sortParams = nullptr);
+		// Times the heap storage of the culling and render queues had to grow. It only grows when a frame needs more than any frame before,
+		// so a count that goes up every frame means the queue path is allocating per frame
+		unsigned int GetQueueAllocations() const { return queueAllocations.load(); }
 
 		virtual void UpdateMaterialInstance(MaterialInstance *matInst) = 0;
 		virtual void ReloadShaders() = 0;
 		virtual void RebindTexture(Texture *texture) {}
 		virtual void RemoveTexture(Texture* t) = 0;
+		// Whether indirect draws can start at an instance other than 0. Only the OpenGL and Vulkan renderers run compute shaders
+		virtual bool SupportsIndirectFirstInstance() const { return currentAPI == GraphicsAPI::OpenGL || currentAPI == GraphicsAPI::Vulkan; }
 
 		void SetFrameTime(float frameTime) { this->frameTime = frameTime; }
 		float GetFrameTime() const { return frameTime; }
 
+		void SetJobSystem(JobSystem *jobSystem) { this->jobSystem = jobSystem; }
+		// Memory for the culling and render queue temporaries. Without one they use the heap
+		void SetFrameAllocator(LinearAllocator *frameAllocator) { this->frameAllocator = frameAllocator; }
 		void AddRenderQueueGenerator(RenderQueueGenerator *renderQueueGenerator) { renderQueueGenerators.push_back(renderQueueGenerator); }
 		void RemoveRenderQueueGenerator(RenderQueueGenerator *generator);
 		
@@ -176,6 +192,13 @@ namespace Engine
 		static GraphicsAPI currentAPI;
 
 		FileManager* fileManager;
+		JobSystem *jobSystem = nullptr;
+		LinearAllocator *frameAllocator = nullptr;
+		std::vector<VisibilityIndices*> cullVisibility;
+		std::vector<const VisibilityIndices*> generatorVisibility;
+		std::vector<unsigned int> visibilityHighWaterMarks;
+		std::vector<RenderQueueSorter> queueSorters;
+		std::atomic<unsigned int> queueAllocations = { 0 };
 
 		unsigned int width;
 		unsigned int height;
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "VertexTypes.h"
+#include "Program/LinearAllocator.h"
+
+#include <vector>
 
 namespace Engine
 {
@@ -10,6 +13,7 @@ namespace Engine
 	class Texture;
 	class Frustum;
 	class ShaderProgram;
+	class Buffer;
 
 	struct Viewport
 	{
@@ -56,6 +60,7 @@ namespace Engine
 		unsigned int pipelineID;
 		unsigned int stateID;
 		bool isCompute;
+		bool batchable;			// The shader reads the transform of each instance, so items using this pass can be merged into instanced draws
 	};
 
 	struct RenderItem
@@ -71,6 +76,8 @@ namespace Engine
 		const void *materialData;
 		unsigned int materialDataSize;
 		unsigned long long sortKey;
+		Buffer *indirectBuffer;				// When set the draw arguments are read from this buffer at indirectOffset (in bytes), usually because a compute shader wrote them
+		unsigned int indirectOffset;
 	};
 
 	struct DispatchItem
@@ -84,13 +91,18 @@ namespace Engine
 		unsigned int materialDataSize;
 	};
 
-	typedef std::vector<unsigned int> VisibilityIndices;
-	typedef std::vector<RenderItem> RenderQueue;
+	// These can live in the renderer frame allocator. Default constructed ones use the heap
+	typedef std::vector<unsigned int, StlLinearAllocator<unsigned int>> VisibilityIndices;
+	typedef std::vector<VisibilityIndices, StlLinearAllocator<VisibilityIndices>> VisibilityList;
+	typedef std::vector<RenderItem, StlLinearAllocator<RenderItem>> RenderQueue;
 
 	class RenderQueueGenerator
 	{
 	public:
 		virtual void Cull(unsigned int passAndFrustumCount, unsigned int *passIds, const Frustum *frustums, std::vector<VisibilityIndices*> &out) = 0;
+		// Called once on the main thread after culling with the visibility of every pass. Anything that updates gpu buffers or data shared between passes must be done here
+		// because GetRenderItems runs in parallel for different passes
+		virtual void PrepareRenderItems(unsigned int passCount, unsigned int *passIds, const std::vector<const VisibilityIndices*> &visibility) {}
 		virtual void GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues) = 0;
 	};
 }
@@ -0,0 +1,255 @@
+#include "GPUVegetationCulling.h"
+
+#include "Graphics/Renderer.h"
+#include "Graphics/Material.h"
+#include "Graphics/Buffers.h"
+#include "Graphics/Mesh.h"
+#include "Graphics/Camera/Frustum.h"
+#include "Program/Log.h"
+
+#include <vector>
+
+namespace Engine
+{
+	static const unsigned int GPU_VEGETATION_VIEWS = static_cast<unsigned int>(VegetationCullView::COUNT);
+	static_assert(MAX_GPU_VEGETATION_VISIBLE >= MAX_GPU_VEGETATION_INSTANCES * GPU_VEGETATION_VIEWS, "The visible instances buffer must fit every instance in every view");
+	static const unsigned int GPU_VEGETATION_BATCHES = GPU_VEGETATION_VIEWS * MAX_GPU_VEGETATION_TYPES * GPU_VEGETATION_LODS;		// One batch per view, type and lod
+	static const unsigned int GPU_VEGETATION_COMMANDS = GPU_VEGETATION_BATCHES * MAX_GPU_VEGETATION_MESHES;
+	static const unsigned int GPU_VEGETATION_COMMAND_SIZE = 5 * sizeof(unsigned int);
+
+	GPUVegetationCulling::GPUVegetationCulling()
+	{
+		renderer = nullptr;
+		supported = false;
+		instancesSSBO = nullptr;
+		paramsSSBO = nullptr;
+		countersSSBO = nullptr;
+		visibleInstancesSSBO = nullptr;
+		indirectBuffer = nullptr;
+		cullMat = nullptr;
+		countPass = 0;
+		prefixPass = 0;
+		writePass = 0;
+		instanceCount = 0;
+		params = {};
+	}
+
+	void GPUVegetationCulling::Init(Renderer *renderer)
+	{
+		this->renderer = renderer;
+		supported = false;
+
+		params = {};
+		params.counts.z = MAX_GPU_VEGETATION_VISIBLE;
+
+		// Without compute shaders or indirect draws that start at an instance other than 0 the buffers aren't created
+		// and the terrain keeps culling the vegetation on the cpu
+		if (!renderer->SupportsIndirectFirstInstance())
+		{
+			Log::Print(LogLevel::LEVEL_INFO, "GPU vegetation culling not supported, using cpu culling\n");
+			return;
+		}
+
+		instancesSSBO = renderer->CreateSSBO(MAX_GPU_VEGETATION_INSTANCES * sizeof(ModelInstanceData), nullptr, sizeof(ModelInstanceData), BufferUsage::DYNAMIC);
+		if (!instancesSSBO)
+			return;
+		instancesSSBO->AddReference();
+
+		paramsSSBO = renderer->CreateSSBO(sizeof(GPUVegetationCullParams), &params, sizeof(GPUVegetationCullParams), BufferUsage::DYNAMIC);
+		paramsSSBO->AddReference();
+
+		// The counts of each batch, where each batch starts in the visible instances buffer and where it ends
+		// The counts need to start at zero, after that the prefix pass clears them for the next frame
+		std::vector<unsigned int> counters(GPU_VEGETATION_BATCHES * 3, 0);
+		countersSSBO = renderer->CreateSSBO(static_cast<unsigned int>(counters.size() * sizeof(unsigned int)), counters.data(), sizeof(unsigned int), BufferUsage::STATIC);
+		countersSSBO->AddReference();
+
+		visibleInstancesSSBO = renderer->CreateSSBO(MAX_GPU_VEGETATION_VISIBLE * sizeof(ModelInstanceData), nullptr, sizeof(ModelInstanceData), BufferUsage::STATIC);
+		visibleInstancesSSBO->AddReference();
+
+		// Every command is written by the prefix pass
+		std::vector<unsigned int> cmds(GPU_VEGETATION_COMMANDS * 5, 0);
+		indirectBuffer = renderer->CreateDrawIndirectBuffer(GPU_VEGETATION_COMMANDS * GPU_VEGETATION_COMMAND_SIZE, cmds.data());
+		indirectBuffer->AddReference();
+
+		supported = true;
+	}
+
+	void GPUVegetationCulling::Dispose()
+	{
+		if (cullMat)
+		{
+			renderer->RemoveMaterialInstance(cullMat);
+			cullMat = nullptr;
+		}
+
+		Buffer **buffers[] = { &instancesSSBO, &paramsSSBO, &countersSSBO, &visibleInstancesSSBO, &indirectBuffer };
+		for (unsigned int i = 0; i < 5; i++)
+		{
+			if (*buffers[i])
+			{
+				(*buffers[i])->RemoveReference();
+				*buffers[i] = nullptr;
+			}
+		}
+
+		supported = false;
+	}
+
+	void GPUVegetationCulling::CreateMaterial(ScriptManager &scriptManager)
+	{
+		if (!IsSupported() || cullMat)
+			return;
+
+		cullMat = renderer->CreateMaterialInstanceFromBaseMat(scriptManager, "Data/Resources/Materials/vegetation_culling_mat.lua", {});
+		countPass = cullMat->baseMaterial->GetShaderPassIndex("count");
+		prefixPass = cullMat->baseMaterial->GetShaderPassIndex("prefix");
+		writePass = cullMat->baseMaterial->GetShaderPassIndex("write");
+	}
+
+	bool GPUVegetationCulling::CanCull(unsigned int instanceCount, unsigned int typeCount, unsigned int maxMeshesPerLOD)
+	{
+		return instanceCount <= MAX_GPU_VEGETATION_INSTANCES && typeCount <= MAX_GPU_VEGETATION_TYPES && maxMeshesPerLOD <= MAX_GPU_VEGETATION_MESHES;
+	}
+
+	void GPUVegetationCulling::SetInstances(const ModelInstanceData *instances, unsigned int count)
+	{
+		if (!IsSupported())
+			return;
+
+		if (count > MAX_GPU_VEGETATION_INSTANCES)
+		{
+			Log::Print(LogLevel::LEVEL_WARNING, "Only %u of the %u vegetation instances can be culled on the gpu\n", MAX_GPU_VEGETATION_INSTANCES, count);
+			count = MAX_GPU_VEGETATION_INSTANCES;
+		}
+
+		instanceCount = count;
+
+		if (count > 0)
+			instancesSSBO->Update(instances, count * sizeof(ModelInstanceData), 0);
+	}
+
+	void GPUVegetationCulling::SetType(unsigned int type, unsigned int firstInstance, unsigned int instanceCount, float radius, float lod1Dist, float lod2Dist)
+	{
+		if (type >= MAX_GPU_VEGETATION_TYPES)
+			return;
+
+		// Instances past the end of the buffer were not uploaded
+		if (firstInstance >= this->instanceCount)
+			instanceCount = 0;
+		else if (firstInstance + instanceCount > this->instanceCount)
+			instanceCount = this->instanceCount - firstInstance;
+
+		GPUVegetationType &t = params.types[type];
+		t.cullParams = glm::vec4(radius, lod1Dist, lod2Dist, 0.0f);
+		t.range = glm::uvec4(firstInstance, instanceCount, 0, 0);
+		t.lodMeshCount = glm::uvec4(0);
+	}
+
+	void GPUVegetationCulling::SetTypeLODMesh(unsigned int type, unsigned int lod, unsigned int meshIndex, const Mesh &mesh)
+	{
+		if (type >= MAX_GPU_VEGETATION_TYPES || lod >= GPU_VEGETATION_LODS || meshIndex >= MAX_GPU_VEGETATION_MESHES)
+			return;
+
+		GPUVegetationType &t = params.types[type];
+
+		// Indices are 16 bits
+		if (mesh.vertexCount > 0)
+			t.meshes[lod * MAX_GPU_VEGETATION_MESHES + meshIndex] = glm::uvec4(mesh.vertexCount, 0, 0, 0);
+		else
+			t.meshes[lod * MAX_GPU_VEGETATION_MESHES + meshIndex] = glm::uvec4(mesh.indexCount, mesh.indexOffset / sizeof(unsigned short), mesh.vertexOffset, 1);
+
+		t.lodMeshCount[lod] = glm::max(t.lodMeshCount[lod], meshIndex + 1);
+	}
+
+	void GPUVegetationCulling::ClearFrustums()
+	{
+		params.counts.x = 0;
+	}
+
+	void GPUVegetationCulling::AddFrustum(VegetationCullView view, const Frustum &frustum)
+	{
+		const unsigned int index = params.counts.x;
+		if (index >= MAX_GPU_VEGETATION_FRUSTUMS)
+			return;
+
+		frustum.GetPlanes(&params.planes[index * 6]);
+		params.frustumViews[index] = static_cast<unsigned int>(view);
+		params.counts.x++;
+	}
+
+	unsigned int GPUVegetationCulling::GetCommandOffset(VegetationCullView view, unsigned int type, unsigned int lod, unsigned int meshIndex) const
+	{
+		const unsigned int batch = (static_cast<unsigned int>(view) * MAX_GPU_VEGETATION_TYPES + type) * GPU_VEGETATION_LODS + lod;
+		return (batch * MAX_GPU_VEGETATION_MESHES + meshIndex) * GPU_VEGETATION_COMMAND_SIZE;
+	}
+
+	void GPUVegetationCulling::Dispatch()
+	{
+		if (!cullMat || params.counts.x == 0 || params.counts.y == 0)
+			return;
+
+		static const unsigned int groupSize = 64;		// Same as the local size of the count and write compute shaders
+
+		unsigned int maxTypeInstances = 0;
+		for (unsigned int i = 0; i < params.counts.y; i++)
+			maxTypeInstances = glm::max(maxTypeInstances, params.types[i].range.y);
+
+		if (maxTypeInstances == 0)
+			return;
+
+		paramsSSBO->Update(&params, sizeof(GPUVegetationCullParams), 0);
+
+		// Each type is a row of groups
+		DispatchItem item = {};
+		item.numGroupsX = (maxTypeInstances + groupSize - 1) / groupSize;
+		item.numGroupsY = params.counts.y;
+		item.numGroupsZ = 1;
+		item.matInstance = cullMat;
+		item.shaderPass = countPass;
+
+		renderer->Dispatch(item);
+
+		BarrierBuffer counters = {};
+		counters.buffer = countersSSBO;
+		counters.readToWrite = false;
+
+		Barrier b = {};
+		b.buffers.push_back(counters);
+		b.srcStage = PipelineStage::COMPUTE;
+		b.dstStage = PipelineStage::COMPUTE;
+
+		renderer->PerformBarrier(b);
+
+		// Turns the counts into ranges of the visible instances buffer and writes the draw commands
+		item.numGroupsX = 1;
+		item.numGroupsY = 1;
+		item.shaderPass = prefixPass;
+
+		renderer->Dispatch(item);
+
+		renderer->PerformBarrier(b);
+
+		item.numGroupsX = (maxTypeInstances + groupSize - 1) / groupSize;
+		item.numGroupsY = params.counts.y;
+		item.shaderPass = writePass;
+
+		renderer->Dispatch(item);
+
+		// The csm pass and the opaque pass both draw with the results so wait here instead of in each of them
+		BarrierBuffer visible = {};
+		visible.buffer = visibleInstancesSSBO;
+		visible.readToWrite = false;
+		BarrierBuffer cmds = {};
+		cmds.buffer = indirectBuffer;
+		cmds.readToWrite = false;
+
+		Barrier drawBarrier = {};
+		drawBarrier.buffers.push_back(visible);
+		drawBarrier.buffers.push_back(cmds);
+		drawBarrier.srcStage = PipelineStage::COMPUTE;
+		drawBarrier.dstStage = PipelineStage::INDIRECT | PipelineStage::VERTEX_INPUT;
+
+		renderer->PerformBarrier(drawBarrier);
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Graphics/UniformBufferTypes.h"
+
+#include "include/glm/glm.hpp"
+
+namespace Engine
+{
+	class Renderer;
+	class Buffer;
+	class Frustum;
+	class ScriptManager;
+	struct MaterialInstance;
+	struct Mesh;
+
+	// Must match the defines in vegetation_culling.glsl
+	static const unsigned int MAX_GPU_VEGETATION_TYPES = 32;
+	static const unsigned int MAX_GPU_VEGETATION_MESHES = 4;			// Per lod model
+	static const unsigned int MAX_GPU_VEGETATION_INSTANCES = 65536;
+	static const unsigned int MAX_GPU_VEGETATION_VISIBLE = MAX_GPU_VEGETATION_INSTANCES * 2;		// Visible instances of all views and lods. Every instance can be visible to both views
+	static const unsigned int MAX_GPU_VEGETATION_FRUSTUMS = 4;
+	static const unsigned int GPU_VEGETATION_LODS = 3;
+
+	// The opaque pass draws the instances visible to the main camera and the csm pass draws the instances visible to any cascade
+	enum class VegetationCullView
+	{
+		CAMERA,
+		SHADOWS,
+		COUNT
+	};
+
+	struct GPUVegetationType
+	{
+		glm::vec4 cullParams;				// x - radius, y - lod 1 distance, z - lod 2 distance. The distances are squared like on the cpu
+		glm::uvec4 range;					// x - first instance, y - number of instances
+		glm::uvec4 lodMeshCount;			// Lods without meshes are not drawn
+		glm::uvec4 meshes[GPU_VEGETATION_LODS * MAX_GPU_VEGETATION_MESHES];		// x - index count (or vertex count), y - first index, z - base vertex, w - 1 if indexed
+	};
+
+	struct GPUVegetationCullParams
+	{
+		glm::vec4 planes[MAX_GPU_VEGETATION_FRUSTUMS * 6];
+		glm::uvec4 frustumViews;			// The view each frustum culls for
+		glm::vec4 camPos;					// Lod selection always uses the main camera so every view picks the same lods
+		glm::uvec4 counts;					// x - number of frustums, y - number of types, z - visible instances capacity
+		GPUVegetationType types[MAX_GPU_VEGETATION_TYPES];
+	};
+
+	// Culls the terrain vegetation in compute shaders. Every instance is tested against the frustums of each view and written to the visible instances buffer
+	// grouped by view, type and lod, together with the indirect draw commands of each mesh.
+	// The buffers have a fixed size and belong to the rendering path because the global buffer slots can't change after the renderer is setup
+	// and the terrain is only created when a scene is loaded. The terrain fills them and draws the meshes with the indirect commands
+	class GPUVegetationCulling
+	{
+	public:
+		GPUVegetationCulling();
+
+		void Init(Renderer *renderer);
+		void Dispose();
+
+		// Called by the vegetation culling compute pass
+		void CreateMaterial(ScriptManager &scriptManager);
+		void Dispatch();
+
+		// False on renderers without compute shaders or indirect draws that start at an instance other than 0
+		bool IsSupported() const { return supported; }
+		// The buffers can't grow so vegetation that doesn't fit has to be culled on the cpu
+		static bool CanCull(unsigned int instanceCount, unsigned int typeCount, unsigned int maxMeshesPerLOD);
+
+		// The instances of each type must be contiguous
+		void SetInstances(const ModelInstanceData *instances, unsigned int count);
+		void SetType(unsigned int type, unsigned int firstInstance, unsigned int instanceCount, float radius, float lod1Dist, float lod2Dist);
+		void SetTypeLODMesh(unsigned int type, unsigned int lod, unsigned int meshIndex, const Mesh &mesh);
+		void SetTypeCount(unsigned int count) { params.counts.y = count; }
+
+		// Called every frame before the pass executes. The views without frustums don't draw anything
+		void ClearFrustums();
+		void AddFrustum(VegetationCullView view, const Frustum &frustum);
+		void SetCameraPosition(const glm::vec3 &camPos) { params.camPos = glm::vec4(camPos, 0.0f); }
+
+		unsigned int GetCommandOffset(VegetationCullView view, unsigned int type, unsigned int lod, unsigned int meshIndex) const;
+
+		Buffer *GetInstancesBuffer() const { return instancesSSBO; }
+		Buffer *GetParamsBuffer() const { return paramsSSBO; }
+		Buffer *GetCountersBuffer() const { return countersSSBO; }
+		Buffer *GetVisibleInstancesBuffer() const { return visibleInstancesSSBO; }
+		Buffer *GetIndirectBuffer() const { return indirectBuffer; }
+
+	private:
+		Renderer *renderer;
+		bool supported;
+		Buffer *instancesSSBO;
+		Buffer *paramsSSBO;
+		Buffer *countersSSBO;
+		Buffer *visibleInstancesSSBO;
+		Buffer *indirectBuffer;
+		MaterialInstance *cullMat;
+		unsigned int countPass;
+		unsigned int prefixPass;
+		unsigned int writePass;
+		unsigned int instanceCount;
+		GPUVegetationCullParams params;
+	};
+}
@@ -7,6 +7,8 @@
 #include "Graphics/Buffers.h"
 #include "Graphics/VertexArray.h"
 #include "Graphics/Effects/DebugDrawManager.h"
+#include "Graphics/Effects/RenderingPath.h"
+#include "GPUVegetationCulling.h"
 #include "Program/Input.h"
 #include "Game/Game.h"
 #include "Graphics/Model.h"
@@ -90,20 +92,9 @@ namespace Engine
 
 		SetHeightmap(matInstance->textures[0]->GetPath());
 
-		// Create vegetation grid
-		/*unsigned int count = resolution / vegCellSize;
-		vegCells.resize(count * count);
-
-		for (unsigned int z = 0; z < count; z++)
-		{
-			for (unsigned int x = 0; x < count; x++)
-			{
-				VegetationCell &cell = vegCells[z * count + x];
-				cell.x = x * vegCellSize;
-				cell.z = z * vegCellSize;
-				cell.aabb = { glm::vec3(cell.x, 0.0f, cell.z), glm::vec3(cell.x + vegCellSize, 10.0f, cell.z + vegCellSize) };
-			}
-		}*/
+		GPUVegetationCulling &vegCulling = game->GetRenderingPath()->GetVegetationCulling();
+		if (vegCulling.IsSupported())
+			gpuVegCulling = &vegCulling;
 
 		LoadVegetationFile(terrainInfo.vegPath);
 
@@ -121,6 +112,15 @@ namespace Engine
 
 	void Terrain::Cull(unsigned int passAndFrustumCount, unsigned int *passIds, const Frustum *frustums, std::vector<VisibilityIndices*> &out)
 	{
+		if (vegCellsDirty)
+			BuildVegetationCells();
+
+		if (gpuVegCulling)
+		{
+			CullVegetationOnGPU(passAndFrustumCount, passIds, frustums, out);
+			return;
+		}
+
 		culledVegInstDataLOD0.clear();
 		culledVegInstDataLOD1.clear();
 		culledVegInstDataLOD2.clear();
@@ -146,26 +146,9 @@ namespace Engine
 				const size_t offsetLOD1 = culledVegInstDataLOD1.size();
 				const size_t offsetLOD2 = culledVegInstDataLOD2.size();
 
-				for (size_t k = v.offset; k < v.offset + v.count; k++)
+				for (unsigned int k = vegTypeFirstCell[j]; k < vegTypeFirstCell[j + 1]; k++)
 				{
-					const ModelInstanceData &m = vegetationInstData[k];
-					float distSqr = glm::length2(camPos - glm::vec3(m.modelMatrix[3]));
-
-					if (distSqr > v.lod2Dist)
-					{
-						if (frustums[i].SphereInFrustum(m.modelMatrix[3], radius) != FrustumIntersect::OUTSIDE)
-							culledVegInstDataLOD2.push_back(m);
-					}
-					else if (distSqr > v.lod1Dist)
-					{
-						if (frustums[i].SphereInFrustum(m.modelMatrix[3], radius) != FrustumIntersect::OUTSIDE)
-							culledVegInstDataLOD1.push_back(m);
-					}
-					else
-					{
-						if (frustums[i].SphereInFrustum(m.modelMatrix[3], radius) != FrustumIntersect::OUTSIDE)
-							culledVegInstDataLOD0.push_back(m);
-					}
+					CullVegetationCell(vegCells[k], frustums[i], camPos, radius, v.lod1Dist, v.lod2Dist);
 				}
 
 				bool idSet = false;
@@ -220,97 +203,223 @@ namespace Engine
 			//std::cout << culled << '\n';
 	}
 
-	void Terrain::GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues)
+	void Terrain::CullVegetationOnGPU(unsigned int passAndFrustumCount, unsigned int *passIds, const Frustum *frustums, std::vector<VisibilityIndices*> &out)
 	{
-		struct Match
-		{
-			unsigned int outQueueIndex;
-			unsigned int passIndex;
-			MaterialInstance *matInstance;
-			unsigned short matIndex;
-		};
+		// Only the frustums are set here, the vegetation culling pass does the rest when the frame graph executes
+		gpuVegCulling->ClearFrustums();
+		gpuVegCulling->SetCameraPosition(game->GetMainCamera()->GetPosition());
 
-		static const unsigned short MAX_PASSES = 8;
+		const unsigned int numTypes = glm::min(static_cast<unsigned int>(vegetation.size()), MAX_GPU_VEGETATION_TYPES);
 
-		for (size_t i = 0; i < visibility.size() - 1; i++)		// Don't check the last index because it's the terrain visibility index
+		for (size_t j = 0; j < numTypes; j++)
 		{
-			Vegetation &v = vegetation[visibility[i]];
+			Vegetation &v = vegetation[j];
+			v.renderLOD0 = true;
+			v.renderLOD1 = v.modelLOD1 != nullptr;
+			v.renderLOD2 = v.modelLOD2 != nullptr;
+		}
 
-			unsigned short numMatching = 0;
-			Match matches[MAX_PASSES] = {};
+		for (unsigned int i = 0; i < passAndFrustumCount; i++)
+		{
+			if (passIds[i] != opaquePassID && passIds[i] != csmPassID)
+				continue;
 
-			// Because the lod models of a vegetation use the same material we can
-			// just find the matching passes one time instead of for each lod
-			const std::vector<MeshMaterial> &meshesAndMaterials = v.model->GetMeshesAndMaterials();
-			for (size_t j = 0; j < meshesAndMaterials.size(); j++)
-			{
-				MaterialInstance *matInst = meshesAndMaterials[j].mat;
+			// Every cascade adds its frustum to the shadows view
+			gpuVegCulling->AddFrustum(passIds[i] == opaquePassID ? VegetationCullView::CAMERA : VegetationCullView::SHADOWS, frustums[i]);
 
-				const std::vector<ShaderPass> &passes = matInst->baseMaterial->GetShaderPasses();
-				for (unsigned int k = 0; k < passCount; k++)
-				{
-					for (size_t l = 0; l < passes.size(); l++)
-					{
-						if (passIds[k] == passes[l].queueID)
-							matches[numMatching++] = { k, static_cast<unsigned int>(l), matInst, static_cast<unsigned short>(j) };
-					}
-				}
+			// The number of visible instances is only known on the gpu so every type is drawn, the types without visible instances draw nothing
+			for (size_t j = 0; j < numTypes; j++)
+			{
+				if (vegetation[j].count > 0)
+					out[i]->push_back(j);
 			}
 
-			// LOD0
-			if (v.renderLOD0)
+			// Put terrain visibility index at last
+			if (data.size() > 0)
+				out[i]->push_back(0);
+		}
+	}
+
+	void Terrain::CullVegetationCell(const VegetationCell &cell, const Frustum &frustum, const glm::vec3 &camPos, float radius, float lod1Dist, float lod2Dist)
+	{
+		const glm::vec3 r = glm::vec3(radius);
+		const FrustumIntersect intersect = frustum.BoxInFrustum(cell.bounds.min - r, cell.bounds.max + r);
+
+		if (intersect == FrustumIntersect::OUTSIDE)
+			return;
+
+		// Squared distance from the camera to the closest and the furthest point of the cell
+		const glm::vec3 closest = glm::clamp(camPos, cell.bounds.min, cell.bounds.max);
+		const glm::vec3 furthest = glm::max(glm::abs(camPos - cell.bounds.min), glm::abs(camPos - cell.bounds.max));
+		const float minDistSqr = glm::length2(camPos - closest);
+		const float maxDistSqr = glm::dot(furthest, furthest);
+
+		// If the cell doesn't cross any lod distance then all of its instances use the same lod
+		std::vector<ModelInstanceData> *cellLOD = nullptr;
+		if (minDistSqr > lod2Dist)
+			cellLOD = &culledVegInstDataLOD2;
+		else if (minDistSqr > lod1Dist && maxDistSqr <= lod2Dist)
+			cellLOD = &culledVegInstDataLOD1;
+		else if (maxDistSqr <= lod1Dist)
+			cellLOD = &culledVegInstDataLOD0;
+
+		const ModelInstanceData *instData = &vegCellInstData[cell.first];
+
+		if (intersect == FrustumIntersect::INSIDE && cellLOD)
+		{
+			cellLOD->insert(cellLOD->end(), instData, instData + cell.count);
+			return;
+		}
+
+		// Only the cells that intersect the frustum need to test each instance
+		unsigned int *visible = vegVisibleInstances.data();
+		unsigned int numVisible = cell.count;
+
+		if (intersect == FrustumIntersect::INSIDE)
+		{
+			for (unsigned int i = 0; i < numVisible; i++)
+				visible[i] = i;
+		}
+		else
+		{
+			numVisible = frustum.CullSpheres(&vegCellPosX[cell.first], &vegCellPosY[cell.first], &vegCellPosZ[cell.first], cell.count, radius, visible);
+		}
+
+		for (unsigned int i = 0; i < numVisible; i++)
+		{
+			const unsigned int index = visible[i];
+			const ModelInstanceData &m = instData[index];
+
+			if (cellLOD)
 			{
-				const std::vector<MeshMaterial> &meshesAndMaterials = v.model->GetMeshesAndMaterials();
+				cellLOD->push_back(m);
+				continue;
+			}
+
+			const unsigned int k = cell.first + index;
+			const float distSqr = glm::length2(camPos - glm::vec3(vegCellPosX[k], vegCellPosY[k], vegCellPosZ[k]));
+
+			if (distSqr > lod2Dist)
+				culledVegInstDataLOD2.push_back(m);
+			else if (distSqr > lod1Dist)
+				culledVegInstDataLOD1.push_back(m);
+			else
+				culledVegInstDataLOD0.push_back(m);
+		}
+	}
+
+	void Terrain::PrepareRenderItems(unsigned int passCount, unsigned int *passIds, const std::vector<const VisibilityIndices*> &visibility)
+	{
+		if (data.size() <= 0)
+			return;
+
+		// When there's terrain data the terrain index is always added to the visibility, so any non empty pass will render the terrain
+		bool terrainVisible = false;
+		for (unsigned int i = 0; i < passCount; i++)
+		{
+			if (visibility[i]->size() > 0)
+				terrainVisible = true;
+		}
+
+		if (!terrainVisible)
+			return;
+
+		if (!isTerrainDataUpdated)
+		{
+			terrainInstancingBuffer->Update(data.data(), data.size() * sizeof(TerrainInstanceData), 0);
+			isTerrainDataUpdated = true;
+		}
+
+		mesh.vertexOffset = 0;
+		mesh.instanceCount = data.size();
+	}
 
-				for (unsigned short i = 0; i < numMatching; i++)
+	// The lods of a vegetation use the same materials as lod0 so only the meshes come from the lod model.
+	// There's one material per mesh so the mesh index can be used for both
+	static void AddVegetationRenderItems(const Model *lod0, const Model *lod, unsigned int passCount, const unsigned int *passIds, RenderQueue &outQueue)
+	{
+		const std::vector<MeshMaterial> &materials = lod0->GetMeshesAndMaterials();
+		const std::vector<MeshMaterial> &meshes = lod->GetMeshesAndMaterials();
+
+		for (size_t i = 0; i < materials.size(); i++)
+		{
+			MaterialInstance *matInst = materials[i].mat;
+
+			const std::vector<ShaderPass> &passes = matInst->baseMaterial->GetShaderPasses();
+			for (unsigned int j = 0; j < passCount; j++)
+			{
+				for (size_t k = 0; k < passes.size(); k++)
 				{
-					const Match &m = matches[i];
+					if (passIds[j] != passes[k].queueID)
+						continue;
 
 					RenderItem ri = {};
-					ri.mesh = &meshesAndMaterials[m.matIndex].mesh;		// We can use the material index because there are for every mesh there is only one material
-					ri.matInstance = m.matInstance;
-					ri.shaderPass = m.passIndex;
-					//outQueues[m.outQueueIndex].push_back(ri);
-					outQueues.push_back(ri);
+					ri.mesh = &meshes[i].mesh;
+					ri.matInstance = matInst;
+					ri.shaderPass = static_cast<unsigned int>(k);
+					outQueue.push_back(ri);
 				}
 			}
+		}
+	}
 
-			// LOD1
-			if (v.renderLOD1)
+	// Same as above but the instance count and the range in the visible instances buffer come from the commands written by the vegetation culling pass
+	static void AddGPUVegetationRenderItems(const GPUVegetationCulling &culling, unsigned int type, unsigned int lod, const Model *lod0, const Model *lodModel, unsigned int passCount, const unsigned int *passIds, unsigned int csmPassID, RenderQueue &outQueue)
+	{
+		const std::vector<MeshMaterial> &materials = lod0->GetMeshesAndMaterials();
+		const std::vector<MeshMaterial> &meshes = lodModel->GetMeshesAndMaterials();
+
+		const size_t count = glm::min(materials.size(), static_cast<size_t>(MAX_GPU_VEGETATION_MESHES));
+
+		for (size_t i = 0; i < count; i++)
+		{
+			MaterialInstance *matInst = materials[i].mat;
+
+			const std::vector<ShaderPass> &passes = matInst->baseMaterial->GetShaderPasses();
+			for (unsigned int j = 0; j < passCount; j++)
 			{
-				const std::vector<MeshMaterial> &meshesAndMaterials = v.modelLOD1->GetMeshesAndMaterials();
+				const VegetationCullView view = passIds[j] == csmPassID ? VegetationCullView::SHADOWS : VegetationCullView::CAMERA;
 
-				for (unsigned short i = 0; i < numMatching; i++)
+				for (size_t k = 0; k < passes.size(); k++)
 				{
-					const Match &m = matches[i];
+					if (passIds[j] != passes[k].queueID)
+						continue;
 
 					RenderItem ri = {};
-					ri.mesh = &meshesAndMaterials[m.matIndex].mesh;		// We can use the material index because there are for every mesh there is only one material
-					ri.matInstance = m.matInstance;
-					ri.shaderPass = m.passIndex;
-					//outQueues[m.outQueueIndex].push_back(ri);
-					//outQueues[m.outQueueIndex].push_back(ri);
-					outQueues.push_back(ri);
+					ri.mesh = &meshes[i].mesh;
+					ri.matInstance = matInst;
+					ri.shaderPass = static_cast<unsigned int>(k);
+					ri.indirectBuffer = culling.GetIndirectBuffer();
+					ri.indirectOffset = culling.GetCommandOffset(view, type, lod, static_cast<unsigned int>(i));
+					outQueue.push_back(ri);
 				}
 			}
+		}
+	}
 
-			// LOD2
-			if (v.renderLOD2)
-			{
-				const std::vector<MeshMaterial> &meshesAndMaterials = v.modelLOD2->GetMeshesAndMaterials();
+	void Terrain::GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues)
+	{
+		for (size_t i = 0; i < visibility.size() - 1; i++)		// Don't check the last index because it's the terrain visibility index
+		{
+			const Vegetation &v = vegetation[visibility[i]];
 
-				for (unsigned short i = 0; i < numMatching; i++)
+			if (gpuVegCulling)
+			{
+				const Model *lods[GPU_VEGETATION_LODS] = { v.model, v.modelLOD1, v.modelLOD2 };
+				for (unsigned int lod = 0; lod < GPU_VEGETATION_LODS; lod++)
 				{
-					const Match &m = matches[i];
-
-					RenderItem ri = {};
-					ri.mesh = &meshesAndMaterials[m.matIndex].mesh;		// We can use the material index because there are for every mesh there is only one material
-					ri.matInstance = m.matInstance;
-					ri.shaderPass = m.passIndex;
-					//outQueues[m.outQueueIndex].push_back(ri);
-					outQueues.push_back(ri);
+					if (lods[lod])
+						AddGPUVegetationRenderItems(*gpuVegCulling, visibility[i], lod, v.model, lods[lod], passCount, passIds, csmPassID, outQueues);
 				}
+				continue;
 			}
+
+			if (v.renderLOD0)
+				AddVegetationRenderItems(v.model, v.model, passCount, passIds, outQueues);
+			if (v.renderLOD1)
+				AddVegetationRenderItems(v.model, v.modelLOD1, passCount, passIds, outQueues);
+			if (v.renderLOD2)
+				AddVegetationRenderItems(v.model, v.modelLOD2, passCount, passIds, outQueues);
 		}
 
 		//renderer->GetFont().AddText("Veg instances: " + std::to_string(culledVegInstData.size()), glm::vec2(10.0f, (float)(renderer->GetHeight() - renderer->GetHeight() * 0.14f)), glm::vec2(0.25f));
@@ -319,7 +428,6 @@ namespace Engine
 		if (data.size() <= 0)
 			return;
 
-		bool anyMatches = false;
 		const std::vector<ShaderPass> &passes = matInstance->baseMaterial->GetShaderPasses();
 		for (size_t i = 0; i < passCount; i++)
 		{
@@ -334,22 +442,10 @@ namespace Engine
 
 					//outQueues[i].push_back(ri);
 					outQueues.push_back(ri);
-					anyMatches = true;
 				}
 			}
 		}
 
-		if (!anyMatches)
-			return;
-
-		if (!isTerrainDataUpdated)
-		{
-			terrainInstancingBuffer->Update(data.data(), data.size() * sizeof(TerrainInstanceData), 0);
-			isTerrainDataUpdated = true;
-		}
-
-		mesh.vertexOffset = 0;
-		mesh.instanceCount = data.size();
 
 		/*if (updateMaterialUBO)
 		{
@@ -476,6 +572,16 @@ namespace Engine
 		if (obstacleMap)
 			stbi_image_free(obstacleMap);
 
+		if (gpuVegCulling)
+		{
+			// The culling lives in the rendering path so stop it from culling this terrain's vegetation
+			gpuVegCulling->SetTypeCount(0);
+			vegInstancingBufferLOD0->RemoveReference();
+			vegInstancingBufferLOD1->RemoveReference();
+			vegInstancingBufferLOD2->RemoveReference();
+			gpuVegCulling = nullptr;
+		}
+
 		for (size_t z = 0; z < nodes.size(); z++)
 		{
 			for (size_t x = 0; x < nodes[z].size(); x++)
@@ -653,6 +759,12 @@ namespace Engine
 				return;
 		}
 
+		if (gpuVegCulling && vegetation.size() >= MAX_GPU_VEGETATION_TYPES)
+		{
+			Log::Print(LogLevel::LEVEL_WARNING, "Can't add more than %u vegetation types when the vegetation is culled on the gpu\n", MAX_GPU_VEGETATION_TYPES);
+			return;
+		}
+
 		Vegetation v = {};
 		v.heightOffset = 0.0f;
 		v.capacity = 0;
@@ -686,6 +798,7 @@ namespace Engine
 		}
 
 		vegetation.push_back(v);
+		vegCellsDirty = true;
 	}
 
 	void Terrain::ChangeVegetationModel(Vegetation &v, int lod, const std::string &newModelPath)
@@ -729,6 +842,9 @@ namespace Engine
 				}
 			}
 		}
+
+		// The gpu culling needs the meshes of the new lod
+		vegCellsDirty = true;
 	}
 
 	void Terrain::PaintVegetation(const std::vector<int> &ids, const glm::vec3 &rayOrigin, const glm::vec3 &rayDir)
@@ -738,12 +854,27 @@ namespace Engine
 
 		IntersectTerrain(rayOrigin, rayDir, intersectionPoint);
 
+		unsigned int numInstances = 0;
+		for (size_t i = 0; i < vegetation.size(); i++)
+			numInstances += vegetation[i].count;
+
 		for (size_t i = 0; i < ids.size(); i++)
 		{
 			Vegetation &v = vegetation[ids[i]];
 
 			for (int j = 0; j < v.density; j++)
 			{
+				// Stop painting instead of leaving instances out of the gpu culling
+				if (gpuVegCulling && numInstances >= MAX_GPU_VEGETATION_INSTANCES)
+				{
+					if (!gpuVegCapacityWarned)
+					{
+						Log::Print(LogLevel::LEVEL_WARNING, "Can't paint more than %u vegetation instances when the vegetation is culled on the gpu\n", MAX_GPU_VEGETATION_INSTANCES);
+						gpuVegCapacityWarned = true;
+					}
+					break;
+				}
+
 				float r01 = Random::Float();
 				float rMinusOne_One = r01 * 2.0f - 1.0f;		// Convert from [0,1] to [-1,1]
 
@@ -781,7 +912,8 @@ namespace Engine
 					v.capacity++;
 				}
 				
-				v.count++;			
+				v.count++;
+				numInstances++;
 			}
 
 			// Update the offsets
@@ -790,6 +922,8 @@ namespace Engine
 				vegetation[j].offset = vegetation[j - 1].offset + vegetation[j - 1].capacity;
 			}
 		}
+
+		vegCellsDirty = true;
 	}
 
 	void Terrain::UndoVegetationPaint(const std::vector<int> &ids)
@@ -803,6 +937,10 @@ namespace Engine
 			Vegetation &v = vegetation[ids[i]];
 			v.count--;
 		}
+
+		gpuVegCapacityWarned = false;
+
+		vegCellsDirty = true;
 	}
 
 	void Terrain::RedoVegetationPaint(const std::vector<int> &ids)
@@ -812,6 +950,8 @@ namespace Engine
 			Vegetation &v = vegetation[ids[i]];
 			v.count++;
 		}
+
+		vegCellsDirty = true;
 	}
 
 	void Terrain::ReseatVegetation()
@@ -838,6 +978,8 @@ namespace Engine
 			glm::vec4 &v = vegetationInstData[i].modelMatrix[3];
 			v = glm::vec4(v.x, GetHeightAt((int)v.x, (int)v.z) + vegetation[dat[datIndex - 1].index].heightOffset, v.z, 1.0f);
 		}
+
+		vegCellsDirty = true;
 	}
 
 	void Terrain::CreateVegColliders()
@@ -1186,6 +1328,20 @@ namespace Engine
 		return heights[z * resolution + x];
 	}
 
+	void Terrain::GetHeightsAt(const glm::vec2 *positions, unsigned int count, float *outHeights) const
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const int x = static_cast<int>(positions[i].x);
+			const int z = static_cast<int>(positions[i].y);
+
+			if (x < 0 || x >= resolution || z < 0 || z >= resolution)
+				outHeights[i] = 0.0f;
+			else
+				outHeights[i] = heights[z * resolution + x];
+		}
+	}
+
 	float Terrain::Barycentric(const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3, const glm::vec2 &pos)
 	{
 		float det = (p2.z - p3.z) * (p1.x - p3.x) + (p3.x - p2.x) * (p1.z - p3.z);
@@ -1406,6 +1562,14 @@ namespace Engine
 
 		s.Close();
 
+		vegCellsDirty = true;
+
+		// The instance buffers of the meshes can't be changed later so decide here where the vegetation is culled
+		if (gpuVegCulling && !GPUVegetationCulling::CanCull(static_cast<unsigned int>(vegetationInstData.size()), static_cast<unsigned int>(vegetation.size()), GetMaxVegetationMeshCount()))
+		{
+			Log::Print(LogLevel::LEVEL_WARNING, "The vegetation doesn't fit in the gpu culling buffers (%u instances, %u types), culling it on the cpu\n", static_cast<unsigned int>(vegetationInstData.size()), static_cast<unsigned int>(vegetation.size()));
+			gpuVegCulling = nullptr;
+		}
 
 		CreateVegInstanceBuffer();
 
@@ -1442,6 +1606,19 @@ namespace Engine
 
 	void Terrain::CreateVegInstanceBuffer()
 	{
+		// The gpu culling writes every visible instance to a single buffer so all lods use it
+		if (gpuVegCulling)
+		{
+			Buffer *visibleInstances = gpuVegCulling->GetVisibleInstancesBuffer();
+			vegInstancingBufferLOD0 = visibleInstances;
+			vegInstancingBufferLOD1 = visibleInstances;
+			vegInstancingBufferLOD2 = visibleInstances;
+			vegInstancingBufferLOD0->AddReference();
+			vegInstancingBufferLOD1->AddReference();
+			vegInstancingBufferLOD2->AddReference();
+			return;
+		}
+
 		// We use a single buffer for instancing for all the vegetation instead of one buffer per mesh
 #ifdef EDITOR
 		vegInstancingBufferLOD0 = renderer->CreateVertexBuffer(nullptr, 3000 * sizeof(ModelInstanceData), BufferUsage::DYNAMIC);
@@ -1457,6 +1634,158 @@ namespace Engine
 #endif
 	}
 
+	void Terrain::BuildVegetationCells()
+	{
+		vegCellsDirty = false;
+
+		unsigned int numInstances = 0;
+		for (size_t i = 0; i < vegetation.size(); i++)
+			numInstances += vegetation[i].count;
+
+		vegCells.clear();
+		vegTypeFirstCell.resize(vegetation.size() + 1);
+		vegCellInstData.resize(numInstances);
+		vegCellPosX.resize(numInstances);
+		vegCellPosY.resize(numInstances);
+		vegCellPosZ.resize(numInstances);
+
+		const int gridSize = glm::max(1, (resolution + vegCellSize - 1) / vegCellSize);
+		std::vector<unsigned int> gridCells(gridSize * gridSize);
+		std::vector<unsigned int> instanceCells;
+
+		unsigned int next = 0;
+		unsigned int maxCellCount = 0;
+
+		// Each vegetation type has its own cells because the types have different radius and lod distances
+		for (size_t i = 0; i < vegetation.size(); i++)
+		{
+			const Vegetation &v = vegetation[i];
+			vegTypeFirstCell[i] = static_cast<unsigned int>(vegCells.size());
+
+			// Counting sort of the instances by grid cell
+			std::fill(gridCells.begin(), gridCells.end(), 0u);
+			instanceCells.resize(v.count);
+
+			for (unsigned int j = 0; j < v.count; j++)
+			{
+				const glm::vec4 &pos = vegetationInstData[v.offset + j].modelMatrix[3];
+				const int x = glm::clamp(static_cast<int>(pos.x) / vegCellSize, 0, gridSize - 1);
+				const int z = glm::clamp(static_cast<int>(pos.z) / vegCellSize, 0, gridSize - 1);
+
+				instanceCells[j] = static_cast<unsigned int>(z * gridSize + x);
+				gridCells[instanceCells[j]]++;
+			}
+
+			// Create the non empty cells. From here gridCells holds the index of the cell in vegCells
+			for (size_t j = 0; j < gridCells.size(); j++)
+			{
+				if (gridCells[j] == 0)
+					continue;
+
+				VegetationCell cell = {};
+				cell.bounds.min = glm::vec3(std::numeric_limits<float>::max());
+				cell.bounds.max = glm::vec3(std::numeric_limits<float>::lowest());
+				cell.first = next;
+				cell.count = 0;
+
+				next += gridCells[j];
+				maxCellCount = glm::max(maxCellCount, gridCells[j]);
+
+				gridCells[j] = static_cast<unsigned int>(vegCells.size());
+				vegCells.push_back(cell);
+			}
+
+			for (unsigned int j = 0; j < v.count; j++)
+			{
+				const ModelInstanceData &m = vegetationInstData[v.offset + j];
+				const glm::vec3 pos = glm::vec3(m.modelMatrix[3]);
+
+				VegetationCell &cell = vegCells[gridCells[instanceCells[j]]];
+				const unsigned int dst = cell.first + cell.count;
+				cell.count++;
+
+				vegCellInstData[dst] = m;
+				vegCellPosX[dst] = pos.x;
+				vegCellPosY[dst] = pos.y;
+				vegCellPosZ[dst] = pos.z;
+
+				cell.bounds.min = glm::min(cell.bounds.min, pos);
+				cell.bounds.max = glm::max(cell.bounds.max, pos);
+			}
+		}
+
+		vegTypeFirstCell[vegetation.size()] = static_cast<unsigned int>(vegCells.size());
+		vegVisibleInstances.resize(maxCellCount);
+
+		if (gpuVegCulling)
+			SetupGPUVegetation();
+	}
+
+	void Terrain::SetupGPUVegetation()
+	{
+		// The cells of each type are contiguous so the cell ordered instances can be uploaded as they are
+		gpuVegCulling->SetInstances(vegCellInstData.data(), static_cast<unsigned int>(vegCellInstData.size()));
+
+		if (vegetation.size() > MAX_GPU_VEGETATION_TYPES)
+			Log::Print(LogLevel::LEVEL_WARNING, "Only the first %u vegetation types are drawn with gpu culling\n", MAX_GPU_VEGETATION_TYPES);
+		if (GetMaxVegetationMeshCount() > MAX_GPU_VEGETATION_MESHES)
+			Log::Print(LogLevel::LEVEL_WARNING, "Only the first %u meshes of each vegetation lod are drawn with gpu culling\n", MAX_GPU_VEGETATION_MESHES);
+
+		const unsigned int numTypes = glm::min(static_cast<unsigned int>(vegetation.size()), MAX_GPU_VEGETATION_TYPES);
+
+		for (unsigned int i = 0; i < numTypes; i++)
+		{
+			const Vegetation &v = vegetation[i];
+
+			unsigned int first = 0;
+			unsigned int count = 0;
+			for (unsigned int j = vegTypeFirstCell[i]; j < vegTypeFirstCell[i + 1]; j++)
+			{
+				if (j == vegTypeFirstCell[i])
+					first = vegCells[j].first;
+
+				count += vegCells[j].count;
+			}
+
+			const AABB &aabb = v.model->GetOriginalAABB();
+			const float radius = glm::max(aabb.max.x, glm::max(aabb.max.y, aabb.max.z));
+
+			gpuVegCulling->SetType(i, first, count, radius, v.lod1Dist, v.lod2Dist);
+
+			const Model *lods[GPU_VEGETATION_LODS] = { v.model, v.modelLOD1, v.modelLOD2 };
+			for (unsigned int lod = 0; lod < GPU_VEGETATION_LODS; lod++)
+			{
+				if (!lods[lod])
+					continue;
+
+				const std::vector<MeshMaterial> &meshes = lods[lod]->GetMeshesAndMaterials();
+				for (size_t j = 0; j < meshes.size(); j++)
+					gpuVegCulling->SetTypeLODMesh(i, lod, static_cast<unsigned int>(j), meshes[j].mesh);
+			}
+		}
+
+		gpuVegCulling->SetTypeCount(numTypes);
+	}
+
+	unsigned int Terrain::GetMaxVegetationMeshCount() const
+	{
+		size_t maxMeshes = 0;
+
+		for (size_t i = 0; i < vegetation.size(); i++)
+		{
+			const Vegetation &v = vegetation[i];
+			const Model *lods[GPU_VEGETATION_LODS] = { v.model, v.modelLOD1, v.modelLOD2 };
+
+			for (unsigned int lod = 0; lod < GPU_VEGETATION_LODS; lod++)
+			{
+				if (lods[lod])
+					maxMeshes = glm::max(maxMeshes, lods[lod]->GetMeshesAndMaterials().size());
+			}
+		}
+
+		return static_cast<unsigned int>(maxMeshes);
+	}
+
 	void Terrain::Save(const std::string &folder, const std::string &sceneName)
 	{
 		std::ofstream file(folder + "terrain_" + sceneName + ".dat");
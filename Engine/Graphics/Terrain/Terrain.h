@@ -16,6 +16,7 @@ namespace Engine
 	class Model;
 	class Collider;
 	class Buffer;
+	class GPUVegetationCulling;
 
 	enum TerrainEditMode
 	{
@@ -38,13 +39,12 @@ namespace Engine
 		glm::vec3 selectionPointAndRadius;
 	};
 
+	// Instances of a single vegetation type that are in the same cell of the vegetation grid
 	struct VegetationCell
 	{
-		std::vector<Vegetation> vegTypes;
-		std::vector<ModelInstanceData> data;
-		AABB aabb;
-		unsigned int x;
-		unsigned int z;
+		AABB bounds;						// Bounds of the instance positions
+		unsigned int first;					// Range in the cell ordered instance arrays
+		unsigned int count;
 	};
 
 	struct VegColInfo
@@ -63,6 +63,7 @@ namespace Engine
 		bool Init(Game *game, const TerrainInfo &terrainInfo);
 
 		void Cull(unsigned int passAndFrustumCount, unsigned int *passIds, const Frustum *frustums, std::vector<VisibilityIndices*> &out) override;
+		void PrepareRenderItems(unsigned int passCount, unsigned int *passIds, const std::vector<const VisibilityIndices*> &visibility) override;
 		void GetRenderItems(unsigned int passCount, unsigned int *passIds, const VisibilityIndices &visibility, RenderQueue &outQueues) override;
 		void UpdateLOD(Camera *camera);
 		void UpdateVegColliders(Camera *camera);
@@ -106,6 +107,8 @@ namespace Engine
 		int GetResolution() const { return resolution; }
 
 		float GetHeightAt(int x, int z);
+		// Same as GetHeightAt for many positions at once. Only reads the heights so it can be called from jobs
+		void GetHeightsAt(const glm::vec2 *positions, unsigned int count, float *outHeights) const;
 		float GetExactHeightAt(float x, float z);
 		glm::vec3 GetNormalAtFast(int x, int z);
 		glm::vec3 GetNormalAt(float x, float z);
@@ -128,6 +131,11 @@ namespace Engine
 		void LoadVegetationFile(const std::string &vegPath);	
 		bool InBounds(int x, int z);
 		void CreateVegInstanceBuffer();
+		void BuildVegetationCells();
+		void SetupGPUVegetation();
+		unsigned int GetMaxVegetationMeshCount() const;
+		void CullVegetationOnGPU(unsigned int passAndFrustumCount, unsigned int *passIds, const Frustum *frustums, std::vector<VisibilityIndices*> &out);
+		void CullVegetationCell(const VegetationCell &cell, const Frustum &frustum, const glm::vec3 &camPos, float radius, float lod1Dist, float lod2Dist);
 		void AddVegInstanceBufferToMesh(const Mesh &mesh, int lod);
 		float Barycentric(const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3, const glm::vec2 &pos);
 
@@ -185,8 +193,23 @@ namespace Engine
 		std::vector<ModelInstanceData> culledVegInstDataLOD1;
 		std::vector<ModelInstanceData> culledVegInstDataLOD2;
 
-		//std::vector<VegetationCell> vegCells;
-		//unsigned int vegCellSize = 64;
+		// Vegetation grid. The instances are copied in cell order so a cell that is completely visible can be copied as a whole
+		// and the cells that intersect the frustum can test their instance positions with SIMD
+		static const int vegCellSize = 64;
+		std::vector<VegetationCell> vegCells;
+		std::vector<unsigned int> vegTypeFirstCell;			// The cells of the vegetation type i are in [vegTypeFirstCell[i], vegTypeFirstCell[i + 1])
+		std::vector<ModelInstanceData> vegCellInstData;
+		std::vector<float> vegCellPosX;
+		std::vector<float> vegCellPosY;
+		std::vector<float> vegCellPosZ;
+		std::vector<unsigned int> vegVisibleInstances;			// Indices of the visible instances of the cell being culled
+		bool vegCellsDirty = true;
+
+		// When the renderer supports compute the culling is done on the gpu and the lod buffers all point to the visible instances buffer.
+		// Vegetation that doesn't fit in the gpu buffers when it's loaded is culled on the cpu
+		GPUVegetationCulling *gpuVegCulling = nullptr;
+		bool gpuVegCapacityWarned = false;
+
 		std::vector<VegColInfo> closestColliders;
 		bool vegColCreated = false;
 		unsigned int maxColliders = 20;
@@ -5,6 +5,8 @@
 
 namespace Engine
 {
+	static const VkDeviceSize MAX_BLOCK_SIZE = 32 * 1024 * 1024;
+
 	VKAllocator::VKAllocator(VKBase *vkContext)
 	{
 		device = vkContext->GetDevice();
@@ -14,9 +16,20 @@ namespace Engine
 
 		VkPhysicalDeviceMemoryProperties mp = vkContext->GetMemoryProperties();
 		memInfo.resize(mp.memoryTypeCount);
-		memoryPools.resize(mp.memoryTypeCount);
+		memoryPools.resize(mp.memoryTypeCount * 2);
 
-		minBlockSize = bufferImageGranularity * 20;
+		for (uint32_t i = 0; i < mp.memoryTypeCount; i++)
+		{
+			// Small heaps like the device local host visible one get smaller blocks so one block doesn't take most of the heap
+			VkDeviceSize blockSize = mp.memoryHeaps[mp.memoryTypes[i].heapIndex].size / 8;
+			if (blockSize > MAX_BLOCK_SIZE)
+				blockSize = MAX_BLOCK_SIZE;
+
+			memoryPools[i * 2].blockSize = blockSize;
+			memoryPools[i * 2].emptyBlocks = 0;
+			memoryPools[i * 2 + 1].blockSize = blockSize;
+			memoryPools[i * 2 + 1].emptyBlocks = 0;
+		}
 
 		currentAllocations = 0;
 		totalAllocationsMade = 0;
@@ -26,77 +39,117 @@ namespace Engine
 	{
 	}
 
-	void VKAllocator::Allocate(Allocation &alloc, VkDeviceSize size, uint32_t memType, bool exclusive)
+	void VKAllocator::Allocate(Allocation &alloc, VkDeviceSize size, VkDeviceSize alignment, uint32_t memType, bool isImage, bool exclusive)
 	{
-		MemoryPool &pool = memoryPools[memType];
+		const uint32_t poolIndex = memType * 2 + (isImage ? 1 : 0);
+		MemoryPool &pool = memoryPools[poolIndex];
 
-		// Allocation must be multiple of buffer image granularity
-		VkDeviceSize realAllocSize = ((size / bufferImageGranularity) + 1) * bufferImageGranularity;    // eg 256 / 1024 = 0   +1 = 1   1*1024=1024
+		alloc = {};
+		alloc.size = size;
+		alloc.memType = memType;
+		alloc.pool = poolIndex;
+		alloc.range = TLSFAllocator::INVALID_RANGE;
 
-		memInfo[memType].totalUsedMemory += realAllocSize;
+		// Exclusive allocations can be mapped while other objects are mapped and big resources would waste most of a block,
+		// so they get their own memory
+		if (exclusive || size > pool.blockSize / 2)
+		{
+			AllocateDedicated(alloc, size, memType);
+			return;
+		}
 
-		BlockLocation location;
-		bool isEmptyBlock = false;
-		bool found = FindFreeBlock(location, isEmptyBlock, realAllocSize, memType, exclusive);
+		uint64_t offset = 0;
+		uint32_t range = TLSFAllocator::INVALID_RANGE;
+		uint32_t blockIndex = DEDICATED_BLOCK;
 
-		if (!found)
+		for (size_t i = 0; i < pool.blocks.size(); i++)
 		{
-			location.blockIndex = AllocNewBlock(realAllocSize, memType, exclusive);
-			location.freeSpotIndex = 0;		// it's the first allocation for the new block
+			Block &block = pool.blocks[i];
+
+			if (block.memory == VK_NULL_HANDLE)
+				continue;
+
+			const bool wasEmpty = block.ranges.IsEmpty();
+
+			if (block.ranges.Allocate(size, alignment, offset, range))
+			{
+				if (wasEmpty)
+					pool.emptyBlocks--;
+
+				blockIndex = static_cast<uint32_t>(i);
+				break;
+			}
 		}
-		else if (isEmptyBlock)
+
+		if (blockIndex == DEDICATED_BLOCK)
 		{
-			AllocEmptyBlock(location.blockIndex, realAllocSize, memType, exclusive);
-			location.freeSpotIndex = 0;
-		}
+			blockIndex = AllocNewBlock(pool, memType);
 
-		Block &block = pool.blocks[location.blockIndex];
-		if (block.exclusive == false && exclusive == true)		// Check so we don't set a exclusive block to false
-			block.exclusive = true;
+			// The allocation is at most half a block so it should fit in a new one, but a big alignment can still make it fail.
+			// The new block is still empty then so it's handled like a block that had all its allocations freed
+			if (blockIndex != DEDICATED_BLOCK && !pool.blocks[blockIndex].ranges.Allocate(size, alignment, offset, range))
+			{
+				Log::Print(LogLevel::LEVEL_WARNING, "Allocation of %llu bytes with alignment %llu doesn't fit in a new block, using a dedicated allocation\n", static_cast<unsigned long long>(size), static_cast<unsigned long long>(alignment));
 
-		alloc.memory = block.alloc.memory;
-		alloc.offset = block.freeSpots[location.freeSpotIndex].offset;
-		alloc.size = size;		// Size neeeds to be the unmodified size
-		alloc.memType = memType;
-		alloc.blockIndex = location.blockIndex;
+				if (pool.emptyBlocks > 0)
+					FreeBlock(pool.blocks[blockIndex], memType);
+				else
+					pool.emptyBlocks++;
 
-		MarkBlockChunkUsed(location, memType, realAllocSize);
+				blockIndex = DEDICATED_BLOCK;
+			}
+
+			// Dedicated memory of the allocation size might still be available when a whole block isn't
+			if (blockIndex == DEDICATED_BLOCK)
+			{
+				AllocateDedicated(alloc, size, memType);
+				return;
+			}
+		}
+
+		memInfo[memType].totalUsedMemory += size;
+
+		alloc.memory = pool.blocks[blockIndex].memory;
+		alloc.offset = static_cast<VkDeviceSize>(offset);
+		alloc.blockIndex = blockIndex;
+		alloc.range = range;
 	}
 
 	void VKAllocator::Free(Allocation &alloc)
 	{
-		if (alloc.size == 0)
+		if (alloc.size == 0 || alloc.memory == VK_NULL_HANDLE)
 			return;
 
-		// Find this alloc in the blocks and mark it as free
-		// if the block is empty free it
-		VkDeviceSize realAllocSize = ((alloc.size / bufferImageGranularity) + 1) * bufferImageGranularity;
+		memInfo[alloc.memType].totalUsedMemory -= alloc.size;
 
-		MemoryPool &pool = memoryPools[alloc.memType];
-		Block &block = pool.blocks[alloc.blockIndex];
+		if (alloc.blockIndex == DEDICATED_BLOCK)
+		{
+			FreeMemory(alloc.memory, alloc.size, alloc.memType);
+			alloc = {};
+			return;
+		}
 
-		block.freeSpots.push_back({ alloc.offset, realAllocSize });		// Add a free spot/chunk for allocation where this allocation was
-		block.totalAvailableSize += realAllocSize;
+		MemoryPool &pool = memoryPools[alloc.pool];
+		Block &block = pool.blocks[alloc.blockIndex];
 
-		memInfo[alloc.memType].totalUsedMemory -= realAllocSize;
+		block.ranges.Free(alloc.range);
 
-		if (block.totalAvailableSize == block.alloc.size || block.exclusive)
+		if (block.ranges.IsEmpty())
 		{
-			// free the memory because there is nothing else using this block
-			memInfo[alloc.memType].totalAllocatedMemory -= block.alloc.size;
-			currentAllocations--;
-
-			vkFreeMemory(device, block.alloc.memory, nullptr);
-
-			// We can't erase the block because it would mess up the allocation block index
-			// Erase the free spots to mark the block as empty
-			block.freeSpots.clear();
-			// Reset the block allocation
-			block.alloc = {};
-			block.totalAvailableSize = 0;
+			// Keep one empty block around so a resource that is created and destroyed often, like a staging buffer, doesn't allocate and free a block every time
+			if (pool.emptyBlocks > 0)
+			{
+				FreeBlock(block, alloc.memType);
 
-			Log::Print(LogLevel::LEVEL_INFO, "Free block found, freeing memory... Current allocs : %d\n", currentAllocations);
+				Log::Print(LogLevel::LEVEL_INFO, "Free block found, freeing memory... Current allocs : %d\n", currentAllocations);
+			}
+			else
+			{
+				pool.emptyBlocks++;
+			}
 		}
+
+		alloc = {};
 	}
 
 	void VKAllocator::PrintStats()
@@ -113,61 +166,25 @@ namespace Engine
 		}
 	}
 
-	bool VKAllocator::FindFreeBlock(BlockLocation &blockLocation, bool &isEmptyBlock, VkDeviceSize allocSize, uint32_t memTypeIndex, bool exclusiveAlloc)
+	void VKAllocator::AllocateDedicated(Allocation &alloc, VkDeviceSize size, uint32_t memType)
 	{
-		MemoryPool &pool = memoryPools[memTypeIndex];
+		alloc.memory = AllocateMemory(size, memType);
+		alloc.offset = 0;
+		alloc.blockIndex = DEDICATED_BLOCK;
 
-		for (size_t i = 0; i < pool.blocks.size(); i++)
-		{
-			const Block &block = pool.blocks[i];
-
-			// If this block is reserved for just one allocation then ignore it
-			if (block.exclusive)
-				continue;
-
-			// Check if the block is empty because it has been freed
-			if (block.alloc.memory == VK_NULL_HANDLE)
-			{
-				isEmptyBlock = true;
-				blockLocation.blockIndex = i;
-				return true;
-			}
-
-			for (size_t j = 0; j < block.freeSpots.size(); j++)
-			{
-				// Check if the block is occupied or not
-				bool canUseBlock = exclusiveAlloc ? block.freeSpots[j].offset == 0 : true;
-				// Check if we have space inside this block for the allocation
-				if (block.freeSpots[j].size >= allocSize && canUseBlock)
-				{
-					blockLocation.blockIndex = i;
-					blockLocation.freeSpotIndex = j;
-					return true;
-				}
-			}
-		}
-
-		return false;
+		if (alloc.memory != VK_NULL_HANDLE)
+			memInfo[memType].totalUsedMemory += size;
 	}
 
-	uint32_t VKAllocator::AllocNewBlock(VkDeviceSize allocSize, uint32_t memTypeIndex, bool exclusiveAlloc)
+	VkDeviceMemory VKAllocator::AllocateMemory(VkDeviceSize size, uint32_t memTypeIndex)
 	{
-		VkDeviceSize newBlockSize = allocSize * 2;
-		if (newBlockSize < minBlockSize && !exclusiveAlloc)
-			newBlockSize = minBlockSize;
-
-		Block newBlock = {};
-
-		newBlock.alloc.memType = memTypeIndex;
-		newBlock.alloc.size = newBlockSize;
-		newBlock.totalAvailableSize = newBlockSize;
-
 		VkMemoryAllocateInfo allocInfo = {};
 		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = newBlockSize;
+		allocInfo.allocationSize = size;
 		allocInfo.memoryTypeIndex = memTypeIndex;
 
-		VkResult res = vkAllocateMemory(device, &allocInfo, nullptr, &newBlock.alloc.memory);
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkResult res = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
 
 		if (res != VK_SUCCESS)
 		{
@@ -178,77 +195,60 @@ namespace Engine
 			else
 				Log::Print(LogLevel::LEVEL_ERROR, "Error allocating memory!\n");
 
-			return -1;
+			return VK_NULL_HANDLE;
 		}
 
-		MemoryPool &pool = memoryPools[memTypeIndex];
-		pool.blocks.push_back(newBlock);
-
-		uint32_t newBlockIndex = pool.blocks.size() - 1;
-		pool.blocks[newBlockIndex].freeSpots.push_back({ 0, newBlockSize });
-
 		currentAllocations++;
 		totalAllocationsMade++;
 
-		memInfo[memTypeIndex].totalAllocatedMemory += newBlockSize;
+		memInfo[memTypeIndex].totalAllocatedMemory += size;
 
-		return newBlockIndex;
+		return memory;
 	}
 
-	void VKAllocator::AllocEmptyBlock(uint32_t blockIndex, VkDeviceSize allocSize, uint32_t memTypeIndex, bool exclusiveAlloc)
+	void VKAllocator::FreeMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memTypeIndex)
 	{
-		VkDeviceSize newBlockSize = allocSize;
-		if (!exclusiveAlloc)
-		{
-			newBlockSize *= 2;
-			if (newBlockSize < minBlockSize)
-				newBlockSize = minBlockSize;
-		}
+		vkFreeMemory(device, memory, nullptr);
 
-		MemoryPool &pool = memoryPools[memTypeIndex];
-		Block &emptyBlock = pool.blocks[blockIndex];
+		currentAllocations--;
+		memInfo[memTypeIndex].totalAllocatedMemory -= size;
+	}
 
-		emptyBlock.alloc.memType = memTypeIndex;
-		emptyBlock.alloc.size = newBlockSize;
-		emptyBlock.totalAvailableSize = newBlockSize;
+	void VKAllocator::FreeBlock(Block &block, uint32_t memTypeIndex)
+	{
+		FreeMemory(block.memory, block.size, memTypeIndex);
 
-		VkMemoryAllocateInfo allocInfo = {};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = newBlockSize;
-		allocInfo.memoryTypeIndex = memTypeIndex;
+		// We can't erase the block because it would mess up the allocation block index
+		block.memory = VK_NULL_HANDLE;
+		block.size = 0;
+		block.ranges.Dispose();
+	}
 
-		VkResult res = vkAllocateMemory(device, &allocInfo, nullptr, &emptyBlock.alloc.memory);
+	uint32_t VKAllocator::AllocNewBlock(MemoryPool &pool, uint32_t memTypeIndex)
+	{
+		VkDeviceMemory memory = AllocateMemory(pool.blockSize, memTypeIndex);
+		if (memory == VK_NULL_HANDLE)
+			return DEDICATED_BLOCK;
 
-		if (res != VK_SUCCESS)
+		// Reuse the slot of a freed block if there's one
+		uint32_t blockIndex = static_cast<uint32_t>(pool.blocks.size());
+		for (size_t i = 0; i < pool.blocks.size(); i++)
 		{
-			if (res == VK_ERROR_OUT_OF_DEVICE_MEMORY)
-				Log::Print(LogLevel::LEVEL_ERROR, "Out of device memory!\n");
-			else if (res == VK_ERROR_TOO_MANY_OBJECTS)
-				Log::Print(LogLevel::LEVEL_ERROR, "Too many allocations!\n");
-			else
-				Log::Print(LogLevel::LEVEL_ERROR, "Error allocating memory!\n");
-
-			return;
+			if (pool.blocks[i].memory == VK_NULL_HANDLE)
+			{
+				blockIndex = static_cast<uint32_t>(i);
+				break;
+			}
 		}
 
-		emptyBlock.freeSpots.push_back({ 0, newBlockSize });
-
-		currentAllocations++;
-		totalAllocationsMade++;
-
-		memInfo[memTypeIndex].totalAllocatedMemory += newBlockSize;
-	}
-
-	void VKAllocator::MarkBlockChunkUsed(const BlockLocation &location, uint32_t memTypeIndex, VkDeviceSize allocSize)
-	{
-		MemoryPool &pool = memoryPools[memTypeIndex];
-		Block &block = pool.blocks[location.blockIndex];
-
-		FreeSpot &freeSpot = block.freeSpots[location.freeSpotIndex];
+		if (blockIndex == pool.blocks.size())
+			pool.blocks.push_back({});
 
-		block.totalAvailableSize -= allocSize;
+		Block &block = pool.blocks[blockIndex];
+		block.memory = memory;
+		block.size = pool.blockSize;
+		block.ranges.Init(pool.blockSize);
 
-		freeSpot.size -= allocSize;
-		freeSpot.offset += allocSize;
+		return blockIndex;
 	}
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Program/TLSFAllocator.h"
+
 #include <vulkan/vulkan.h>
 
 #include <vector>
@@ -14,32 +16,23 @@ namespace Engine
 		VkDeviceSize offset;
 		VkDeviceSize size;
 		uint32_t memType;
+		uint32_t pool;
 		uint32_t blockIndex;
-	};
-
-	struct BlockLocation
-	{
-		uint32_t blockIndex;
-		uint32_t freeSpotIndex;
-	};
-
-	struct FreeSpot
-	{
-		VkDeviceSize offset;
-		VkDeviceSize size;
+		uint32_t range;				// Range of the block's allocator
 	};
 
 	struct Block
 	{
-		Allocation alloc;
-		std::vector<FreeSpot> freeSpots;	// Where in the block do we have free spot for allocation
-		bool exclusive;						// Is this block exclusive for just one buffer/image. Otherwise if we map 2 objects at once for the same device memory we get an error. Ideal for UBO's
-		VkDeviceSize totalAvailableSize;
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		TLSFAllocator ranges;
 	};
 
 	struct MemoryPool
 	{
-		std::vector<Block> blocks;
+		std::vector<Block> blocks;		// Blocks that were freed keep their index so the allocations of the other blocks stay valid
+		VkDeviceSize blockSize;
+		uint32_t emptyBlocks;
 	};
 
 	struct MemoryInfo
@@ -54,8 +47,10 @@ namespace Engine
 		VKAllocator(VKBase *vkContext);
 		~VKAllocator();
 
+		// alignment -> The alignment of the memory requirements, the offset of the allocation is a multiple of it
+		// isImage -> Images with optimal tiling use different blocks than buffers so they never need the buffer image granularity padding
 		// exclusiveAlloc -> Make an allocation exclusive for the objects requesting the allocation. It won't be shared with other objects
-		void Allocate(Allocation &alloc, VkDeviceSize size, uint32_t memType, bool exclusiveAlloc);
+		void Allocate(Allocation &alloc, VkDeviceSize size, VkDeviceSize alignment, uint32_t memType, bool isImage, bool exclusiveAlloc);
 
 		// Make sure to destroy the buffer/image when calling this function
 		void Free(Allocation &alloc);
@@ -66,21 +61,24 @@ namespace Engine
 		uint32_t GetTotalAllocationsMade() const { return totalAllocationsMade; }
 
 	private:
-		bool FindFreeBlock(BlockLocation &blockLocation, bool &isEmptyBlock, VkDeviceSize allocSize, uint32_t memTypeIndex, bool exclusiveAlloc);
-		// Returns the index of the block in the memory pool with index memTypeIndex
-		uint32_t AllocNewBlock(VkDeviceSize allocSize, uint32_t memTypeIndex, bool exclusiveAlloc);
-		// Used to allocate a block that was previously freed
-		void AllocEmptyBlock(uint32_t blockIndex, VkDeviceSize allocSize, uint32_t memTypeIndex, bool exclusiveAlloc);
-		void MarkBlockChunkUsed(const BlockLocation &location, uint32_t memTypeIndex, VkDeviceSize allocSize);
+		// The allocation gets its own memory instead of a range of a block
+		void AllocateDedicated(Allocation &alloc, VkDeviceSize size, uint32_t memType);
+		VkDeviceMemory AllocateMemory(VkDeviceSize size, uint32_t memTypeIndex);
+		void FreeMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t memTypeIndex);
+		// Returns the index of the new block in the pool or DEDICATED_BLOCK if the memory couldn't be allocated
+		uint32_t AllocNewBlock(MemoryPool &pool, uint32_t memTypeIndex);
+		// Keeps the block's slot in the pool so the block indices of the other allocations stay valid
+		void FreeBlock(Block &block, uint32_t memTypeIndex);
 
 	private:
+		static const uint32_t DEDICATED_BLOCK = 0xFFFFFFFF;
+
 		VkDevice device;
 		uint32_t currentAllocations;
 		uint32_t totalAllocationsMade;
 		VkDeviceSize bufferImageGranularity;
-		VkDeviceSize minBlockSize;
 
 		std::vector<MemoryInfo> memInfo;
-		std::vector<MemoryPool> memoryPools;		// We have a pool for each memory type
+		std::vector<MemoryPool> memoryPools;		// We have a pool for buffers and another for images for each memory type
 	};
 }
@@ -685,19 +685,25 @@ namespace Engine
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
-		VkPhysicalDeviceFeatures deviceFeatures = {};
-		deviceFeatures.textureCompressionBC = VK_TRUE;
-		deviceFeatures.shaderClipDistance = VK_TRUE;
-		deviceFeatures.wideLines = VK_TRUE;
-		deviceFeatures.fragmentStoresAndAtomics = VK_TRUE;
-		deviceFeatures.geometryShader = VK_TRUE;
-		deviceFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+		VkPhysicalDeviceFeatures enabledFeatures = {};
+		enabledFeatures.textureCompressionBC = VK_TRUE;
+		enabledFeatures.shaderClipDistance = VK_TRUE;
+		enabledFeatures.wideLines = VK_TRUE;
+		enabledFeatures.fragmentStoresAndAtomics = VK_TRUE;
+		enabledFeatures.geometryShader = VK_TRUE;
+		enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+		// The gpu vegetation culling writes indirect commands that start at an instance other than 0
+		// Without it the vegetation is culled on the cpu
+		enabledFeatures.drawIndirectFirstInstance = deviceFeatures.drawIndirectFirstInstance;
+
+		if (deviceFeatures.drawIndirectFirstInstance == VK_FALSE)
+			Log::Print(LogLevel::LEVEL_WARNING, "Device doesn't support drawIndirectFirstInstance\n");
 
 		VkDeviceCreateInfo deviceInfo = {};
 		deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
 		deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-		deviceInfo.pEnabledFeatures = &deviceFeatures;
+		deviceInfo.pEnabledFeatures = &enabledFeatures;
 		deviceInfo.enabledExtensionCount = deviceExtensions.size();			// We check for support at physical device selection
 		deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
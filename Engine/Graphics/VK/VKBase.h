@@ -54,6 +54,7 @@ namespace Engine
 		uint32_t GetGraphicsQueueFamily() const { return queueIndices.graphicsFamilyIndex; }
 
 		VkPhysicalDeviceFeatures GetDeviceFeatures() const { return deviceFeatures; }
+		const VkPhysicalDeviceProperties &GetDeviceProperties() const { return deviceProperties; }
 		VkPhysicalDeviceLimits GetDeviceLimits() const { return deviceProperties.limits; }
 		VkPhysicalDeviceMemoryProperties GetMemoryProperties() const { return gpuMemoryProperties; }
 
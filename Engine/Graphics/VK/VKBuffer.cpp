@@ -45,7 +45,7 @@ namespace Engine
 				VkMemoryRequirements memReqs;
 				vkGetBufferMemoryRequirements(device, stagingBuffer, &memReqs);
 
-				allocator->Allocate(stagingAlloc, memReqs.size, vkutils::FindMemoryType(physicalDevice, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT), false);
+				allocator->Allocate(stagingAlloc, memReqs.size, memReqs.alignment, vkutils::FindMemoryType(physicalDevice, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT), false, false);
 
 				vkBindBufferMemory(device, stagingBuffer, stagingAlloc.memory, stagingAlloc.offset);			// If offset non-zero then it's required to be divisible by memReqs.alignment
 
@@ -91,7 +91,7 @@ namespace Engine
 				VkMemoryRequirements memReqs;
 				vkGetBufferMemoryRequirements(device, stagingBuffer, &memReqs);
 
-				allocator->Allocate(stagingAlloc, memReqs.size, vkutils::FindMemoryType(physicalDevice, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT), false);
+				allocator->Allocate(stagingAlloc, memReqs.size, memReqs.alignment, vkutils::FindMemoryType(physicalDevice, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT), false, false);
 
 				vkBindBufferMemory(device, stagingBuffer, stagingAlloc.memory, stagingAlloc.offset);			// If offset non-zero then it's required to be divisible by memReqs.alignment
 
@@ -156,10 +156,11 @@ namespace Engine
 		}
 		else if (type == BufferType::ShaderStorageBuffer)
 		{
+			// Storage buffers can also be bound as vertex buffers so a compute shader can write per instance data, eg the culled vegetation instances
 			// IF DATA IS NOT NULL USE HOST_COHERENT. ADD STAGING BUFFER INSTEAD TO UPLOAD TO DEVICE_LOCAL
 			if (usage == BufferUsage::DYNAMIC || data != nullptr)
 			{
-				Create(physicalDevice, (VkDeviceSize)size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, true);
+				Create(physicalDevice, (VkDeviceSize)size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, true);
 				Map();
 				if (data)
 				{
@@ -169,7 +170,7 @@ namespace Engine
 			}
 			else if (usage == BufferUsage::STATIC)
 			{
-				Create(physicalDevice, (VkDeviceSize)size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+				Create(physicalDevice, (VkDeviceSize)size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
 			}
 		}
 	}
@@ -202,7 +203,7 @@ namespace Engine
 		//this->size = memReqs.size;
 		alignedSize = memReqs.size;
 
-		allocator->Allocate(alloc, memReqs.size, vkutils::FindMemoryType(physicalDevice, memReqs.memoryTypeBits, properties), exclusiveAlloc);
+		allocator->Allocate(alloc, memReqs.size, memReqs.alignment, vkutils::FindMemoryType(physicalDevice, memReqs.memoryTypeBits, properties), false, exclusiveAlloc);
 
 		// Associate memory with the buffer
 		vkBindBufferMemory(device, buffer, alloc.memory, alloc.offset);			// If offset non-zero then it's required to be divisible by memReqs.alignment
@@ -22,9 +22,13 @@
 
 #include <array>
 #include <iostream>
+#include <cstdio>
+#include <cstring>
 
 namespace Engine
 {
+	static const char *PIPELINE_CACHE_PATH = "Data/Shaders/Vulkan/pipeline_cache.data";
+
 	VKRenderer::VKRenderer(FileManager *fileManager, GLFWwindow *window, unsigned int width, unsigned int height, unsigned int monitorWidth, unsigned int monitorHeight)
 	{
 		this->fileManager = fileManager;
@@ -52,10 +56,14 @@ namespace Engine
 		mappedInstanceData = nullptr;
 		instanceDataOffset = 0;
 		instanceDataBufferSingleSize = 0;
+		instanceDataOverflow = 0;
 		currentFrame = 0;
 		currentCamera = 0;
 		cameraUBOData = nullptr;
 		cameraUBO = nullptr;
+		pipelineCache = VK_NULL_HANDLE;
+		pendingPipelines = 0;
+		stopPipelineThread = false;
 		singleCameraAlignedSize = 0;
 		allCamerasAlignedSize = 0;
 		framesWaitedToRemove = 0;
@@ -84,6 +92,9 @@ namespace Engine
 
 		std::cout << "Max push constant size: " << base.GetDeviceLimits().maxPushConstantsSize << '\n';
 
+		LoadPipelineCache();
+		pipelineThread = std::thread(&VKRenderer::PipelineThreadLoop, this);
+
 		swapChain.Init(base.GetAllocator(), physicalDevice, surface, device, width, height);
 
 		if (!CreateDefaultRenderPass())
@@ -630,6 +641,9 @@ namespace Engine
 		if (this->width = width && this->height == height)
 			return;
 
+		// The queued pipelines use the render passes of the framebuffers
+		WaitForPipelines();
+
 		VkDevice device = base.GetDevice();
 		vkDeviceWaitIdle(device);
 
@@ -781,11 +795,32 @@ namespace Engine
 
 	void VKRenderer::Submit(const RenderQueue &renderQueue)
 	{
+		const char *frameEnd = (char*)instanceDataSSBO->Mapped() + (currentFrame + 1) * instanceDataBufferSingleSize;
+
 		for (size_t i = 0; i < renderQueue.size(); i++)
 		{
 			// Copy the transform and the mesh data
 			const RenderItem &ri = renderQueue[i];
 
+			unsigned int size = 0;
+			if (ri.transform)
+				size += sizeof(glm::mat4);
+			if (ri.instanceData)
+				size += ri.instanceDataSize;
+			if (ri.meshParams)
+				size += ri.meshParamsSize;
+
+			// Writing past the frame region would overwrite the data of a frame the gpu might still be reading
+			// The items that don't fit are skipped this frame and the buffer grows before the next one
+			if (mappedInstanceData + size > frameEnd)
+			{
+				if (instanceDataOverflow == 0)
+					Log::Print(LogLevel::LEVEL_WARNING, "Instance data buffer full, skipping render items and growing it next frame\n");
+
+				instanceDataOverflow += size;
+				continue;
+			}
+
 			if (ri.transform)
 			{
 				//mapped = (char*)ri.transform;
@@ -810,6 +845,12 @@ namespace Engine
 
 	void VKRenderer::Submit(const RenderItem &renderItem)
 	{
+		if (renderItem.indirectBuffer)
+		{
+			SubmitIndirect(renderItem, renderItem.indirectBuffer);
+			return;
+		}
+
 		const std::vector<Buffer*> &vbs = renderItem.mesh->vao->GetVertexBuffers();
 		VKBuffer* ib = static_cast<VKBuffer*>(renderItem.mesh->vao->GetIndexBuffer());
 
@@ -825,6 +866,18 @@ namespace Engine
 		VkPipeline pipeline = pipelines[pass.pipelineID];
 		const VkCommandBuffer &cb = frameResources[currentFrame].frameCmdBuffer;
 
+		// The pipeline is still being created so skip the draw, but the instance data was already written so keep the offset in sync
+		if (pipeline == VK_NULL_HANDLE)
+		{
+			if (renderItem.transform)
+				instanceDataOffset += 1;
+			else if (renderItem.instanceData)
+				instanceDataOffset += renderItem.instanceDataSize / sizeof(glm::mat4);
+
+			instanceDataOffset += renderItem.meshParamsSize / sizeof(glm::mat4);
+			return;
+		}
+
 		//if (pipeline != curPipeline)
 		vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);		// TODO: Sort pipelines
 		vkCmdBindVertexBuffers(cb, 0, vertexBuffers.size(), vertexBuffers.data(), vbOffsets.data());
@@ -911,6 +964,9 @@ namespace Engine
 		VkPipeline pipeline = pipelines[pass.pipelineID];
 		const VkCommandBuffer &cb = frameResources[currentFrame].frameCmdBuffer;
 
+		if (pipeline == VK_NULL_HANDLE)
+			return;
+
 		vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);		// TODO: Sort pipelines
 		vkCmdBindVertexBuffers(cb, 0, vertexBuffers.size(), vertexBuffers.data(), vbOffsets.data());
 
@@ -929,11 +985,11 @@ namespace Engine
 		if (ib)
 		{
 			vkCmdBindIndexBuffer(cb, ib->GetBuffer(), 0, VK_INDEX_TYPE_UINT16);
-			vkCmdDrawIndexedIndirect(cb, indBuffer->GetBuffer(), 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+			vkCmdDrawIndexedIndirect(cb, indBuffer->GetBuffer(), renderItem.indirectOffset, 1, sizeof(VkDrawIndexedIndirectCommand));
 		}
 		else
 		{
-			vkCmdDrawIndirect(cb, indBuffer->GetBuffer(), 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+			vkCmdDrawIndirect(cb, indBuffer->GetBuffer(), renderItem.indirectOffset, 1, sizeof(VkDrawIndexedIndirectCommand));
 		}
 
 		curPipeline = pipeline;
@@ -1564,11 +1620,17 @@ namespace Engine
 					bmb.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
 					bmb.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
 				}
-				else
+				else if (barrier.dstStage & PipelineStage::INDIRECT)
 				{
 					bmb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
 					bmb.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
 				}
+				else
+				{
+					// Another compute shader keeps writing the commands, eg after they were reset
+					bmb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+					bmb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+				}
 				
 				bmb.buffer = buf->GetBuffer();
 				bmb.offset = 0;
@@ -1582,11 +1644,17 @@ namespace Engine
 				{
 					bmb.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
 					bmb.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+					if (barrier.srcStage & PipelineStage::VERTEX_INPUT)
+						bmb.srcAccessMask |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
 				}
 				else
 				{
 					bmb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
 					bmb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+					if (barrier.dstStage & PipelineStage::VERTEX_INPUT)
+						bmb.dstAccessMask |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
 				}
 
 				bmb.buffer = buf->GetBuffer();
@@ -1612,6 +1680,8 @@ namespace Engine
 			srcStage |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 		if (barrier.srcStage & DEPTH_STENCIL_WRITE)
 			srcStage |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		if (barrier.srcStage & VERTEX_INPUT)
+			srcStage |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
 
 		if (barrier.dstStage & INDIRECT)
 			dstStage |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
@@ -1625,6 +1695,8 @@ namespace Engine
 			dstStage |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 		if (barrier.dstStage & DEPTH_STENCIL_WRITE)
 			dstStage |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		if (barrier.dstStage & VERTEX_INPUT)
+			dstStage |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
 
 		
 		vkCmdPipelineBarrier(frameResources[currentFrame].frameCmdBuffer, srcStage, dstStage,
@@ -1765,6 +1837,8 @@ namespace Engine
 	{
 		currentCamera = 0;
 
+		ApplyFinishedPipelines();
+
 		VkDevice device = base.GetDevice();
 
 		if (needsTransfers)
@@ -1799,6 +1873,9 @@ namespace Engine
 		/*vkWaitForFences(device, 1, &frameResources[currentFrame].computeFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
 		vkResetFences(device, 1, &frameResources[currentFrame].computeFence);*/
 
+		if (instanceDataOverflow > 0)
+			GrowInstanceDataBuffer();
+
 		// Update this frame descriptor sets before we begin the command buffer
 		UpdateDescriptorSets();
 
@@ -2009,6 +2086,7 @@ namespace Engine
 	void VKRenderer::ReloadShaders()
 	{
 		// We can use this because reloading shaders will only happen when focusing on the editor
+		WaitForPipelines();
 		vkDeviceWaitIdle(base.GetDevice());
 
 		Log::Print(LogLevel::LEVEL_INFO, "Reloading shaders...\n");
@@ -2112,6 +2190,19 @@ namespace Engine
 	{
 		VkDevice device = base.GetDevice();
 
+		if (pipelineThread.joinable())
+		{
+			WaitForPipelines();
+
+			{
+				std::lock_guard<std::mutex> lock(pipelineMutex);
+				stopPipelineThread = true;
+			}
+
+			pipelineCondition.notify_one();
+			pipelineThread.join();
+		}
+
 		vkDeviceWaitIdle(device);
 
 		for (auto it = shaderPrograms.begin(); it != shaderPrograms.end(); it++)
@@ -2179,6 +2270,14 @@ namespace Engine
 		{
 			vkDestroyPipeline(device, pipelines[i], nullptr);
 		}
+		pipelines.clear();
+
+		if (pipelineCache != VK_NULL_HANDLE)
+		{
+			SavePipelineCache();
+			vkDestroyPipelineCache(device, pipelineCache, nullptr);
+			pipelineCache = VK_NULL_HANDLE;
+		}
 		for (size_t i = 0; i < computePipelineLayouts.size(); i++)
 		{
 			vkDestroyPipelineLayout(device, computePipelineLayouts[i], nullptr);
@@ -2399,7 +2498,7 @@ namespace Engine
 			pipelineInfo.layout = pipelineLayout;
 			pipelineInfo.stage = s->GetComputeStageInfo();
 
-			if (vkCreateComputePipelines(base.GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+			if (vkCreateComputePipelines(base.GetDevice(), pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
 			{
 				Log::Print(LogLevel::LEVEL_ERROR, "Failed to create graphics pipeline!\n");
 				return false;
@@ -2409,6 +2508,11 @@ namespace Engine
 		}
 		else
 		{
+			GraphicsPipelineState *state = new GraphicsPipelineState();
+			state->pipelineID = reload ? p.pipelineID : static_cast<unsigned int>(pipelines.size());
+			state->shader = static_cast<VKShader*>(p.shader);
+			state->pipeline = VK_NULL_HANDLE;
+
 			// Find the render pass
 			VkRenderPass renderPass = VK_NULL_HANDLE;
 			VKFramebuffer *fb = nullptr;
@@ -2431,37 +2535,35 @@ namespace Engine
 			}
 
 			// Vertex input
-			std::vector<VkVertexInputBindingDescription> bindings;
-			std::vector<VkVertexInputAttributeDescription> attribs;
-			CreateVertexInputState(p.vertexInputDescs, bindings, attribs);
+			CreateVertexInputState(p.vertexInputDescs, state->bindings, state->attribs);
 
-			VkPipelineVertexInputStateCreateInfo vertexInput = vkutils::init::VertexInput(bindings.size(), bindings.data(), attribs.size(), attribs.data());
+			state->vertexInput = vkutils::init::VertexInput(state->bindings.size(), state->bindings.data(), state->attribs.size(), state->attribs.data());
 			// Input assembly
-			VkPipelineInputAssemblyStateCreateInfo inputAssembly = vkutils::init::InputAssembly(static_cast<VkPrimitiveTopology>(p.topology), 0);
+			state->inputAssembly = vkutils::init::InputAssembly(static_cast<VkPrimitiveTopology>(p.topology), 0);
 			// Rasterization
-			VkPipelineRasterizationStateCreateInfo rasterization = vkutils::init::Rasterization(VK_POLYGON_MODE_FILL, static_cast<VkCullModeFlags>(p.rasterizerState.cullFace), static_cast<VkFrontFace>(p.rasterizerState.frontFace));
+			state->rasterization = vkutils::init::Rasterization(VK_POLYGON_MODE_FILL, static_cast<VkCullModeFlags>(p.rasterizerState.cullFace), static_cast<VkFrontFace>(p.rasterizerState.frontFace));
 
 			if (p.topology == 1)
-				rasterization.lineWidth = 2.0f;
+				state->rasterization.lineWidth = 2.0f;
 
 
 			// Multisample
-			VkPipelineMultisampleStateCreateInfo multisample = vkutils::init::Multisample(VK_SAMPLE_COUNT_1_BIT);
+			state->multisample = vkutils::init::Multisample(VK_SAMPLE_COUNT_1_BIT);
 			// Blend attachment
-			VkPipelineColorBlendAttachmentState blendAttachment = vkutils::init::BlendAttachment(p.blendState.enableBlending);
+			state->blendAttachment = vkutils::init::BlendAttachment(p.blendState.enableBlending);
 
 			if (!p.blendState.enableColorWriting)
-				blendAttachment.colorWriteMask = 0;
+				state->blendAttachment.colorWriteMask = 0;
 
 			// Blend state
-			VkPipelineColorBlendStateCreateInfo blendState = vkutils::init::BlendState(1, &blendAttachment);
+			state->blendState = vkutils::init::BlendState(1, &state->blendAttachment);
 			if (fbIndex < framebuffers.size())
 			{
 				if (framebuffers[fbIndex]->IsDepthOnly())
-					blendState = vkutils::init::BlendState(0, nullptr);
+					state->blendState = vkutils::init::BlendState(0, nullptr);
 			}
 			// Depth stencil
-			VkPipelineDepthStencilStateCreateInfo depthStencil = vkutils::init::DepthStencil(p.depthStencilState.depthEnable, p.depthStencilState.depthWrite, static_cast<VkCompareOp>(p.depthStencilState.depthFunc));
+			state->depthStencil = vkutils::init::DepthStencil(p.depthStencilState.depthEnable, p.depthStencilState.depthWrite, static_cast<VkCompareOp>(p.depthStencilState.depthFunc));
 
 			VkExtent2D extent;
 			if (fb)
@@ -2474,7 +2576,8 @@ namespace Engine
 				extent = swapChain.GetExtent();
 			}
 
-			VkViewport viewport = {};
+			VkViewport &viewport = state->viewport;
+			viewport = {};
 			viewport.x = 0.0f;
 			viewport.y = 0.0f;
 			viewport.width = (float)extent.width;
@@ -2483,7 +2586,8 @@ namespace Engine
 			viewport.maxDepth = 1.0f;
 
 			// Scissor
-			VkRect2D scissor = {};
+			VkRect2D &scissor = state->scissor;
+			scissor = {};
 			scissor.offset = { 0, 0 };
 			scissor.extent = { static_cast<uint32_t>(monitorWidth), static_cast<uint32_t>(monitorHeight) };		// Set the scissor to the monitor resolution. Like this we don't have to worry about dynamic scissor or when resizing
 			if (extent.width > monitorWidth)
@@ -2496,7 +2600,8 @@ namespace Engine
 			}
 
 
-			VkPipelineViewportStateCreateInfo viewportState = {};
+			VkPipelineViewportStateCreateInfo &viewportState = state->viewportState;
+			viewportState = {};
 			viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 			viewportState.viewportCount = 1;
 			viewportState.pViewports = &viewport;
@@ -2504,22 +2609,24 @@ namespace Engine
 			viewportState.pScissors = &scissor;
 
 			// Dynamic state
-			VkDynamicState dynamicState[] = { VK_DYNAMIC_STATE_VIEWPORT };
+			state->dynamicState = VK_DYNAMIC_STATE_VIEWPORT;
 
-			VkPipelineDynamicStateCreateInfo dynamicInfo = {};
+			VkPipelineDynamicStateCreateInfo &dynamicInfo = state->dynamicInfo;
+			dynamicInfo = {};
 			dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-			dynamicInfo.pDynamicStates = dynamicState;
+			dynamicInfo.pDynamicStates = &state->dynamicState;
 			dynamicInfo.dynamicStateCount = 1;
 			dynamicInfo.flags = 0;
 
-			VkGraphicsPipelineCreateInfo pipelineInfo = {};
+			VkGraphicsPipelineCreateInfo &pipelineInfo = state->pipelineInfo;
+			pipelineInfo = {};
 			pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-			pipelineInfo.pInputAssemblyState = &inputAssembly;
+			pipelineInfo.pInputAssemblyState = &state->inputAssembly;
 			pipelineInfo.pViewportState = &viewportState;
-			pipelineInfo.pRasterizationState = &rasterization;
-			pipelineInfo.pMultisampleState = &multisample;
-			pipelineInfo.pDepthStencilState = &depthStencil;
-			pipelineInfo.pColorBlendState = &blendState;
+			pipelineInfo.pRasterizationState = &state->rasterization;
+			pipelineInfo.pMultisampleState = &state->multisample;
+			pipelineInfo.pDepthStencilState = &state->depthStencil;
+			pipelineInfo.pColorBlendState = &state->blendState;
 			pipelineInfo.pDynamicState = &dynamicInfo;
 			pipelineInfo.layout = graphicsPipelineLayout;
 			pipelineInfo.renderPass = renderPass;
@@ -2528,49 +2635,29 @@ namespace Engine
 			pipelineInfo.basePipelineIndex = -1;
 
 			if (p.vertexInputDescs.size() > 0)
-				pipelineInfo.pVertexInputState = &vertexInput;
+				pipelineInfo.pVertexInputState = &state->vertexInput;
 			else
 				pipelineInfo.pVertexInputState = nullptr;
 
-
-			// Compile the shader instead of loading the spirv so that we can set flags. Could use a bool to know if we load or compile shader. Eg compile when in editor but don't compile when loading a game
-			VKShader *s = static_cast<VKShader*>(p.shader);
-			if(!s->Compile(base.GetDevice()))
-				return false;
-
-			if (!s->CreateShaderModule(base.GetDevice()))
+			// Compiling the shader and creating the pipeline can take a while so it's done on the pipeline thread and the material load doesn't stall the frame.
+			// Reloads only happen in the editor with the device idle so they're created right away
+			if (!reload)
 			{
-				Log::Print(LogLevel::LEVEL_ERROR, "Failed to create shader modules!");
-				return false;
-			}
+				pipelines.push_back(VK_NULL_HANDLE);
 
-			if (s->HasGeometry())
-			{
-				VkPipelineShaderStageCreateInfo shaderStages[] = { s->GetVertexStageInfo(), s->GetGeometryStageInfo(), s->GetFragmentStageInfo() };
-				pipelineInfo.stageCount = 3;
-				pipelineInfo.pStages = shaderStages;
+				std::lock_guard<std::mutex> lock(pipelineMutex);
+				queuedPipelines.push_back(state);
+				pendingPipelines++;
+				pipelineCondition.notify_one();
 
-				if (vkCreateGraphicsPipelines(base.GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
-				{
-					Log::Print(LogLevel::LEVEL_ERROR, "Failed to create graphics pipeline!\n");
-					return false;
-				}
+				return true;
 			}
-			else
-			{
-				VkPipelineShaderStageCreateInfo shaderStages[] = { s->GetVertexStageInfo(), s->GetFragmentStageInfo() };			
-				pipelineInfo.stageCount = 2;
-				pipelineInfo.pStages = shaderStages;
 
-				if (vkCreateGraphicsPipelines(base.GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
-				{
-					Log::Print(LogLevel::LEVEL_ERROR, "Failed to create graphics pipeline!\n");
-					return false;
-				}
-			}
+			pipeline = CreateGraphicsPipeline(*state);
+			delete state;
 
-			// We don't need the shader modules after pipeline creation
-			s->Dispose(base.GetDevice());
+			if (pipeline == VK_NULL_HANDLE)
+				return false;
 		}
 		
 		if (reload)
@@ -2587,6 +2674,202 @@ namespace Engine
 		return true;
 	}
 
+	VkPipeline VKRenderer::CreateGraphicsPipeline(GraphicsPipelineState &state)
+	{
+		// Compile the shader instead of loading the spirv so that we can set flags. Could use a bool to know if we load or compile shader. Eg compile when in editor but don't compile when loading a game
+		VKShader *s = state.shader;
+		if (!s->Compile(base.GetDevice()))
+			return VK_NULL_HANDLE;
+
+		if (!s->CreateShaderModule(base.GetDevice()))
+		{
+			Log::Print(LogLevel::LEVEL_ERROR, "Failed to create shader modules!");
+			return VK_NULL_HANDLE;
+		}
+
+		VkPipelineShaderStageCreateInfo shaderStages[3];
+		shaderStages[0] = s->GetVertexStageInfo();
+
+		if (s->HasGeometry())
+		{
+			shaderStages[1] = s->GetGeometryStageInfo();
+			shaderStages[2] = s->GetFragmentStageInfo();
+			state.pipelineInfo.stageCount = 3;
+		}
+		else
+		{
+			shaderStages[1] = s->GetFragmentStageInfo();
+			state.pipelineInfo.stageCount = 2;
+		}
+
+		state.pipelineInfo.pStages = shaderStages;
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		if (vkCreateGraphicsPipelines(base.GetDevice(), pipelineCache, 1, &state.pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+		{
+			Log::Print(LogLevel::LEVEL_ERROR, "Failed to create graphics pipeline!\n");
+			pipeline = VK_NULL_HANDLE;
+		}
+
+		// We don't need the shader modules after pipeline creation
+		s->Dispose(base.GetDevice());
+
+		return pipeline;
+	}
+
+	void VKRenderer::PipelineThreadLoop()
+	{
+		while (true)
+		{
+			GraphicsPipelineState *state = nullptr;
+
+			{
+				std::unique_lock<std::mutex> lock(pipelineMutex);
+				pipelineCondition.wait(lock, [this]() { return stopPipelineThread || queuedPipelines.size() > 0; });
+
+				// Only stop once the queue is empty, the states would leak otherwise
+				if (queuedPipelines.size() == 0)
+					return;
+
+				state = queuedPipelines.front();
+				queuedPipelines.pop_front();
+			}
+
+			state->pipeline = CreateGraphicsPipeline(*state);
+
+			{
+				std::lock_guard<std::mutex> lock(pipelineMutex);
+				finishedPipelines.push_back(state);
+				pendingPipelines--;
+			}
+
+			pipelinesDoneCondition.notify_all();
+		}
+	}
+
+	void VKRenderer::ApplyFinishedPipelines()
+	{
+		std::vector<GraphicsPipelineState*> finished;
+
+		{
+			std::lock_guard<std::mutex> lock(pipelineMutex);
+			finished.swap(finishedPipelines);
+		}
+
+		for (size_t i = 0; i < finished.size(); i++)
+		{
+			GraphicsPipelineState *state = finished[i];
+
+			// A pipeline that failed stays VK_NULL_HANDLE so its draws keep being skipped
+			if (state->pipeline == VK_NULL_HANDLE)
+				Log::Print(LogLevel::LEVEL_ERROR, "Pipeline %u failed to be created, its draws will be skipped\n", state->pipelineID);
+			else
+				pipelines[state->pipelineID] = state->pipeline;
+
+			delete state;
+		}
+	}
+
+	void VKRenderer::WaitForPipelines()
+	{
+		{
+			std::unique_lock<std::mutex> lock(pipelineMutex);
+			pipelinesDoneCondition.wait(lock, [this]() { return pendingPipelines == 0; });
+		}
+
+		ApplyFinishedPipelines();
+	}
+
+	void VKRenderer::LoadPipelineCache()
+	{
+		std::vector<unsigned char> data;
+
+		FILE *file = fopen(PIPELINE_CACHE_PATH, "rb");
+		if (file)
+		{
+			fseek(file, 0, SEEK_END);
+			const long size = ftell(file);
+			fseek(file, 0, SEEK_SET);
+
+			if (size > 0)
+			{
+				data.resize(static_cast<size_t>(size));
+				if (fread(data.data(), 1, data.size(), file) != data.size())
+					data.clear();
+			}
+
+			fclose(file);
+		}
+
+		// Only use the data if it was saved by the same device and driver. The driver should also reject it but some don't check
+		if (data.size() > 0)
+		{
+			const VkPhysicalDeviceProperties &props = base.GetDeviceProperties();
+
+			uint32_t header[4] = {};		// Header length, header version, vendor id and device id
+			bool valid = data.size() >= sizeof(header) + VK_UUID_SIZE;
+
+			if (valid)
+			{
+				memcpy(header, data.data(), sizeof(header));
+				valid = header[0] >= sizeof(header) + VK_UUID_SIZE && header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header[2] == props.vendorID && header[3] == props.deviceID &&
+					memcmp(data.data() + sizeof(header), props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+			}
+
+			if (!valid)
+			{
+				Log::Print(LogLevel::LEVEL_INFO, "Pipeline cache was created by a different device or driver, ignoring it\n");
+				data.clear();
+			}
+		}
+
+		VkPipelineCacheCreateInfo cacheInfo = {};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.size() > 0 ? data.data() : nullptr;
+
+		if (vkCreatePipelineCache(base.GetDevice(), &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+		{
+			// Try again with an empty cache in case the data was the problem
+			cacheInfo.initialDataSize = 0;
+			cacheInfo.pInitialData = nullptr;
+
+			if (vkCreatePipelineCache(base.GetDevice(), &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+			{
+				Log::Print(LogLevel::LEVEL_ERROR, "Failed to create pipeline cache\n");
+				pipelineCache = VK_NULL_HANDLE;
+			}
+		}
+		else
+		{
+			Log::Print(LogLevel::LEVEL_INFO, "Loaded pipeline cache with %u bytes\n", static_cast<unsigned int>(data.size()));
+		}
+	}
+
+	void VKRenderer::SavePipelineCache()
+	{
+		if (pipelineCache == VK_NULL_HANDLE)
+			return;
+
+		size_t size = 0;
+		if (vkGetPipelineCacheData(base.GetDevice(), pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0)
+			return;
+
+		std::vector<unsigned char> data(size);
+		if (vkGetPipelineCacheData(base.GetDevice(), pipelineCache, &size, data.data()) != VK_SUCCESS)
+			return;
+
+		FILE *file = fopen(PIPELINE_CACHE_PATH, "wb");
+		if (!file)
+		{
+			Log::Print(LogLevel::LEVEL_WARNING, "Failed to save the pipeline cache to %s\n", PIPELINE_CACHE_PATH);
+			return;
+		}
+
+		fwrite(data.data(), 1, size, file);
+		fclose(file);
+	}
+
 	bool VKRenderer::CreateDefaultRenderPass()
 	{
 		if (defaultRenderPass != VK_NULL_HANDLE)
@@ -2740,6 +3023,41 @@ namespace Engine
 		needsTransfers = true;
 	}
 
+	void VKRenderer::GrowInstanceDataBuffer()
+	{
+		// Every frame in flight uses the buffer
+		vkDeviceWaitIdle(base.GetDevice());
+
+		const unsigned int requiredSize = instanceDataBufferSingleSize + instanceDataOverflow;
+		while (instanceDataBufferSingleSize < requiredSize)
+			instanceDataBufferSingleSize *= 2;
+
+		instanceDataOverflow = 0;
+
+		delete instanceDataSSBO;
+		instanceDataSSBO = new VKBuffer(&base, nullptr, instanceDataBufferSingleSize * MAX_FRAMES_IN_FLIGHT, BufferType::ShaderStorageBuffer, BufferUsage::DYNAMIC);
+
+		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			VkDescriptorBufferInfo info = {};
+			info.buffer = instanceDataSSBO->GetBuffer();
+			info.offset = static_cast<VkDeviceSize>(i * instanceDataBufferSingleSize);
+			info.range = static_cast<VkDeviceSize>(instanceDataBufferSingleSize);
+
+			VkWriteDescriptorSet write = {};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.dstBinding = INSTANCE_DATA_SSBO;
+			write.dstSet = frameResources[i].globalBuffersSet;
+			write.pBufferInfo = &info;
+
+			vkUpdateDescriptorSets(base.GetDevice(), 1, &write, 0, nullptr);
+		}
+
+		Log::Print(LogLevel::LEVEL_INFO, "Instance data buffer grown to %u KiB per frame\n", instanceDataBufferSingleSize / 1024);
+	}
+
 	void VKRenderer::UpdateDescriptorSets()
 	{
 		for (size_t i = 0; i < setsToUpdate[currentFrame].size(); i++)
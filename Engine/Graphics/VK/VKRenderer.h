@@ -6,9 +6,15 @@
 #include "VKFramebuffer.h"
 #include "Graphics/UniformBufferTypes.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
 namespace Engine
 {
 	class VKTexture2D;
+	class VKShader;
 
 	enum class PipelineType
 	{
@@ -31,6 +37,31 @@ namespace Engine
 		uint32_t mips;
 	};
 
+	// Everything a graphics pipeline needs so it can be created on the pipeline thread after CreatePipeline returns.
+	// Allocated on the heap because the create info points to the other members
+	struct GraphicsPipelineState
+	{
+		unsigned int pipelineID;
+		VKShader *shader;
+		VkPipeline pipeline;
+
+		std::vector<VkVertexInputBindingDescription> bindings;
+		std::vector<VkVertexInputAttributeDescription> attribs;
+		VkPipelineVertexInputStateCreateInfo vertexInput;
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+		VkPipelineRasterizationStateCreateInfo rasterization;
+		VkPipelineMultisampleStateCreateInfo multisample;
+		VkPipelineColorBlendAttachmentState blendAttachment;
+		VkPipelineColorBlendStateCreateInfo blendState;
+		VkPipelineDepthStencilStateCreateInfo depthStencil;
+		VkViewport viewport;
+		VkRect2D scissor;
+		VkPipelineViewportStateCreateInfo viewportState;
+		VkDynamicState dynamicState;
+		VkPipelineDynamicStateCreateInfo dynamicInfo;
+		VkGraphicsPipelineCreateInfo pipelineInfo;
+	};
+
 	class VKRenderer : public Renderer
 	{
 	public:
@@ -47,6 +78,8 @@ namespace Engine
 		void Present() override;
 		void WaitIdle() override;
 
+		bool SupportsIndirectFirstInstance() const override { return base.GetDeviceFeatures().drawIndirectFirstInstance == VK_TRUE; }
+
 		VertexArray *CreateVertexArray(const VertexInputDesc &desc, Buffer *vertexBuffer, Buffer *indexBuffer) override;
 		VertexArray *CreateVertexArray(const VertexInputDesc *descs, unsigned int descCount, const std::vector<Buffer*> &vertexBuffers, Buffer *indexBuffer) override;
 		Buffer *CreateVertexBuffer(const void *data, unsigned int size, BufferUsage usage) override;
@@ -113,10 +146,21 @@ namespace Engine
 
 		void CreateVertexInputState(const std::vector<VertexInputDesc> &descs, std::vector<VkVertexInputBindingDescription> &bindings, std::vector<VkVertexInputAttributeDescription> &attribs);
 		bool CreatePipeline(ShaderPass &p, MaterialInstance *mat, bool reload = false);
+		// Compiles the shader and creates the pipeline. Called on the pipeline thread unless the pipeline is created synchronously
+		VkPipeline CreateGraphicsPipeline(GraphicsPipelineState &state);
+		void PipelineThreadLoop();
+		// Replaces the placeholders of the pipelines the pipeline thread has finished
+		void ApplyFinishedPipelines();
+		// Blocks until every queued pipeline is created
+		void WaitForPipelines();
+		void LoadPipelineCache();
+		void SavePipelineCache();
 		bool CreateDefaultRenderPass();
 		void PrepareTexture2D(VKTexture2D *tex);
 		void PrepareTexture3D(VKTexture3D *tex);
 		void UpdateDescriptorSets();
+		// Recreates the instance data buffer big enough for the data that didn't fit last frame. Waits for the gpu so it's only done at a frame boundary
+		void GrowInstanceDataBuffer();
 		void CreateSetForMaterialInstance(MaterialInstance *matInst, PipelineType pipeType);
 
 	private:
@@ -169,7 +213,17 @@ namespace Engine
 		std::vector<VKBuffer*> ubos;
 		std::vector<VKBuffer*> drawIndirectBufs;
 		std::vector<VKBuffer*> ssbos;
-		std::vector<VkPipeline> pipelines;
+		std::vector<VkPipeline> pipelines;			// Pipelines that are still being created are VK_NULL_HANDLE and the draws that use them are skipped
+
+		VkPipelineCache pipelineCache;
+		std::thread pipelineThread;
+		std::mutex pipelineMutex;
+		std::condition_variable pipelineCondition;
+		std::condition_variable pipelinesDoneCondition;
+		std::deque<GraphicsPipelineState*> queuedPipelines;
+		std::vector<GraphicsPipelineState*> finishedPipelines;
+		unsigned int pendingPipelines;			// Queued plus the one being created
+		bool stopPipelineThread;
 
 		//std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
 		//std::vector<VkWriteDescriptorSet> globalSetWrites;
@@ -183,6 +237,7 @@ namespace Engine
 		VKBuffer* instanceDataSSBO;
 		unsigned int instanceDataOffset;
 		unsigned int instanceDataBufferSingleSize;
+		unsigned int instanceDataOverflow;			// Bytes of the render items that didn't fit in the buffer this frame
 		char *mappedInstanceData;
 		
 		VkPipeline curPipeline;
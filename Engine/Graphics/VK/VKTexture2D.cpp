@@ -423,7 +423,7 @@ namespace Engine
 		VkMemoryRequirements memReqs;
 		vkGetImageMemoryRequirements(device, image, &memReqs);
 
-		allocator->Allocate(alloc, memReqs.size, vkutils::FindMemoryType(physicalDevice, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), false);
+		allocator->Allocate(alloc, memReqs.size, memReqs.alignment, vkutils::FindMemoryType(physicalDevice, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), true, false);
 
 		vkBindImageMemory(device, image, alloc.memory, alloc.offset);
 
@@ -0,0 +1,557 @@
+#include "AABBTree.h"
+
+#include "Graphics/Camera/Frustum.h"
+#include "Program/Utils.h"
+
+#include <cassert>
+
+namespace Engine
+{
+	static AABB Combine(const AABB &a, const AABB &b)
+	{
+		return AABB{ glm::min(a.min, b.min), glm::max(a.max, b.max) };
+	}
+
+	// Insertion cost of the surface area heuristic
+	static float SurfaceArea(const AABB &aabb)
+	{
+		glm::vec3 d = aabb.max - aabb.min;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	static bool Contains(const AABB &a, const AABB &b)
+	{
+		return a.min.x <= b.min.x && a.min.y <= b.min.y && a.min.z <= b.min.z && b.max.x <= a.max.x && b.max.y <= a.max.y && b.max.z <= a.max.z;
+	}
+
+	AABBTree::AABBTree()
+	{
+		root = NULL_NODE;
+		freeList = NULL_NODE;
+		proxyCount = 0;
+		margin = 0.1f;
+	}
+
+	int AABBTree::CreateProxy(const AABB &aabb, unsigned int userData)
+	{
+		int proxyID = AllocateNode();
+
+		AABBTreeNode &n = nodes[proxyID];
+		n.aabb.min = aabb.min - glm::vec3(margin);
+		n.aabb.max = aabb.max + glm::vec3(margin);
+		n.userData = userData;
+		n.height = 0;
+
+		InsertLeaf(proxyID);
+		proxyCount++;
+
+		return proxyID;
+	}
+
+	void AABBTree::DestroyProxy(int proxyID)
+	{
+		assert(proxyID >= 0 && proxyID < (int)nodes.size() && nodes[proxyID].IsLeaf());
+
+		RemoveLeaf(proxyID);
+		FreeNode(proxyID);
+		proxyCount--;
+	}
+
+	bool AABBTree::MoveProxy(int proxyID, const AABB &aabb)
+	{
+		assert(proxyID >= 0 && proxyID < (int)nodes.size() && nodes[proxyID].IsLeaf());
+
+		// Nothing to do if the object is still inside the fat aabb
+		if (Contains(nodes[proxyID].aabb, aabb))
+			return false;
+
+		RemoveLeaf(proxyID);
+
+		nodes[proxyID].aabb.min = aabb.min - glm::vec3(margin);
+		nodes[proxyID].aabb.max = aabb.max + glm::vec3(margin);
+
+		InsertLeaf(proxyID);
+
+		return true;
+	}
+
+	void AABBTree::Clear()
+	{
+		nodes.clear();
+		root = NULL_NODE;
+		freeList = NULL_NODE;
+		proxyCount = 0;
+	}
+
+	void AABBTree::QueryFrustum(const Frustum &frustum, std::vector<unsigned int, StlLinearAllocator<unsigned int>> &out) const
+	{
+		if (root == NULL_NODE)
+			return;
+
+		// The leafs are gathered and tested in batches with the SIMD box kernel instead of one by one
+		float centerX[QUERY_LEAF_BATCH];
+		float centerY[QUERY_LEAF_BATCH];
+		float centerZ[QUERY_LEAF_BATCH];
+		float extentX[QUERY_LEAF_BATCH];
+		float extentY[QUERY_LEAF_BATCH];
+		float extentZ[QUERY_LEAF_BATCH];
+		unsigned int leafUserData[QUERY_LEAF_BATCH];
+		unsigned int visible[QUERY_LEAF_BATCH];
+		unsigned int leafCount = 0;
+
+		auto flushLeafs = [&]()
+		{
+			const BoxesSoA boxes = { centerX, centerY, centerZ, extentX, extentY, extentZ, leafCount };
+			unsigned int numVisible = frustum.CullBoxes(boxes, visible);
+			for (unsigned int i = 0; i < numVisible; i++)
+				out.push_back(leafUserData[visible[i]]);
+
+			leafCount = 0;
+		};
+
+		int stack[MAX_QUERY_STACK];
+		int stackSize = 0;
+		stack[stackSize++] = root;
+
+		while (stackSize > 0)
+		{
+			int nodeID = stack[--stackSize];
+
+			const AABBTreeNode &n = nodes[nodeID];
+
+			if (n.IsLeaf())
+			{
+				const glm::vec3 center = (n.aabb.min + n.aabb.max) * 0.5f;
+				const glm::vec3 extents = (n.aabb.max - n.aabb.min) * 0.5f;
+				centerX[leafCount] = center.x;
+				centerY[leafCount] = center.y;
+				centerZ[leafCount] = center.z;
+				extentX[leafCount] = extents.x;
+				extentY[leafCount] = extents.y;
+				extentZ[leafCount] = extents.z;
+				leafUserData[leafCount] = n.userData;
+				leafCount++;
+
+				if (leafCount == QUERY_LEAF_BATCH)
+					flushLeafs();
+
+				continue;
+			}
+
+			FrustumIntersect result = frustum.BoxInFrustum(n.aabb.min, n.aabb.max);
+
+			if (result == FrustumIntersect::OUTSIDE)
+				continue;
+
+			if (result == FrustumIntersect::INSIDE)
+			{
+				// The whole subtree is visible so there's no need to test the children
+				AddSubtreeLeafs(nodeID, out);
+			}
+			else
+			{
+				assert(stackSize + 2 <= MAX_QUERY_STACK);
+				stack[stackSize++] = n.child1;
+				stack[stackSize++] = n.child2;
+			}
+		}
+
+		if (leafCount > 0)
+			flushLeafs();
+	}
+
+	void AABBTree::QueryRay(const glm::vec3 &origin, const glm::vec3 &dir, std::vector<unsigned int> &out) const
+	{
+		if (root == NULL_NODE)
+			return;
+
+		int stack[MAX_QUERY_STACK];
+		int stackSize = 0;
+		stack[stackSize++] = root;
+
+		while (stackSize > 0)
+		{
+			int nodeID = stack[--stackSize];
+
+			const AABBTreeNode &n = nodes[nodeID];
+
+			if (!utils::RayAABBIntersection(origin, dir, n.aabb))
+				continue;
+
+			if (n.IsLeaf())
+			{
+				out.push_back(n.userData);
+			}
+			else
+			{
+				assert(stackSize + 2 <= MAX_QUERY_STACK);
+				stack[stackSize++] = n.child1;
+				stack[stackSize++] = n.child2;
+			}
+		}
+	}
+
+	void AABBTree::QuerySphere(const glm::vec3 &center, float radius, std::vector<unsigned int> &out) const
+	{
+		if (root == NULL_NODE)
+			return;
+
+		int stack[MAX_QUERY_STACK];
+		int stackSize = 0;
+		stack[stackSize++] = root;
+
+		while (stackSize > 0)
+		{
+			int nodeID = stack[--stackSize];
+
+			const AABBTreeNode &n = nodes[nodeID];
+
+			if (!utils::AABBSphereIntersection(n.aabb, center, radius))
+				continue;
+
+			if (n.IsLeaf())
+			{
+				out.push_back(n.userData);
+			}
+			else
+			{
+				assert(stackSize + 2 <= MAX_QUERY_STACK);
+				stack[stackSize++] = n.child1;
+				stack[stackSize++] = n.child2;
+			}
+		}
+	}
+
+	void AABBTree::QueryAABB(const AABB &aabb, std::vector<unsigned int> &out) const
+	{
+		if (root == NULL_NODE)
+			return;
+
+		int stack[MAX_QUERY_STACK];
+		int stackSize = 0;
+		stack[stackSize++] = root;
+
+		while (stackSize > 0)
+		{
+			int nodeID = stack[--stackSize];
+
+			const AABBTreeNode &n = nodes[nodeID];
+
+			if (!utils::AABBABBBIntersection(n.aabb, aabb))
+				continue;
+
+			if (n.IsLeaf())
+			{
+				out.push_back(n.userData);
+			}
+			else
+			{
+				assert(stackSize + 2 <= MAX_QUERY_STACK);
+				stack[stackSize++] = n.child1;
+				stack[stackSize++] = n.child2;
+			}
+		}
+	}
+
+	int AABBTree::AllocateNode()
+	{
+		// Grow the node pool and add the new nodes to the free list
+		if (freeList == NULL_NODE)
+		{
+			size_t oldCapacity = nodes.size();
+			size_t newCapacity = oldCapacity > 0 ? oldCapacity * 2 : 16;
+			nodes.resize(newCapacity);
+
+			for (size_t i = oldCapacity; i < newCapacity - 1; i++)
+			{
+				nodes[i].parent = static_cast<int>(i + 1);
+				nodes[i].height = -1;
+			}
+			nodes[newCapacity - 1].parent = NULL_NODE;
+			nodes[newCapacity - 1].height = -1;
+
+			freeList = static_cast<int>(oldCapacity);
+		}
+
+		int nodeID = freeList;
+		AABBTreeNode &n = nodes[nodeID];
+		freeList = n.parent;
+
+		n.parent = NULL_NODE;
+		n.child1 = NULL_NODE;
+		n.child2 = NULL_NODE;
+		n.height = 0;
+		n.userData = 0;
+
+		return nodeID;
+	}
+
+	void AABBTree::FreeNode(int nodeID)
+	{
+		nodes[nodeID].parent = freeList;
+		nodes[nodeID].height = -1;
+		freeList = nodeID;
+	}
+
+	void AABBTree::InsertLeaf(int leaf)
+	{
+		if (root == NULL_NODE)
+		{
+			root = leaf;
+			nodes[root].parent = NULL_NODE;
+			return;
+		}
+
+		// Find the best sibling for the new leaf
+		const AABB leafAABB = nodes[leaf].aabb;
+		int index = root;
+
+		while (!nodes[index].IsLeaf())
+		{
+			int child1 = nodes[index].child1;
+			int child2 = nodes[index].child2;
+
+			float area = SurfaceArea(nodes[index].aabb);
+			float combinedArea = SurfaceArea(Combine(nodes[index].aabb, leafAABB));
+
+			// Cost of creating a new parent for this node and the new leaf
+			float cost = 2.0f * combinedArea;
+
+			// Minimum cost of pushing the leaf further down the tree
+			float inheritanceCost = 2.0f * (combinedArea - area);
+
+			float cost1 = SurfaceArea(Combine(leafAABB, nodes[child1].aabb)) + inheritanceCost;
+			if (!nodes[child1].IsLeaf())
+				cost1 -= SurfaceArea(nodes[child1].aabb);
+
+			float cost2 = SurfaceArea(Combine(leafAABB, nodes[child2].aabb)) + inheritanceCost;
+			if (!nodes[child2].IsLeaf())
+				cost2 -= SurfaceArea(nodes[child2].aabb);
+
+			if (cost < cost1 && cost < cost2)
+				break;
+
+			index = cost1 < cost2 ? child1 : child2;
+		}
+
+		int sibling = index;
+
+		// Create a new parent. Don't keep references to nodes across AllocateNode because it can resize the nodes
+		int oldParent = nodes[sibling].parent;
+		int newParent = AllocateNode();
+		nodes[newParent].parent = oldParent;
+		nodes[newParent].aabb = Combine(leafAABB, nodes[sibling].aabb);
+		nodes[newParent].height = nodes[sibling].height + 1;
+		nodes[newParent].child1 = sibling;
+		nodes[newParent].child2 = leaf;
+		nodes[sibling].parent = newParent;
+		nodes[leaf].parent = newParent;
+
+		if (oldParent != NULL_NODE)
+		{
+			if (nodes[oldParent].child1 == sibling)
+				nodes[oldParent].child1 = newParent;
+			else
+				nodes[oldParent].child2 = newParent;
+		}
+		else
+		{
+			root = newParent;
+		}
+
+		// Walk back up the tree fixing the heights and aabbs
+		index = nodes[leaf].parent;
+		while (index != NULL_NODE)
+		{
+			index = Balance(index);
+
+			int child1 = nodes[index].child1;
+			int child2 = nodes[index].child2;
+
+			nodes[index].height = 1 + glm::max(nodes[child1].height, nodes[child2].height);
+			nodes[index].aabb = Combine(nodes[child1].aabb, nodes[child2].aabb);
+
+			index = nodes[index].parent;
+		}
+	}
+
+	void AABBTree::RemoveLeaf(int leaf)
+	{
+		if (leaf == root)
+		{
+			root = NULL_NODE;
+			return;
+		}
+
+		int parent = nodes[leaf].parent;
+		int grandParent = nodes[parent].parent;
+		int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+		if (grandParent != NULL_NODE)
+		{
+			// Destroy the parent and connect the sibling to the grand parent
+			if (nodes[grandParent].child1 == parent)
+				nodes[grandParent].child1 = sibling;
+			else
+				nodes[grandParent].child2 = sibling;
+
+			nodes[sibling].parent = grandParent;
+			FreeNode(parent);
+
+			int index = grandParent;
+			while (index != NULL_NODE)
+			{
+				index = Balance(index);
+
+				int child1 = nodes[index].child1;
+				int child2 = nodes[index].child2;
+
+				nodes[index].aabb = Combine(nodes[child1].aabb, nodes[child2].aabb);
+				nodes[index].height = 1 + glm::max(nodes[child1].height, nodes[child2].height);
+
+				index = nodes[index].parent;
+			}
+		}
+		else
+		{
+			root = sibling;
+			nodes[sibling].parent = NULL_NODE;
+			FreeNode(parent);
+		}
+	}
+
+	int AABBTree::Balance(int iA)
+	{
+		// Perform a left or right rotation if node A is imbalanced. Returns the new root of the subtree
+		AABBTreeNode &A = nodes[iA];
+		if (A.IsLeaf() || A.height < 2)
+			return iA;
+
+		int iB = A.child1;
+		int iC = A.child2;
+		AABBTreeNode &B = nodes[iB];
+		AABBTreeNode &C = nodes[iC];
+
+		int balance = C.height - B.height;
+
+		// Rotate C up
+		if (balance > 1)
+		{
+			int iF = C.child1;
+			int iG = C.child2;
+			AABBTreeNode &F = nodes[iF];
+			AABBTreeNode &G = nodes[iG];
+
+			// Swap A and C
+			C.child1 = iA;
+			C.parent = A.parent;
+			A.parent = iC;
+
+			// A's old parent should point to C
+			if (C.parent != NULL_NODE)
+			{
+				if (nodes[C.parent].child1 == iA)
+					nodes[C.parent].child1 = iC;
+				else
+					nodes[C.parent].child2 = iC;
+			}
+			else
+			{
+				root = iC;
+			}
+
+			if (F.height > G.height)
+			{
+				C.child2 = iF;
+				A.child2 = iG;
+				G.parent = iA;
+				A.aabb = Combine(B.aabb, G.aabb);
+				C.aabb = Combine(A.aabb, F.aabb);
+
+				A.height = 1 + glm::max(B.height, G.height);
+				C.height = 1 + glm::max(A.height, F.height);
+			}
+			else
+			{
+				C.child2 = iG;
+				A.child2 = iF;
+				F.parent = iA;
+				A.aabb = Combine(B.aabb, F.aabb);
+				C.aabb = Combine(A.aabb, G.aabb);
+
+				A.height = 1 + glm::max(B.height, F.height);
+				C.height = 1 + glm::max(A.height, G.height);
+			}
+
+			return iC;
+		}
+
+		// Rotate B up
+		if (balance < -1)
+		{
+			int iD = B.child1;
+			int iE = B.child2;
+			AABBTreeNode &D = nodes[iD];
+			AABBTreeNode &E = nodes[iE];
+
+			// Swap A and B
+			B.child1 = iA;
+			B.parent = A.parent;
+			A.parent = iB;
+
+			// A's old parent should point to B
+			if (B.parent != NULL_NODE)
+			{
+				if (nodes[B.parent].child1 == iA)
+					nodes[B.parent].child1 = iB;
+				else
+					nodes[B.parent].child2 = iB;
+			}
+			else
+			{
+				root = iB;
+			}
+
+			if (D.height > E.height)
+			{
+				B.child2 = iD;
+				A.child1 = iE;
+				E.parent = iA;
+				A.aabb = Combine(C.aabb, E.aabb);
+				B.aabb = Combine(A.aabb, D.aabb);
+
+				A.height = 1 + glm::max(C.height, E.height);
+				B.height = 1 + glm::max(A.height, D.height);
+			}
+			else
+			{
+				B.child2 = iE;
+				A.child1 = iD;
+				D.parent = iA;
+				A.aabb = Combine(C.aabb, D.aabb);
+				B.aabb = Combine(A.aabb, E.aabb);
+
+				A.height = 1 + glm::max(C.height, D.height);
+				B.height = 1 + glm::max(A.height, E.height);
+			}
+
+			return iB;
+		}
+
+		return iA;
+	}
+
+	void AABBTree::AddSubtreeLeafs(int nodeID, std::vector<unsigned int, StlLinearAllocator<unsigned int>> &out) const
+	{
+		const AABBTreeNode &n = nodes[nodeID];
+
+		if (n.IsLeaf())
+		{
+			out.push_back(n.userData);
+			return;
+		}
+
+		AddSubtreeLeafs(n.child1, out);
+		AddSubtreeLeafs(n.child2, out);
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "BoundingVolumes.h"
+#include "Program/LinearAllocator.h"
+
+#include <vector>
+
+namespace Engine
+{
+	class Frustum;
+
+	struct AABBTreeNode
+	{
+		AABB aabb;
+		unsigned int userData;
+		int parent;				// Used as the next free node when the node is in the free list
+		int child1;
+		int child2;
+		int height;				// Leafs have height 0, free nodes -1
+
+		bool IsLeaf() const { return child1 == -1; }
+	};
+
+	// Dynamic bounding volume hierarchy. Leafs store a fattened AABB so objects can move a bit without the tree having to be updated
+	class AABBTree
+	{
+	public:
+		AABBTree();
+
+		int CreateProxy(const AABB &aabb, unsigned int userData);
+		void DestroyProxy(int proxyID);
+		// Returns true if the proxy had to be reinserted because the aabb moved outside the fat aabb
+		bool MoveProxy(int proxyID, const AABB &aabb);
+		void Clear();
+
+		void SetUserData(int proxyID, unsigned int userData) { nodes[proxyID].userData = userData; }
+		unsigned int GetUserData(int proxyID) const { return nodes[proxyID].userData; }
+		const AABB &GetFatAABB(int proxyID) const { return nodes[proxyID].aabb; }
+		unsigned int GetProxyCount() const { return proxyCount; }
+		int GetHeight() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+
+		// The queries push the user data of the leafs whose fat aabb passes the test. They don't modify the tree so they can run in parallel.
+		// The frustum query writes to the same list type as the renderer visibility so culling can output to it directly
+		void QueryFrustum(const Frustum &frustum, std::vector<unsigned int, StlLinearAllocator<unsigned int>> &out) const;
+		void QueryRay(const glm::vec3 &origin, const glm::vec3 &dir, std::vector<unsigned int> &out) const;
+		void QuerySphere(const glm::vec3 &center, float radius, std::vector<unsigned int> &out) const;
+		void QueryAABB(const AABB &aabb, std::vector<unsigned int> &out) const;
+
+	public:
+		static const int NULL_NODE = -1;
+		// The tree is kept balanced so the traversal stack never gets close to this
+		static const int MAX_QUERY_STACK = 256;
+		// Leafs tested together by the frustum query
+		static const unsigned int QUERY_LEAF_BATCH = 16;
+
+	private:
+		int AllocateNode();
+		void FreeNode(int nodeID);
+		void InsertLeaf(int leaf);
+		void RemoveLeaf(int leaf);
+		int Balance(int nodeID);
+		void AddSubtreeLeafs(int nodeID, std::vector<unsigned int, StlLinearAllocator<unsigned int>> &out) const;
+
+	private:
+		std::vector<AABBTreeNode> nodes;
+		int root;
+		int freeList;
+		unsigned int proxyCount;
+		float margin;
+	};
+}
@@ -2,35 +2,111 @@
 
 #include "Program/Log.h"
 
+#include <cstdlib>
+
 namespace Engine
 {
+	static const char *tagNames[] = { "General", "Components", "Renderer", "Physics", "AI", "Animation", "Particles", "Frame" };
+	static_assert(sizeof(tagNames) / sizeof(tagNames[0]) == static_cast<unsigned int>(MemoryTag::COUNT), "Every memory tag needs a name");
+
 	Allocator::Allocator()
 	{
-		usedMemory = 0;
-		numAllocations = 0;
+		for (unsigned int i = 0; i < static_cast<unsigned int>(MemoryTag::COUNT); i++)
+			stats[i] = {};
+
+		totalStats = {};
 	}
 
 	Allocator::~Allocator()
 	{
 	}
 
-	void *Allocator::Allocate(unsigned int size)
+	void *Allocator::Allocate(unsigned int size, MemoryTag tag)
 	{
-		usedMemory += size;
-		numAllocations++;
-		return malloc(size);
+		unsigned char *block = static_cast<unsigned char*>(malloc(size + HEADER_SIZE));
+		if (!block)
+		{
+			Log::Print(LogLevel::LEVEL_ERROR, "Failed to allocate %u bytes\n", size);
+			return nullptr;
+		}
+
+		AllocationHeader *header = reinterpret_cast<AllocationHeader*>(block);
+		header->size = size;
+		header->tag = tag;
+
+		{
+			std::lock_guard<std::mutex> lock(statsMutex);
+
+			AllocatorStats &s = stats[static_cast<unsigned int>(tag)];
+			s.liveBytes += size;
+			s.numAllocations++;
+			if (s.liveBytes > s.peakBytes)
+				s.peakBytes = s.liveBytes;
+
+			totalStats.liveBytes += size;
+			totalStats.numAllocations++;
+			if (totalStats.liveBytes > totalStats.peakBytes)
+				totalStats.peakBytes = totalStats.liveBytes;
+		}
+
+		return block + HEADER_SIZE;
 	}
 
 	void Allocator::Free(void *ptr)
 	{
-		//used
-		numAllocations++;
-		free(ptr);
+		if (!ptr)
+			return;
+
+		unsigned char *block = static_cast<unsigned char*>(ptr) - HEADER_SIZE;
+		const AllocationHeader *header = reinterpret_cast<const AllocationHeader*>(block);
+
+		{
+			std::lock_guard<std::mutex> lock(statsMutex);
+
+			AllocatorStats &s = stats[static_cast<unsigned int>(header->tag)];
+			s.liveBytes -= header->size;
+			s.numFrees++;
+
+			totalStats.liveBytes -= header->size;
+			totalStats.numFrees++;
+		}
+
+		free(block);
+	}
+
+	AllocatorStats Allocator::GetStats(MemoryTag tag) const
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+		return stats[static_cast<unsigned int>(tag)];
+	}
+
+	AllocatorStats Allocator::GetTotalStats() const
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+		return totalStats;
+	}
+
+	const char *Allocator::GetTagName(MemoryTag tag)
+	{
+		return tagNames[static_cast<unsigned int>(tag)];
 	}
 
 	void Allocator::PrintStats()
 	{
-		Log::Print(LogLevel::LEVEL_INFO, "\nTotal allocated memory: %.2f mib\n", (float)usedMemory / 1024.0f / 1024.0f);
-		Log::Print(LogLevel::LEVEL_INFO, "Num allocations: %u\n\n", numAllocations);
+		std::lock_guard<std::mutex> lock(statsMutex);
+
+		Log::Print(LogLevel::LEVEL_INFO, "\nTotal allocated memory: %.2f mib (peak %.2f mib)\n", (float)totalStats.liveBytes / 1024.0f / 1024.0f, (float)totalStats.peakBytes / 1024.0f / 1024.0f);
+		Log::Print(LogLevel::LEVEL_INFO, "Num allocations: %u Num frees: %u\n", totalStats.numAllocations, totalStats.numFrees);
+
+		for (unsigned int i = 0; i < static_cast<unsigned int>(MemoryTag::COUNT); i++)
+		{
+			const AllocatorStats &s = stats[i];
+			if (s.numAllocations == 0)
+				continue;
+
+			Log::Print(LogLevel::LEVEL_INFO, "%s: %.2f kib live, %.2f kib peak, %u allocations, %u frees\n", tagNames[i], (float)s.liveBytes / 1024.0f, (float)s.peakBytes / 1024.0f, s.numAllocations, s.numFrees);
+		}
+
+		Log::Print(LogLevel::LEVEL_INFO, "\n");
 	}
-}
\ No newline at end of file
+}
@@ -1,20 +1,67 @@
 #pragma once
 
+#include <mutex>
+#include <cstddef>
+
 namespace Engine
 {
+	// Subsystem an allocation belongs to so the stats can show where the memory goes
+	enum class MemoryTag : unsigned char
+	{
+		GENERAL,
+		COMPONENTS,
+		RENDERER,
+		PHYSICS,
+		AI,
+		ANIMATION,
+		PARTICLES,
+		FRAME,
+
+		COUNT
+	};
+
+	struct AllocatorStats
+	{
+		size_t liveBytes;
+		size_t peakBytes;
+		unsigned int numAllocations;
+		unsigned int numFrees;
+	};
+
+	// General purpose heap. Every allocation stores a small header with its size and tag so Free can keep accurate stats.
+	// It's the parent of the linear and pool allocators, which take big blocks from it and hand out memory themselves
 	class Allocator
 	{
 	public:
 		Allocator();
 		~Allocator();
 
-		void *Allocate(unsigned int size);
+		void *Allocate(unsigned int size, MemoryTag tag = MemoryTag::GENERAL);
 		void Free(void *ptr);
 
+		AllocatorStats GetStats(MemoryTag tag) const;
+		AllocatorStats GetTotalStats() const;
+		static const char *GetTagName(MemoryTag tag);
+
 		void PrintStats();
 
+	public:
+		// Alignment of the returned memory, the same malloc guarantees
+		static const unsigned int ALIGNMENT = alignof(std::max_align_t);
+
 	private:
-		unsigned int usedMemory;
-		unsigned int numAllocations;
+		struct AllocationHeader
+		{
+			unsigned int size;
+			MemoryTag tag;
+		};
+
+		// Rounded up to the alignment so the returned memory keeps the alignment of the malloc'd block
+		static const unsigned int HEADER_SIZE = (sizeof(AllocationHeader) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+	private:
+		AllocatorStats stats[static_cast<unsigned int>(MemoryTag::COUNT)];
+		AllocatorStats totalStats;
+		mutable std::mutex statsMutex;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,35 @@
+#include "Benchmarks.h"
+
+#include "TLSFAllocatorFuzz.h"
+#include "Program/Log.h"
+#include "Graphics/RenderQueueBenchmark.h"
+#include "Graphics/RenderQueueAllocationCheck.h"
+#include "Graphics/Animation/AnimationBenchmark.h"
+#include "AI/AStarBenchmark.h"
+
+namespace Engine
+{
+	bool RunBenchmarks()
+	{
+		unsigned int failed = 0;
+
+		// Keep going after a failure so one run reports everything that broke
+		if (!RunRenderQueueSortBenchmark())
+			failed++;
+		if (!RunRenderQueueAllocationCheck())
+			failed++;
+		if (!RunAnimationBenchmark())
+			failed++;
+		if (!RunTLSFAllocatorFuzz())
+			failed++;
+		if (!RunPathBenchmark())
+			failed++;
+
+		if (failed > 0)
+			Log::Print(LogLevel::LEVEL_ERROR, "%u benchmarks failed\n", failed);
+		else
+			Log::Print(LogLevel::LEVEL_INFO, "All benchmarks passed\n");
+
+		return failed == 0;
+	}
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+namespace Engine
+{
+	// Runs every benchmark and check that doesn't need a window or a gpu with their default settings, one after the other.
+	// Returns false if any of them failed so it can be used from a command line switch or a build script
+	bool RunBenchmarks();
+}
@@ -0,0 +1,240 @@
+#include "JobSystem.h"
+
+#include "Random.h"
+#include "Log.h"
+
+namespace Engine
+{
+	static thread_local unsigned int threadIndex = 0;
+
+	JobSystem::JobSystem()
+	{
+		queues = nullptr;
+		jobStorage = nullptr;
+		numQueues = 0;
+		queuedJobs = 0;
+		running = false;
+	}
+
+	void JobSystem::Init(int numWorkers)
+	{
+		if (numWorkers < 0)
+		{
+			unsigned int hardwareThreads = std::thread::hardware_concurrency();
+			numWorkers = hardwareThreads > 1 ? static_cast<int>(hardwareThreads - 1) : 0;
+		}
+
+		numQueues = static_cast<unsigned int>(numWorkers) + 1;
+		queues = new JobQueue[numQueues];
+		jobStorage = new Job[numQueues * JOB_QUEUE_CAPACITY];
+		queuedJobs = 0;
+		running = true;
+
+		for (unsigned int i = 0; i < numQueues; i++)
+		{
+			queues[i].jobs = &jobStorage[i * JOB_QUEUE_CAPACITY];
+			queues[i].head = 0;
+			queues[i].count = 0;
+		}
+
+		threadIndex = 0;
+
+		for (unsigned int i = 1; i < numQueues; i++)
+		{
+			workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+		}
+
+		Log::Print(LogLevel::LEVEL_INFO, "Init Job system with %u worker threads\n", numQueues - 1);
+	}
+
+	void JobSystem::Dispose()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			running = false;
+		}
+		sleepCondition.notify_all();
+
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			workers[i].join();
+		}
+		workers.clear();
+
+		if (queues)
+		{
+			delete[] queues;
+			queues = nullptr;
+		}
+		if (jobStorage)
+		{
+			delete[] jobStorage;
+			jobStorage = nullptr;
+		}
+		numQueues = 0;
+
+		Log::Print(LogLevel::LEVEL_INFO, "Disposing Job system\n");
+	}
+
+	void JobSystem::Wait(JobCounter *counter)
+	{
+		if (!counter)
+			return;
+
+		const unsigned int index = GetThreadIndex();
+
+		while (!counter->IsDone())
+		{
+			if (!RunNextJob(index))
+				std::this_thread::yield();
+		}
+	}
+
+	unsigned int JobSystem::GetThreadIndex()
+	{
+		return threadIndex;
+	}
+
+	void JobSystem::WorkerLoop(unsigned int index)
+	{
+		threadIndex = index;
+		Random::InitThread();
+
+		while (running)
+		{
+			if (RunNextJob(index))
+				continue;
+
+			// Jobs are still queued but none could run, so they're waiting on a dependency. Don't go to sleep because they will be ready soon
+			if (queuedJobs > 0)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepCondition.wait(lock, [this]() { return queuedJobs > 0 || !running; });
+		}
+	}
+
+	void JobSystem::Submit(const Job &job)
+	{
+		if (numQueues > 0 && Push(job))
+			return;
+
+		// The queue is full or the job system is not running
+		if (job.dependency)
+			Wait(job.dependency);
+
+		Execute(job);
+	}
+
+	bool JobSystem::Push(const Job &job)
+	{
+		// Threads that weren't created by the job system also push to the main thread queue
+		JobQueue &q = queues[GetThreadIndex() < numQueues ? GetThreadIndex() : 0];
+
+		{
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if (q.count == JOB_QUEUE_CAPACITY)
+				return false;
+
+			q.jobs[(q.head + q.count) & (JOB_QUEUE_CAPACITY - 1)] = job;
+			q.count++;
+		}
+
+		queuedJobs++;
+		return true;
+	}
+
+	bool JobSystem::Pop(unsigned int index, Job &job)
+	{
+		JobQueue &q = queues[index];
+
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (q.count == 0)
+			return false;
+
+		// Take the most recent job, its data is more likely to still be in the cache
+		q.count--;
+		job = q.jobs[(q.head + q.count) & (JOB_QUEUE_CAPACITY - 1)];
+		queuedJobs--;
+		return true;
+	}
+
+	bool JobSystem::Steal(unsigned int index, Job &job)
+	{
+		for (unsigned int i = 1; i < numQueues; i++)
+		{
+			JobQueue &q = queues[(index + i) % numQueues];
+
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if (q.count == 0)
+				continue;
+
+			// Steal the oldest job, it's usually the largest chunk of work left
+			job = q.jobs[q.head];
+			q.head = (q.head + 1) & (JOB_QUEUE_CAPACITY - 1);
+			q.count--;
+			queuedJobs--;
+			return true;
+		}
+
+		return false;
+	}
+
+	bool JobSystem::RunNextJob(unsigned int index)
+	{
+		if (numQueues == 0)
+			return false;
+
+		Job job;
+		if (!Pop(index, job) && !Steal(index, job))
+			return false;
+
+		if (job.dependency && !job.dependency->IsDone())
+		{
+			// Put it at the front so the jobs it depends on, which are usually behind it, get popped first.
+			// If it was stolen this queue can be full, then wait for the dependency here
+			JobQueue &q = queues[index];
+			std::unique_lock<std::mutex> lock(q.mutex);
+
+			if (q.count < JOB_QUEUE_CAPACITY)
+			{
+				q.head = (q.head - 1) & (JOB_QUEUE_CAPACITY - 1);
+				q.jobs[q.head] = job;
+				q.count++;
+				queuedJobs++;
+				return false;
+			}
+
+			lock.unlock();
+			Wait(job.dependency);
+		}
+
+		Execute(job);
+
+		return true;
+	}
+
+	void JobSystem::Execute(const Job &job)
+	{
+		job.function(job);
+
+		if (job.counter)
+			job.counter->count--;
+	}
+
+	void JobSystem::WakeWorkers(bool all)
+	{
+		// Taking the lock makes sure a worker that is about to sleep sees the new jobs
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+
+		if (all)
+			sleepCondition.notify_all();
+		else
+			sleepCondition.notify_one();
+	}
+}
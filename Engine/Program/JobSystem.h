@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+namespace Engine
+{
+	// Holds the number of jobs that haven't finished yet. Jobs can also use a counter as a dependency and only start once it reaches zero
+	struct JobCounter
+	{
+		JobCounter() : count(0) {}
+
+		bool IsDone() const { return count.load() == 0; }
+
+		std::atomic<unsigned int> count;
+	};
+
+	// Size of the lambda captures a job can store. Jobs are copied around by value so no memory is allocated when running them
+	static const unsigned int JOB_DATA_SIZE = 48;
+
+	struct Job
+	{
+		void(*function)(const Job &job);
+		JobCounter *counter;
+		JobCounter *dependency;
+		unsigned int start;			// Range of the group for ParallelFor jobs
+		unsigned int end;
+		alignas(8) unsigned char data[JOB_DATA_SIZE];
+	};
+
+	// Fixed pool of worker threads with a job queue per thread, the main thread included.
+	// A thread pushes and pops jobs from the back of its own queue and when it runs out of jobs it steals from the front of the other queues
+	class JobSystem
+	{
+	public:
+		JobSystem();
+
+		// Passing -1 creates a worker for each hardware thread except the main one. With 0 workers the jobs run on the thread that waits for them
+		void Init(int numWorkers = -1);
+		void Dispose();
+
+		// The function is copied into the job so it must only capture pointers, references and plain values
+		template<typename F>
+		void Run(const F &function, JobCounter *counter, JobCounter *dependency = nullptr);
+		// Splits [0, count) in groups of groupSize and runs one job per group. The function is called as function(start, end)
+		template<typename F>
+		void ParallelFor(unsigned int count, unsigned int groupSize, const F &function, JobCounter *counter);
+		// The calling thread keeps running jobs until the counter reaches zero, so it's safe to wait inside a job
+		void Wait(JobCounter *counter);
+
+		// Number of threads that execute jobs, the main thread included
+		unsigned int GetNumThreads() const { return numQueues; }
+		// 0 for the main thread and [1, GetNumThreads()) for the workers. Can be used to index per thread data
+		static unsigned int GetThreadIndex();
+
+	private:
+		static const unsigned int JOB_QUEUE_CAPACITY = 2048;		// Must be a power of two
+
+		// Ring buffer of jobs so a queue never allocates after Init
+		struct JobQueue
+		{
+			std::mutex mutex;
+			Job *jobs;
+			unsigned int head;
+			unsigned int count;
+		};
+
+		template<typename F>
+		static void CallFunction(const Job &job) { (*reinterpret_cast<const F*>(job.data))(); }
+		template<typename F>
+		static void CallGroupFunction(const Job &job) { (*reinterpret_cast<const F*>(job.data))(job.start, job.end); }
+
+		template<typename F>
+		static void StoreFunction(Job &job, const F &function);
+
+		void WorkerLoop(unsigned int index);
+		// Runs the job right away when the queue of the thread is full
+		void Submit(const Job &job);
+		bool Push(const Job &job);
+		bool Pop(unsigned int index, Job &job);
+		bool Steal(unsigned int index, Job &job);
+		bool RunNextJob(unsigned int index);
+		void Execute(const Job &job);
+		void WakeWorkers(bool all);
+
+	private:
+		std::vector<std::thread> workers;
+		JobQueue *queues;
+		Job *jobStorage;
+		unsigned int numQueues;
+
+		std::atomic<unsigned int> queuedJobs;		// Jobs in the queues that no thread took yet. Workers only sleep when there are none
+		std::atomic<bool> running;
+		std::mutex sleepMutex;
+		std::condition_variable sleepCondition;
+	};
+
+	template<typename F>
+	void JobSystem::StoreFunction(Job &job, const F &function)
+	{
+		static_assert(sizeof(F) <= JOB_DATA_SIZE, "Job captures too large, capture a pointer to the data instead");
+		static_assert(alignof(F) <= 8, "Job captures alignment too large");
+		static_assert(std::is_trivially_copyable<F>::value && std::is_trivially_destructible<F>::value, "Jobs can only capture pointers, references and plain values");
+
+		new (job.data) F(function);
+	}
+
+	template<typename F>
+	void JobSystem::Run(const F &function, JobCounter *counter, JobCounter *dependency)
+	{
+		Job job;
+		job.function = &CallFunction<F>;
+		job.counter = counter;
+		job.dependency = dependency;
+		job.start = 0;
+		job.end = 0;
+		StoreFunction(job, function);
+
+		if (counter)
+			counter->count++;
+
+		Submit(job);
+		WakeWorkers(false);
+	}
+
+	template<typename F>
+	void JobSystem::ParallelFor(unsigned int count, unsigned int groupSize, const F &function, JobCounter *counter)
+	{
+		if (count == 0)
+			return;
+
+		if (groupSize == 0)
+			groupSize = 1;
+
+		const unsigned int numGroups = (count + groupSize - 1) / groupSize;
+
+		if (counter)
+			counter->count += numGroups;
+
+		Job job;
+		job.function = &CallGroupFunction<F>;
+		job.counter = counter;
+		job.dependency = nullptr;
+		StoreFunction(job, function);
+
+		for (unsigned int i = 0; i < numGroups; i++)
+		{
+			job.start = i * groupSize;
+			job.end = job.start + groupSize < count ? job.start + groupSize : count;
+			Submit(job);
+		}
+
+		WakeWorkers(true);
+	}
+}
@@ -0,0 +1,120 @@
+#include "LinearAllocator.h"
+
+#include "Program/Log.h"
+
+#include <cstdint>
+
+namespace Engine
+{
+	LinearAllocator::LinearAllocator()
+	{
+		parent = nullptr;
+		tag = MemoryTag::FRAME;
+		buffer = nullptr;
+		capacity = 0;
+		offset = 0;
+		overflowBytes = 0;
+		peakUsed = 0;
+	}
+
+	void LinearAllocator::Init(Allocator *parent, unsigned int capacity, MemoryTag tag)
+	{
+		this->parent = parent;
+		this->tag = tag;
+		this->capacity = capacity;
+
+		buffer = static_cast<unsigned char*>(parent->Allocate(capacity, tag));
+		offset = 0;
+		overflowBytes = 0;
+		peakUsed = 0;
+	}
+
+	void LinearAllocator::Dispose()
+	{
+		Reset();
+
+		if (buffer)
+		{
+			parent->Free(buffer);
+			buffer = nullptr;
+		}
+		capacity = 0;
+	}
+
+	void *LinearAllocator::Allocate(unsigned int size, unsigned int alignment)
+	{
+		unsigned int current = offset.load();
+		unsigned int start = 0;
+
+		// The buffer only has the alignment of the parent allocator, so align the address instead of the offset
+		const uintptr_t base = reinterpret_cast<uintptr_t>(buffer);
+
+		do
+		{
+			start = static_cast<unsigned int>(((base + current + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1)) - base);
+
+			if (start + size > capacity)
+			{
+				std::lock_guard<std::mutex> lock(overflowMutex);
+
+				if (overflowAllocations.empty())
+					Log::Print(LogLevel::LEVEL_WARNING, "Linear allocator out of memory (capacity %u bytes), falling back to the heap\n", capacity);
+
+				// Allocate extra space when the parent alignment is not enough so the pointer can be moved forward
+				const unsigned int padding = alignment > Allocator::ALIGNMENT ? alignment - Allocator::ALIGNMENT : 0;
+
+				unsigned char *ptr = static_cast<unsigned char*>(parent->Allocate(size + padding, tag));
+				overflowAllocations.push_back(ptr);
+				overflowBytes += size + padding;
+
+				const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+				return ptr + (((address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1)) - address);
+			}
+
+		} while (!offset.compare_exchange_weak(current, start + size));
+
+		return buffer + start;
+	}
+
+	void LinearAllocator::Reset()
+	{
+		const unsigned int used = GetUsedMemory();
+		if (used > peakUsed)
+			peakUsed = used;
+
+		for (size_t i = 0; i < overflowAllocations.size(); i++)
+			parent->Free(overflowAllocations[i]);
+
+		overflowAllocations.clear();
+
+		// Grow so the next frame fits in the block
+		if (overflowBytes > 0)
+		{
+			parent->Free(buffer);
+			capacity = used + used / 4;
+			buffer = static_cast<unsigned char*>(parent->Allocate(capacity, tag));
+
+			Log::Print(LogLevel::LEVEL_INFO, "Linear allocator grown to %u bytes\n", capacity);
+		}
+
+		overflowBytes = 0;
+		offset = 0;
+	}
+
+	void LinearAllocator::FreeToMarker(unsigned int marker)
+	{
+		if (marker <= offset.load())
+			offset = marker;
+	}
+
+	unsigned int LinearAllocator::GetUsedMemory() const
+	{
+		const unsigned int used = offset.load();
+		return (used < capacity ? used : capacity) + overflowBytes;
+	}
+
+	void LinearAllocator::PrintStats(const char *name)
+	{
+		Log::Print(LogLevel::LEVEL_INFO, "%s: %.2f kib capacity, %.2f kib used, %.2f kib peak\n", name, (float)capacity / 1024.0f, (float)GetUsedMemory() / 1024.0f, (float)peakUsed / 1024.0f);
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+namespace Engine
+{
+	// Bump allocator over one block taken from the parent allocator. Nothing is freed individually, Reset releases everything at once,
+	// which makes it a good fit for memory that only lives for a frame. Allocate can be called from several threads at the same time.
+	// If the block runs out the allocation falls back to the parent and the block grows to the high water mark on the next Reset
+	class LinearAllocator
+	{
+	public:
+		LinearAllocator();
+
+		void Init(Allocator *parent, unsigned int capacity, MemoryTag tag = MemoryTag::FRAME);
+		void Dispose();
+
+		void *Allocate(unsigned int size, unsigned int alignment = 16);
+		// Invalidates every allocation. Must not be called while other threads are allocating
+		void Reset();
+
+		// Stack style usage from a single thread. Everything allocated after the marker was taken is released
+		unsigned int GetMarker() const { return offset.load(); }
+		void FreeToMarker(unsigned int marker);
+
+		unsigned int GetCapacity() const { return capacity; }
+		unsigned int GetUsedMemory() const;
+		unsigned int GetPeakUsedMemory() const { return peakUsed; }
+
+		void PrintStats(const char *name);
+
+	private:
+		Allocator *parent;
+		MemoryTag tag;
+		unsigned char *buffer;
+		unsigned int capacity;
+		std::atomic<unsigned int> offset;
+
+		std::mutex overflowMutex;
+		std::vector<void*> overflowAllocations;
+		unsigned int overflowBytes;
+		unsigned int peakUsed;
+	};
+
+	// Lets std containers use a linear allocator. Deallocation does nothing, the memory is released when the linear allocator is reset.
+	// A default constructed adapter has no linear allocator and uses the normal heap, so containers that outlive the frame keep working
+	template<typename T>
+	class StlLinearAllocator
+	{
+	public:
+		typedef T value_type;
+
+		StlLinearAllocator() : linearAllocator(nullptr) {}
+		explicit StlLinearAllocator(LinearAllocator *linearAllocator) : linearAllocator(linearAllocator) {}
+		template<typename U>
+		StlLinearAllocator(const StlLinearAllocator<U> &other) : linearAllocator(other.linearAllocator) {}
+
+		T *allocate(size_t n)
+		{
+			if (linearAllocator)
+				return static_cast<T*>(linearAllocator->Allocate(static_cast<unsigned int>(n * sizeof(T)), alignof(T) > 16 ? alignof(T) : 16));
+
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+
+		void deallocate(T *ptr, size_t n)
+		{
+			if (!linearAllocator)
+				::operator delete(ptr);
+		}
+
+		template<typename U>
+		bool operator==(const StlLinearAllocator<U> &other) const { return linearAllocator == other.linearAllocator; }
+		template<typename U>
+		bool operator!=(const StlLinearAllocator<U> &other) const { return linearAllocator != other.linearAllocator; }
+
+		LinearAllocator *linearAllocator;
+	};
+}
@@ -12,9 +12,11 @@ namespace Engine
 {
 	std::function<void(LogLevel, const char*)> Log::callbackFunc;
 	std::ofstream Log::logFile;
+	std::mutex Log::logMutex;
 
 	void Log::SetCallbackFunc(const std::function<void(LogLevel, const char*)> &func)
 	{
+		std::lock_guard<std::mutex> lock(logMutex);
 		callbackFunc = func;
 	}
 
@@ -26,6 +28,8 @@ namespace Engine
 		const unsigned int MAX_CHARS = 1024;
 		static char buf[MAX_CHARS];
 
+		std::lock_guard<std::mutex> lock(logMutex);
+
 		va_list argList;
 		va_start(argList, str);
 		charsWritten = vsnprintf(buf, MAX_CHARS, str, argList);
@@ -54,6 +58,8 @@ namespace Engine
 		const unsigned int MAX_CHARS = 4096;
 		static char buffer[MAX_CHARS];
 
+		std::lock_guard<std::mutex> lock(logMutex);
+
 		int charsWritten = vsnprintf(buffer, MAX_CHARS, str, argList);
 		
 		if (callbackFunc)
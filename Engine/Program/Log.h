@@ -6,6 +6,7 @@
 #include <string>
 #include <functional>
 #include <fstream>
+#include <mutex>
 
 namespace Engine
 {
@@ -22,8 +23,10 @@ namespace Engine
 	{
 	public:
 
-		// Calls func whenever something calls Print. Useful for the console window in the editor
+		// Calls func whenever something calls Print. Useful for the console window in the editor.
+		// The callback can be called from any thread, one call at a time
 		static void SetCallbackFunc(const std::function<void(LogLevel, const char *)> &func);
+		// Can be called from any thread
 		static int Print(LogLevel level, const char *str, ...);
 		static void Close();
 
@@ -33,5 +36,6 @@ namespace Engine
 	private:
 		static std::function<void(LogLevel, const char*)> callbackFunc;
 		static std::ofstream logFile;
+		static std::mutex logMutex;			// Protects the print buffer, the callback and the log file
 	};
 }
@@ -86,10 +86,10 @@ namespace Engine
 		}
 
 		// Add primitive models materials and textures
-		const std::vector<ModelInstance> &models = game->GetModelManager().GetModels();
-		for (size_t i = 0; i < models.size(); i++)
+		const ModelManager &modelManager = game->GetModelManager();
+		for (unsigned int i = 0; i < modelManager.GetModelCount(); i++)
 		{
-			Model *m = models[i].model;
+			Model *m = modelManager.GetModelAt(i);
 
 			if (m->GetType() == ModelType::PRIMITIVE_CUBE || m->GetType() == ModelType::PRIMITIVE_SPHERE)
 			{
@@ -0,0 +1,93 @@
+#include "PoolAllocator.h"
+
+#include "Program/Log.h"
+
+namespace Engine
+{
+	PoolAllocator::PoolAllocator()
+	{
+		parent = nullptr;
+		tag = MemoryTag::GENERAL;
+		elementSize = 0;
+		elementsPerChunk = 0;
+		freeList = nullptr;
+		numUsed = 0;
+		peakUsed = 0;
+	}
+
+	void PoolAllocator::Init(Allocator *parent, unsigned int elementSize, unsigned int elementsPerChunk, MemoryTag tag)
+	{
+		this->parent = parent;
+		this->tag = tag;
+		this->elementsPerChunk = elementsPerChunk > 0 ? elementsPerChunk : 1;
+
+		// Every element must be able to hold the free list pointer and keep the same alignment as the chunk
+		if (elementSize < sizeof(FreeElement))
+			elementSize = sizeof(FreeElement);
+
+		this->elementSize = (elementSize + Allocator::ALIGNMENT - 1) / Allocator::ALIGNMENT * Allocator::ALIGNMENT;
+
+		freeList = nullptr;
+		numUsed = 0;
+		peakUsed = 0;
+	}
+
+	void PoolAllocator::Dispose()
+	{
+		if (numUsed > 0)
+			Log::Print(LogLevel::LEVEL_WARNING, "Pool allocator disposed with %u elements still in use\n", numUsed);
+
+		for (size_t i = 0; i < chunks.size(); i++)
+			parent->Free(chunks[i]);
+
+		chunks.clear();
+		freeList = nullptr;
+		numUsed = 0;
+	}
+
+	void *PoolAllocator::Allocate()
+	{
+		if (!freeList)
+			AllocChunk();
+
+		FreeElement *element = freeList;
+		freeList = element->next;
+
+		numUsed++;
+		if (numUsed > peakUsed)
+			peakUsed = numUsed;
+
+		return element;
+	}
+
+	void PoolAllocator::Free(void *ptr)
+	{
+		if (!ptr)
+			return;
+
+		FreeElement *element = static_cast<FreeElement*>(ptr);
+		element->next = freeList;
+		freeList = element;
+
+		numUsed--;
+	}
+
+	void PoolAllocator::AllocChunk()
+	{
+		unsigned char *chunk = static_cast<unsigned char*>(parent->Allocate(elementSize * elementsPerChunk, tag));
+		chunks.push_back(chunk);
+
+		// Link the elements in order so they are handed out in address order
+		for (unsigned int i = elementsPerChunk; i > 0; i--)
+		{
+			FreeElement *element = reinterpret_cast<FreeElement*>(chunk + (i - 1) * elementSize);
+			element->next = freeList;
+			freeList = element;
+		}
+	}
+
+	void PoolAllocator::PrintStats(const char *name)
+	{
+		Log::Print(LogLevel::LEVEL_INFO, "%s: %u elements of %u bytes in use, %u peak, %u chunks\n", name, numUsed, elementSize, peakUsed, static_cast<unsigned int>(chunks.size()));
+	}
+}
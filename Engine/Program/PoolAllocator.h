@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <vector>
+#include <new>
+#include <utility>
+
+namespace Engine
+{
+	// Hands out fixed size elements from chunks taken from the parent allocator. Freed elements go to a free list and are reused,
+	// so adding and removing components doesn't touch the heap once the pool is warm. Not thread safe
+	class PoolAllocator
+	{
+	public:
+		PoolAllocator();
+
+		void Init(Allocator *parent, unsigned int elementSize, unsigned int elementsPerChunk, MemoryTag tag = MemoryTag::GENERAL);
+		void Dispose();
+
+		void *Allocate();
+		void Free(void *ptr);
+
+		template<typename T, typename... Args>
+		T *New(Args&&... args)
+		{
+			return new (Allocate()) T(std::forward<Args>(args)...);
+		}
+
+		template<typename T>
+		void Delete(T *ptr)
+		{
+			if (!ptr)
+				return;
+
+			ptr->~T();
+			Free(ptr);
+		}
+
+		unsigned int GetElementSize() const { return elementSize; }
+		unsigned int GetNumUsedElements() const { return numUsed; }
+		unsigned int GetPeakUsedElements() const { return peakUsed; }
+		unsigned int GetNumChunks() const { return static_cast<unsigned int>(chunks.size()); }
+
+		void PrintStats(const char *name);
+
+	private:
+		void AllocChunk();
+
+	private:
+		struct FreeElement
+		{
+			FreeElement *next;
+		};
+
+		Allocator *parent;
+		MemoryTag tag;
+		unsigned int elementSize;
+		unsigned int elementsPerChunk;
+		std::vector<void*> chunks;
+		FreeElement *freeList;
+		unsigned int numUsed;
+		unsigned int peakUsed;
+	};
+}
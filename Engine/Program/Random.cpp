@@ -1,7 +1,18 @@
 #include "Random.h"
 
+#include "JobSystem.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define RANDOM_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RANDOM_NEON
+#include <arm_neon.h>
+#endif
+
 namespace Engine
 {
+	static const int MAX_WORLEY_ROW_CELLS = 64;
 	int Random::hash[512] = {
 		151,160,137, 91, 90, 15,131, 13,201, 95, 96, 53,194,233,  7,225,
 		140, 36,103, 30, 69,142,  8, 99, 37,240, 21, 10, 23,190,  6,148,
@@ -69,16 +80,15 @@ namespace Engine
 
 
 	std::random_device Random::rd;
-	std::mt19937 Random::mt;
-	std::uniform_real_distribution<float> Random::dist;
-	std::uniform_int_distribution<int> Random::intDist;
+	std::mutex Random::rdMutex;
+	thread_local std::mt19937 Random::mt;
+	thread_local std::uniform_real_distribution<float> Random::dist;
+	thread_local std::uniform_int_distribution<int> Random::intDist;
 	glm::vec3 Random::worleyPoints[8];
 
 	void Random::Init()
 	{
-		mt.seed(rd());
-		dist.param(std::uniform_real_distribution<float>::param_type(0.0f, 1.0f));
-		intDist.param(std::uniform_int_distribution<int>::param_type(0, 1));
+		InitThread();
 
 		worleyPoints[0] = glm::vec3(0.2f, 0.5f, 0.1f);
 		worleyPoints[1] = glm::vec3(0.8f, 0.3f, 0.4f);
@@ -90,6 +100,16 @@ namespace Engine
 		worleyPoints[7] = glm::vec3(0.25f, 0.9f, 0.9f);
 	}
 
+	void Random::InitThread()
+	{
+		{
+			std::lock_guard<std::mutex> lock(rdMutex);
+			mt.seed(rd());
+		}
+		dist.param(std::uniform_real_distribution<float>::param_type(0.0f, 1.0f));
+		intDist.param(std::uniform_int_distribution<int>::param_type(0, 1));
+	}
+
 	float Random::Value1DSharp(float x, float frequency)
 	{
 		x *= frequency;
@@ -418,6 +438,157 @@ namespace Engine
 		return glm::clamp(d, 0.0f, 1.0f);
 	}
 
+	void Random::Perlin3DRow(const glm::vec3 &start, float step, unsigned int count, float frequency, float octaves, float lacunarity, float persistence, float *out)
+	{
+		for (unsigned int i = 0; i < count; i++)
+			out[i] = Perlin3D(start.x + i * step, start.y, start.z, frequency, octaves, lacunarity, persistence);
+	}
+
+	void Random::WorleyNoiseRow(const glm::vec3 &start, float step, unsigned int count, float cellCount, float *out)
+	{
+		const int cells = static_cast<int>(cellCount);
+
+		// The cell points can only be looked up in a table when the cells tile the volume
+		if (static_cast<float>(cells) != cellCount || cells <= 0 || cells > MAX_WORLEY_ROW_CELLS)
+		{
+			for (unsigned int i = 0; i < count; i++)
+				out[i] = WorleyNoise(glm::vec3(start.x + i * step, start.y, start.z), cellCount);
+			return;
+		}
+
+		// Every point of the row is in the same cell in y and z, so only the 3x3 rows of cells around it are searched.
+		// Hash the point of each of those cells once, instead of hashing 27 cells for every point like WorleyNoise
+		const float pCellY = start.y * cellCount;
+		const float pCellZ = start.z * cellCount;
+		const float floorY = std::floor(pCellY);
+		const float floorZ = std::floor(pCellZ);
+
+		float cellPoints[9][MAX_WORLEY_ROW_CELLS];
+		float offsetY[9];
+		float offsetZ[9];
+
+		for (int z = -1; z <= 1; z++)
+		{
+			for (int y = -1; y <= 1; y++)
+			{
+				const int row = (z + 1) * 3 + y + 1;
+				const float cellY = glm::mod(floorY + y, cellCount);
+				const float cellZ = glm::mod(floorZ + z, cellCount);
+
+				offsetY[row] = pCellY - (floorY + y);
+				offsetZ[row] = pCellZ - (floorZ + z);
+
+				// Same as noise() on the integer cell coordinates
+				for (int x = 0; x < cells; x++)
+					cellPoints[row][x] = Hash(static_cast<float>(x) + cellY * 57.0f + 113.0f * cellZ);
+			}
+		}
+
+		unsigned int i = 0;
+
+#if defined(RANDOM_SSE) || defined(RANDOM_NEON)
+		const unsigned int simdCount = count & ~3u;
+
+		for (; i < simdCount; i += 4)
+		{
+			float pCellX[4];
+			int cellX[4];
+			for (unsigned int l = 0; l < 4; l++)
+			{
+				pCellX[l] = (start.x + (i + l) * step) * cellCount;
+				cellX[l] = static_cast<int>(std::floor(pCellX[l]));
+			}
+
+#if defined(RANDOM_SSE)
+			const __m128 px = _mm_loadu_ps(pCellX);
+			__m128 d = _mm_set1_ps(1.0e10f);
+#else
+			const float32x4_t px = vld1q_f32(pCellX);
+			float32x4_t d = vdupq_n_f32(1.0e10f);
+#endif
+
+			for (int row = 0; row < 9; row++)
+			{
+				for (int x = -1; x <= 1; x++)
+				{
+					// The points can be in different cells along x so the cell points are gathered per lane
+					float tx[4];
+					float point[4];
+					for (unsigned int l = 0; l < 4; l++)
+					{
+						const int cx = cellX[l] + x;
+						tx[l] = static_cast<float>(cx);
+						point[l] = cellPoints[row][((cx % cells) + cells) % cells];
+					}
+
+#if defined(RANDOM_SSE)
+					const __m128 p = _mm_loadu_ps(point);
+					const __m128 dx = _mm_sub_ps(_mm_sub_ps(px, _mm_loadu_ps(tx)), p);
+					const __m128 dy = _mm_sub_ps(_mm_set1_ps(offsetY[row]), p);
+					const __m128 dz = _mm_sub_ps(_mm_set1_ps(offsetZ[row]), p);
+					const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					d = _mm_min_ps(d, dist);
+#else
+					const float32x4_t p = vld1q_f32(point);
+					const float32x4_t dx = vsubq_f32(vsubq_f32(px, vld1q_f32(tx)), p);
+					const float32x4_t dy = vsubq_f32(vdupq_n_f32(offsetY[row]), p);
+					const float32x4_t dz = vsubq_f32(vdupq_n_f32(offsetZ[row]), p);
+					const float32x4_t dist = vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz));
+					d = vminq_f32(d, dist);
+#endif
+				}
+			}
+
+#if defined(RANDOM_SSE)
+			d = _mm_min_ps(_mm_max_ps(d, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+			_mm_storeu_ps(out + i, d);
+#else
+			d = vminq_f32(vmaxq_f32(d, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+			vst1q_f32(out + i, d);
+#endif
+		}
+#endif
+
+		// Remaining points, or all of them if there's no SIMD support
+		for (; i < count; i++)
+		{
+			const float pCellX = (start.x + i * step) * cellCount;
+			const int cellX = static_cast<int>(std::floor(pCellX));
+			float d = 1.0e10f;
+
+			for (int row = 0; row < 9; row++)
+			{
+				for (int x = -1; x <= 1; x++)
+				{
+					const int cx = cellX + x;
+					const float p = cellPoints[row][((cx % cells) + cells) % cells];
+					const glm::vec3 tp = glm::vec3(pCellX - static_cast<float>(cx), offsetY[row], offsetZ[row]) - p;
+					d = glm::min(d, glm::dot(tp, tp));
+				}
+			}
+
+			out[i] = glm::clamp(d, 0.0f, 1.0f);
+		}
+	}
+
+	void Random::BakeVolume(JobSystem *jobSystem, unsigned int depth, const VolumeSliceFunction &bakeSlice)
+	{
+		if (!jobSystem || jobSystem->GetNumThreads() <= 1)
+		{
+			for (unsigned int z = 0; z < depth; z++)
+				bakeSlice(z);
+			return;
+		}
+
+		JobCounter counter;
+		jobSystem->ParallelFor(depth, 1, [&bakeSlice](unsigned int start, unsigned int end)
+		{
+			for (unsigned int z = start; z < end; z++)
+				bakeSlice(z);
+		}, &counter);
+		jobSystem->Wait(&counter);
+	}
+
 	float Random::Float()
 	{
 		return dist(mt);
@@ -3,13 +3,22 @@
 #include "include/glm/glm.hpp"
 
 #include <random>
+#include <mutex>
+#include <functional>
 
 namespace Engine
 {
+	class JobSystem;
+
+	// Fills the slice z of a volume. The slices are independent so they can be baked in parallel
+	typedef std::function<void(unsigned int z)> VolumeSliceFunction;
+
 	class Random
 	{
 	public:
 		static void Init();
+		// Seeds the random generator of the calling thread. Every thread has its own generator so Float and Int can be used from jobs
+		static void InitThread();
 
 		static float Value1DSharp(float x, float frequency);
 		static float Value1DSmooth(float x, float frequency);
@@ -24,6 +33,13 @@ namespace Engine
 		static float Perlin3D(float x, float y, float z, float frequency, float octaves, float lacunarity, float persistence);
 		static float WorleyNoise(const glm::vec3 &point, float cellCount);
 
+		// Batch versions for baking noise textures. They fill count points of a row along x that starts at start and advances by step.
+		// The Worley row hashes the cells around the row once and searches the cells of 4 points at a time
+		static void Perlin3DRow(const glm::vec3 &start, float step, unsigned int count, float frequency, float octaves, float lacunarity, float persistence, float *out);
+		static void WorleyNoiseRow(const glm::vec3 &start, float step, unsigned int count, float cellCount, float *out);
+		// Calls bakeSlice for every slice of a volume with the given depth. The slices are spread across the threads of the job system when there is one
+		static void BakeVolume(JobSystem *jobSystem, unsigned int depth, const VolumeSliceFunction &bakeSlice);
+
 		// Returns a random float between 0 and 1
 		static float Float();
 		// Returns a random float between low and high
@@ -45,9 +61,10 @@ namespace Engine
 		static glm::vec2 gradient2D[4];
 		static glm::vec3 gradient3D[16];
 		static std::random_device rd;
-		static std::mt19937 mt;
-		static std::uniform_real_distribution<float> dist;
-		static std::uniform_int_distribution<int> intDist;
+		static std::mutex rdMutex;
+		static thread_local std::mt19937 mt;
+		static thread_local std::uniform_real_distribution<float> dist;
+		static thread_local std::uniform_int_distribution<int> intDist;
 		static glm::vec3 worleyPoints[8];
 	};
 }
@@ -1,6 +1,7 @@
 #include "Serializer.h"
 
 #include "Program/FileManager.h"
+#include "Program/Version.h"
 
 namespace Engine
 {
@@ -10,6 +11,7 @@ namespace Engine
 		dataSize = 0;
 		data = nullptr;
 		pos = 0;
+		patchVersion = PATCH_VERSION;
 	}
 
 	void Serializer::OpenForWriting()
@@ -26,6 +28,7 @@ namespace Engine
 			dataSize = (size_t)file.tellg();
 			file.seekg(0, file.beg);
 			data = new char[dataSize];
+			pos = 0;
 			file.read(data, dataSize);
 			file.close();
 		}
@@ -24,6 +24,10 @@ namespace Engine
 		char *GetData() const { return data; }
 		size_t GetDataSize() const { return pos; }
 
+		// Patch version of the data being read so new fields can be skipped when loading older files. Defaults to the current version
+		void SetPatchVersion(unsigned int patch) { patchVersion = patch; }
+		unsigned int GetPatchVersion() const { return patchVersion; }
+
 		void Write(bool data);
 		void Write(short data);
 		void Write(unsigned short data);
@@ -89,5 +93,6 @@ namespace Engine
 		size_t dataSize;
 		char *data;
 		size_t pos;
+		unsigned int patchVersion;
 	};
 }
@@ -0,0 +1,313 @@
+#include "TLSFAllocator.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Engine
+{
+	static uint32_t HighestBit(uint64_t value)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return static_cast<uint32_t>(index);
+#elif defined(__GNUC__)
+		return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#else
+		uint32_t index = 0;
+		while (value >>= 1)
+			index++;
+		return index;
+#endif
+	}
+
+	static uint32_t LowestBit(uint64_t value)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return static_cast<uint32_t>(index);
+#elif defined(__GNUC__)
+		return static_cast<uint32_t>(__builtin_ctzll(value));
+#else
+		uint32_t index = 0;
+		while ((value & 1) == 0)
+		{
+			value >>= 1;
+			index++;
+		}
+		return index;
+#endif
+	}
+
+	TLSFAllocator::TLSFAllocator()
+	{
+		size = 0;
+		usedSize = 0;
+		numAllocations = 0;
+		flBitmap = 0;
+
+		for (uint32_t i = 0; i < FL_COUNT; i++)
+		{
+			slBitmaps[i] = 0;
+			for (uint32_t j = 0; j < SL_COUNT; j++)
+				freeLists[i][j] = INVALID_RANGE;
+		}
+	}
+
+	void TLSFAllocator::Init(uint64_t size)
+	{
+		Dispose();
+
+		this->size = size;
+
+		if (size == 0)
+			return;
+
+		// The whole block starts as a single free range
+		const uint32_t r = NewRange();
+		ranges[r].offset = 0;
+		ranges[r].size = size;
+		InsertFree(r);
+	}
+
+	void TLSFAllocator::Dispose()
+	{
+		size = 0;
+		usedSize = 0;
+		numAllocations = 0;
+		flBitmap = 0;
+
+		for (uint32_t i = 0; i < FL_COUNT; i++)
+		{
+			slBitmaps[i] = 0;
+			for (uint32_t j = 0; j < SL_COUNT; j++)
+				freeLists[i][j] = INVALID_RANGE;
+		}
+
+		ranges.clear();
+		unusedRanges.clear();
+	}
+
+	bool TLSFAllocator::Allocate(uint64_t size, uint64_t alignment, uint64_t &offset, uint32_t &range)
+	{
+		if (size == 0)
+			size = 1;
+		if (alignment == 0)
+			alignment = 1;
+
+		// Looking for the size plus the worst padding means any range found fits once it's aligned
+		const uint32_t r = FindFree(size + alignment - 1);
+		if (r == INVALID_RANGE)
+			return false;
+
+		RemoveFree(r);
+
+		const uint64_t alignedOffset = (ranges[r].offset + alignment - 1) & ~(alignment - 1);
+		const uint64_t padding = alignedOffset - ranges[r].offset;
+
+		// The physical neighbours of a free range are never free, so the padding and the remainder become free ranges of their own
+		if (padding > 0)
+		{
+			const uint32_t p = NewRange();
+			ranges[p].offset = ranges[r].offset;
+			ranges[p].size = padding;
+			ranges[p].prevPhysical = ranges[r].prevPhysical;
+			ranges[p].nextPhysical = r;
+
+			if (ranges[r].prevPhysical != INVALID_RANGE)
+				ranges[ranges[r].prevPhysical].nextPhysical = p;
+
+			ranges[r].prevPhysical = p;
+			ranges[r].offset = alignedOffset;
+			ranges[r].size -= padding;
+
+			InsertFree(p);
+		}
+
+		if (ranges[r].size > size)
+		{
+			const uint32_t n = NewRange();
+			ranges[n].offset = ranges[r].offset + size;
+			ranges[n].size = ranges[r].size - size;
+			ranges[n].prevPhysical = r;
+			ranges[n].nextPhysical = ranges[r].nextPhysical;
+
+			if (ranges[r].nextPhysical != INVALID_RANGE)
+				ranges[ranges[r].nextPhysical].prevPhysical = n;
+
+			ranges[r].nextPhysical = n;
+			ranges[r].size = size;
+
+			InsertFree(n);
+		}
+
+		ranges[r].free = false;
+
+		usedSize += size;
+		numAllocations++;
+
+		offset = ranges[r].offset;
+		range = r;
+
+		return true;
+	}
+
+	void TLSFAllocator::Free(uint32_t range)
+	{
+		if (range >= ranges.size() || ranges[range].free)
+			return;
+
+		usedSize -= ranges[range].size;
+		numAllocations--;
+
+		uint32_t r = range;
+		ranges[r].free = true;
+
+		const uint32_t prev = ranges[r].prevPhysical;
+		if (prev != INVALID_RANGE && ranges[prev].free)
+		{
+			RemoveFree(prev);
+			r = Merge(prev, r);
+		}
+
+		const uint32_t next = ranges[r].nextPhysical;
+		if (next != INVALID_RANGE && ranges[next].free)
+		{
+			RemoveFree(next);
+			r = Merge(r, next);
+		}
+
+		InsertFree(r);
+	}
+
+	void TLSFAllocator::Mapping(uint64_t size, uint32_t &fl, uint32_t &sl)
+	{
+		// The sizes below SL_COUNT get a list each, after that each power of two is split in SL_COUNT lists
+		if (size < SL_COUNT)
+		{
+			fl = 0;
+			sl = static_cast<uint32_t>(size);
+		}
+		else
+		{
+			const uint32_t bit = HighestBit(size);
+			fl = bit - SL_LOG2 + 1;
+			sl = static_cast<uint32_t>(size >> (bit - SL_LOG2)) - SL_COUNT;
+		}
+	}
+
+	uint32_t TLSFAllocator::NewRange()
+	{
+		Range newRange = {};
+		newRange.prevPhysical = INVALID_RANGE;
+		newRange.nextPhysical = INVALID_RANGE;
+		newRange.prevFree = INVALID_RANGE;
+		newRange.nextFree = INVALID_RANGE;
+		newRange.free = true;
+
+		if (unusedRanges.size() > 0)
+		{
+			const uint32_t r = unusedRanges.back();
+			unusedRanges.pop_back();
+			ranges[r] = newRange;
+			return r;
+		}
+
+		ranges.push_back(newRange);
+		return static_cast<uint32_t>(ranges.size() - 1);
+	}
+
+	void TLSFAllocator::InsertFree(uint32_t range)
+	{
+		uint32_t fl, sl;
+		Mapping(ranges[range].size, fl, sl);
+
+		Range &r = ranges[range];
+		r.free = true;
+		r.prevFree = INVALID_RANGE;
+		r.nextFree = freeLists[fl][sl];
+
+		if (r.nextFree != INVALID_RANGE)
+			ranges[r.nextFree].prevFree = range;
+
+		freeLists[fl][sl] = range;
+		slBitmaps[fl] |= 1u << sl;
+		flBitmap |= 1ull << fl;
+	}
+
+	void TLSFAllocator::RemoveFree(uint32_t range)
+	{
+		uint32_t fl, sl;
+		Mapping(ranges[range].size, fl, sl);
+
+		Range &r = ranges[range];
+
+		if (r.prevFree != INVALID_RANGE)
+			ranges[r.prevFree].nextFree = r.nextFree;
+		else
+			freeLists[fl][sl] = r.nextFree;
+
+		if (r.nextFree != INVALID_RANGE)
+			ranges[r.nextFree].prevFree = r.prevFree;
+
+		r.prevFree = INVALID_RANGE;
+		r.nextFree = INVALID_RANGE;
+
+		if (freeLists[fl][sl] == INVALID_RANGE)
+		{
+			slBitmaps[fl] &= ~(1u << sl);
+			if (slBitmaps[fl] == 0)
+				flBitmap &= ~(1ull << fl);
+		}
+	}
+
+	uint32_t TLSFAllocator::FindFree(uint64_t size)
+	{
+		// Round up to the next list so every range in the list found is big enough
+		if (size >= SL_COUNT)
+		{
+			const uint64_t round = (1ull << (HighestBit(size) - SL_LOG2)) - 1;
+			if (size > UINT64_MAX - round)
+				return INVALID_RANGE;
+
+			size += round;
+		}
+
+		uint32_t fl, sl;
+		Mapping(size, fl, sl);
+
+		uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+		if (slMap == 0)
+		{
+			// No list big enough in this level so use the smallest list of the next non empty level
+			const uint64_t flMap = fl + 1 < FL_COUNT ? flBitmap & (~0ull << (fl + 1)) : 0;
+			if (flMap == 0)
+				return INVALID_RANGE;
+
+			fl = LowestBit(flMap);
+			slMap = slBitmaps[fl];
+		}
+
+		sl = LowestBit(slMap);
+
+		return freeLists[fl][sl];
+	}
+
+	uint32_t TLSFAllocator::Merge(uint32_t prev, uint32_t range)
+	{
+		Range &p = ranges[prev];
+		const Range &r = ranges[range];
+
+		p.size += r.size;
+		p.nextPhysical = r.nextPhysical;
+
+		if (r.nextPhysical != INVALID_RANGE)
+			ranges[r.nextPhysical].prevPhysical = prev;
+
+		unusedRanges.push_back(range);
+
+		return prev;
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Engine
+{
+	// Two level segregated fit allocator for ranges of a block that it doesn't own, eg a piece of gpu memory.
+	// The free ranges are kept in lists indexed by the log2 of their size and 16 subdivisions of it, with a bitmap of the non empty lists,
+	// so allocating and freeing are O(1). Freed ranges are merged with their free neighbours right away. Not thread safe
+	class TLSFAllocator
+	{
+	public:
+		static const uint32_t INVALID_RANGE = 0xFFFFFFFF;
+
+		TLSFAllocator();
+
+		void Init(uint64_t size);
+		void Dispose();
+
+		// Alignment must be a power of two. Returns false if there's no free range that fits
+		bool Allocate(uint64_t size, uint64_t alignment, uint64_t &offset, uint32_t &range);
+		void Free(uint32_t range);
+
+		uint64_t GetSize() const { return size; }
+		uint64_t GetUsedSize() const { return usedSize; }
+		uint32_t GetNumAllocations() const { return numAllocations; }
+		bool IsEmpty() const { return numAllocations == 0; }
+
+	private:
+		static const uint32_t SL_LOG2 = 4;
+		static const uint32_t SL_COUNT = 1 << SL_LOG2;
+		static const uint32_t FL_COUNT = 64 - SL_LOG2 + 1;
+
+		struct Range
+		{
+			uint64_t offset;
+			uint64_t size;
+			uint32_t prevPhysical;			// Neighbour ranges in the block, used to merge free ranges
+			uint32_t nextPhysical;
+			uint32_t prevFree;				// Ranges in the same free list
+			uint32_t nextFree;
+			bool free;
+		};
+
+		static void Mapping(uint64_t size, uint32_t &fl, uint32_t &sl);
+
+		uint32_t NewRange();
+		void InsertFree(uint32_t range);
+		void RemoveFree(uint32_t range);
+		uint32_t FindFree(uint64_t size);
+		// Merges range into prev and returns prev
+		uint32_t Merge(uint32_t prev, uint32_t range);
+
+	private:
+		uint64_t size;
+		uint64_t usedSize;
+		uint32_t numAllocations;
+		uint64_t flBitmap;
+		uint32_t slBitmaps[FL_COUNT];
+		uint32_t freeLists[FL_COUNT][SL_COUNT];
+		std::vector<Range> ranges;
+		std::vector<uint32_t> unusedRanges;			// Range structs that can be reused
+	};
+}
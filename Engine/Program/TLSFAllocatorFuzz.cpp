@@ -0,0 +1,169 @@
+#include "TLSFAllocatorFuzz.h"
+
+#include "TLSFAllocator.h"
+#include "Program/Log.h"
+
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace Engine
+{
+	static const unsigned int FUZZ_RESET_INTERVAL = 5000;
+	static const unsigned int FUZZ_MAX_ALIGNMENT_LOG2 = 16;
+	static const unsigned int FUZZ_MAX_ERRORS_LOGGED = 10;
+	static const unsigned int FUZZ_SL_LOG2 = 4;			// Same as the second level subdivisions of the allocator
+
+	struct FuzzAllocation
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint32_t range;
+	};
+
+	struct FuzzState
+	{
+		TLSFAllocator allocator;
+		std::vector<FuzzAllocation> allocations;
+		std::map<uint64_t, uint64_t> usedRanges;		// Offset to end of the live allocations, to find overlaps
+		uint64_t usedSize;
+		unsigned int errors;
+	};
+
+	static void FuzzError(FuzzState &state, unsigned int operation, const char *check, uint64_t offset, uint64_t size)
+	{
+		if (state.errors < FUZZ_MAX_ERRORS_LOGGED)
+			Log::Print(LogLevel::LEVEL_ERROR, "TLSF fuzz operation %u: %s (offset %llu, size %llu)\n", operation, check, static_cast<unsigned long long>(offset), static_cast<unsigned long long>(size));
+
+		state.errors++;
+	}
+
+	static void FuzzFree(FuzzState &state, size_t index)
+	{
+		const FuzzAllocation a = state.allocations[index];
+
+		state.allocator.Free(a.range);
+		state.usedRanges.erase(a.offset);
+		state.usedSize -= a.size;
+
+		state.allocations[index] = state.allocations.back();
+		state.allocations.pop_back();
+	}
+
+	// Requests are rounded up to the next size list, so the whole block can only be requested when its size is the first of a list.
+	// The first size of the block's list is always found when the block is a single free range
+	static uint64_t GetWholeBlockRequest(uint64_t blockSize)
+	{
+		if (blockSize < (1ull << FUZZ_SL_LOG2))
+			return blockSize;
+
+		unsigned int bit = 0;
+		while ((blockSize >> bit) > 1)
+			bit++;
+
+		return blockSize & ~((1ull << (bit - FUZZ_SL_LOG2)) - 1);
+	}
+
+	// Frees everything and checks the block went back to a single free range
+	static void FuzzFreeAll(FuzzState &state, unsigned int operation, uint64_t blockSize)
+	{
+		while (state.allocations.size() > 0)
+			FuzzFree(state, state.allocations.size() - 1);
+
+		if (!state.allocator.IsEmpty() || state.allocator.GetUsedSize() != 0)
+			FuzzError(state, operation, "allocator not empty after freeing everything", 0, state.allocator.GetUsedSize());
+
+		uint64_t offset = 0;
+		uint32_t range = TLSFAllocator::INVALID_RANGE;
+
+		const uint64_t request = GetWholeBlockRequest(blockSize);
+
+		if (!state.allocator.Allocate(request, 1, offset, range))
+		{
+			FuzzError(state, operation, "free ranges were not merged back into the whole block", 0, request);
+			return;
+		}
+
+		if (offset != 0)
+			FuzzError(state, operation, "whole block allocation doesn't start at 0", offset, request);
+
+		state.allocator.Free(range);
+	}
+
+	bool RunTLSFAllocatorFuzz(unsigned int operations, uint64_t blockSize, unsigned int seed)
+	{
+		std::mt19937 mt(seed);
+		std::uniform_int_distribution<int> percentDist(0, 99);
+		std::uniform_int_distribution<unsigned int> alignmentDist(0, FUZZ_MAX_ALIGNMENT_LOG2);
+		// Sizes are spread over every size class, from a few bytes to an eighth of the block
+		std::uniform_real_distribution<double> sizeLog2Dist(0.0, std::log2(static_cast<double>(blockSize / 8)));
+
+		FuzzState state;
+		state.allocator.Init(blockSize);
+		state.usedSize = 0;
+		state.errors = 0;
+
+		unsigned int allocationsMade = 0;
+		unsigned int allocationsFailed = 0;
+
+		for (unsigned int op = 0; op < operations; op++)
+		{
+			if (op > 0 && op % FUZZ_RESET_INTERVAL == 0)
+				FuzzFreeAll(state, op, blockSize);
+
+			// Allocate more than free so the block fills up and allocations start failing
+			if (state.allocations.size() == 0 || percentDist(mt) < 55)
+			{
+				const uint64_t size = static_cast<uint64_t>(std::exp2(sizeLog2Dist(mt)));
+				const uint64_t alignment = 1ULL << alignmentDist(mt);
+
+				FuzzAllocation a = {};
+				a.size = size;
+
+				if (!state.allocator.Allocate(size, alignment, a.offset, a.range))
+				{
+					allocationsFailed++;
+					continue;
+				}
+
+				allocationsMade++;
+
+				if ((a.offset & (alignment - 1)) != 0)
+					FuzzError(state, op, "offset not aligned", a.offset, size);
+				if (a.offset + size > blockSize)
+					FuzzError(state, op, "range outside of the block", a.offset, size);
+
+				// The closest live ranges before and after the new one must not reach into it
+				std::map<uint64_t, uint64_t>::iterator next = state.usedRanges.lower_bound(a.offset);
+				if (next != state.usedRanges.end() && next->first < a.offset + size)
+					FuzzError(state, op, "range overlaps the next allocation", a.offset, size);
+				if (next != state.usedRanges.begin() && std::prev(next)->second > a.offset)
+					FuzzError(state, op, "range overlaps the previous allocation", a.offset, size);
+
+				state.usedRanges[a.offset] = a.offset + size;
+				state.allocations.push_back(a);
+				state.usedSize += size;
+			}
+			else
+			{
+				std::uniform_int_distribution<size_t> indexDist(0, state.allocations.size() - 1);
+				FuzzFree(state, indexDist(mt));
+			}
+
+			if (state.allocator.GetUsedSize() != state.usedSize || state.allocator.GetNumAllocations() != state.allocations.size())
+				FuzzError(state, op, "used size or allocation count doesn't match the live allocations", 0, state.allocator.GetUsedSize());
+		}
+
+		FuzzFreeAll(state, operations, blockSize);
+		state.allocator.Dispose();
+
+		Log::Print(LogLevel::LEVEL_INFO, "TLSF fuzz: %u operations, %u allocations, %u failed because the block was full, %u errors\n", operations, allocationsMade, allocationsFailed, state.errors);
+
+		if (state.errors > 0)
+			Log::Print(LogLevel::LEVEL_ERROR, "TLSF allocator fuzz found %u errors\n", state.errors);
+
+		return state.errors == 0;
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Engine
+{
+	// Allocates and frees random ranges with random alignments and checks that the ranges are aligned, inside the block and don't overlap.
+	// Every few thousand operations everything is freed and the whole block must be allocatable again, which only works if the free ranges merged.
+	// Logs an error for each check that fails and returns false if any did. Doesn't need a gpu so it can run from the editor or a tool
+	bool RunTLSFAllocatorFuzz(unsigned int operations = 200000, uint64_t blockSize = 32 * 1024 * 1024, unsigned int seed = 1);
+}
@@ -6,7 +6,7 @@ namespace Engine
 	// Some additions, could have breaking changes
 	static const unsigned int MINOR_VERSION = 0;
 	// Bug fixes, minor additions, etc. Compatibility with older versions is kept
-	static const unsigned int PATCH_VERSION = 5;
+	static const unsigned int PATCH_VERSION = 6;
 
 	const char* GetVersionString();
 }
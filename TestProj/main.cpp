@@ -4,10 +4,12 @@
 #include "Graphics/MeshDefaults.h"
 #include "Program/Random.h"
 #include "Graphics/Effects/ForwardRenderer.h"
+#include "Program/Benchmarks.h"
 
 #include "include/glm/gtc/matrix_transform.hpp"
 
 #include <chrono>
+#include <cstring>
 
 class MyApplication : public Engine::Application
 {
@@ -136,8 +138,12 @@ private:
 	float curTime;
 };
 
-int main()
+int main(int argc, char *argv[])
 {
+	// Runs the benchmarks without creating a window, eg from a build script. The exit code says if any failed
+	if (argc > 1 && std::strcmp(argv[1], "--benchmarks") == 0)
+		return Engine::RunBenchmarks() ? 0 : 1;
+
 	const unsigned int WIDTH = 1280;
 	const unsigned int HEIGHT = 720;
 